@@ -183,10 +183,18 @@ public abstract ref<tm> localtime_s(ref<time_t> time, ref<tm> result);
 @Linux("libc.s0.6", "malloc")
 public abstract address malloc(unsigned size);
 
+@Windows("msvcrt.dll", "memchr")
+@Linux("libc.so.6", "memchr")
+public abstract pointer<byte> memchr(address s, int c, long amount);
+
 @Windows("msvcrt.dll", "memcpy")
 @Linux("libc.so.6", "memcpy")
 public abstract address memcpy(address destination, address source, long amount);
 
+@Windows("msvcrt.dll", "memmove")
+@Linux("libc.so.6", "memmove")
+public abstract address memmove(address destination, address source, long amount);
+
 @Windows("msvcrt.dll", "memset")
 @Linux("libc.so.6", "memset")
 public abstract address memset(address destination, byte value, long amount);
@@ -178,6 +178,11 @@ public class Call extends ParameterBag {
 				ref<Node> source = _arguments.node;
 				return tree.newCast(type, source).fold(tree, voidContext, compileContext);
 			}
+			if (!voidContext && compileContext.inlineFunctions()) {
+				ref<Node> inlined = inlineCall(this, tree, compileContext);
+				if (inlined != null)
+					return inlined.fold(tree, false, compileContext);
+			}
 			ref<NodeList> ellipArgs = getEllipsisArguments();
 			if (ellipArgs != null) {
 				// Cap each of the ellipsis arguments for subsequent processing (BEFORE folding because
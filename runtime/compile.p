@@ -53,6 +53,10 @@ public class CompileContext extends CodegenContext {
 	public string[] includes;					// a list of zero or more directories containing sources to be included in the build
 
 	public string imageVersion;					// If not null, the image version string for any build of a pxi.
+	public int threads;							// If greater than zero, the number of threads used to parse units,
+												// otherwise one per CPU.
+	public boolean noInline;					// If true, calls are never replaced by the body of the function called.
+	public ref<CompileTimings> timings;			// If not null, records where the compile spends its time.
 
 	private ref<DomainForest> _forest;
 	private ref<Scope> _root;
@@ -174,17 +178,17 @@ public class CompileContext extends CodegenContext {
 	}
 
 	CompileContext(ref<Arena> arena, boolean verbose, boolean logImports) {
-		super(verbose, memory.StartingHeap.PRODUCTION, null, null);
+		super(verbose, memory.StartingHeap.PRODUCTION, null, null, null);
 		init(arena, null, logImports);
 	}
 
-	CompileContext(ref<Arena> arena, ref<thread.ThreadPool<boolean>> workers, boolean verbose, memory.StartingHeap memoryHeap, string profilePath, string coveragePath, boolean logImports) {
-		super(verbose, memoryHeap, profilePath, coveragePath);
+	CompileContext(ref<Arena> arena, ref<thread.ThreadPool<boolean>> workers, boolean verbose, memory.StartingHeap memoryHeap, string profilePath, string coveragePath, string allocationProfilePath, boolean logImports) {
+		super(verbose, memoryHeap, profilePath, coveragePath, allocationProfilePath);
 		init(arena, workers, logImports);
 	}
 
 	CompileContext(ref<DomainForest> forest, ref<thread.ThreadPool<boolean>> workers) {
-		super(false, memory.StartingHeap.PRODUCTION, null, null);
+		super(false, memory.StartingHeap.PRODUCTION, null, null, null);
 		_forest = forest;
 		_pool = forest.pool();
 		clearDeclarationModifiers();
@@ -200,19 +204,37 @@ public class CompileContext extends CodegenContext {
 		TypeFamily tf;
 		for (; tf < TypeFamily.BUILTIN_TYPES; tf = TypeFamily(int(tf) + 1))
 			_builtInType.append(_pool.newBuiltInType(tf));
-//		if (workers == null) {
-//			workers = new thread.ThreadPool<boolean>(thread.cpuCount());
-//			_workersAreCreated = true;
-//		}
-//		_workers = workers;
+		_workers = workers;
 	}
 
 	~CompileContext() {
-		if (_workersAreCreated)
-			delete _workers;
+		releaseWorkers();
 		if (_forestIsCreated)
 			delete _forest;
 	}
+	/*
+	 * If no pool was supplied to the constructor, one is created the first time there is more than one unit to
+	 * parse at once. It is deleted again once the front end is done with it, so the threads do not linger while
+	 * the compiled program runs.
+	 */
+	private ref<thread.ThreadPool<boolean>> workers() {
+		if (_workers == null) {
+			int threadCount = threads > 0 ? threads : thread.cpuCount();
+			if (threadCount > 1) {
+				_workers = new thread.ThreadPool<boolean>(threadCount);
+				_workersAreCreated = true;
+			}
+		}
+		return _workers;
+	}
+
+	private void releaseWorkers() {
+		if (_workersAreCreated) {
+			delete _workers;
+			_workers = null;
+			_workersAreCreated = false;
+		}
+	}
 
 	public boolean loadRoot(boolean buildingCorePackage, ref<context.Package>... usedPackages) {
 //		printf("buildingCorePackage=%s\n", buildingCorePackage);
@@ -240,6 +262,12 @@ public class CompileContext extends CodegenContext {
 		_packages.append(usedPackages);
 		return true;
 	}
+	/**
+	 * @return The packages from which the compile may import symbols, starting with the core package.
+	 */
+	public ref<context.Package>[] packages() {
+		return _packages;
+	}
 
 	public ref<Target> compile(string filename, string... extraUnits) {
 		if (verbose())
@@ -333,27 +361,58 @@ public class CompileContext extends CodegenContext {
 
 	private boolean parseUnits(string[] unitFilenames, string packageDir) {
 		ref<Unit> outer = definingFile;
-		boolean success = true;
+		ref<Unit>[] units;
 		for (i in unitFilenames) {
 			ref<Unit> unit = _arena.defineUnit(unitFilenames[i], packageDir);
 			// The unit name has already been seen, and parsed. Ignore this instance.
-			if (unit.parsed())
-				continue;
-
-			if (!unit.parse(this)) {
-				if (verbose())
-					printf("  parse FAIL    [%d] %s\n", i, unitFilenames[i]);
-				success = false;
-			}
-
-			if (unit.buildScopes(this)) {
+			if (unit.markParsed())
+				units.append(unit);
+		}
+		parseConcurrently(units);
+		for (i in units) {
+			if (units[i].buildScopes(this)) {
 				if (_logImports) {
-					printf("        Built scopes for %s\n", unitFilenames[i]);
+					printf("        Built scopes for %s\n", units[i].filename());
 				}
 			}
 		}
 		definingFile = outer;
-		return success;
+		return true;
+	}
+
+	private class ParallelParse {
+		ref<CompileContext> compileContext;
+		ref<ref<Unit>[]> units;
+	}
+	/*
+	 * Parse units that have been marked as parsed, on the worker threads when there is more than one of them.
+	 * Parsing a unit touches only that unit and its own syntax tree, so the trees do not depend on how the work
+	 * is divided. Scopes are still built one unit at a time, in order, by the caller. A timed compile parses on
+	 * this thread, so that the allocations of each unit can be told apart.
+	 *
+	 * Scope building and code generation are not split up this way. Building the scopes of a unit adds to the
+	 * arena's scope list and namespace forest, and resolves names in scopes built by earlier units, so its
+	 * result depends on the order the units are taken in. Code generation emits every function into the one
+	 * code buffer and fixup lists of the encoder, and the order of emission is the layout of the image. Either
+	 * would need its shared state split by unit or by function and merged in a fixed order to keep images
+	 * identical for any number of threads.
+	 */
+	private void parseConcurrently(ref<Unit>[] units) {
+		if (units.length() > 1 && timings == null && workers() != null) {
+			ParallelParse pp = { compileContext: this, units: &units };
+			_workers.parallelFor(units.length(), parseOneUnit, &pp);
+		}
+		// Anything the workers did not get to, because a parse threw an exception or there are no workers,
+		// gets parsed here.
+		for (i in units) {
+			if (units[i].tree() == null)
+				units[i].parseTree(this);
+		}
+	}
+
+	private static void parseOneUnit(address context, int index) {
+		ref<ParallelParse> pp = ref<ParallelParse>(context);
+		(*pp.units)[index].parseTree(pp.compileContext);
 	}
 	
 	ref<Target>, boolean finishCompile(boolean isCorePackage,
@@ -400,6 +459,7 @@ public class CompileContext extends CodegenContext {
 		boolean nodesOrdered = true;
 		if (checkInOrder != null)
 			nodesOrdered = checkInOrder(mainUnit.tree().root(), mainUnit.source());
+		releaseWorkers();
 		if (verbose())
 			printf("Beginning code generation\n");
 		return Target.generate(mainUnit, this), nodesOrdered;
@@ -413,6 +473,7 @@ public class CompileContext extends CodegenContext {
 
 	public boolean populateNamespace(ref<Ternary> namespaceNode) {
 		boolean success = true;
+		ref<Unit>[] toParse;
 		for (i in _packages) {
 			string domain;
 
@@ -424,28 +485,24 @@ public class CompileContext extends CodegenContext {
 			string[] units = populateFromPackage(_packages[i], domain, names);
 			string directory = _packages[i].directory();
 			for (j in units) {
-				string filename = storage.path(directory, units[j]);
 				ref<Unit> unit = _arena.defineImportedUnit(units[j], directory);
 				
 				// The unit name has already been seen, and parsed. Ignore this instance.
-				if (unit.parsed())
-					continue;
-
-
-				if (!unit.parse(this)) {
-					printf("  parse FAIL    [%d] %s\n", j, filename);
-					success = false;
-				}
-
-				if (unit.buildScopes(this)) {
-					if (_logImports) {
-						printf("        Built scopes for imported unit %s\n", unit.filename());
-					}
-				} else if (verbose()) {
-					printf("    %d recursive buildScopes FAILED\n", thread.currentThread().id());
-				}					
+				if (unit.markParsed())
+					toParse.append(unit);
 			}
 		}
+		parseConcurrently(toParse);
+		for (i in toParse) {
+			ref<Unit> unit = toParse[i];
+			if (unit.buildScopes(this)) {
+				if (_logImports) {
+					printf("        Built scopes for imported unit %s\n", unit.filename());
+				}
+			} else if (verbose()) {
+				printf("    %d recursive buildScopes FAILED\n", thread.currentThread().id());
+			}					
+		}
 		return success;
 	}
 
@@ -458,14 +515,18 @@ public class CompileContext extends CodegenContext {
 
 	public void resolveImports() {
 //		printf("preps done\n");
+		enterPhase(CompilePhase.RESOLVE_IMPORTS);
 		while (_importedScopes < _arena.scopes().length()) {
 			ref<Scope> s = (*_arena.scopes())[_importedScopes];
 			_importedScopes++;
 //			printf(" --- defineImports %d/%d\n", importedScopes, _arena.scopes().length());
 			if (s.definition() != null &&
-				s.storageClass() != StorageClass.TEMPLATE_INSTANCE)
+				s.storageClass() != StorageClass.TEMPLATE_INSTANCE) {
+				chargeTo(s);
 				s.definition().traverse(Node.Traversal.PRE_ORDER, defineImports, this);
+			}
 		}
+		exitPhase();
 //		printf("Lookups done\n");
 	}
 
@@ -601,6 +662,7 @@ public class CompileContext extends CodegenContext {
 	}
 
 	public void buildScopes() {
+		enterPhase(CompilePhase.BUILD_SCOPES);
 		while (_arena.builtScopes < _arena.scopes().length()) {
 			ref<Scope> s = (*_arena.scopes())[_arena.builtScopes];
 //			s.print(0, false);
@@ -629,10 +691,12 @@ public class CompileContext extends CodegenContext {
 //			printf("s = %p %s\n", s, string(s.storageClass()));
 			if (s.definition() != null &&
 				s.storageClass() != StorageClass.TEMPLATE_INSTANCE) {
+				chargeTo(s);
 				buildUnderScope(s);
 			}
 		}
 		annotations = null;
+		exitPhase();
 	}
 	
 	public void exemptScopes() {
@@ -1201,11 +1265,13 @@ public class CompileContext extends CodegenContext {
 	}
 
 	public void assignTypes() {
+		enterPhase(CompilePhase.ASSIGN_TYPES);
 		for (int i = 0; i < _arena.scopes().length(); i++) {
 			_current = (*_arena.scopes())[i];
 
 			if (_current.definition() == null)
 				continue;
+			chargeTo(_current);
 			switch (_current.definition().op()) {
 			case UNIT:
 				assignTypeToNode(_current.definition());
@@ -1237,6 +1303,7 @@ public class CompileContext extends CodegenContext {
 						assignTypeToNode(func);
 					if ((func.referenced || !_current.isTemplateFunction()) && func.body != null && func.body.type == null) {
 						modified = true;
+						chargeTo(_current);
 						assignTypes(func.body);
 						_current.checkDefaultConstructorCalls(this);
 					}
@@ -1273,12 +1340,15 @@ public class CompileContext extends CodegenContext {
 				}
 			}
 		}
+		exitPhase();
  	}
 
 	public void assignTypes(ref<Scope> scope, ref<Node> n) {
 		ref<Scope> outer = _current;
 		_current = scope;
+		enterPhase(CompilePhase.ASSIGN_TYPES);
 		assignTypeToNode(n);
+		exitPhase();
 		_current = outer;
 	}
 
@@ -1518,13 +1588,41 @@ public class CompileContext extends CodegenContext {
 		_baseLiveSymbol = _liveSymbols.length();
 //		printf("Folding:\n");
 //		node.print(0);
+		if (timings != null)
+			timings.enter(CompilePhase.FOLD, unit);
 		ref<Node> n = node.fold(unit.tree(), false, this);
+		exitPhase();
 		_liveSymbols.resize(_baseLiveSymbol);
 		_liveSymbolScopes.resize(_baseLiveSymbol);
 		_baseLiveSymbol = outerBaseLive;
 		return n;
 	}
+	/*
+	 * These do nothing unless the compile is being timed.
+	 */
+	public void enterPhase(CompilePhase phase) {
+		if (timings != null)
+			timings.enter(phase);
+	}
+
+	public void exitPhase() {
+		if (timings != null)
+			timings.exit();
+	}
+
+	private void chargeTo(ref<Scope> scope) {
+		if (timings != null)
+			timings.setUnit(scope.unit());
+	}
 	
+	/**
+	 * @return true if small functions may be inlined. Profiles and coverage counts describe the
+	 * functions as they are written, so they turn inlining off.
+	 */
+	public boolean inlineFunctions() {
+		return !noInline && profilePath() == null && coveragePath() == null;
+	}
+
 	public ref<ParameterScope> dispatchExceptionScope() {
 		if (_dispatchException == null) {
 			ref<Symbol> re = _forest.getSymbol("parasol", "exception.dispatchException", this);
@@ -2478,18 +2576,40 @@ public class Unit extends SourceFile {
 			return false;
 		_parsed = true;
 		compileContext.definingFile = this;
-		_tree = new SyntaxTree();
-		_tree.parse(this, compileContext);
-		for (ref<NodeList> nl = _tree.root().statements(); nl != null; nl = nl.next) {
+		parseTree(compileContext);
+		return true;
+	}
+	/*
+	 * Mark the unit as parsed, so that its tree can be built later by parseTree, possibly on another thread.
+	 *
+	 * Returns true if the unit had not already been marked.
+	 */
+	boolean markParsed() {
+		if (_parsed)
+			return false;
+		_parsed = true;
+		return true;
+	}
+	/*
+	 * Build the syntax tree of the unit. This touches nothing outside the unit and its tree, so different units may
+	 * be parsed by different threads at the same time.
+	 */
+	void parseTree(ref<CompileContext> compileContext) {
+		ref<SyntaxTree> tree = new SyntaxTree();
+		if (compileContext.timings != null)
+			compileContext.timings.enter(CompilePhase.PARSE, this);
+		tree.parse(this, compileContext);
+		compileContext.exitPhase();
+		for (ref<NodeList> nl = tree.root().statements(); nl != null; nl = nl.next) {
 			if (nl.node.op() == Operator.DECLARE_NAMESPACE) {
 				if (_namespaceNode == null) {
 					ref<Unary> u = ref<Unary>(nl.node);
 					_namespaceNode = ref<Ternary>(u.operand());
 				} else
-					nl.node.add(MessageId.NON_UNIQUE_NAMESPACE, _tree.pool());
+					nl.node.add(MessageId.NON_UNIQUE_NAMESPACE, tree.pool());
 			}
 		}
-		return true;
+		_tree = tree;
 	}
 /*
 	public void noNamespaceError(ref<CompileContext> compileContext) {
@@ -0,0 +1,392 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+namespace parasol:compiler;
+
+import parasol:context;
+import parasol:process;
+import parasol:pxi;
+import parasol:runtime;
+import parasol:storage;
+import parasol:stream;
+import parasol:x86_64.X86_64;
+
+/**
+ * The environment variable naming the directory of the compile cache. If it is not set, the cache is
+ * $HOME/.cache/parasol/pc.
+ */
+public string COMPILE_CACHE_ENV = "PARASOL_COMPILE_CACHE";
+
+private string CACHE_FORMAT = "parasol compile cache 2";
+/**
+ * A persistent cache of compiled programs, keyed by the content of their source files.
+ *
+ * The compiler compiles every unit a program imports, including the core package, each time the program
+ * runs. The cache lets a program that has not changed since its last run skip the compile entirely.
+ *
+ * Each entry is named by a hash of everything that selects what is compiled other than the sources
+ * themselves: the pxi file of the running compiler, the main file, the context and the compile options.
+ * An entry holds the compiled image and a list of every source file the compile read, together with
+ * the {@link storage.ContentHash} of its contents. The list also records each package the compile
+ * resolved, with its version and directory, and includes the manifest and metadata files of each one.
+ * The entry is used only if every one of those files still has the same hash and every package still
+ * resolves to the same directory and version in the active context.
+ *
+ * Units are not compiled separately, so a change to any file of a program, including the main file,
+ * means the whole program is compiled again.
+ *
+ * @threading Several processes may use the same cache directory at once. Files are written under
+ * temporary names and renamed into place. The image of an entry is named by the hash of its inputs,
+ * so a reader never pairs a list of inputs with the image built from a different list.
+ */
+public class CompileCache {
+	private string _directory;
+	private string _key;
+	/**
+	 * If the pxi file of the running compiler cannot be found, the cache is not {@link usable}.
+	 *
+	 * @param directory The directory holding the cache. It is created when the first entry is stored.
+	 * @param keyData Strings that, along with the compiler itself, select what the compile produces.
+	 */
+	public CompileCache(string directory, string... keyData) {
+		_directory = directory;
+		long compiler;
+		boolean found;
+		(compiler, found) = compilerHash();
+		if (!found)
+			return;
+		storage.ContentHash hash;
+		hash.add(compiler);
+		for (i in keyData)
+			hash.add(keyData[i]);
+		_key = hash.toString();
+	}
+	/**
+	 * @return true if entries can be looked up and stored, false if the cache would be ignored.
+	 */
+	public boolean usable() {
+		return _key != null;
+	}
+	/**
+	 * @return The cache directory named by the environment, or null if no directory can be determined.
+	 */
+	public static string defaultDirectory() {
+		string directory = process.environment.get(COMPILE_CACHE_ENV);
+		if (directory != null)
+			return directory.length() > 0 ? directory : null;
+		string home = process.environment.get("HOME");
+		if (home == null)
+			return null;
+		return storage.path(home, ".cache/parasol/pc");
+	}
+	/**
+	 * Find a current image for the program.
+	 *
+	 * @param activeContext The context the program would be compiled in. Each package recorded in the entry
+	 * is looked up there.
+	 *
+	 * @return The path of the pxi file holding the image, or null if there is no entry,
+	 * any of its source files have changed or any of its packages now resolves differently.
+	 */
+	public string lookup(ref<context.Context> activeContext) {
+		if (_key == null)
+			return null;
+		ref<storage.FileReader> r = storage.openTextFile(inputsPath());
+		if (r == null)
+			return null;
+		string image;
+		boolean current = r.readLine() == CACHE_FORMAT;
+		if (current) {
+			string line = r.readLine();
+			if (line != null && line.startsWith("image "))
+				image = line.substr(6);
+			else
+				current = false;
+		}
+		while (current) {
+			string line = r.readLine();
+			if (line == null)
+				break;
+			if (line.startsWith("package ")) {
+				current = samePackage(activeContext, line.substr(8));
+				continue;
+			}
+			int space = line.indexOf(' ');
+			if (space < 0) {
+				current = false;
+				break;
+			}
+			long hash;
+			boolean success;
+			(hash, success) = storage.contentHash(line.substr(space + 1));
+			string actual;
+			actual.printf("%16.16x", hash);
+			if (!success || actual != line.substr(0, space))
+				current = false;
+		}
+		delete r;
+		if (!current)
+			return null;
+		string pxiFile = storage.path(_directory, image);
+		if (!storage.exists(pxiFile))
+			return null;
+		return pxiFile;
+	}
+	/**
+	 * Store the image of a successful compile.
+	 *
+	 * This must be called before the target runs, since running it relocates the image in place.
+	 *
+	 * @param arena The arena of the compile. Every unit with a file name is recorded as an input.
+	 * @param target The compiled program.
+	 * @param packages The packages the compile resolved, as returned by {@link CompileContext.packages}.
+	 *
+	 * @return true if the entry was stored, false otherwise.
+	 */
+	public boolean store(ref<Arena> arena, ref<Target> target, ref<context.Package>[] packages) {
+		if (_key == null)
+			return false;
+		string[] inputs;
+		ref<Unit>[] units = arena.units();
+		for (i in units) {
+			string filename = units[i].filename();
+			if (filename != null)
+				inputs.append(storage.absolutePath(filename));
+		}
+		string list;
+		storage.ContentHash digest;
+		for (i in packages) {
+			string version = packageVersion(packages[i]);
+			if (version == null)
+				return false;
+			string record;
+			record.printf("package %s %s %s", packages[i].name(), version,
+										storage.absolutePath(packages[i].directory()));
+			digest.add(record);
+			list.append(record + "\n");
+			inputs.append(storage.absolutePath(packages[i].manifestPath()));
+			inputs.append(storage.absolutePath(storage.path(packages[i].directory(), context.PACKAGE_METADATA)));
+		}
+		for (i in inputs) {
+			long hash;
+			boolean success;
+			(hash, success) = storage.contentHash(inputs[i]);
+			if (!success)
+				return false;
+			digest.add(hash);
+			list.printf("%16.16x %s\n", hash, inputs[i]);
+		}
+		if (!storage.ensure(_directory))
+			return false;
+		string image = _key + "-" + digest.toString() + ".pxi";
+		string pxiFile = storage.path(_directory, image);
+		string previous = currentImage();
+		if (previous != image) {
+			string temp = temporaryName(pxiFile);
+			ref<pxi.Pxi> output = pxi.Pxi.create(temp);
+			target.writePxi(output);
+			boolean written = output.write();
+			delete output;
+			if (!written || !storage.rename(temp, pxiFile)) {
+				storage.deleteFile(temp);
+				return false;
+			}
+		}
+		string temp = temporaryName(inputsPath());
+		storage.File f;
+		if (!f.create(temp))
+			return false;
+		boolean written = f.write(CACHE_FORMAT + "\nimage " + image + "\n" + list) >= 0;
+		f.close();
+		if (!written || !storage.rename(temp, inputsPath())) {
+			storage.deleteFile(temp);
+			return false;
+		}
+		if (previous != null && previous != image)
+			storage.deleteFile(storage.path(_directory, previous));
+		return true;
+	}
+	/**
+	 * Run the image stored in a pxi file, in this process.
+	 *
+	 * @param pxiFile The path returned by {@link lookup}.
+	 * @param args The command line. The first element is the name of the program, the rest are passed to it.
+	 *
+	 * @return The value returned by the program's main function, or 0 if it did not return normally.
+	 * @return true if the program returned normally, false if it threw an uncaught exception.
+	 * @return true if the image was run, false if it could not be loaded.
+	 */
+	public static int, boolean, boolean run(string pxiFile, string[] args) {
+		ref<pxi.Pxi> p = pxi.Pxi.load(pxiFile);
+		if (p == null)
+			return 0, false, false;
+		// store wrote a single section, in the format X86_64Lnx.writePxi uses.
+		if (p.sectionCount() != 1 || p.sectionType(0) != runtime.Target.X86_64_LNX_NEW ||
+			runtime.compileTarget != runtime.Target.X86_64_LNX) {
+			delete p;
+			return 0, false, false;
+		}
+		pxi.SectionEntry entry = p.entry(0);
+		storage.File f;
+		boolean loaded;
+		pointer<byte> image;
+		if (f.open(pxiFile) && f.seek(entry.offset, storage.Seek.START) == entry.offset) {
+			image = pointer<byte>(runtime.allocateRegion(entry.length));
+			loaded = f.read(image, entry.length) == entry.length;
+		}
+		f.close();
+		delete p;
+		if (!loaded)
+			return 0, false, false;
+		int returnValue;
+		boolean result;
+		(returnValue, result) = X86_64.runImage(ref<pxi.X86_64SectionHeader>(image), image, int(entry.length),
+												runtime.startingHeap(), null, null, null, args);
+		return returnValue, result, true;
+	}
+
+	private string currentImage() {
+		ref<storage.FileReader> r = storage.openTextFile(inputsPath());
+		if (r == null)
+			return null;
+		string image;
+		if (r.readLine() == CACHE_FORMAT) {
+			string line = r.readLine();
+			if (line != null && line.startsWith("image "))
+				image = line.substr(6);
+		}
+		delete r;
+		return image;
+	}
+
+	/*
+	 * A package line of the inputs file holds the name, version and directory of a package, separated by
+	 * single spaces. Names and versions contain no spaces, so the directory is the rest of the line.
+	 */
+	private static boolean samePackage(ref<context.Context> activeContext, string record) {
+		int space = record.indexOf(' ');
+		if (space < 0)
+			return false;
+		int versionEnd = record.indexOf(' ', space + 1);
+		if (versionEnd < 0)
+			return false;
+		ref<context.Package> p = activeContext.getPackage(record.substr(0, space));
+		if (p == null)
+			return false;
+		return storage.absolutePath(p.directory()) == record.substr(versionEnd + 1) &&
+			   packageVersion(p) == record.substr(space + 1, versionEnd);
+	}
+	/*
+	 * Reading the version throws if the package metadata is missing or malformed. Such a package is never
+	 * recorded, nor does it match a recorded one.
+	 */
+	private static string packageVersion(ref<context.Package> p) {
+		string version;
+		try {
+			version = p.version();
+		} catch (Exception e) {
+		}
+		return version;
+	}
+
+	private string inputsPath() {
+		return storage.path(_directory, _key + ".inputs");
+	}
+
+	private static string temporaryName(string path) {
+		string s;
+		s.printf("%s.%d.tmp", path, process.getpid());
+		return s;
+	}
+}
+/*
+ * A hash of the pxi file the running compiler was loaded from, so a change to any part of the compiler,
+ * code or data, names a different set of entries. The runtime is started as 'parasolrt <pxi file> ...',
+ * so the file is the first argument on the process command line. It is only used if it holds the image
+ * that is running: its header must match the header of the running image. A compiler that was compiled
+ * and run in memory by another one has no file of its own.
+ *
+ * @return The hash of the file.
+ * @return true if the pxi file of the running compiler was found, false otherwise.
+ */
+private long, boolean compilerHash() {
+	ref<storage.FileReader> r = storage.openBinaryFile("/proc/self/cmdline");
+	if (r == null)
+		return 0, false;
+	// The file reports a size of zero, so it is read until the end of the second argument.
+	string pxiFile;
+	int arguments;
+	while (arguments < 2) {
+		int c = r.read();
+		if (c == stream.EOF)
+			break;
+		if (c == 0)
+			arguments++;
+		else if (arguments == 1)
+			pxiFile.append(byte(c));
+	}
+	delete r;
+	if (arguments < 2)
+		return 0, false;
+	if (!holdsRunningImage(pxiFile))
+		return 0, false;
+	return storage.contentHash(pxiFile);
+}
+
+private boolean holdsRunningImage(string pxiFile) {
+	ref<pxi.Pxi> p = pxi.Pxi.load(pxiFile);
+	if (p == null)
+		return false;
+	storage.File f;
+	if (!f.open(pxiFile)) {
+		delete p;
+		return false;
+	}
+	boolean found;
+	for (int i = 0; i < p.sectionCount() && !found; i++) {
+		pxi.SectionEntry entry = p.entry(i);
+		long imageOffset;
+		long length;
+		if (p.sectionType(i) == runtime.Target.X86_64_LNX_NEW) {
+			imageOffset = entry.offset;
+			length = entry.length;
+		} else if (p.sectionType(i) == runtime.Target.X86_64_LNX_PRELINKED) {
+			pxi.X86_64PrelinkHeader prelink;
+			if (f.seek(entry.offset, storage.Seek.START) != entry.offset ||
+				f.read(&prelink, prelink.bytes) != prelink.bytes)
+				continue;
+			imageOffset = entry.offset + prelink.imageOffset;
+			length = prelink.imageLength;
+		} else
+			continue;
+		if (length != runtime.imageLength())
+			continue;
+		pxi.X86_64SectionHeader header;
+		if (f.seek(imageOffset, storage.Seek.START) != imageOffset ||
+			f.read(&header, header.bytes) != header.bytes)
+			continue;
+		pointer<byte> fromFile = pointer<byte>(&header);
+		pointer<byte> running = pointer<byte>(runtime.pxiHeader());
+		found = true;
+		for (int j = 0; j < header.bytes; j++)
+			if (fromFile[j] != running[j]) {
+				found = false;
+				break;
+			}
+	}
+	f.close();
+	delete p;
+	return found;
+}
@@ -57,9 +57,11 @@ private string parasolCommand;
 private string pxiFile;
 private string targetArgument;
 private string importPathArgument;
+private string coverageArgument;
 
 public void initTestObjects(string argv0, string argv1, boolean verbose, 
-				boolean symbols, string target, string importPathArg, string rootDir, boolean showParseStageErrorsArgument) {
+				boolean symbols, string target, string importPathArg, string rootDir, boolean showParseStageErrorsArgument,
+				string coveragePath) {
 	verboseFlag = verbose;
 	showParseStageErrors = showParseStageErrorsArgument;
 	if (rootDir != null)
@@ -70,6 +72,7 @@ public void initTestObjects(string argv0, string argv1, boolean verbose,
 	pxiFile = argv1;
 	targetArgument = target;
 	importPathArgument = importPathArg;
+	coverageArgument = coveragePath;
 	printSymbolTable = symbols;
 	script.objectFactory("codePoint", CodePointObject.factory);
 	script.objectFactory("compile", CompileObject.factory);
@@ -730,6 +733,8 @@ class RunObject extends script.Object {
 		if (_include != null) {
 			args.append("--include=" + _include);
 		}
+		if (coverageArgument != null)
+			args.append("--cover=" + coverageArgument);
 		if (verboseFlag)
 			args.append("-v");
 		args.append(_filename);
@@ -627,6 +627,14 @@ public class Package extends VolatilePackage {
 	public void setDirectory(string directory) {
 		_directory = directory;
 	}
+	/**
+	 * Return the path of the package manifest, which lists the units of each namespace in the package.
+	 *
+	 * @return The path of the manifest file.
+	 */
+	public string manifestPath() {
+		return storage.path(_directory, PACKAGE_MANIFEST);
+	}
 	/**
 	 * Open the package and preapre for it being analyzed.
 	 *
@@ -78,7 +78,7 @@ class WindowsExceptionHandling extends OSExceptionHandling {
 	}
 
 	static long windowsExceptionHandler(ref<windows.EXCEPTION_POINTERS> exceptionInfo) {
-		ref<ExceptionContext> context = createExceptionContext(address(exceptionInfo.ContextRecord.Rsp));
+		ref<ExceptionContext> context = createExceptionContext(address(exceptionInfo.ContextRecord.Rsp), true);
 		context.framePointer = address(exceptionInfo.ContextRecord.Rbp);
 		context.exceptionAddress = address(exceptionInfo.ContextRecord.Rip);
 		context.exceptionType = int(exceptionInfo.ExceptionRecord.ExceptionCode);
@@ -141,7 +141,7 @@ class LinuxExceptionHandling extends OSExceptionHandling {
 	}
 
 	static ref<ExceptionContext> fillExceptionInfo(ref<linux.siginfo_t> info, ref<linux.ucontext_t> uContext) {
-		ref<ExceptionContext> context = createExceptionContext(address(uContext.uc_mcontext.gregs.rsp));
+		ref<ExceptionContext> context = createExceptionContext(address(uContext.uc_mcontext.gregs.rsp), true);
 		context.exceptionAddress = address(uContext.uc_mcontext.gregs.rip);
 		context.framePointer = address(uContext.uc_mcontext.gregs.rbp);
 		context.exceptionType = (info.si_signo << 8) + info.si_code;
@@ -207,7 +207,8 @@ class LinuxExceptionHandling extends OSExceptionHandling {
  * statement.
  *
  * Note: Currently, a thrown exception caches an ExceptionContext object to hold the stack trace
- * of the exception. This memory is not re-claimed.
+ * of the exception. This memory is not re-claimed. Only the return addresses of the stack are
+ * kept. They are turned into source locations when {@link textStackTrace} is called.
  * 
  * @threading It is not thread safe to throw the same exception object in two different threads
  * at the same time.
@@ -271,8 +272,9 @@ public class Exception {
 	public string textStackTrace() {
 		if (_exceptionContext == null)
 			return null;
+		if (_exceptionContext.frames == null)
+			captureFrames();
 		string output;
-		boolean locationIsExact = true;
 
 //		printf("    failure address %p\n", _exceptionContext.exceptionAddress);
 		address stackHigh = pointer<byte>(_exceptionContext.stackPointer) + _exceptionContext.stackSize;
@@ -282,7 +284,8 @@ public class Exception {
 		ip_ptr := long(ip);
 		// If the exception address is not in Parasol code, then start by printing all possible
 		// Parasol code addresses found on thes tack, in case the C stack doesn't work out
-		if (ip_ptr < runtime.image.codeAddress() || ip_ptr >= runtime.image.highCodeAddress()) {
+		if (_exceptionContext.stackCopy != null &&
+			(ip_ptr < runtime.image.codeAddress() || ip_ptr >= runtime.image.highCodeAddress())) {
 			output.printf("Exception address is outside Parasol code space, dumping Parasol code addresses found on the stack:\n\n");
 			int relativeSp = 0;
 			for (pointer<pointer<byte>> sp = pointer<pointer<byte>>(_exceptionContext.stackPointer);
@@ -299,29 +302,36 @@ public class Exception {
 			output.printf("\n");
 		}
 		string tag = "->";
-		long lowCode = runtime.image.codeAddress();
-		int staticMemoryLength = int(runtime.image.highCodeAddress() - lowCode);
-		int ignoreFrames = ignoreTopFrames();
+		for (int i = ignoreTopFrames(); i < _exceptionContext.frameCount; i++) {
+			string locationLabel = runtime.image.formattedReturnLocation(long(_exceptionContext.frames[i]));
+			output.printf(" %2s %s\n", tag, locationLabel);
+			tag = "";
+		}
+		return output;
+	}
+	/*
+	 * Record the return address of each frame on the stack where the exception was thrown. This is
+	 * all that is kept of the stack for a thrown exception. The addresses are only turned into source
+	 * locations if a stack trace is requested.
+	 */
+	private void captureFrames() {
+		int count;
 		pointer<address> frame;
-		int(address, address) comparator = comparatorCurrentIp;
+		pointer<byte> ip;
 		for (;;) {
-			ref<pxi.X86_64ExceptionEntry> ee;
-			address ip;
-			(ee, frame, ip) = nextFrame(frame, false, comparator);
+			(frame, ip) = callerFrame(frame, false);
 			if (frame == null)
 				break;
-			comparator = comparatorReturnAddress;
-
-			relative := int(long(ip) - lowCode);
-			if (ignoreFrames > 0)
-				ignoreFrames--;
-			else {
-				string locationLabel = runtime.image.formattedLocation(long(ip) - 1, relative);
-				output.printf(" %2s %s\n", tag, locationLabel);
-				tag = "";
-			}
+			count++;
 		}
-		return output;
+		pointer<address> frames = pointer<address>(memory.alloc(address.bytes * (count + 1)));
+		frame = null;
+		for (int i = 0; i < count; i++) {
+			(frame, ip) = callerFrame(frame, false);
+			frames[i] = ip;
+		}
+		_exceptionContext.frames = frames;
+		_exceptionContext.frameCount = count;
 	}
 	
 	int ignoreTopFrames() {
@@ -336,31 +346,30 @@ public class Exception {
 		// null). If there is an _exceptionContext set but no lastCrawledFramePointer, we are processing a hardware
 		// exception for the first time.
 		
-		int(address, address) comparator = comparatorReturnAddress;
+		boolean returnAddress = true;
 		pointer<address> frame;
 		boolean useRealStack;
 		if (_exceptionContext == null) {
 			// An inital throw statement of an unthrown exception
-			_exceptionContext = createExceptionContext(stackPointer);
+			_exceptionContext = createExceptionContext(stackPointer, false);
 			_exceptionContext.framePointer = framePointer;
 			_exceptionContext.exceptionAddress = pointer<address>(stackPointer)[-1];
 		} else if (_exceptionContext.lastCrawledFramePointer == null) {
 			// first time handling of a hardware exception
-			comparator = comparatorCurrentIp;
+			returnAddress = false;
 		} else { // else a re-thrown exception
 			frame = pointer<address>(stackPointer) + -2;
 			useRealStack = true;
 		}
-		pointer<pxi.X86_64ExceptionEntry> ee = pointer<pxi.X86_64ExceptionEntry>(exceptionsAddress());
-		pointer<pxi.X86_64ExceptionEntry> eeFirst = ee;
-		int count = exceptionsCount();
+		if (_exceptionContext.frames == null)
+			captureFrames();
+		ExceptionTable table;
 		for (;;) {
 //			printf("  frame = %p \n", frame);
 			ref<pxi.X86_64ExceptionEntry> ee;
 			address ip;
-			(ee, frame, ip) = nextFrame(frame, useRealStack, comparator);
-//			printf("  -> frame %p ip %p (%x) ee = [%d]\n", frame, ip, pointer<byte>(ip) - lowCode, 
-//											ee != null ? pointer<pxi.X86_64ExceptionEntry>(ee) - eeFirst : -1);
+			(ee, frame, ip) = nextFrame(frame, useRealStack, &table, returnAddress);
+//			printf("  -> frame %p ip %p (%x) ee = %p\n", frame, ip, pointer<byte>(ip) - lowCode, ee);
 			if (frame == null)
 				break;
 
@@ -370,7 +379,7 @@ public class Exception {
 				callCatchHandler(this, frame, ee.handler);
 				process.exit(1);
 			}
-			comparator = comparatorReturnAddress;
+			returnAddress = true;
 		}
 		printf("\nFATAL: Thread %s could not find a stack handler for this address.\n", thread.currentThread().name());
 		printf("Parasol code based at %p\n", runtime.image.codeAddress());
@@ -378,20 +387,48 @@ public class Exception {
 		process.exit(1);
 	}
 
-	private ref<pxi.X86_64ExceptionEntry>, pointer<address>, address nextFrame(pointer<address> lastFrame, boolean useRealStack, int comparator(address ip, address elem)) {
-//		printf("nextFrame(%p, %s)\n", lastFrame, comparator == comparatorCurrentIp ? "current ip" : "return address");
-		pointer<address> frame;
-		pointer<byte> ip;
-
+	private ref<pxi.X86_64ExceptionEntry>, pointer<address>, address nextFrame(pointer<address> lastFrame, boolean useRealStack,
+																			ref<ExceptionTable> table, boolean returnAddress) {
+//		printf("nextFrame(%p, %s)\n", lastFrame, returnAddress ? "return address" : "current ip");
 		lowCode := pointer<byte>(runtime.image.codeAddress());
 		highCode := pointer<byte>(runtime.image.highCodeAddress());
-		pointer<pxi.X86_64ExceptionEntry> ee = pointer<pxi.X86_64ExceptionEntry>(exceptionsAddress());
-		int count = exceptionsCount();
-		if (count == 0) {
+		if (table.count() == 0) {
 			printf("No exceptions table for this image.\n");
 			process.exit(1);
 		}
-//		printf("ee = %p count = %d\n", ee, count);
+		pointer<address> frame;
+		pointer<byte> ip;
+		(frame, ip) = callerFrame(lastFrame, useRealStack);
+
+//		printf("lowCode = %p highCode = %p\n", lowCode, highCode);
+		if (ip >= lowCode && ip < highCode) {
+			int location = int(ip - lowCode);
+//			printf("%x Checking location %x", frame, location);
+			ref<pxi.X86_64ExceptionEntry> ee = table.find(location, returnAddress);
+//			printf(" -> found %p\n", ee);
+			if (ee != null) {
+//				printf("(handler %x)\n", ee.handler);
+
+				// If we have a handler, call it.
+				if (ee.handler != 0)
+					return ee, frame, ip;
+			} //else 
+//				printf("\n");
+		} //else
+//			printf("frame with non-Parasol ip %x\n", frame);
+
+		return null, frame, ip;
+	} 
+	/*
+	 * Find the frame that called the one at lastFrame, or the frame of the exception itself if lastFrame
+	 * is null.
+	 *
+	 * RETURNS: The frame found, or null if there are no more frames on the stack.
+	 *			The return address (or for the exception frame, the exception address) in that frame.
+	 */
+	private pointer<address>, pointer<byte> callerFrame(pointer<address> lastFrame, boolean useRealStack) {
+		pointer<address> frame;
+		pointer<byte> ip;
 
 		if (lastFrame == null) {
 			frame = pointer<address>(_exceptionContext.framePointer);
@@ -410,8 +447,7 @@ public class Exception {
 		}
 		address stackTop = address(long(_exceptionContext.stackBase) + _exceptionContext.stackSize);
 		pointer<address> searchEnd = pointer<address>(stackTop) + -2;
-		int location = int(ip - lowCode);
-//		printf("location %x %p ? %p ? %p\n", location, address(lastFrame + 2), frame, searchEnd);
+//		printf("location %p %p ? %p ? %p\n", ip, address(lastFrame + 2), frame, searchEnd);
 
 
 		if (frame < lastFrame + 2 || frame >= searchEnd) {
@@ -432,28 +468,8 @@ public class Exception {
 					break;
 			}
 		}
-
-//		printf("lowCode = %p highCode = %p\n", lowCode, highCode);
-		if (ip >= lowCode && ip < highCode) {
-			int location = int(ip - lowCode);
-//			printf("%x Checking location %x", frame, location);
-			address result = bsearch(&location, ee, count, pxi.X86_64ExceptionEntry.bytes, comparator);
-//			printf(" -> found %d\n", pointer<pxi.X86_64ExceptionEntry>(result) - ee);
-			if (result != null) {
-				ref<pxi.X86_64ExceptionEntry> ee = ref<pxi.X86_64ExceptionEntry>(result);
-
-//				printf("(handler %x)\n", ee.handler);
-
-				// If we have a handler, call it.
-				if (ee.handler != 0)
-					return ee, frame, ip;
-			} //else 
-//				printf("\n");
-		} //else
-//			printf("frame with non-Parasol ip %x\n", frame);
-
-		return null, frame, ip;
-	} 
+		return frame, ip;
+	}
 	/*
 	 * findStack confirms whether there are any valid stack frames (ones with Parasol code from
 	 * this image in them). Second, if it is valid, it counts how many frames there are so calling code
@@ -498,6 +514,75 @@ public class Exception {
 	}
 }
 
+/*
+ * The exception table of the running image, as searched while unwinding the stack.
+ *
+ * The runtime builds an ExceptionIndex for each image it runs and publishes it as a runtime parameter.
+ * Lookups use that index when it is present. Otherwise (for example, when running under an older
+ * libparasol) they binary search the whole table.
+ */
+class ExceptionTable {
+	private ref<ExceptionIndex> _index;
+	private pointer<pxi.X86_64ExceptionEntry> _entries;
+	private int _count;
+
+	ExceptionTable() {
+		_index = ref<ExceptionIndex>(runtime.getRuntimeParameter(runtime.EXCEPTION_INDEX));
+		if (_index != null) {
+			_entries = _index.entries;
+			_count = _index.count;
+		} else {
+			_entries = pointer<pxi.X86_64ExceptionEntry>(exceptionsAddress());
+			_count = exceptionsCount();
+		}
+	}
+
+	int count() {
+		return _count;
+	}
+	/*
+	 * Find the entry covering a code location. A return address is treated as belonging to the call
+	 * instruction just before it.
+	 *
+	 * RETURNS: The covering entry, or null if there is none.
+	 */
+	ref<pxi.X86_64ExceptionEntry> find(int location, boolean returnAddress) {
+		if (_index == null) {
+			address result = bsearch(&location, _entries, _count, pxi.X86_64ExceptionEntry.bytes,
+										returnAddress ? comparatorReturnAddress : comparatorCurrentIp);
+			return ref<pxi.X86_64ExceptionEntry>(result);
+		}
+		if (returnAddress)
+			location--;
+		int bucket = location >> _index.shift;
+		if (location < 0 || bucket >= _index.bucketCount)
+			return null;
+		// The answer is the last entry at or before location, and it lies in [lo, hi].
+		int lo = _index.buckets[bucket];
+		int hi = _index.buckets[bucket + 1];
+		while (lo < hi) {
+			int mid = (lo + hi + 1) >> 1;
+			if (_entries[mid].location <= location)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		if (lo < 0 || lo >= _count - 1)
+			return null;
+		return ref<pxi.X86_64ExceptionEntry>(_entries + lo);
+	}
+}
+/*
+ * Mirrors the ExceptionIndex class in src/C++/executionContext.h, which describes its contents.
+ */
+class ExceptionIndex {
+	pointer<pxi.X86_64ExceptionEntry> entries;
+	pointer<int> buckets;
+	int count;
+	int shift;
+	int bucketCount;
+}
+
 private address bsearch(address key, address tableAddress, int tableSize, int rowSize, int comparator(address a, address b)) {
 	pointer<byte> table = pointer<byte>(tableAddress);
 	while (tableSize > 0) {
@@ -960,7 +1045,15 @@ private int pxiOffset(address a) {
 	
 }
 
-ref<ExceptionContext> createExceptionContext(address stackPointer) {
+/*
+ * Create the context of an exception thrown with the given stack pointer.
+ *
+ * A hardware exception copies the stack, which is kept for the life of the exception, so that a stack
+ * trace can also show the code addresses found in a stack that could not be walked. Other exceptions
+ * only keep the return addresses captured when they are first thrown, and search for their handler in
+ * the live stack.
+ */
+ref<ExceptionContext> createExceptionContext(address stackPointer, boolean copyStack) {
 	address top = runtime.stackTop();
 
 	long stackSize;
@@ -970,12 +1063,19 @@ ref<ExceptionContext> createExceptionContext(address stackPointer) {
 		stackSize = ((long(stackPointer) + 8192) & ~long(0x1fff)) - long(stackPointer);
 	else
 		stackSize = long(top) - long(stackPointer);
-	if (stackSize > 32 * 1024)
-		stackSize = 32 * 1024;		// Limit dumps of really big stacks.
-	pointer<byte> mem = pointer<byte>(memory.alloc(stackSize + ExceptionContext.bytes));
-	ref<ExceptionContext> results = ref<ExceptionContext>(mem);
-	results.stackCopy = mem + ExceptionContext.bytes;
-	C.memcpy(results.stackCopy, stackPointer, stackSize);
+	ref<ExceptionContext> results;
+	if (copyStack) {
+		if (stackSize > 32 * 1024)
+			stackSize = 32 * 1024;		// Limit dumps of really big stacks.
+		pointer<byte> mem = pointer<byte>(memory.alloc(stackSize + ExceptionContext.bytes));
+		results = ref<ExceptionContext>(mem);
+		C.memset(results, 0, ExceptionContext.bytes);
+		results.stackCopy = mem + ExceptionContext.bytes;
+		C.memcpy(results.stackCopy, stackPointer, stackSize);
+	} else {
+		results = ref<ExceptionContext>(memory.alloc(ExceptionContext.bytes));
+		C.memset(results, 0, ExceptionContext.bytes);
+	}
 	results.stackPointer = stackPointer;
 	results.stackBase = stackPointer;
 	results.stackSize = int(stackSize);
@@ -1029,9 +1129,15 @@ class ExceptionContext {
 	//
 	//	COPY_ADDRESS = STACK_ADDRESS - stackBase + stackCopy;
 	
+	//
+	// Only hardware exceptions copy the stack. For other exceptions stackCopy is null, and stackBase and
+	// stackSize describe the live stack, which is only read while the exception is being thrown.
+	
 	address stackBase;			// The machine address of the hardware stack this copy was taken from
 	pointer<byte> stackCopy;	// The first byte of the copy
 	address memoryAddress;		// Valid only for access exceptions: memory location referenced
+	pointer<address> frames;	// The return address of each frame, captured when first thrown
+	int frameCount;				// The number of frames
 	int exceptionType;			// Exception type
 	int exceptionFlags;			// Flags (dependent on type).
 	int stackSize;				// The length of the copy
@@ -1044,6 +1150,8 @@ class ExceptionContext {
 	long slot(address stackAddress) {
 		if (!valid(stackAddress))
 			return 0;
+		if (stackCopy == null)
+			return *ref<long>(stackAddress);
 		long addr = long(stackAddress);
 		long base = long(stackBase);
 		long copy = long(address(stackCopy));
@@ -725,6 +725,52 @@ public class FileReader extends Reader {
 			_cursor--;
 	}
 
+	public long read(address buffer, long length) {
+		pointer<byte> output = pointer<byte>(buffer);
+		long total = 0;
+		while (total < length) {
+			if (_cursor >= _length && length - total >= _buffer.length()) {
+				// Whole buffers' worth go straight from the file to the caller.
+				long n = _file.read(output + total, length - total);
+				if (n <= 0)
+					break;
+				total += n;
+				_cursor = 0;
+				_length = 0;
+				continue;
+			}
+			substring span = peek();
+			if (span.length() == 0)
+				break;
+			int n = span.length();
+			if (n > length - total)
+				n = int(length - total);
+			C.memcpy(output + total, span.c_str(), n);
+			_cursor += n;
+			total += n;
+		}
+		return total;
+	}
+
+	public string readLine() {
+		return readLineFromSpans();
+	}
+
+	public substring peek() {
+		if (_cursor >= _length) {
+			int len = _file.read(&_buffer);
+			if (len <= 0)
+				return substring();
+			_length = len;
+			_cursor = 0;
+		}
+		return substring(&_buffer[_cursor], _length - _cursor);
+	}
+
+	public void consume(int count) {
+		_cursor += count;
+	}
+
 	public long tell() {
 		return _file.seek(0, Seek.CURRENT) + _cursor - _length;
 	}
@@ -781,6 +827,40 @@ public class TextFileReader extends FileReader {
 		} while (c == '\r');
 		return c;
 	}
+
+	public long read(address buffer, long length) {
+		pointer<byte> output = pointer<byte>(buffer);
+
+		for (int i = 0; i < length; i++) {
+			int c = _read();
+			if (c == EOF)
+				return i;
+			output[i] = byte(c);
+		}
+		return length;
+	}
+	/*
+	 * The span stops short of any carriage return or ctrl-Z. Carriage returns at the start of the buffered
+	 * data are skipped.
+	 */
+	public substring peek() {
+		for (;;) {
+			substring span = super.peek();
+			if (span.length() == 0)
+				return span;
+			pointer<byte> data = span.c_str();
+			if (data[0] == '\r') {
+				super.consume(1);
+				continue;
+			}
+			if (data[0] == 26)
+				return substring();
+			for (int i = 1; i < span.length(); i++)
+				if (data[i] == '\r' || data[i] == 26)
+					return substring(data, i);
+			return span;
+		}
+	}
 }
 
 public class BinaryFileWriter = FileWriter;
@@ -941,6 +1021,18 @@ public class StdinReader extends FileReader {
 			process.stdout.flush();
 		return super._read();
 	}
+
+	public long read(address buffer, long length) {
+		if (process.stdout.class == LineWriter)
+			process.stdout.flush();
+		return super.read(buffer, length);
+	}
+
+	public substring peek() {
+		if (process.stdout.class == LineWriter)
+			process.stdout.flush();
+		return super.peek();
+	}
 }
 
 /**
@@ -27,12 +27,14 @@ namespace parasol:http;
 import parasol:exception.IllegalArgumentException;
 import parasol:exception.IllegalOperationException;
 import parasol:log;
+import parasol:memory;
 import parasol:process;
 import parasol:storage;
 import parasol:thread;
 import parasol:thread.Thread;
 import parasol:thread.ThreadPool;
 import parasol:thread.currentThread;
+import parasol:time;
 import parasol:net.Connection;
 import parasol:net.Socket;
 import parasol:net.Encryption;
@@ -102,6 +104,19 @@ private monitor class ServerVolatileData {
  * then define other services and static content for other paths. An incoming URL will only match the
  * "/" service if no other path does match.
  *
+ * <b>Connections</b>
+ *
+ * Each enabled protocol is served by one or more accept threads (see {@link setAcceptThreads}), each with its
+ * own listening socket on the protocol's port. Each accept thread runs an epoll event loop over its listening
+ * socket and the unencrypted connections it has accepted. An idle connection costs no thread: the accept thread
+ * collects request headers as they arrive and hands each complete request to a pool of worker threads (see
+ * {@link setWorkerThreads}), which parse it and call the service. If the response allows it, the connection is
+ * then kept alive and goes back to the event loop to wait for the next request. A connection that stays idle
+ * longer than the keep-alive timeout (see {@link setKeepAliveTimeout}) is closed.
+ *
+ * Encrypted connections are handed to a worker thread as soon as they are accepted, and are closed after one
+ * request.
+ *
  * @threading
  * Most calls are not thread safe, so calling any of these methods on a server that has been started will
  * produce unpredictable results.
@@ -140,13 +155,17 @@ public class Server {
 	boolean _secureServiceEnabled;
 	char _httpPort;									// actual port used, if not zero
 	char _httpsPort;								// actual port used, if not zero
-	ref<Socket> _publicSocket;
-	ref<Socket> _secureSocket;
 	private string _hostname;
-	private ref<ThreadPool<int>> _requestThreads;
+	private ref<ThreadPool<int>> _requestThreads;	// created when the server is first started
+	private int _workerThreads;
 	private PathHandler[] _handlers;
-	private ref<Thread> _httpsThread;
-	private ref<Thread> _httpThread;
+	private ref<Reactor>[] _reactors;				// The accept threads of both protocols
+	private int _acceptThreads;						// per protocol, zero for one per processor
+	private long _keepAliveTimeout;					// milliseconds
+	private boolean _requestRegions;
+	private ref<memory.Region>[] _idleRegions;
+	private Monitor _regionsLock;
+	private StaticContentCache _staticContentCache;
 	/**
 	 * The various roles a server can play determine how messages should be interpreted. 
 	 */
@@ -166,13 +185,14 @@ public class Server {
 		_secureServiceEnabled = true;
 		_httpsPort = 443;
 		_hostname = "";
-		_requestThreads = new ThreadPool<int>(4);
+		_workerThreads = 4;
+		_keepAliveTimeout = 60000;
 	}
 
 	~Server() {
 		wait();
-		delete _publicSocket;
-		delete _secureSocket;
+		delete _requestThreads;
+		_idleRegions.deleteAll();
 	}
 	/**
 	 * Enables requests on the http protocol.
@@ -250,6 +270,97 @@ public class Server {
 		_secureServiceEnabled = newState;
 		return priorState;
 	}
+	/**
+	 * Handle each request with a {@link parasol:memory.Region} as the allocator of its thread.
+	 *
+	 * While a {@link Service} processes a request, everything it allocates with new, including strings and
+	 * the parsed request itself, comes from the request's Region. The Region is reset when the request is done
+	 * and then reused for a later request, so that the temporaries of a request cost a pointer bump each and
+	 * are released all at once.
+	 *
+	 * A Service must not keep anything it allocates past the end of the request, nor hand it to another thread
+	 * to delete. A request that asks to upgrade the connection (for example, to a Web Socket) is dispatched with
+	 * the process heap as the allocator, since the objects serving the connection outlive the request. Any other
+	 * Service that keeps the connection open must allocate what it keeps from the process heap, with
+	 * {@link parasol:memory.setThreadAllocator}(null). When a Service keeps the connection or throws an exception,
+	 * the memory of its Region is left in place and never reclaimed.
+	 *
+	 * This takes effect with the next request.
+	 *
+	 * @param newState true to give requests a Region, false to use the process heap.
+	 *
+	 * @return the prior state, true if requests used Regions, false if not.
+	 */
+	public boolean setRequestRegions(boolean newState) {
+		boolean priorState = _requestRegions;
+		_requestRegions = newState;
+		return priorState;
+	}
+	/**
+	 * Set the number of worker threads that parse requests and call services.
+	 *
+	 * A worker thread is only busy while a request is being processed, so this is the number of requests
+	 * the server can process at once. By default there are 4 worker threads.
+	 *
+	 * This takes effect the next time the server is started. Once the server has been started, the number
+	 * of worker threads can be raised but not lowered.
+	 *
+	 * @param count The number of worker threads. Must be greater than zero.
+	 */
+	public void setWorkerThreads(int count) {
+		if (count <= 0)
+			throw IllegalArgumentException(string(count));
+		_workerThreads = count;
+		if (_requestThreads != null && count > _requestThreads.totalThreads())
+			_requestThreads.resize(count);
+	}
+	/**
+	 * Set the number of threads that accept connections on each port.
+	 *
+	 * Each accept thread binds its own socket to the port, using the SO_REUSEPORT socket option, and
+	 * waits in its own epoll event loop for new connections and for requests on the connections it has
+	 * accepted. The kernel spreads incoming connections among them. By default there is one accept thread
+	 * per processor.
+	 *
+	 * This takes effect the next time the server is started.
+	 *
+	 * @param count The number of accept threads per enabled protocol, or zero for one per processor.
+	 */
+	public void setAcceptThreads(int count) {
+		if (count < 0)
+			throw IllegalArgumentException(string(count));
+		_acceptThreads = count;
+	}
+	/**
+	 * Set how long a kept-alive connection may wait for its next request before the server closes it.
+	 *
+	 * The default is 60 seconds. Idle connections are checked about once a second.
+	 *
+	 * This may be called at any time.
+	 *
+	 * @param timeout The longest time an idle connection is kept open.
+	 */
+	public void setKeepAliveTimeout(time.Duration timeout) {
+		_keepAliveTimeout = timeout.milliseconds();
+	}
+	/**
+	 * Set the limits of the memory cache shared by the static content services of this server.
+	 *
+	 * Files no larger than fileBytes are kept in memory after they are first served, until the total
+	 * would exceed cacheBytes, when the least recently served files are dropped. A cached file is checked
+	 * against the size and modification time of the file on each request, so changes on disk are seen
+	 * at once. Larger files are sent from the file system with sendfile on each request.
+	 *
+	 * By default the cache holds up to 64 megabytes, in files of up to 1 megabyte.
+	 *
+	 * @param cacheBytes The largest total size of the cached files. Zero disables the cache.
+	 * @param fileBytes The size of the largest file to cache.
+	 */
+	public void setStaticContentCache(long cacheBytes, long fileBytes) {
+		if (cacheBytes < 0 || fileBytes < 0 || fileBytes > int.MAX_VALUE)
+			throw IllegalArgumentException(string(cacheBytes) + ", " + string(fileBytes));
+		_staticContentCache.setLimits(cacheBytes, fileBytes);
+	}
 	/**
 	 * Returns the http port.
 	 *
@@ -301,7 +412,7 @@ public class Server {
 	 * produce unpredictable results.
 	 */
 	public void staticContent(string absPath, string filename) {
-		ref<Service> handler = new StaticContentService(filename);
+		ref<Service> handler = new StaticContentService(filename, &_staticContentCache);
 		post(PathHandler(absPath, handler, ServiceClass.ANY_SECURITY_LEVEL));
 	}
 	/**
@@ -319,7 +430,7 @@ public class Server {
 	 * produce unpredictable results.
 	 */
 	public void httpsStaticContent(string absPath, string filename) {
-		ref<Service> handler = new StaticContentService(filename);
+		ref<Service> handler = new StaticContentService(filename, &_staticContentCache);
 		post(PathHandler(absPath, handler, ServiceClass.SECURED_ONLY));
 	}
 	/**
@@ -337,7 +448,7 @@ public class Server {
 	 * produce unpredictable results.
 	 */
 	public void httpStaticContent(string absPath, string filename) {
-		ref<Service> handler = new StaticContentService(filename);
+		ref<Service> handler = new StaticContentService(filename, &_staticContentCache);
 		post(PathHandler(absPath, handler, ServiceClass.UNSECURED_ONLY));
 	}
 	/**
@@ -424,24 +535,34 @@ public class Server {
 		} else {
 			_hostname = "localhost";
 		}
-		if (_publicServiceEnabled) {
-			_publicSocket = bindSocket(scope, _httpPort, Encryption.NONE);
-			if (_httpPort == 0)
-				_httpPort = _publicSocket.port();
-			_httpThread = new Thread("HTTP Accept Loop " + _httpPort);
-			_httpThread.start(startHttpEntry, this);
-		}
-		if (_secureServiceEnabled) {
-			_secureSocket = bindSocket(scope, _httpsPort, Encryption.SSLv23);
-			if (_httpsPort == 0)
-				_httpsPort = _secureSocket.port();
-			_httpsThread = new Thread("HTTPS Accept Loop " + _httpsPort);
-			_httpsThread.start(startHttpsEntry, this);
-		}
+		if (_requestThreads == null)
+			_requestThreads = new ThreadPool<int>(_workerThreads);
+		if (_publicServiceEnabled)
+			_httpPort = startReactors(scope, _httpPort, Encryption.NONE);
+		if (_secureServiceEnabled)
+			_httpsPort = startReactors(scope, _httpsPort, Encryption.SSLv23);
 		return true;
 	}
+	/*
+	 * Start the accept threads of one protocol. If port is zero, the first socket bound picks the port and
+	 * the rest share it.
+	 *
+	 * @return The port actually used.
+	 */
+	private char startReactors(ServerScope scope, char port, Encryption encryption) {
+		int count = _acceptThreads > 0 ? _acceptThreads : thread.cpuCount();
+		for (int i = 0; i < count; i++) {
+			ref<Socket> socket = bindSocket(scope, port, encryption, count > 1);
+			if (port == 0)
+				port = socket.port();
+			ref<Reactor> reactor = new Reactor(this, socket);
+			_reactors.append(reactor);
+			reactor.start((encryption == Encryption.NONE ? "HTTP" : "HTTPS") + " Accept Loop " + port + "." + i);
+		}
+		return port;
+	}
 
-	private ref<Socket> bindSocket(ServerScope scope, char port, Encryption encryption) {
+	private ref<Socket> bindSocket(ServerScope scope, char port, Encryption encryption, boolean reusePort) {
 		if (cipherList == null)
 			cipherList = "HIGH:"; //"DEFAULT:-DHE-RSA-DES-CBC3-SHA:-DES-CBC3-SHA";
 		if (certificatesFile == null) {
@@ -460,6 +581,11 @@ public class Server {
 				certificatesFile = file;
 		}
 		ref<Socket> socket = Socket.create(encryption, cipherList, certificatesFile, privateKeyFile, dhParamsFile);
+		if (reusePort && !socket.reusePort()) {
+			delete socket;
+			throw net.SocketException("Could not set SO_REUSEPORT for http%s port %d",
+								encryption == Encryption.NONE ? "" : "s", port);
+		}
 		if (socket.bind(port, scope)) {
 			if (!socket.listen()) {
 				logger.debug("listen failed\n");
@@ -473,20 +599,10 @@ public class Server {
 			throw net.SocketException("Socket.bind failed for http%s port %d", 
 								encryption == Encryption.NONE ? "" : "s", port);
 		}
+		// The accept threads wait in epoll, so accept must not block if another thread took the connection.
+		socket.setNonBlocking();
 		return socket;
 	}
-
-	private static void startHttpEntry(address param) {
-		ref<Server> server = ref<Server>(param);
-//		printf("Starting http on port %d\n", server._httpPort);
-		server.acceptLoop(server._publicSocket);
-	}
-
-	private static void startHttpsEntry(address param) {
-		ref<Server> server = ref<Server>(param);
-//		printf("Starting https on port %d\n", server._httpsPort);
-		server.acceptLoop(server._secureSocket);
-	}
 	/**
 	 * Stop listening on any open ports.
 	 *
@@ -495,10 +611,8 @@ public class Server {
 	 * Active requests will complete.
 	 */
 	public void stop() {
-		if (_publicSocket != null)
-			_publicSocket.close();
-		if (_secureSocket != null)
-			_secureSocket.close();
+		for (i in _reactors)
+			_reactors[i].stop();
 	}
 	/**
 	 * Wait for the server to shut down.
@@ -510,36 +624,20 @@ public class Server {
 	 * this method terminate when any on-going http requests have completed.
 	 */
 	public void wait() {
-		if (_httpThread != null) {
-			_httpThread.join();
-			delete _httpThread;
-			_httpThread = null;
-		}
-		if (_publicSocket != null) {
-			delete _publicSocket;
-			_publicSocket = null;
-		}
-		if (_httpsThread != null) {
-			_httpsThread.join();
-			delete _httpsThread;
-			_httpsThread = null;
-		}
-		if (_secureSocket != null) {
-			delete _secureSocket;
-			_secureSocket = null;
-		}
-		_requestThreads.waitForIdle();
-	}
-
-	void acceptLoop(ref<Socket> socket) {
-		while (!socket.closed()) {
-			ref<net.Connection> connection = socket.accept();
-			if (connection != null) {
-				ref<HttpContext> context = new HttpContext(this, connection);
-//				logger.debug( "about to execute 'processHttpRequest' threads %d", _requestThreads.idleThreads());
-				_requestThreads.execute(processHttpRequest, context);
-			}
-		}
+		for (i in _reactors)
+			_reactors[i].join();
+		if (_requestThreads != null)
+			_requestThreads.waitForIdle();
+		_reactors.deleteAll();
+	}
+
+	void execute(ref<HttpContext> context) {
+//		logger.debug( "about to execute 'processHttpRequest' threads %d", _requestThreads.idleThreads());
+		_requestThreads.execute(processHttpRequest, context);
+	}
+
+	long keepAliveTimeout() {
+		return _keepAliveTimeout;
 	}
 
 	boolean dispatch(ref<Request> request, ref<Response> response, boolean secured) {
@@ -586,6 +684,22 @@ public class Server {
 	public string hostname() {
 		return _hostname;
 	}
+
+	ref<memory.Region> takeRegion() {
+		if (!_requestRegions)
+			return null;
+		lock (_regionsLock) {
+			if (_idleRegions.length() > 0)
+				return _idleRegions.pop();
+		}
+		return new memory.Region();
+	}
+
+	void releaseRegion(ref<memory.Region> region) {
+		lock (_regionsLock) {
+			_idleRegions.append(region);
+		}
+	}
 }
 
 private enum ServiceClass {
@@ -611,41 +725,363 @@ private class PathHandler {
 private class HttpContext {
 	public ref<Server> server;
 	public ref<net.Connection> connection;
+	public ref<Reactor> reactor;			// null for an encrypted connection
+	public int fd;							// connection.requestFd(), kept because closing the connection clears it
+	public boolean idle;					// waiting in the reactor's epoll set, guarded by the reactor's lock
+	public long deadline;					// when an idle connection is closed, guarded by the reactor's lock
 //	public int requestFd;
 //	public sockaddr_in sourceAddress;
 //	public int addressLength;
 
-	public HttpContext(ref<Server> server, ref<net.Connection> connection) {
+	public HttpContext(ref<Server> server, ref<net.Connection> connection, ref<Reactor> reactor) {
 		this.server = server;
 		this.connection = connection;
+		this.reactor = reactor;
+		this.fd = connection.requestFd();
 //		this.requestFd = requestFd;
 //		this.sourceAddress = sourceAddress;
 //		this.addressLength = addressLength;
 	}
 }
+/*
+ * An accept thread: an epoll event loop over one listening socket and the unencrypted connections accepted
+ * from it.
+ *
+ * Connections are registered with EPOLLONESHOT, so that only one thread works on a connection at a time. The
+ * reactor reads request headers as they arrive. Once a connection has a complete header, a worker thread
+ * owns it until the response is sent, and then either parks it back in the epoll set or closes it.
+ */
+private class Reactor {
+	@Constant
+	private static int EVENTS_PER_WAIT = 256;
+	@Constant
+	private static int SWEEP_INTERVAL = 1000;			// milliseconds between checks for idle connections
+
+	private ref<Server> _server;
+	private ref<Socket> _socket;
+	private int _listenfd;
+	private int _epollfd;
+	private ref<Thread> _thread;
+	private Monitor _lock;
+	private ref<HttpContext>[] _connections;			// indexed by file descriptor, guarded by _lock
+	private boolean _stopping;							// guarded by _lock
+	private boolean _closeListener;						// stop shut the listening socket down, but did not close it
+
+	Reactor(ref<Server> server, ref<Socket> socket) {
+		_server = server;
+		_socket = socket;
+		_listenfd = socket.socketFd();
+		_epollfd = linux.epoll_create1(linux.EPOLL_CLOEXEC);
+		if (_epollfd < 0)
+			throw net.SocketException("epoll_create1 failed: %s", linux.strerror(linux.errno()));
+		linux.epoll_event e;
+		e.events = linux.EPOLLIN;
+		e.fd = _listenfd;
+		if (linux.epoll_ctl(_epollfd, linux.EPOLL_CTL_ADD, _listenfd, &e) != 0)
+			throw net.SocketException("epoll_ctl failed for port %d: %s", socket.port(), linux.strerror(linux.errno()));
+	}
+
+	~Reactor() {
+		delete _thread;
+		// Socket.close only shuts the listening socket down, so close the descriptor here. If accept failed
+		// first, it has already closed the descriptor.
+		if (_closeListener)
+			linux.close(_listenfd);
+		delete _socket;
+		linux.close(_epollfd);
+	}
+
+	void start(string name) {
+		_thread = new Thread(name);
+		_thread.start(reactorEntry, this);
+	}
+
+	private static void reactorEntry(address param) {
+		ref<Reactor>(param).run();
+	}
+
+	void stop() {
+		_closeListener = _socket.close();
+	}
+
+	void join() {
+		if (_thread != null)
+			_thread.join();
+	}
+
+	private void run() {
+		linux.epoll_event[] events;
+		events.resize(EVENTS_PER_WAIT);
+		long nextSweep = now() + SWEEP_INTERVAL;
+		while (!_socket.closed()) {
+			int n = linux.epoll_wait(_epollfd, &events[0], events.length(), SWEEP_INTERVAL);
+			for (int i = 0; i < n; i++) {
+				if (events[i].fd == _listenfd)
+					acceptConnections();
+				else
+					readRequest(events[i].fd);
+			}
+			long t = now();
+			if (t >= nextSweep) {
+				closeIdleConnections(t);
+				nextSweep = t + SWEEP_INTERVAL;
+			}
+		}
+		shutdown();
+	}
+
+	private void acceptConnections() {
+		for (;;) {
+			ref<net.Connection> connection = _socket.accept();
+			if (connection == null)
+				return;
+			if (connection.secured()) {
+				// The security handshake and the request are read on a worker thread.
+				_server.execute(new HttpContext(_server, connection, null));
+				continue;
+			}
+			connection.setNoDelay();
+			ref<HttpContext> context = new HttpContext(_server, connection, this);
+			lock (_lock) {
+				if (context.fd >= _connections.length())
+					_connections.resize(context.fd + 1);
+				_connections[context.fd] = context;
+			}
+			rearm(context, linux.EPOLL_CTL_ADD);
+		}
+	}
+	/*
+	 * Collect what has arrived on a connection. A worker thread gets the connection once the request header
+	 * is complete.
+	 */
+	private void readRequest(int fd) {
+		ref<HttpContext> context;
+		lock (_lock) {
+			if (fd < _connections.length())
+				context = _connections[fd];
+			if (context == null || !context.idle)
+				return;
+			context.idle = false;
+		}
+		if (context.connection.readAvailable() < 0)
+			close(context);
+		else if (context.connection.hasHttpMessage())
+			_server.execute(context);
+		else
+			rearm(context, linux.EPOLL_CTL_MOD);
+	}
+	/*
+	 * Wait for the next request on a connection whose response has been sent.
+	 */
+	void park(ref<HttpContext> context) {
+		rearm(context, linux.EPOLL_CTL_MOD);
+	}
+
+	private void rearm(ref<HttpContext> context, int op) {
+		lock (_lock) {
+			if (!_stopping) {
+				context.idle = true;
+				context.deadline = now() + _server.keepAliveTimeout();
+				linux.epoll_event e;
+				e.events = linux.EPOLLIN | linux.EPOLLRDHUP | linux.EPOLLONESHOT;
+				e.fd = context.fd;
+				if (linux.epoll_ctl(_epollfd, op, context.fd, &e) == 0)
+					return;
+				logger.error("epoll_ctl failed for connection %d: %s", context.fd, linux.strerror(linux.errno()));
+			}
+			forget(context);
+		}
+		delete context.connection;
+		delete context;
+	}
+	/*
+	 * Close a connection that has been taken out of the epoll set by an event.
+	 */
+	void close(ref<HttpContext> context) {
+		lock (_lock) {
+			forget(context);
+		}
+		delete context.connection;
+		delete context;
+	}
+	/*
+	 * The service has kept the connection, so the reactor lets go of it.
+	 */
+	void release(ref<HttpContext> context) {
+		lock (_lock) {
+			forget(context);
+		}
+		delete context;
+	}
+	/*
+	 * Drop a connection from the table and the epoll set. The caller holds _lock and closes the connection
+	 * after releasing it, so that the descriptor cannot be reused while it is still in the table.
+	 */
+	private void forget(ref<HttpContext> context) {
+		_connections[context.fd] = null;
+		if (!_stopping)
+			linux.epoll_ctl(_epollfd, linux.EPOLL_CTL_DEL, context.fd, null);
+	}
+
+	private void closeIdleConnections(long t) {
+		ref<HttpContext>[] expired;
+		lock (_lock) {
+			for (i in _connections) {
+				ref<HttpContext> context = _connections[i];
+				if (context != null && context.idle && context.deadline <= t) {
+					forget(context);
+					expired.append(context);
+				}
+			}
+		}
+		for (i in expired)
+			delete expired[i].connection;
+		expired.deleteAll();
+	}
+	/*
+	 * The listening socket is closed. Idle connections are closed now. Busy ones are closed by their worker
+	 * threads when the request is done.
+	 */
+	private void shutdown() {
+		ref<HttpContext>[] idle;
+		lock (_lock) {
+			_stopping = true;
+			for (i in _connections) {
+				ref<HttpContext> context = _connections[i];
+				if (context != null && context.idle) {
+					forget(context);
+					idle.append(context);
+				}
+			}
+		}
+		for (i in idle)
+			delete idle[i].connection;
+		idle.deleteAll();
+	}
+
+	private static long now() {
+		time.Instant t = time.Clock.MONOTONIC.get();
+		return t.seconds() * 1000 + t.nanoseconds() / 1000000;
+	}
+}
+
+private enum Disposition {
+	CLOSE,						// The response is sent and the connection should be closed.
+	KEEP_ALIVE,					// The response is sent and the connection can carry another request.
+	SERVICE_OWNS_CONNECTION,	// The service kept the connection, for example as a web socket.
+}
 
 private void processHttpRequest(address ctx) {
 	ref<HttpContext> context = ref<HttpContext>(ctx);
-	if (!context.connection.acceptSecurityHandshake()) {
+	if (context.reactor == null) {
+		// An encrypted connection: one request, then the connection is closed.
+		if (context.connection.acceptSecurityHandshake() &&
+			processRequest(context) == Disposition.SERVICE_OWNS_CONNECTION) {
+			int fd = context.fd;
+			delete context;
+			finishUpgrade(fd);
+			return;
+		}
+		context.connection.close();
+		delete context.connection;
+		delete context;
 		return;
 	}
-	Request request(context.server, context.connection);
+	for (;;) {
+		Disposition disposition;
+		try {
+			disposition = processRequest(context);
+		} catch (Exception e) {
+			context.reactor.close(context);
+			throw e;
+		}
+		switch (disposition) {
+		case KEEP_ALIVE:
+			if (context.connection.hasHttpMessage())
+				continue;				// The client pipelined its next request.
+			context.reactor.park(context);
+			return;
+
+		case SERVICE_OWNS_CONNECTION:
+			int fd = context.fd;
+			context.reactor.release(context);
+			finishUpgrade(fd);
+			return;
+
+		default:
+			context.reactor.close(context);
+			return;
+		}
+	}
+}
+
+private Disposition processRequest(ref<HttpContext> context) {
+	ref<memory.Region> region = context.server.takeRegion();
+	if (region == null)
+		return handleRequest(context, null);
+	ref<memory.Allocator> priorAllocator = memory.setThreadAllocator(region);
+	Disposition disposition;
+	try {
+		disposition = handleRequest(context, region);
+	} catch (Exception e) {
+		memory.setThreadAllocator(priorAllocator);
+		region.abandon();				// The exception may refer to memory in the region.
+		context.server.releaseRegion(region);
+		throw e;
+	}
+	memory.setThreadAllocator(priorAllocator);
+	if (disposition == Disposition.SERVICE_OWNS_CONNECTION)
+		region.abandon();				// The service may still be using objects allocated during the request.
+	else
+		region.reset();
+	context.server.releaseRegion(region);
+	return disposition;
+}
+/*
+ * The Request, HttpParser and Response live in this frame so that they are destroyed before the caller
+ * resets the request's Region.
+ *
+ * The connection is flushed but not closed, so that its descriptor stays in use until the caller has taken
+ * it out of the reactor.
+ */
+private Disposition handleRequest(ref<HttpContext> context, ref<memory.Region> region) {
+	Request request(context.server, context.connection, region);
 	HttpParser parser(context.connection);
 	Response response(context.connection);
 	if (parser.parseRequest(&request)) {
 		if (request.method == Request.Method.NO_CONTENTS)
 			response.error(400);
-		else if (context.server.dispatch(&request, &response, context.connection.secured())) {
-			delete context;
-			return;				// if dispatch returns true, we want to keep the connection open (for at least a while).
-		} else
-			response.close();
+		else {
+			response.allowKeepAlive(request.keepAliveRequested(), context.reactor != null,
+									request.method == Request.Method.HEAD);
+			// The objects that serve an upgraded connection, such as a Web Socket, outlive the request and
+			// may be deleted by other threads, so they must come from the process heap. A Web Socket does not
+			// start reading until the connection has been released, in finishUpgrade.
+			ref<memory.Allocator> priorAllocator;
+			boolean upgrade = request.headers.contains("upgrade");
+			if (upgrade) {
+				beginUpgrade(context.fd);
+				if (region != null)
+					priorAllocator = memory.setThreadAllocator(null);
+			}
+			boolean ownsConnection = context.server.dispatch(&request, &response, context.connection.secured());
+			if (upgrade && region != null)
+				memory.setThreadAllocator(priorAllocator);
+			if (ownsConnection)
+				return Disposition.SERVICE_OWNS_CONNECTION;	// The service keeps the connection open (for at least a while).
+			if (upgrade)
+				finishUpgrade(context.fd);
+			if (response.complete() && request.contentConsumed())
+				return Disposition.KEEP_ALIVE;
+			return Disposition.CLOSE;
+		}
 	} else {
 		logger.debug( "Could not parse request from %s", net.dottedIP(context.connection.sourceIPv4()));
 //		request.print();
 		response.error(400);
 	}
-	delete context;
+	response.complete();
+	return Disposition.CLOSE;
 }
 /**
  * The base class used for all services defined on {@link Server}.
@@ -719,6 +1155,8 @@ public class Request {
 	private string[string] _parameters;			// These will be the parsed query parameters.
 	private ref<net.Connection> _connection;
 	private ref<Server> _server;
+	private ref<memory.Region> _region;
+	private boolean _contentRead;
 	/**
 	 * The set of values returned in the method field of the Request class.
 	 */
@@ -745,6 +1183,12 @@ public class Request {
 		_server = server;
 		_connection = connection;
 	}
+
+	Request(ref<Server> server, ref<net.Connection> connection, ref<memory.Region> region) {
+		_server = server;
+		_connection = connection;
+		_region = region;
+	}
 	/**
 	 * A convenience method to extract the family field of the source connection's network address.
 	 *
@@ -862,8 +1306,30 @@ public class Request {
 			cl--;
 		}
 		content.resize(specifiedContentLength - cl);
+		_contentRead = cl == 0;
 		return content, specifiedContentLength;
 	}
+	/*
+	 * HTTP/1.1 connections are persistent unless the client says otherwise. An HTTP/1.0 client must ask.
+	 */
+	boolean keepAliveRequested() {
+		string connection;
+		if (headers.contains("connection"))
+			connection = headers["connection"].toLowerCase();
+		if (httpVersion == "1.1")
+			return connection == null || connection.indexOf("close") < 0;
+		else
+			return connection != null && connection.indexOf("keep-alive") >= 0;
+	}
+	/*
+	 * Whether the connection is positioned at the start of the next request. That is so if the request
+	 * has no content, or readContent read all of it.
+	 */
+	boolean contentConsumed() {
+		if (headers.contains("transfer-encoding"))
+			return false;
+		return _contentRead || contentLength() == 0;
+	}
 	/**
 	 * Fetch the Connection object of the request.
 	 *
@@ -878,6 +1344,15 @@ public class Request {
 	public string hostname() {
 		return _server.hostname();
 	}
+	/**
+	 * Fetch the Region that memory allocated while handling the request comes from.
+	 *
+	 * @return The Region of the request, or null if the server does not give requests a Region. See
+	 * {@link Server.setRequestRegions}.
+	 */
+	public ref<memory.Region> region() {
+		return _region;
+	}
 	/**
 	 * A debugging method to print the result of the {@link toString} method onto the process' stdout stream.
 	 */
@@ -1007,9 +1482,16 @@ public class ParsedResponse {
  * call {@link endOfHeaders} thenselves on the first call in a response.
  */
 public class Response {
+	@Constant
+	private static int DIRECT_WRITE_MIN = 8192;
+
 	private ref<net.Connection> _connection;
 	private boolean _statusWritten;
 	private boolean _headersEnded;
+	private boolean _keepAliveRequested;	// The client asked to send more requests on the connection.
+	private boolean _keepAlive;				// The connection will carry another request after this response.
+	private boolean _bodyFramed;			// The client can find the end of the body without the connection closing.
+	private boolean _connectionHeader;		// The service wrote a Connection header.
 
 	Response() {
 		_connection = null;
@@ -1020,12 +1502,33 @@ public class Response {
 	}
 	
 	void close() {
+		complete();
+		_connection.close();
+	}
+	/*
+	 * Called before the request is dispatched.
+	 *
+	 * @param requested Whether the client asked for a persistent connection.
+	 * @param allowed Whether the server can keep this connection.
+	 * @param headRequest true for a HEAD request, whose response never has a body.
+	 */
+	void allowKeepAlive(boolean requested, boolean allowed, boolean headRequest) {
+		_keepAliveRequested = requested;
+		_keepAlive = requested && allowed;
+		_bodyFramed = headRequest;
+	}
+	/*
+	 * Finish the response and flush it to the connection.
+	 *
+	 * @return true if the connection can carry another request.
+	 */
+	boolean complete() {
 		if (!_statusWritten)
 			throw IllegalOperationException("no status line");
 		if (!_headersEnded)
 			endOfHeaders();
 		_connection.flush();
-		_connection.close();
+		return _keepAlive;
 	}
 	/**
 	 * This writes content data to the connection.
@@ -1083,8 +1586,47 @@ public class Response {
 			throw IllegalOperationException("no status line");
 		if (!_headersEnded)
 			endOfHeaders();
-		for (int i = 0; i < length; i++)
-			_connection.putc(data[i]);
+		if (length < DIRECT_WRITE_MIN) {
+			for (int i = 0; i < length; i++)
+				_connection.putc(data[i]);
+			return;
+		}
+		// A large block is written straight to the connection, not copied through its buffer.
+		if (!_connection.flush()) {
+			_keepAlive = false;
+			return;
+		}
+		while (length > 0) {
+			int n = _connection.write(data, length);
+			if (n <= 0) {
+				_keepAlive = false;		// The client cannot find the end of a body that was cut short.
+				return;
+			}
+			data += n;
+			length -= n;
+		}
+	}
+	/**
+	 * Send part of a file as the body of the response.
+	 *
+	 * The headers are ended, if they have not been already. On an unencrypted connection the kernel
+	 * copies the file to the socket, so the file contents never pass through the process.
+	 *
+	 * @param fd The file descriptor of a file open for reading.
+	 * @param offset The offset in the file of the first byte to send.
+	 * @param length The number of bytes to send.
+	 *
+	 * @return true if all of the bytes were sent, false otherwise.
+	 */
+	public boolean sendFile(int fd, long offset, long length) {
+		if (!_statusWritten)
+			throw IllegalOperationException("no status line");
+		if (!_headersEnded)
+			endOfHeaders();
+		if (_connection.sendFile(fd, offset, length) == length)
+			return true;
+		_keepAlive = false;
+		return false;
 	}
 	/**
 	 * This writes content data to the connection.
@@ -1244,6 +1786,8 @@ public class Response {
 		if (_statusWritten)
 			throw IllegalOperationException("status line already written");
 		_statusWritten = true;
+		if (statusCode < 200 || statusCode == 204 || statusCode == 304)
+			_bodyFramed = true;						// These responses never have a body.
 		_connection.printf("HTTP/1.1 %d %s\r\n", statusCode, reasonPhrase);
 	}
 	/**
@@ -1257,15 +1801,34 @@ public class Response {
 			throw IllegalOperationException("no status line");
 		if (_headersEnded)
 			throw IllegalOperationException("heaaders ended");
+		switch (label.toLowerCase()) {
+		case "content-length":
+		case "transfer-encoding":
+			_bodyFramed = true;
+			break;
+
+		case "connection":
+			_connectionHeader = true;
+			if (value.toLowerCase().indexOf("close") >= 0)
+				_keepAlive = false;
+		}
 		_connection.printf("%s: %s\r\n", label, value);
 	}
 	/**
 	 * Signal the end of the headers section of your response.
+	 *
+	 * The connection is only kept open for another request if the headers tell the client where the body
+	 * ends, with a Content-Length or Transfer-Encoding header. Otherwise the body ends when the connection
+	 * is closed, and if the client asked to keep the connection, a Connection: close header is added.
 	 */
 	public void endOfHeaders() {
 		if (!_statusWritten)
 			throw IllegalOperationException("no status line");
 		_headersEnded = true;
+		if (!_bodyFramed)
+			_keepAlive = false;
+		if (_keepAliveRequested && !_keepAlive && !_connectionHeader)
+			_connection.write("Connection: close\r\n");
 		_connection.write("\r\n");
 		_connection.flush();
 	}
@@ -2337,16 +2900,27 @@ class HttpParser {
 /**
  * This is the implementation class for hosting static content through a {@link Server}.
  */
+/*
+ * Serves the files under a directory, or a single file.
+ *
+ * GET and HEAD are supported. Each response carries an ETag made from the size and modification time of
+ * the file, so a conditional request with a matching If-None-Match gets a 304. A single byte range
+ * (Range: bytes=...) gets a 206. If the client accepts gzip and a file with the same name plus .gz
+ * exists beside the requested one, the compressed file is sent instead.
+ */
 class StaticContentService extends Service {
 	private string _filename;
+	private ref<StaticContentCache> _cache;
 	
-	StaticContentService(string filename) {
+	StaticContentService(string filename, ref<StaticContentCache> cache) {
 		_filename = filename;
+		_cache = cache;
 	}
 
 	public boolean processRequest(ref<Request> request, ref<Response> response) {
 //		logger.debug( "Static Content! fetching %s / %s", _filename, request.serviceResource);
-		if (request.method != Request.Method.GET) {
+		boolean head = request.method == Request.Method.HEAD;
+		if (request.method != Request.Method.GET && !head) {
 			response.error(501);
 			return false;
 		}
@@ -2355,46 +2929,374 @@ class StaticContentService extends Service {
 			filename = storage.path(_filename, request.serviceResource, null);
 		else
 			filename = _filename;
-		if (storage.exists(filename)) {
-			if (storage.isDirectory(filename)) {
-				string f = storage.path(filename, "index.html");
-				if (!storage.exists(f) || storage.isDirectory(f)) {
-					response.error(404);
+		linux.statStruct s;
+		if (linux.stat(filename.c_str(), &s) != 0) {
+			response.error(404);
+			return false;
+		}
+		if (linux.S_ISDIR(s.st_mode)) {
+			string f = storage.path(filename, "index.html");
+			if (linux.stat(f.c_str(), &s) != 0 || linux.S_ISDIR(s.st_mode)) {
+				response.error(404);
+				return false;
+			}
+			if (!filename.endsWith("/")) {
+				response.redirect(302, "http" + (request.secured() ? "s" : "") + "://" + request.hostname() + 
+								request.url + "/");
+				return false;
+			} 
+			filename = f;
+		}
+		string contentType = staticContentType(filename);
+		boolean gzip;
+		if (acceptsGzip(request)) {
+			string compressed = filename + ".gz";
+			linux.statStruct cs;
+			if (linux.stat(compressed.c_str(), &cs) == 0 && !linux.S_ISDIR(cs.st_mode)) {
+				filename = compressed;
+				s = cs;
+				gzip = true;
+			}
+		}
+		long size = s.st_size;
+		long modified = s.st_mtim.tv_sec * 1000000000 + s.st_mtim.tv_nsec;
+		string etag;
+		etag.printf("\"%x-%x%s\"", modified, size, gzip ? "-gz" : "");
+		if (request.headers.contains("if-none-match") && etagMatches(request.headers["if-none-match"], etag)) {
+			response.redirect(304, null);
+			response.header("ETag", etag);
+			response.endOfHeaders();
+			return false;
+		}
+		long start = 0;
+		long length = size;
+		RangeResult range = RangeResult.NONE;
+		if (request.headers.contains("range") &&
+			(!request.headers.contains("if-range") || request.headers["if-range"] == etag))
+			(range, start, length) = parseRange(request.headers["range"], size);
+		if (range == RangeResult.UNSATISFIABLE) {
+			response.statusLine(416, "Range Not Satisfiable");
+			response.header("Content-Range", "bytes */" + string(size));
+			response.header("Content-Length", "0");
+			response.endOfHeaders();
+			return false;
+		}
+		// Get hold of the content before committing to a status line, so a file that cannot be read gets
+		// a 500.
+		ref<CachedFile> cached;
+		int fd = -1;
+		if (!head && length > 0) {
+			cached = _cache.get(filename, size, modified);
+			if (cached == null) {
+				fd = linux.open(filename.c_str(), linux.O_RDONLY);
+				if (fd < 0) {
+					response.error(500);
 					return false;
 				}
-				if (!filename.endsWith("/")) {
-					response.redirect(302, "http" + (request.secured() ? "s" : "") + "://" + request.hostname() + 
-									request.url + "/");
-					return false;
-				} 
-				filename = f;
 			}
-			storage.File f;
-			if (f.open(filename)) {
-				response.ok();
-				long size = f.size(); 
-				if (filename.endsWith(".html"))
-					response.header("Content-Type", "text/html; charset=utf-8");
-				response.header("Content-Length", string(size));
-				response.endOfHeaders();
-//				printf("Reading %d bytes from file %s\n", size, filename);
-				byte[] buffer;
-				buffer.resize(8192);
-				for (;;) {
-					int n = f.read(&buffer);
-					if (n <= 0)
-						break;
-//					printf("Read %d bytes\n", n);
-					response.write(&buffer[0], n);
-//					printf("Wrote a response\n");
-				}
-				f.close();
-			} else
-				response.error(500);
+		}
+		if (range == RangeResult.SATISFIABLE) {
+			response.statusLine(206, "Partial Content");
+			response.header("Content-Range", "bytes " + string(start) + "-" + string(start + length - 1) + "/" + 
+									string(size));
 		} else
-			response.error(404);
-		
+			response.ok();
+		if (contentType != null)
+			response.header("Content-Type", contentType);
+		if (gzip)
+			response.header("Content-Encoding", "gzip");
+		response.header("Vary", "Accept-Encoding");
+		response.header("ETag", etag);
+		response.header("Accept-Ranges", "bytes");
+		response.header("Content-Length", string(length));
+		response.endOfHeaders();
+		if (cached != null) {
+			response.write(pointer<byte>(&cached.content[0]) + start, int(length));
+			cached.release();
+		} else if (fd >= 0) {
+			response.sendFile(fd, start, length);
+			linux.close(fd);
+		}
+		return false;
+	}
+}
+
+/**
+ * The outcome of parsing a Range header.
+ */
+public enum RangeResult {
+	NONE,				// No usable Range header: send the whole file.
+	SATISFIABLE,		// Send the one range.
+	UNSATISFIABLE,		// The range lies outside the file.
+}
+/**
+ * Parse the value of a Range header. Only a single byte range is supported. A header with more than
+ * one range, or one that cannot be parsed, is ignored, as RFC 7233 allows.
+ *
+ * @param header The value of the Range header.
+ * @param size The size of the entity, in bytes.
+ *
+ * @return How to respond.
+ * @return The offset of the first byte to send.
+ * @return The number of bytes to send.
+ */
+public RangeResult, long, long parseRange(string header, long size) {
+	string spec = header.trim();
+	if (!spec.startsWith("bytes=") || spec.indexOf(',') >= 0)
+		return RangeResult.NONE, 0, size;
+	spec = spec.substr(6).trim();
+	int dash = spec.indexOf('-');
+	if (dash < 0)
+		return RangeResult.NONE, 0, size;
+	string first = spec.substr(0, dash).trim();
+	string last = spec.substr(dash + 1).trim();
+	long start;
+	long end;
+	boolean success;
+	if (first.length() == 0) {
+		// A suffix range: the last n bytes.
+		long n;
+		(n, success) = parseRangeOffset(last);
+		if (!success)
+			return RangeResult.NONE, 0, size;
+		if (n == 0 || size == 0)
+			return RangeResult.UNSATISFIABLE, 0, 0;
+		if (n > size)
+			n = size;
+		return RangeResult.SATISFIABLE, size - n, n;
+	}
+	(start, success) = parseRangeOffset(first);
+	if (!success)
+		return RangeResult.NONE, 0, size;
+	if (last.length() == 0)
+		end = size - 1;
+	else {
+		(end, success) = parseRangeOffset(last);
+		if (!success || end < start)
+			return RangeResult.NONE, 0, size;
+		if (end >= size)
+			end = size - 1;
+	}
+	if (start >= size)
+		return RangeResult.UNSATISFIABLE, 0, 0;
+	return RangeResult.SATISFIABLE, start, end - start + 1;
+}
+
+private long, boolean parseRangeOffset(string s) {
+	if (s.length() == 0 || !s[0].isDigit())
+		return 0, false;
+	return long.parse(s);
+}
+/**
+ * Compare an If-None-Match header value with an entity tag.
+ *
+ * @param header The value of the If-None-Match header.
+ * @param etag The entity tag of the resource, including its quotes.
+ *
+ * @return true if the header names the entity tag, or is *.
+ */
+public boolean etagMatches(string header, string etag) {
+	string[] tags = header.split(',');
+	for (i in tags) {
+		string tag = tags[i].trim();
+		if (tag == "*")
+			return true;
+		if (tag.startsWith("W/"))			// A weak comparison is good enough for If-None-Match.
+			tag = tag.substr(2);
+		if (tag == etag)
+			return true;
+	}
+	return false;
+}
+/*
+ * @return true if the request's Accept-Encoding header allows a gzip encoded response.
+ */
+private boolean acceptsGzip(ref<Request> request) {
+	if (!request.headers.contains("accept-encoding"))
 		return false;
+	string[] codings = request.headers["accept-encoding"].toLowerCase().split(',');
+	for (i in codings) {
+		string coding = codings[i].trim();
+		string name = coding;
+		double q = 1;
+		int semi = coding.indexOf(';');
+		if (semi >= 0) {
+			name = coding.substr(0, semi).trim();
+			string parameter = coding.substr(semi + 1).trim();
+			if (parameter.startsWith("q=")) {
+				boolean success;
+				(q, success) = double.parse(parameter.substr(2));
+				if (!success)
+					q = 1;
+			}
+		}
+		if (name == "gzip" || name == "x-gzip")
+			return q > 0;
+	}
+	return false;
+}
+
+private string staticContentType(string filename) {
+	int dot = filename.lastIndexOf('.');
+	if (dot < 0)
+		return null;
+	switch (filename.substr(dot + 1).toLowerCase()) {
+	case "html":
+	case "htm":		return "text/html; charset=utf-8";
+	case "css":		return "text/css; charset=utf-8";
+	case "js":		return "text/javascript; charset=utf-8";
+	case "json":	return "application/json";
+	case "txt":		return "text/plain; charset=utf-8";
+	case "xml":		return "application/xml";
+	case "svg":		return "image/svg+xml";
+	case "png":		return "image/png";
+	case "jpg":
+	case "jpeg":	return "image/jpeg";
+	case "gif":		return "image/gif";
+	case "ico":		return "image/x-icon";
+	case "pdf":		return "application/pdf";
+	case "wasm":	return "application/wasm";
+	}
+	return null;
+}
+/*
+ * A file held in a StaticContentCache. A reference is held by the cache and one by each request that is
+ * sending it, so that a file dropped from the cache is not freed while it is still being sent.
+ */
+private class CachedFile extends thread.RefCounted {
+	string content;
+	long size;
+	long modified;				// nanoseconds since the epoch
+	string path;				// the key of the cache entry, guarded by the cache's lock
+	ref<CachedFile> newer;		// the neighbors in the cache's list by last use, guarded by the cache's lock
+	ref<CachedFile> older;
+}
+/*
+ * The files most recently served by the static content services of a server. The entries are keyed by
+ * path and checked against the size and modification time the caller just read from the file system.
+ *
+ * The cached files are also kept in a list, most recently used first, so the least recently used file is
+ * dropped without a search.
+ */
+private class StaticContentCache {
+	private Monitor _lock;
+	private ref<CachedFile>[string] _files;		// guarded by _lock
+	private ref<CachedFile> _newest;			// guarded by _lock
+	private ref<CachedFile> _oldest;			// guarded by _lock
+	private long _bytes;						// the total size of the cached files, guarded by _lock
+	private long _limit;
+	private long _fileLimit;
+
+	StaticContentCache() {
+		_limit = 64 * 1024 * 1024;
+		_fileLimit = 1024 * 1024;
+	}
+
+	~StaticContentCache() {
+		while (_oldest != null)
+			drop(_oldest);
+	}
+
+	void setLimits(long cacheBytes, long fileBytes) {
+		lock (_lock) {
+			_limit = cacheBytes;
+			_fileLimit = fileBytes;
+			trim(0);
+		}
+	}
+	/*
+	 * Get the contents of a file, reading the file if it is not cached or has changed.
+	 *
+	 * The cache outlives the request being served, so the cache's memory comes from the process heap,
+	 * even when the request is using a Region.
+	 *
+	 * @return The file, with a reference for the caller to release, or null if the file is too large
+	 * for the cache or could not be read.
+	 */
+	ref<CachedFile> get(string path, long size, long modified) {
+		ref<memory.Allocator> allocator = memory.setThreadAllocator(null);
+		ref<CachedFile> f = getFromHeap(path, size, modified);
+		memory.setThreadAllocator(allocator);
+		return f;
+	}
+
+	private ref<CachedFile> getFromHeap(string path, long size, long modified) {
+		lock (_lock) {
+			if (size > _fileLimit || size > _limit)
+				return null;
+			if (_files.contains(path)) {
+				ref<CachedFile> f = _files[path];
+				if (f.size == size && f.modified == modified) {
+					unlink(f);
+					pushNewest(f);
+					f.refer();
+					return f;
+				}
+				drop(f);
+			}
+		}
+		// Read the file without holding the lock. Two threads may both read a file that is not cached yet.
+		ref<CachedFile> f = new CachedFile;
+		f.size = size;
+		f.modified = modified;
+		f.content.resize(int(size));
+		storage.File file;
+		if (!file.open(path) || file.read(&f.content[0], size) != size) {
+			file.close();
+			f.release();
+			return null;
+		}
+		file.close();
+		lock (_lock) {
+			if (!_files.contains(path)) {
+				trim(size);
+				f.path = path;
+				_files[path] = f;
+				_bytes += size;
+				pushNewest(f);
+				f.refer();
+			}
+		}
+		return f;
+	}
+	/*
+	 * Drop least recently used files until another of the given size fits. The caller holds _lock.
+	 */
+	private void trim(long incoming) {
+		while (_oldest != null && _bytes + incoming > _limit)
+			drop(_oldest);
+	}
+	/*
+	 * The caller holds _lock.
+	 */
+	private void drop(ref<CachedFile> f) {
+		_files.remove(f.path);
+		unlink(f);
+		_bytes -= f.size;
+		f.release();
+	}
+
+	private void pushNewest(ref<CachedFile> f) {
+		f.older = _newest;
+		f.newer = null;
+		if (_newest != null)
+			_newest.newer = f;
+		else
+			_oldest = f;
+		_newest = f;
+	}
+
+	private void unlink(ref<CachedFile> f) {
+		if (f.newer != null)
+			f.newer.older = f.older;
+		else
+			_newest = f.older;
+		if (f.older != null)
+			f.older.newer = f.newer;
+		else
+			_oldest = f.newer;
+		f.newer = null;
+		f.older = null;
 	}
 }
 /**
@@ -21,6 +21,7 @@ namespace parasol:net;
 
 import parasol:exception;
 import parasol:log;
+import parasol:memory;
 import native:net;
 import native:linux;
 import native:C;
@@ -172,8 +173,14 @@ public class Socket {
 		return socket;
 	}
 
+	@Constant
+	private static int MIN_ACCEPT_DELAY = 5;		// milliseconds
+	@Constant
+	private static int MAX_ACCEPT_DELAY = 1000;
+
 	private char _port;
 	private int _socketfd;
+	private int _acceptDelay;						// milliseconds slept after the last failed accept, if any
 
 	protected Socket() {
 		_socketfd = net.socket(net.AF_INET, net.SOCK_STREAM, 0);
@@ -262,6 +269,31 @@ public class Socket {
 //		logger.debug("socketfd = %d port = %d", _socketfd, _port);
 		return true;
 	}
+	/**
+	 * Let other sockets bind the same port.
+	 *
+	 * Each socket bound to a port with this option set gets its own queue of incoming connections, and
+	 * the kernel spreads new connections among them. This lets several threads accept connections on one
+	 * port without contending for one queue. Every socket sharing the port must call this method before
+	 * calling {@link bind}.
+	 *
+	 * @return true if the option could be set, false otherwise.
+	 */
+	public boolean reusePort() {
+		int xx = 1;
+		return net.setsockopt(_socketfd, net.SOL_SOCKET, net.SO_REUSEPORT, &xx, xx.bytes) == 0;
+	}
+	/**
+	 * Make {@link accept} return immediately when no connection is waiting, instead of blocking.
+	 *
+	 * @return true if the socket could be made non-blocking, false otherwise.
+	 */
+	public boolean setNonBlocking() {
+		int fileFlags = linux.fcntl(_socketfd, linux.F_GETFL, 0);
+		if (fileFlags < 0)
+			return false;
+		return linux.fcntl(_socketfd, linux.F_SETFL, fileFlags | linux.O_NONBLOCK) == 0;
+	}
 	/**
 	 * Listen for an incoming connection.
 	 *
@@ -283,20 +315,44 @@ public class Socket {
 	 *
 	 * After a socket is bound and is listening, it must call accept to create a connection.
 	 *
-	 * @return The open connection on success, null on failure.
+	 * Some failures leave the socket able to accept later connections: no connection waiting on a
+	 * non-blocking socket (see {@link setNonBlocking}), an interrupted call, a connection dropped before it
+	 * could be accepted, and running out of file descriptors or memory. In each case null is returned and the
+	 * socket stays open. After running out of a resource, the call first sleeps, for longer each time it
+	 * happens again, so that a caller in a loop does not spin until a resource is freed.
+	 *
+	 * Any other failure closes the socket.
+	 *
+	 * @return The open connection on success, null on failure. Call {@link closed} to tell whether the
+	 * socket can still be used.
 	 */
 	public ref<Connection> accept() {
 		net.sockaddr_in a;
 		int addrlen = a.bytes;
-		// TODO: Develop a test framework that allows us to test this scenario.
-		int acceptfd = net.accept(_socketfd, &a, &addrlen);
+		int fd = _socketfd;
+		int acceptfd = net.accept(fd, &a, &addrlen);
 		if (acceptfd < 0) {
-			if (linux.errno() != linux.EINVAL &&
-				linux.errno() != linux.EBADF)
-				logger.debug("accept on port %d failed %s", _port, linux.strerror(linux.errno()));
-			net.closesocket(_socketfd);
+			int err = linux.errno();
+			if (err == linux.EAGAIN || err == linux.EINTR || err == linux.ECONNABORTED)
+				return null;
+			if (err == linux.EMFILE || err == linux.ENFILE || err == linux.ENOBUFS || err == linux.ENOMEM) {
+				if (_acceptDelay == 0)
+					_acceptDelay = MIN_ACCEPT_DELAY;
+				else if (_acceptDelay < MAX_ACCEPT_DELAY)
+					_acceptDelay *= 2;
+				logger.error("accept on port %d failed %s, retrying in %d msec", _port, linux.strerror(err), _acceptDelay);
+				thread.sleep(_acceptDelay);
+				return null;
+			}
+			// EINVAL and EBADF mean that the socket was closed, possibly by another thread.
+			if (err != linux.EINVAL && err != linux.EBADF)
+				logger.error("accept on port %d failed %s", _port, linux.strerror(err));
+			// Only close the descriptor if no other thread closed the socket first.
+			if (fd >= 0 && thread.compareAndSwap(&_socketfd, fd, -1) == fd)
+				net.closesocket(fd);
 			return null;
 		}
+		_acceptDelay = 0;
 		return createConnection(acceptfd, &a, addrlen);
 	}
 	/**
@@ -314,11 +370,15 @@ public class Socket {
 	 * Close a socket.
 	 *
 	 * Note that on Linux this will cause any pending operations on other threads to fail.
+	 *
+	 * @return true if this call closed the socket, false if it was already closed.
 	 */
-	public void close() {
-		net.shutdown(_socketfd, net.SHUT_RDWR);
-//		net.closesocket(_socketfd);
-		_socketfd = -1;
+	public boolean close() {
+		int fd = thread.exchange(&_socketfd, -1);
+		if (fd < 0)
+			return false;
+		net.shutdown(fd, net.SHUT_RDWR);
+		return true;
 	}
 	/**
 	 * Check whether a socket is closed.
@@ -328,6 +388,14 @@ public class Socket {
 	public boolean closed() {
 		return _socketfd < 0;
 	}
+	/**
+	 * The socket's file descriptor.
+	 *
+	 * @return The file descriptor, or -1 if the socket is closed.
+	 */
+	public int socketFd() {
+		return _socketfd;
+	}
 	/**
 	 * The port this socket is using.
 	 *
@@ -486,6 +554,10 @@ class ConnectionWriter extends Writer {
 public class Connection {
 	@Constant
 	private static int BUFFER_MAX = 8192;
+	@Constant
+	private static int MESSAGE_HEADER_MAX = 65536;
+	@Constant
+	protected static long SEND_FILE_CHUNK = 1 << 20;
 
 	protected int _acceptfd;
 	private net.sockaddr_in _address;
@@ -502,6 +574,8 @@ public class Connection {
 	}
 
 	~Connection() {
+		if (_acceptfd < 0)
+			return;
 		flush();
 //		logger.debug("~Connection %p %d\n", this, _acceptfd);
 		net.closesocket(_acceptfd);
@@ -552,6 +626,9 @@ public class Connection {
 	}
 
 	// These implement buffered writes using _buffer.
+	//
+	// The buffers outlive any one request, and may be freed on another thread, so they always come from the
+	// process heap, even while a request's Region is the thread's allocator.
 
 	/**
 	 * Print formatted output to the connection.
@@ -579,16 +656,20 @@ public class Connection {
 	 * @threading This call is not thread-safe.
 	 */
 	public int write(string s) {
+		ref<memory.Allocator> priorAllocator = memory.setThreadAllocator(null);
 		if (s.length() + _buffer.length() >= BUFFER_MAX) {
 			int fill = BUFFER_MAX - _buffer.length();
 			if (fill > 0) {
 				_buffer.append(&s[0], fill);
-				if (!flush())
+				if (!flush()) {
+					memory.setThreadAllocator(priorAllocator);
 					return fill;
+				}
 			}
 			_buffer = s.substr(fill);
 		} else
 			_buffer.append(s);
+		memory.setThreadAllocator(priorAllocator);
 		return s.length();
 	}
 	/**
@@ -624,7 +705,9 @@ public class Connection {
 	 * @threading This call is not thread-safe.
 	 */
 	public void putc(int c) {
+		ref<memory.Allocator> priorAllocator = memory.setThreadAllocator(null);
 		_buffer.append(byte(c));
+		memory.setThreadAllocator(priorAllocator);
 		if (_buffer.length() >= BUFFER_MAX)
 			flush();
 	}
@@ -639,10 +722,51 @@ public class Connection {
 		if (_buffer.length() > 0) {
 			if (write(&_buffer[0], _buffer.length()) != _buffer.length())
 				return false;
+			ref<memory.Allocator> priorAllocator = memory.setThreadAllocator(null);
 			_buffer = "";
+			memory.setThreadAllocator(priorAllocator);
 		}
 		return true;
 	}
+	/**
+	 * Send part of an open file, after any buffered output.
+	 *
+	 * The file is mapped into memory and written from there, so it is not copied through a read buffer.
+	 * An unencrypted connection does better: the kernel copies the file straight to the socket.
+	 *
+	 * @param fd The file descriptor of a file open for reading.
+	 * @param offset The offset in the file of the first byte to send.
+	 * @param length The number of bytes to send.
+	 *
+	 * @return The number of bytes of the file sent. If this is less than length, the connection or
+	 * the file failed.
+	 *
+	 * @threading This call is not thread-safe.
+	 */
+	public long sendFile(int fd, long offset, long length) {
+		if (length <= 0 || !flush())
+			return 0;
+		// mmap requires an offset that is a multiple of the page size.
+		long pageSize = linux.sysconf(linux.SysConf._SC_PAGESIZE);
+		long mapOffset = offset - offset % pageSize;
+		long mapLength = length + (offset - mapOffset);
+		address map = linux.mmap(null, mapLength, linux.PROT_READ, linux.MAP_SHARED, fd, mapOffset);
+		if (long(map) == -1)
+			return 0;
+		pointer<byte> data = pointer<byte>(map) + (offset - mapOffset);
+		long sent = 0;
+		while (sent < length) {
+			long chunk = length - sent;
+			if (chunk > SEND_FILE_CHUNK)
+				chunk = SEND_FILE_CHUNK;
+			int n = write(data + sent, int(chunk));
+			if (n <= 0)
+				break;
+			sent += n;
+		}
+		linux.munmap(map, mapLength);
+		return sent;
+	}
 
 	// These implement buffered reads using _inBuffer;
 
@@ -655,8 +779,11 @@ public class Connection {
 	 */
 	public int read() {
 		if (_cursor >= _actual) {
-			if (_inBuffer.length() == 0)
+			if (_inBuffer.length() == 0) {
+				ref<memory.Allocator> priorAllocator = memory.setThreadAllocator(null);
 				_inBuffer.resize(8192);
+				memory.setThreadAllocator(priorAllocator);
+			}
 			_actual = read(&_inBuffer[0], _inBuffer.length());
 			if (_actual <= 0) {
 				if (_actual < 0)
@@ -671,6 +798,86 @@ public class Connection {
 		}
 		return _inBuffer[_cursor++];
 	}
+	/**
+	 * Append whatever data has already arrived on an unencrypted connection to the read buffer, without
+	 * blocking.
+	 *
+	 * This lets an event loop collect an HTTP message a piece at a time as the data arrives, then hand the
+	 * connection to a thread that parses the message with {@link read}.
+	 *
+	 * @return The number of bytes read, zero if no data was waiting. The value is -1 if the connection
+	 * is encrypted, the peer closed the connection, the read failed or the buffered data is larger than
+	 * any HTTP message header this class accepts.
+	 */
+	public int readAvailable() {
+		if (secured())
+			return -1;
+		int remaining = _actual > _cursor ? _actual - _cursor : 0;
+		if (_cursor > 0 && remaining > 0)
+			_inBuffer = _inBuffer.substr(_cursor, _actual);
+		_cursor = 0;
+		_actual = remaining;
+		if (_inBuffer.length() < BUFFER_MAX)
+			_inBuffer.resize(BUFFER_MAX);
+		else if (_actual == _inBuffer.length()) {
+			if (_actual >= MESSAGE_HEADER_MAX)
+				return -1;
+			_inBuffer.resize(2 * _actual);
+		}
+		int n = net.recv(_acceptfd, &_inBuffer[_actual], _inBuffer.length() - _actual, net.MSG_DONTWAIT);
+		if (n > 0) {
+			_actual += n;
+			return n;
+		}
+		if (n < 0 && (linux.errno() == linux.EAGAIN || linux.errno() == linux.EINTR))
+			return 0;
+		return -1;
+	}
+	/**
+	 * Check whether the read buffer holds the whole header section of an HTTP message, up to and
+	 * including the blank line that ends it. Blank lines ahead of the message are skipped, as the
+	 * parser does.
+	 *
+	 * @return true if the buffered data includes a complete message header, false otherwise.
+	 */
+	public boolean hasHttpMessage() {
+		int i = _cursor;
+		while (i < _actual && (_inBuffer[i] == '\r' || _inBuffer[i] == '\n'))
+			i++;
+		for (; i + 3 < _actual; i++) {
+			if (_inBuffer[i] == '\r' && _inBuffer[i + 1] == '\n' && _inBuffer[i + 2] == '\r' && _inBuffer[i + 3] == '\n')
+				return true;
+		}
+		return false;
+	}
+	/**
+	 * Take whatever data is in the read buffer and has not yet been consumed.
+	 *
+	 * A protocol that takes over a connection after an HTTP exchange, such as a Web Socket, calls this so that
+	 * data the peer sent right behind the HTTP message is not lost.
+	 *
+	 * @return The unread contents of the read buffer. The read buffer is left empty.
+	 */
+	public string takeReadBuffer() {
+		string s;
+		if (_actual > _cursor)
+			s = _inBuffer.substr(_cursor, _actual);
+		_cursor = 0;
+		_actual = 0;
+		return s;
+	}
+	/**
+	 * Send small writes immediately, rather than holding them until earlier data is acknowledged.
+	 *
+	 * An HTTP server writing a response in more than one piece on a kept-alive connection should set
+	 * this. Otherwise the last piece of each response can wait for the client's delayed acknowledgement.
+	 *
+	 * @return true if the option could be set, false otherwise.
+	 */
+	public boolean setNoDelay() {
+		int xx = 1;
+		return net.setsockopt(_acceptfd, net.IPPROTO_TCP, net.TCP_NODELAY, &xx, xx.bytes) == 0;
+	}
 	/**
 	 * Unread the last byte read from the buffer.
 	 *
@@ -834,12 +1041,50 @@ class PlainConnection extends Connection {
 	}
 
 	public int write(pointer<byte> buffer, int length) {
-		return net.send(_acceptfd, buffer, length, 0);
+		// A peer that has closed its end should fail the write, not raise SIGPIPE.
+		return net.send(_acceptfd, buffer, length, net.MSG_NOSIGNAL);
+	}
+
+	public long sendFile(int fd, long offset, long length) {
+		if (length <= 0 || !flush())
+			return 0;
+		// sendfile has no MSG_NOSIGNAL, so hold off SIGPIPE on this thread while it runs.
+		linux.sigset_t pipe;
+		linux.sigset_t priorMask;
+		linux.sigemptyset(&pipe);
+		linux.sigaddset(&pipe, linux.SIGPIPE);
+		linux.pthread_sigmask(linux.SIG_BLOCK, &pipe, &priorMask);
+		long sent = 0;
+		while (sent < length) {
+			long chunk = length - sent;
+			if (chunk > SEND_FILE_CHUNK)
+				chunk = SEND_FILE_CHUNK;
+			// sendfile advances offset past the bytes it sent.
+			long n = linux.sendfile(_acceptfd, fd, &offset, chunk);
+			if (n < 0 && linux.errno() == linux.EINTR)
+				continue;
+			if (n <= 0) {
+				if (n < 0 && linux.errno() == linux.EPIPE && linux.sigismember(&priorMask, linux.SIGPIPE) == 0) {
+					// Discard the signal raised by the failed send, so it is not delivered below.
+					linux.sigset_t pending;
+					linux.sigpending(&pending);
+					if (linux.sigismember(&pending, linux.SIGPIPE) != 0)
+						linux.sigwaitinfo(&pipe, null);
+				}
+				break;
+			}
+			sent += n;
+		}
+		linux.pthread_sigmask(linux.SIG_SETMASK, &priorMask, null);
+		return sent;
 	}
 
 	public void close() {
+		if (_acceptfd < 0)
+			return;
 		flush();
 		net.closesocket(_acceptfd);
+		_acceptfd = -1;
 	}
 
 	public boolean secured() {
@@ -1163,6 +1408,7 @@ class SSLConnection extends Connection {
 		} else
 			logger.debug("null _ssl indicates possible double close?");
 		net.closesocket(_acceptfd);
+		_acceptfd = -1;
 //		logger.debug("SSL_closed done");
 	}
 
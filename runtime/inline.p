@@ -0,0 +1,430 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+namespace parasol:compiler;
+
+import parasol:runtime;
+/*
+ * Tree-level inlining of small functions.
+ *
+ * A call is replaced by the body of the function it calls when the function takes no arguments, cannot be
+ * overridden and computes a single scalar value from the fields of its object and constants. This covers
+ * accessors like vector.length() and string.length(), which otherwise pay for a call and a frame on every
+ * use.
+ *
+ * Inlining happens as calls are folded, which is before temporaries are assigned. The body of a callee is
+ * captured before the callee itself is folded, since folding rewrites the tree in place.
+ *
+ * An inlined expression contains no calls and no statements, so it adds nothing to the exception table.
+ * Source locations are only recorded for statements, so the caller's statement carries the location of any
+ * fault in inlined code.
+ */
+/**
+ * The largest number of nodes an inlined expression may have.
+ */
+@Constant
+private int INLINE_NODE_LIMIT = 12;
+/**
+ * Capture the inlinable expression of a function, if it has one.
+ *
+ * This must be called before the body of the function is folded. The code generator calls it just before
+ * folding each function. Call sites call it, through inlineCall, for functions that may not have been
+ * generated yet.
+ */
+public void captureInlineExpression(ref<ParameterScope> scope, ref<CompileContext> compileContext) {
+	if (scope.inlineChecked)
+		return;
+	ref<FunctionDeclaration> func = ref<FunctionDeclaration>(scope.definition());
+	if (func == null || func.op() != Operator.FUNCTION || func.body == null)
+		return;
+	// Template functions are typed as they are generated, so there is nothing to capture until then.
+	if (func.body.type == null)
+		return;
+	scope.inlineChecked = true;
+	if (!inlinableFunction(scope, compileContext))
+		return;
+	InlineSite site;
+	site.tree = scope.unit().tree();
+	ref<Node> e = inlinableBody(site.tree, func.body, scope.type.returnValueType());
+	if (e == null)
+		return;
+	int cost = inlineCost(e);
+	if (cost < 0 || cost > INLINE_NODE_LIMIT)
+		return;
+	site.location = e.location();
+	scope.inlineExpression = site.copy(e);
+}
+/**
+ * @return The expression to replace the call, not yet folded, or null if the call cannot be inlined.
+ */
+ref<Node> inlineCall(ref<Call> call, ref<SyntaxTree> tree, ref<CompileContext> compileContext) {
+	if (call.arguments() != null)
+		return null;
+	ref<ParameterScope> callee = call.overload();
+	if (callee == null)
+		return null;
+	captureInlineExpression(callee, compileContext);
+	if (callee.inlineExpression == null)
+		return null;
+	InlineSite site;
+	site.tree = tree;
+	site.location = call.location();
+	switch (call.category()) {
+	case METHOD_CALL:
+		ref<Node> target = call.target();
+		switch (target.op()) {
+		case IDENTIFIER:
+			// An implicit call on this object: the fields mean the same thing in the caller.
+			if (target.symbol() == null || target.symbol().storageClass() == StorageClass.LOCK)
+				return null;
+			break;
+
+		case DOT:
+			ref<Selection> dot = ref<Selection>(target);
+			if (!duplicableObject(dot.left()))
+				return null;
+			site.object = dot.left();
+			site.objectIsPointer = dot.indirect();
+			break;
+
+		default:
+			return null;
+		}
+		break;
+
+	case FUNCTION_CALL:
+		// A function with no object can only have captured an expression of constants.
+		break;
+
+	default:
+		return null;
+	}
+	ref<Node> result = site.copy(callee.inlineExpression);
+	if (result != null)
+		result.type = call.type;
+	return result;
+}
+
+private boolean inlinableFunction(ref<ParameterScope> scope, ref<CompileContext> compileContext) {
+	if (scope.kind() != ParameterScope.Kind.FUNCTION ||
+		scope.functionCategory() != FunctionDeclaration.Category.NORMAL)
+		return false;
+	if (scope.type == null || scope.type.deferAnalysis() || scope.nativeBinding)
+		return false;
+	if (scope.type.parameterCount() != 0 || scope.type.hasEllipsis() || scope.type.returnCount() != 1)
+		return false;
+	if (!scalarType(scope.type.returnValueType()))
+		return false;
+	ref<Scope> enclosing = scope.enclosing();
+	// A monitor method takes the lock on entry and a lock scope delegates to the locked object.
+	if (enclosing.isMonitor() || enclosing.storageClass() == StorageClass.LOCK)
+		return false;
+	if (scope.hasThis() && scope.usesVTable(compileContext))
+		return false;
+	return true;
+}
+/*
+ * Recognize the two shapes of body that compute a single expression:
+ *
+ *     return e;
+ *
+ *     if (c) return e1; else return e2;		or		if (c) return e1; return e2;
+ *
+ * The second is returned as a conditional expression, or for a boolean function returning true and false,
+ * as c or !c.
+ */
+private ref<Node> inlinableBody(ref<SyntaxTree> tree, ref<Block> body, ref<Type> returnType) {
+	ref<NodeList> statements = body.statements();
+	if (statements == null)
+		return null;
+	ref<Node> first = statements.node;
+	if (statements.next == null) {
+		if (first.op() == Operator.RETURN)
+			return returnedExpression(first, returnType);
+		if (first.op() != Operator.IF)
+			return null;
+		ref<Ternary> ifNode = ref<Ternary>(first);
+		return conditionalReturn(tree, ifNode.left(), ifNode.middle(), ifNode.right(), returnType);
+	}
+	if (statements.next.next != null || first.op() != Operator.IF)
+		return null;
+	ref<Ternary> ifNode = ref<Ternary>(first);
+	if (ifNode.right() != null)
+		return null;
+	return conditionalReturn(tree, ifNode.left(), ifNode.middle(), statements.next.node, returnType);
+}
+
+private ref<Node> conditionalReturn(ref<SyntaxTree> tree, ref<Node> test, ref<Node> trueStatement, ref<Node> falseStatement, ref<Type> returnType) {
+	if (test == null || test.type == null || test.type.family() != runtime.TypeFamily.BOOLEAN)
+		return null;
+	ref<Node> trueValue = returnedExpression(singleStatement(trueStatement), returnType);
+	ref<Node> falseValue = returnedExpression(singleStatement(falseStatement), returnType);
+	if (trueValue == null || falseValue == null)
+		return null;
+	// A boolean conditional expression cannot be generated where a condition code is wanted, as in the
+	// test of an if statement. Only the forms that reduce to the test itself are inlined.
+	if (returnType.family() == runtime.TypeFamily.BOOLEAN) {
+		if (trueValue.op() == Operator.TRUE && falseValue.op() == Operator.FALSE)
+			return test;
+		if (trueValue.op() == Operator.FALSE && falseValue.op() == Operator.TRUE) {
+			ref<Node> n = tree.newUnary(Operator.NOT, test, test.location());
+			n.type = returnType;
+			return n;
+		}
+		return null;
+	}
+	ref<Node> n = tree.newTernary(Operator.CONDITIONAL, test, trueValue, falseValue, test.location());
+	n.type = returnType;
+	return n;
+}
+
+private ref<Node> singleStatement(ref<Node> n) {
+	if (n == null || n.op() != Operator.BLOCK)
+		return n;
+	ref<NodeList> statements = ref<Block>(n).statements();
+	if (statements == null || statements.next != null)
+		return null;
+	return statements.node;
+}
+
+private ref<Node> returnedExpression(ref<Node> n, ref<Type> returnType) {
+	if (n == null || n.op() != Operator.RETURN)
+		return null;
+	ref<NodeList> values = ref<Return>(n).arguments();
+	if (values == null || values.next != null)
+		return null;
+	ref<Node> e = values.node;
+	if (e.type == null || !e.type.equals(returnType))
+		return null;
+	return e;
+}
+/*
+ * The number of nodes in an expression that can be inlined, or -1 if it cannot be. Every value the
+ * expression computes must be a scalar, so that folding the copy never introduces a call or a temporary
+ * that needs a destructor.
+ */
+private int inlineCost(ref<Node> n) {
+	if (n.type == null || !scalarType(n.type))
+		return -1;
+	switch (n.op()) {
+	case IDENTIFIER:
+		return memberField(n.symbol()) ? 1 : -1;
+
+	case DOT:
+		ref<Selection> dot = ref<Selection>(n);
+		if (!memberField(dot.symbol()))
+			return -1;
+		int cost = objectCost(dot.left());
+		return cost < 0 ? -1 : cost + 1;
+
+	case INTEGER:
+	case CHARACTER:
+	case TRUE:
+	case FALSE:
+	case NULL:
+		return 1;
+
+	case NOT:
+	case NEGATE:
+	case BIT_COMPLEMENT:
+	case CAST:
+		cost = inlineCost(ref<Unary>(n).operand());
+		return cost < 0 ? -1 : cost + 1;
+
+	case ADD:
+	case SUBTRACT:
+	case MULTIPLY:
+	case AND:
+	case OR:
+	case EXCLUSIVE_OR:
+	case LEFT_SHIFT:
+	case RIGHT_SHIFT:
+	case UNSIGNED_RIGHT_SHIFT:
+		// Pointer arithmetic is scaled as it is folded, and the scaled form does not combine well with
+		// the addressing of the caller's expression.
+		switch (n.type.family()) {
+		case ADDRESS:
+		case REF:
+		case POINTER:
+			return -1;
+		}
+
+	case EQUALITY:
+	case NOT_EQUAL:
+	case IDENTITY:
+	case NOT_IDENTITY:
+	case LESS:
+	case GREATER:
+	case LESS_EQUAL:
+	case GREATER_EQUAL:
+	case LOGICAL_AND:
+	case LOGICAL_OR:
+		ref<Binary> b = ref<Binary>(n);
+		int left = inlineCost(b.left());
+		int right = inlineCost(b.right());
+		return left < 0 || right < 0 ? -1 : left + right + 1;
+
+	case CONDITIONAL:
+		ref<Ternary> t = ref<Ternary>(n);
+		int test = inlineCost(t.left());
+		int trueCost = inlineCost(t.middle());
+		int falseCost = inlineCost(t.right());
+		if (test < 0 || trueCost < 0 || falseCost < 0)
+			return -1;
+		return test + trueCost + falseCost + 1;
+	}
+	return -1;
+}
+/*
+ * The object of a field selection in an inlined expression: this, a field of this, or a field of one of those.
+ * These may have any type.
+ */
+private int objectCost(ref<Node> n) {
+	switch (n.op()) {
+	case THIS:
+		return 1;
+
+	case IDENTIFIER:
+		return memberField(n.symbol()) ? 1 : -1;
+
+	case DOT:
+		ref<Selection> dot = ref<Selection>(n);
+		if (!memberField(dot.symbol()))
+			return -1;
+		int cost = objectCost(dot.left());
+		return cost < 0 ? -1 : cost + 1;
+	}
+	return -1;
+}
+/*
+ * An object expression at a call site that can be evaluated more than once without side effects.
+ */
+private boolean duplicableObject(ref<Node> n) {
+	switch (n.op()) {
+	case THIS:
+		return true;
+
+	case IDENTIFIER:
+		ref<Symbol> sym = n.symbol();
+		if (sym == null || sym.class != PlainSymbol)
+			return false;
+		switch (sym.storageClass()) {
+		case AUTO:
+		case PARAMETER:
+		case MEMBER:
+		case STATIC:
+			return true;
+		}
+		return false;
+
+	case DOT:
+		ref<Selection> dot = ref<Selection>(n);
+		return memberField(dot.symbol()) && duplicableObject(dot.left());
+	}
+	return false;
+}
+
+private boolean memberField(ref<Symbol> sym) {
+	return sym != null && sym.class == PlainSymbol && sym.storageClass() == StorageClass.MEMBER;
+}
+
+private boolean scalarType(ref<Type> t) {
+	switch (t.family()) {
+	case SIGNED_8:
+	case SIGNED_16:
+	case SIGNED_32:
+	case SIGNED_64:
+	case UNSIGNED_8:
+	case UNSIGNED_16:
+	case UNSIGNED_32:
+	case UNSIGNED_64:
+	case BOOLEAN:
+	case ADDRESS:
+	case REF:
+	case POINTER:
+		return true;
+	}
+	return false;
+}
+/*
+ * Copies an inlined expression into a tree.
+ *
+ * If object is set, the fields of this in the expression become fields of object. Otherwise the expression
+ * is copied as it is, which is right for an implicit call on this object and for the copy kept with the
+ * function.
+ */
+class InlineSite {
+	ref<SyntaxTree> tree;
+	SourceOffset location;
+	ref<Node> object;
+	boolean objectIsPointer;
+
+	ref<Node> copy(ref<Node> n) {
+		ref<Node> result;
+		switch (n.op()) {
+		case IDENTIFIER:
+			if (object == null || !memberField(n.symbol()))
+				return n.clone(tree);
+			result = tree.newSelection(duplicate(object), n.symbol(), objectIsPointer, location);
+			break;
+
+		case DOT:
+			ref<Selection> dot = ref<Selection>(n);
+			if (dot.left().op() == Operator.THIS && object != null)
+				result = tree.newSelection(duplicate(object), dot.symbol(), objectIsPointer, location);
+			else
+				result = tree.newSelection(copy(dot.left()), dot.symbol(), dot.indirect(), location);
+			break;
+
+		case THIS:
+		case INTEGER:
+		case CHARACTER:
+		case TRUE:
+		case FALSE:
+		case NULL:
+			return n.clone(tree);
+
+		case NOT:
+		case NEGATE:
+		case BIT_COMPLEMENT:
+		case CAST:
+			result = tree.newUnary(n.op(), copy(ref<Unary>(n).operand()), location);
+			break;
+
+		case CONDITIONAL:
+			ref<Ternary> t = ref<Ternary>(n);
+			result = tree.newTernary(Operator.CONDITIONAL, copy(t.left()), copy(t.middle()), copy(t.right()), location);
+			break;
+
+		default:
+			ref<Binary> b = ref<Binary>(n);
+			result = tree.newBinary(n.op(), copy(b.left()), copy(b.right()), location);
+		}
+		result.type = n.type;
+		return result;
+	}
+	/*
+	 * A fresh copy of the object of the call. Each use of a field of the object needs its own nodes, since
+	 * folding may rewrite them.
+	 */
+	private ref<Node> duplicate(ref<Node> n) {
+		if (n.op() != Operator.DOT)
+			return n.clone(tree);
+		ref<Selection> dot = ref<Selection>(n);
+		ref<Node> result = tree.newSelection(duplicate(dot.left()), dot.symbol(), dot.indirect(), n.location());
+		result.type = n.type;
+		return result;
+	}
+}
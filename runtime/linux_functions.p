@@ -107,6 +107,15 @@ public abstract int dup(int fd);
 @Linux("libc.so.6", "dup2")
 public abstract int dup2(int oldfd, int newfd);
 
+@Linux("libc.so.6", "epoll_create1")
+public abstract int epoll_create1(int createFlags);
+
+@Linux("libc.so.6", "epoll_ctl")
+public abstract int epoll_ctl(int epfd, int op, int fd, ref<epoll_event> event);
+
+@Linux("libc.so.6", "epoll_wait")
+public abstract int epoll_wait(int epfd, ref<epoll_event> events, int maxevents, int timeout);
+
 @Linux("libc.so.6", "__errno_location")
 private abstract ref<int> __errno_location();
 
@@ -122,6 +131,9 @@ public abstract int fcntl(int fd, int cmd, int arg0);
 @Linux("libc.so.6", "fdatasync")
 public abstract int fdatasync(int fd);
 
+@Linux("libc.so.6", "flock")
+public abstract int flock(int fd, int operation);
+
 @Linux("libc.so.6", "fork")
 public abstract pid_t fork();
 
@@ -194,6 +206,9 @@ public abstract int link(pointer<byte> oldpath, pointer<byte> newpath);
 @Linux("libc.so.6", "lseek")
 public abstract off_t lseek(int fd, off_t offset, int whence);
 
+@Linux("libc.so.6", "madvise")
+public abstract int madvise(address addr, long length, int advice);
+
 @Linux("libc.so.6", "mkdir")
 public abstract int mkdir(pointer<byte> path, mode_t mode);
 
@@ -323,6 +338,9 @@ public abstract int sem_timedwait(ref<sem_t> sem, ref<timespec> abs_timeout);
 @Linux("libpthread.so.0", "sem_wait")
 public abstract int sem_wait(ref<sem_t> sem);
 
+@Linux("libc.so.6", "sendfile")
+public abstract long sendfile(int out_fd, int in_fd, ref<long> offset, long count);
+
 @Linux("libc.so.6", "setenv")
 public abstract int setenv(pointer<byte> name, pointer<byte> value, int overwrite);
 
@@ -377,6 +395,9 @@ public abstract int signal(int signum, void(int) handler);
 @Linux("libc.so.6", "sigorset")
 public abstract int sigorset(ref<sigset_t> dest, ref<sigset_t> left, ref<sigset_t> right);
 
+@Linux("libc.so.6", "sigpending")
+public abstract int sigpending(ref<sigset_t> set);
+
 @Linux("libc.so.6", "sigwaitinfo")
 public abstract int sigwaitinfo(ref<sigset_t> set, ref<siginfo_t> info);
 
@@ -395,6 +416,9 @@ public abstract long syscall(long callId, long p1, long p2);
 @Linux("libc.so.6", "syscall")
 public abstract long syscall(long callId, long p1, long p2, long p3);
 
+@Linux("libc.so.6", "syscall")
+public abstract long syscall(long callId, long p1, long p2, long p3, long p4);
+
 @Linux("libc.so.6", "statvfs")
 public abstract int statvfs(pointer<byte> path, ref<statvfsStruct> buf);
 /**
@@ -444,6 +468,15 @@ public abstract int tcsetpgrp(int fd, pid_t pgrp_id);
 @Linux("libc.so.6", "timegm")
 public abstract time_t timegm(ref<tm> time);
 
+@Linux("librt.so.1", "timer_create")
+public abstract int timer_create(int clockid, ref<sigevent> sevp, ref<timer_t> timerid);
+
+@Linux("librt.so.1", "timer_delete")
+public abstract int timer_delete(timer_t timerid);
+
+@Linux("librt.so.1", "timer_settime")
+public abstract int timer_settime(timer_t timerid, int timerFlags, ref<itimerspec> newValue, ref<itimerspec> oldValue);
+
 @Linux("libc.so.6", "unlink")
 public abstract int unlink(pointer<byte> path);
 
@@ -492,6 +525,24 @@ public abstract int __xstat(int statVersion, pointer<byte> path, ref<statStruct>
 public pid_t gettid() {
 	return pid_t(syscall(186));
 }
+
+public int FUTEX_WAIT_PRIVATE = 128;
+public int FUTEX_WAKE_PRIVATE = 129;
+/*
+ * The futex call has no wrapper in the Linux library either.
+ *
+ * futexWait blocks the calling thread as long as word still holds expected, until a futexWake on the same word.
+ * It may also return early, so callers must re-check the word.
+ */
+public int futexWait(ref<int> word, int expected) {
+	return int(syscall(202, long(word), FUTEX_WAIT_PRIVATE, expected, 0));
+}
+/*
+ * Wakes up to count threads blocked in futexWait on word. Returns the number of threads woken.
+ */
+public int futexWake(ref<int> word, int count) {
+	return int(syscall(202, long(word), FUTEX_WAKE_PRIVATE, count));
+}
 /*
  * POSIX requires that seteuid set all thread's permissions in the process, but this call side-steps
  * the POSIX requirements and switches just the calling thread's permissions. This should be used with caution
@@ -831,6 +882,38 @@ public int TCSADRAIN = 1;
 @Constant
 public int TCSAFLUSH = 2;
 
+@Constant
+public int EPOLL_CLOEXEC = 02000000;
+@Constant
+public int EPOLL_CTL_ADD = 1;
+@Constant
+public int EPOLL_CTL_DEL = 2;
+@Constant
+public int EPOLL_CTL_MOD = 3;
+@Constant
+public unsigned EPOLLIN = 0x001;
+@Constant
+public unsigned EPOLLOUT = 0x004;
+@Constant
+public unsigned EPOLLERR = 0x008;
+@Constant
+public unsigned EPOLLHUP = 0x010;
+@Constant
+public unsigned EPOLLRDHUP = 0x2000;
+@Constant
+public unsigned EPOLLONESHOT = 0x40000000;
+@Constant
+public unsigned EPOLLET = 0x80000000;
+/*
+ * On x86-64 the C struct is packed, so the 64-bit data union starts at offset 4. Parasol has neither unions
+ * nor packed classes, so the union is declared as two ints. Only the fd member of the union is used.
+ */
+public class epoll_event {
+	public unsigned events;
+	public int fd;
+	private int dataHigh;
+}
+
 
 public class DIR {
 	private int dummy;			// Don't expose anything about this structure
@@ -1064,7 +1147,7 @@ public int PROT_WRITE = 0x02;
 @Constant
 public int PROT_EXEC = 0x04;
 @Constant
-public int PROT_NONE = 0x08;
+public int PROT_NONE = 0x00;
 @Constant
 public int PROT_GROWSDOWN = 0x01000000;
 @Constant
@@ -1091,6 +1174,8 @@ public int MAP_ANONYMOUS = 0x20;            /* Don't use a file.  */
 public int MAP_ANON =      MAP_ANONYMOUS;
 /* When MAP_HUGETLB is set bits [26:31] encode the log2 of the huge page size.  */
 @Constant
+public int MAP_NORESERVE = 0x4000;          /* Don't check for reservations.  */
+@Constant
 public int MAP_HUGE_SHIFT = 26;
 @Constant
 public int MAP_HUGE_MASK = 0x3f;
@@ -1129,6 +1214,8 @@ public int MAP_HUGE_MASK = 0x3f;
 #endif
 
  */
+@Constant
+public int MADV_DONTNEED = 4;
 
 @Constant
 public int RTLD_LAZY = 0x00001;
@@ -1312,9 +1399,11 @@ public int EIO = 5;		/* I/O error */
 public int EBADF = 9;	/* Bad file number */
 @Constant
 public int ECHILD = 10;	/* No child processes */
+@Constant
+public int EAGAIN = 11;	/* Try again */
+@Constant
+public int ENOMEM = 12;	/* Out of memory */
 /*
-#define	EAGAIN		11	/* Try again */
-#define	ENOMEM		12	/* Out of memory */
 #define	EACCES		13	/* Permission denied */
 #define	EFAULT		14	/* Bad address */
 #define	ENOTBLK		15	/* Block device required */
@@ -1331,9 +1420,11 @@ public int EEXIST = 17;	/* File exists */
  */
 @Constant
 public int EINVAL = 22;	/* Invalid argument */
+@Constant
+public int ENFILE = 23;	/* File table overflow */
+@Constant
+public int EMFILE = 24;	/* Too many open files */
 /*
-#define	ENFILE		23	/* File table overflow */
-#define	EMFILE		24	/* Too many open files */
 #define	ENOTTY		25	/* Not a typewriter */
 #define	ETXTBSY		26	/* Text file busy */
 #define	EFBIG		27	/* File too large */
@@ -1341,7 +1432,10 @@ public int EINVAL = 22;	/* Invalid argument */
 #define	ESPIPE		29	/* Illegal seek */
 #define	EROFS		30	/* Read-only file system */
 #define	EMLINK		31	/* Too many links */
-#define	EPIPE		32	/* Broken pipe */
+*/
+@Constant
+public int EPIPE = 32;	/* Broken pipe */
+/*
 #define	EDOM		33	/* Math argument out of domain of func */
 #define	ERANGE		34	/* Math result not representable */
 
@@ -1424,12 +1518,14 @@ public int EINVAL = 22;	/* Invalid argument */
 #define	ENETDOWN	100	/* Network is down */
 #define	ENETUNREACH	101	/* Network is unreachable */
 #define	ENETRESET	102	/* Network dropped connection because of reset */
-#define	ECONNABORTED	103	/* Software caused connection abort */
 */
 @Constant
+public int ECONNABORTED = 103;	/* Software caused connection abort */
+@Constant
 public int ECONNRESET = 104;	/* Connection reset by peer */
+@Constant
+public int ENOBUFS = 105;	/* No buffer space available */
 /*
-#define	ENOBUFS		105	/* No buffer space available */
 #define	EISCONN		106	/* Transport endpoint is already connected */
 #define	ENOTCONN	107	/* Transport endpoint is not connected */
 #define	ESHUTDOWN	108	/* Cannot send after transport endpoint shutdown */
@@ -1542,6 +1638,11 @@ public class timespec {
 	public long tv_nsec;
 }
 
+public class itimerspec {
+	public timespec it_interval;
+	public timespec it_value;
+}
+
 public class pthread_attr_t {
 	public int align;
 	private int _filler1;
@@ -1941,6 +2042,32 @@ public class user_fpregs_struct = libc_fpstate;
 
 public class sigval_t = address;		// in C actually a union
 public class clock_t = int;
+public class timer_t = address;
+/**
+ * This is defined in C with a union following sigev_notify. Only the thread id member, used
+ * with SIGEV_THREAD_ID, is exposed.
+ */
+public class sigevent {
+	public sigval_t sigev_value;
+	public int sigev_signo;
+	public int sigev_notify;
+	public pid_t sigev_notify_thread_id;
+	private int _filler0;
+	private long _filler1;
+	private long _filler2;
+	private long _filler3;
+	private long _filler4;
+	private long _filler5;
+}
+
+@Constant
+public int SIGEV_SIGNAL = 0;
+@Constant
+public int SIGEV_NONE = 1;
+@Constant
+public int SIGEV_THREAD = 2;
+@Constant
+public int SIGEV_THREAD_ID = 4;
 
 /* Encoding of the file mode.  */
 
@@ -2457,6 +2584,15 @@ public int F_GETOWNER_UIDS = 17;
 @Constant
 public int FD_CLOEXEC =     1;      /* actually anything with low bit set goes */
 
+@Constant
+public int LOCK_SH =	1;			/* Shared lock. */
+@Constant
+public int LOCK_EX =	2;			/* Exclusive lock. */
+@Constant
+public int LOCK_NB =	4;			/* Or'd with one of the above to prevent blocking. */
+@Constant
+public int LOCK_UN =	8;			/* Remove lock. */
+
 public class rlim_t = long;			// actually Unsigned<64>
 
 @Constant
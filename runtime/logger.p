@@ -573,7 +573,8 @@ public monitor class Logger {
 
 	private void queueEvent(ref<LogEvent> logEvent) {
 		// All log messages go through here. Level has been confirmed as high enough to care about.
-
+		// The queued copies are deleted by the writer thread, so they must come from the process heap.
+		ref<memory.Allocator> allocator = memory.setThreadAllocator(null);
 		ref<Logger> context = this;
 		do {
 			lock (*context) {
@@ -585,6 +586,7 @@ public monitor class Logger {
 					context = null;
 			}
 		} while (context != null);
+		memory.setThreadAllocator(allocator);
 	}
 
 	ref<Logger>, boolean getChild(string name, string newPath) {
@@ -23,8 +23,8 @@ import parasol:thread;
 
 ref<log.Logger> logger = log.getLogger("rpc");
 
-void marshalBoolean(ref<string> output, ref<boolean> object) {
-	(*output).append(*object ? 't' : 'f');
+void marshalBoolean(ref<byte[]> output, ref<boolean> object) {
+	output.append(*object ? byte('t') : byte('f'));
 }
 
 boolean unmarshalBoolean(ref<pointer<byte>> value) {
@@ -42,14 +42,14 @@ boolean unmarshalBoolean(ref<pointer<byte>> value) {
 	throw IllegalArgumentException(s);
 }
 
-void marshalShort(ref<string> output, ref<short> object) {
+void marshalShort(ref<byte[]> output, ref<short> object) {
 	short value = *object;
 	if (value >= -128 && value <= 127) {
-		(*output).append('1');
-		(*output) += substring(pointer<byte>(&value), 1);
+		output.append(byte('1'));
+		output.append(pointer<byte>(&value), 1);
 	} else {
-		(*output).append('S');
-		(*output) += substring(pointer<byte>(&value), 2);
+		output.append(byte('S'));
+		output.append(pointer<byte>(&value), 2);
 	}
 }
 
@@ -70,17 +70,17 @@ short unmarshalShort(ref<pointer<byte>> value) {
 	throw IllegalArgumentException(s);
 }
 
-void marshalInt(ref<string> output, ref<int> object) {
+void marshalInt(ref<byte[]> output, ref<int> object) {
 	int value = *object;
 	if (value >= -128 && value <= 127) {
-		(*output).append('1');
-		(*output) += substring(pointer<byte>(&value), 1);
+		output.append(byte('1'));
+		output.append(pointer<byte>(&value), 1);
 	} else if (value >= -32768 && value <= 32767) {
-		(*output).append('S');
-		(*output) += substring(pointer<byte>(&value), 2);
+		output.append(byte('S'));
+		output.append(pointer<byte>(&value), 2);
 	} else {
-		(*output).append('i');
-		(*output) += substring(pointer<byte>(&value), 4);
+		output.append(byte('i'));
+		output.append(pointer<byte>(&value), 4);
 	}
 }
 
@@ -106,20 +106,20 @@ int unmarshalInt(ref<pointer<byte>> value) {
 	throw IllegalArgumentException(s);
 }
 
-void marshalLong(ref<string> output, ref<long> object) {
+void marshalLong(ref<byte[]> output, ref<long> object) {
 	long value = *object;
 	if (value >= -128 && value <= 127) {
-		(*output).append('1');
-		(*output) += substring(pointer<byte>(&value), 1);
+		output.append(byte('1'));
+		output.append(pointer<byte>(&value), 1);
 	} else if (value >= -32768 && value <= 32767) {
-		(*output).append('S');
-		(*output) += substring(pointer<byte>(&value), 2);
+		output.append(byte('S'));
+		output.append(pointer<byte>(&value), 2);
 	} else if (value >= int.MIN_VALUE && value <= int.MAX_VALUE) {
-		(*output).append('i');
-		(*output) += substring(pointer<byte>(&value), 4);
+		output.append(byte('i'));
+		output.append(pointer<byte>(&value), 4);
 	} else {
-		(*output).append('L');
-		(*output) += substring(pointer<byte>(&value), 8);
+		output.append(byte('L'));
+		output.append(pointer<byte>(&value), 8);
 	}
 }
 
@@ -150,22 +150,22 @@ long unmarshalLong(ref<pointer<byte>> value) {
 	throw IllegalArgumentException(s);
 }
 
-void marshalByte(ref<string> output, ref<byte> object) {
-	(*output).append(*object);
+void marshalByte(ref<byte[]> output, ref<byte> object) {
+	output.append(*object);
 }
 
 byte unmarshalByte(ref<pointer<byte>> value) {
 	return *(*value)++;
 }
 
-void marshalChar(ref<string> output, ref<char> object) {
+void marshalChar(ref<byte[]> output, ref<char> object) {
 	char value = *object;
 	if (value <= byte.MAX_VALUE) {
-		(*output).append('b');
-		(*output) += substring(pointer<byte>(&value), 1);
+		output.append(byte('b'));
+		output.append(pointer<byte>(&value), 1);
 	} else {
-		(*output).append('c');
-		(*output) += substring(pointer<byte>(&value), 2);
+		output.append(byte('c'));
+		output.append(pointer<byte>(&value), 2);
 	}
 }
 
@@ -186,17 +186,17 @@ char unmarshalChar(ref<pointer<byte>> value) {
 	throw IllegalArgumentException(s);
 }
 
-void marshalUnsigned(ref<string> output, ref<unsigned> object) {
+void marshalUnsigned(ref<byte[]> output, ref<unsigned> object) {
 	unsigned value = *object;
 	if (value <= unsigned(byte.MAX_VALUE)) {
-		(*output).append('b');
-		(*output) += substring(pointer<byte>(&value), 1);
+		output.append(byte('b'));
+		output.append(pointer<byte>(&value), 1);
 	} else if (value <= unsigned(char.MAX_VALUE)) {
-		(*output).append('c');
-		(*output) += substring(pointer<byte>(&value), 2);
+		output.append(byte('c'));
+		output.append(pointer<byte>(&value), 2);
 	} else {
-		(*output).append('u');
-		(*output) += substring(pointer<byte>(&value), 4);
+		output.append(byte('u'));
+		output.append(pointer<byte>(&value), 4);
 	}
 }
 
@@ -222,15 +222,15 @@ unsigned unmarshalUnsigned(ref<pointer<byte>> value) {
 	throw IllegalArgumentException(s);
 }
 
-void marshalString(ref<string> output, ref<string> object) {
+void marshalString(ref<byte[]> output, ref<string> object) {
 	if (*object == null)
-		(*output).append('N');
+		output.append(byte('N'));
 	else if (object.length() == 0)
-		(*output).append('Z');
+		output.append(byte('Z'));
 	else {
 		int len = object.length();
 		marshalInt(output, &len);
-		(*output).append(*object);
+		output.append(&(*object)[0], len);
 	}
 }
 
@@ -37,6 +37,11 @@ import parasol:text;
  * Clever bit twiddlers will always find clever ways to pack objects into a single allocation.
  */
 public address alloc(long size) {
+	if (threadAllocators > 0) {
+		ref<Allocator> a = ref<Allocator>(runtime.getRuntimeParameter(runtime.THREAD_ALLOCATOR));
+		if (a != null)
+			return a.alloc(size);
+	}
 	if (currentHeap != null)
 		return currentHeap.alloc(size);
 	else
@@ -48,11 +53,72 @@ public address alloc(long size) {
  * It is called from inline code.
  */
 public void free(address p) {
+	if (threadAllocators > 0) {
+		ref<Allocator> a = ref<Allocator>(runtime.getRuntimeParameter(runtime.THREAD_ALLOCATOR));
+		if (a != null) {
+			a.free(p);
+			return;
+		}
+	}
 	if (currentHeap != null)
 		currentHeap.free(p);
 	else
 		heap.free(p);
 }
+/**
+ * Allocate memory that the caller will completely initialize.
+ *
+ * Unlike {@link alloc}, the memory is not guaranteed to be filled with zeroes. Allocators that
+ * would otherwise have to clear the block can skip that work.
+ */
+public address allocUninitialized(long size) {
+	if (threadAllocators > 0) {
+		ref<Allocator> a = ref<Allocator>(runtime.getRuntimeParameter(runtime.THREAD_ALLOCATOR));
+		if (a != null)
+			return a.allocUninitialized(size);
+	}
+	if (currentHeap != null)
+		return currentHeap.allocUninitialized(size);
+	else
+		return heap.alloc(size);
+}
+/**
+ * Make an Allocator the one used by the new and delete operators on the calling thread, in place of
+ * the process heap.
+ *
+ * The Allocator must be able to free memory that came from the process heap, since objects created
+ * before the call may be deleted while it is in place.
+ *
+ * @param allocator The Allocator to use, or null to go back to the process heap.
+ *
+ * @return The Allocator the thread was using, or null if it was using the process heap.
+ */
+public ref<Allocator> setThreadAllocator(ref<Allocator> allocator) {
+	ref<Allocator> previous = ref<Allocator>(runtime.getRuntimeParameter(runtime.THREAD_ALLOCATOR));
+	if (previous == allocator)
+		return previous;
+	lock (threadAllocatorsLock) {
+		if (previous == null)
+			threadAllocators++;
+		else if (allocator == null)
+			threadAllocators--;
+	}
+	runtime.setRuntimeParameter(runtime.THREAD_ALLOCATOR, allocator);
+	return previous;
+}
+/**
+ * @return The Allocator set for the calling thread by {@link setThreadAllocator}, or null if the thread
+ * uses the process heap.
+ */
+public ref<Allocator> threadAllocator() {
+	return ref<Allocator>(runtime.getRuntimeParameter(runtime.THREAD_ALLOCATOR));
+}
+/*
+ * The number of threads with an allocator of their own. Only a thread that has set its own allocator
+ * needs to see an up-to-date count, and it changed the count itself.
+ */
+private int threadAllocators;
+private Monitor threadAllocatorsLock;
 /*
  * On startup, initialize the heap for normal or leak-detection mode.
  */
@@ -60,14 +126,20 @@ private ref<Allocator> currentHeap;
 
 private Heap heap;
 private LeakHeap leakHeap(runtime.returnAddress());
+private ThreadCachingHeap cachingHeap;
 
 public enum StartingHeap {
 	PRODUCTION,
 	DETECT_LEAKS,
-	GUARD
+	GUARD,
+	THREAD_CACHING
 }
 
 currentHeap = &heap;
+// An image run by the compiler inherits the compiler's runtime parameters, including the thread cache of
+// whatever heap the compiler is using.
+runtime.setRuntimeParameter(runtime.HEAP_CACHE, null);
+runtime.setRuntimeParameter(runtime.THREAD_ALLOCATOR, null);
 thread.Thread.init();
 
 switch (runtime.startingHeap()) {
@@ -81,19 +153,114 @@ case DETECT_LEAKS:
 case GUARD:
 	currentHeap = &guardedHeap;
 	break;
+
+case THREAD_CACHING:
+	if (cachingHeap.initialize())
+		currentHeap = &cachingHeap;
+	break;
+}
+
+private ref<AllocationProfiler> heapProfiler;
+
+if (runtime.startingHeap() != StartingHeap.DETECT_LEAKS) {
+	heapProfiler = AllocationProfiler.configured(currentHeap);
+	if (heapProfiler != null)
+		currentHeap = heapProfiler;
 }
 /** @ignore 
  * Called when the main thread hits an uncaught exception.
  */
 public void resetHeap() {
-	currentHeap = &heap;
+	// The blocks of these heaps cannot be freed by any other heap.
+	if (currentHeap != &cachingHeap && currentHeap != heapProfiler && currentHeap != heapCounter)
+		currentHeap = &heap;
+}
+/**
+ * @return The allocation profiler wrapping the process heap, or null if allocation profiling is not enabled.
+ */
+public ref<AllocationProfiler> allocationProfiler() {
+	return heapProfiler;
+}
+/**
+ * @return The process heap if it is a ThreadCachingHeap, otherwise null.
+ */
+public ref<ThreadCachingHeap> threadCachingHeap() {
+	ref<Allocator> h = currentHeap;
+	if (h == heapCounter)
+		h = heapCounter.allocator();
+	if (h == &cachingHeap)
+		return &cachingHeap;
+	else
+		return null;
+}
+
+private ref<AllocationCounter> heapCounter;
+private int heapCounterUsers;
+private Monitor heapCounterLock;
+/**
+ * Count the memory allocated from the process heap by every thread from now on.
+ *
+ * Allocators that get their memory from the process heap, such as a {@link NoReleasePool}, are counted
+ * by the blocks they take from it, not by the requests made of them.
+ *
+ * Each call must be matched by a call to {@link stopCountingAllocations}. The process heap is counted
+ * until the last of them.
+ *
+ * @return The counter. Every call returns the same one. Its counts only grow, so a caller measures what was
+ * allocated between two points by taking the difference of the counts read at each.
+ */
+public ref<AllocationCounter> countAllocations() {
+	lock (heapCounterLock) {
+		if (heapCounter == null)
+			heapCounter = new AllocationCounter(currentHeap);
+		if (heapCounterUsers == 0 && heapCounter.allocator() == currentHeap)
+			currentHeap = heapCounter;
+		heapCounterUsers++;
+	}
+	return heapCounter;
+}
+/**
+ * Stop counting the memory allocated from the process heap, once every caller of {@link countAllocations}
+ * has called this.
+ *
+ * The counter is then taken out of the path of each allocation. It is not deleted, since another thread may
+ * still be in one of its methods, and the next call to countAllocations uses it again.
+ */
+public void stopCountingAllocations() {
+	lock (heapCounterLock) {
+		if (heapCounterUsers == 0)
+			return;
+		heapCounterUsers--;
+		if (heapCounterUsers == 0 && currentHeap == heapCounter)
+			currentHeap = heapCounter.allocator();
+	}
+}
+/** @ignore
+ * Called by each new thread before it allocates any memory.
+ */
+public void threadStarted() {
+	runtime.setRuntimeParameter(runtime.HEAP_CACHE, null);
+	runtime.setRuntimeParameter(runtime.THREAD_ALLOCATOR, null);
+}
+/** @ignore
+ * Called by each thread as the last thing it does. Returns the contents of the thread's caches to
+ * their heaps.
+ */
+public void threadFinished() {
+	ref<ThreadCachingHeap.ThreadCache> tc = ref<ThreadCachingHeap.ThreadCache>(runtime.getRuntimeParameter(runtime.HEAP_CACHE));
+	runtime.setRuntimeParameter(runtime.HEAP_CACHE, null);
+	while (tc != null) {
+		ref<ThreadCachingHeap.ThreadCache> next = tc.nextHeap;
+		tc.heap.dropCache(tc);
+		tc = next;
+	}
 }
 /*
  * Set up the process streams as soon as any special heap is established.
  */
 storage.setProcessStreams(false);
 
-if (currentHeap != &heap)
+if (runtime.startingHeap() == StartingHeap.DETECT_LEAKS || runtime.startingHeap() == StartingHeap.GUARD)
 	printf("Using %s\n", string(runtime.startingHeap()));
 /**
  * Thrown when a memory allocator cannot satisfy a request.
@@ -176,6 +343,21 @@ public class Allocator {
 	 * @exception CorruptHeapException is thrown if the allocator detects data corruption.
 	 */
 	public abstract void free(address p);
+	/**
+	 * Allocate a block of memory that the caller will completely initialize.
+	 *
+	 * By default, this is the same as {@link alloc}. An Allocator that has to clear each block
+	 * can override this method to skip that step.
+	 *
+	 * @param n The number of bytes to allocate.
+	 *
+	 * @return The allocated memory, whose contents are undefined.
+	 *
+	 * @exception OutOfMemoryException is thrown if the memory allocation request fails.
+	 */
+	public address allocUninitialized(long n) {
+		return alloc(n);
+	}
 }
 
 public class GuardedHeap extends Allocator {
@@ -310,6 +492,463 @@ public class Heap extends Allocator {
 		C.free(p);
 	}
 }
+/**
+ * A production heap that keeps a cache of free blocks for each thread.
+ *
+ * Requests of up to 8KB are rounded up to one of 36 size classes. The blocks of a class are carved
+ * from 64KB spans of a single range of address space, reserved when the heap is initialized. A thread
+ * allocates from and frees to its own cache without taking any lock, and only moves blocks between
+ * its cache and the shared lists of a class in batches. Larger requests, and frees of memory that was
+ * allocated before the heap was installed, are passed through to the C library.
+ *
+ * When every block of a span has been freed back to its class, the span is set aside for use by any
+ * size class. Once more than {@link retainedBytes} of such spans are being held, the pages of each
+ * further one are returned to the operating system. The default is 4MB. It can be set with the
+ * PARASOL_HEAP_RETAIN environment variable (a number of kilobytes) or by calling {@link setRetainedBytes}.
+ *
+ * A ThreadCachingHeap must outlive every thread that allocates from it.
+ */
+public class ThreadCachingHeap extends Allocator {
+	@Constant
+	private static int SPAN_SIZE = 0x10000;
+	@Constant
+	private static int SPAN_HEADER = 64;		// Keeps the blocks of a span 16-byte aligned.
+	@Constant
+	private static long REGION_SIZE = 0x800000000;	// 32GB of address space
+	@Constant
+	private static int COMMIT_SPANS = 16;		// The number of spans made accessible at a time.
+	@Constant
+	private static int MAX_SMALL = 8192;
+	@Constant
+	private static int CLASS_COUNT = 36;
+	@Constant
+	private static int PAGE_SIZE = 4096;
+	@Constant
+	private static long DEFAULT_RETAINED_BYTES = 4 * 1024 * 1024;
+
+	class Span {
+		ref<Span> next;
+		ref<Span> previous;
+		pointer<address> freeList;	// Blocks freed back to this span.
+		int sizeClass;
+		int inUse;					// Blocks held by threads, whether allocated or cached.
+		int carved;					// Blocks ever handed out. Those after these have never been touched.
+		int capacity;
+		boolean partial;			// In the partial list of its class.
+	}
+
+	class SizeClass {
+		Monitor guard;
+		ref<Span> partial;			// Spans with blocks that can be handed out.
+		int blockSize;
+		int spans;
+		long inUse;
+		long refills;
+		long returns;
+	}
+
+	class ThreadCache {
+		ref<ThreadCachingHeap> heap;
+		ref<ThreadCache> nextHeap;	// The cache of the same thread for another ThreadCachingHeap.
+		ref<ThreadCache> next;		// The cache of another thread for this heap.
+		pointer<pointer<address>> lists;
+		pointer<int> counts;
+	}
+
+	private pointer<byte> _base;
+	private pointer<byte> _limit;
+	private pointer<byte> _committed;
+	private pointer<byte> _nextSpan;
+	private pointer<byte> _classOf;		// Indexed by (size + 15) / 16
+	private pointer<int> _batches;
+	private ref<SizeClass>[] _classes;
+	private Monitor _spanLock;			// Guards the fields below. Taken after a SizeClass lock, if any.
+	private ref<Span> _emptySpans;
+	private int _emptySpanCount;
+	private long _retainedBytes;
+	private long _releasedSpans;
+	private ref<ThreadCache> _caches;
+
+	public ThreadCachingHeap() {
+	}
+	/**
+	 * Reserve the address space of the heap and build its size classes.
+	 *
+	 * @return true if the heap can be used, false if the address space could not be reserved
+	 * (or this is not a Linux process).
+	 */
+	public boolean initialize() {
+		if (_base != null)
+			return true;
+		if (runtime.compileTarget != runtime.Target.X86_64_LNX)
+			return false;
+		address region = linux.mmap(null, REGION_SIZE + SPAN_SIZE, linux.PROT_NONE,
+									linux.MAP_PRIVATE|linux.MAP_ANONYMOUS|linux.MAP_NORESERVE, -1, 0);
+		if (long(region) == -1)
+			return false;
+		_base = pointer<byte>((long(region) + SPAN_SIZE - 1) & ~long(SPAN_SIZE - 1));
+		_limit = _base + REGION_SIZE;
+		_committed = _base;
+		_nextSpan = _base;
+		_batches = pointer<int>(C.calloc(CLASS_COUNT, int.bytes));
+		int c = 0;
+		for (int size = 16; size <= 256; size += 16)
+			addClass(c++, size);
+		for (int base = 256; base < MAX_SMALL; base <<= 1)
+			for (int i = 1; i <= 4; i++)
+				addClass(c++, base + i * (base >> 2));
+		_classOf = pointer<byte>(C.calloc(MAX_SMALL / 16 + 1, 1));
+		c = 0;
+		for (int i = 0; i <= MAX_SMALL / 16; i++) {
+			while (_classes[c].blockSize < i * 16)
+				c++;
+			_classOf[i] = byte(c);
+		}
+		_retainedBytes = DEFAULT_RETAINED_BYTES;
+		pointer<byte> retain = C.getenv("PARASOL_HEAP_RETAIN".c_str());
+		if (retain != null) {
+			long kilobytes;
+			boolean success;
+			(kilobytes, success) = long.parse(string(retain));
+			if (success && kilobytes >= 0)
+				_retainedBytes = kilobytes * 1024;
+		}
+		return true;
+	}
+
+	private void addClass(int c, int blockSize) {
+		ref<SizeClass> sc = new SizeClass;
+		sc.blockSize = blockSize;
+		_classes.append(sc);
+		int batch = 4096 / blockSize;
+		if (batch < 2)
+			batch = 2;
+		else if (batch > 32)
+			batch = 32;
+		_batches[c] = batch;
+	}
+
+	public void clear() {
+	}
+
+	public address alloc(long n) {
+		if (n > MAX_SMALL || _base == null)
+			return largeBlock(n);
+		address p = take(n);
+		C.memset(p, 0, n);
+		return p;
+	}
+	/**
+	 * Allocate a block without clearing it. The first word holds a stale free list link and the
+	 * rest may hold whatever a previous owner of the block left there.
+	 */
+	public address allocUninitialized(long n) {
+		if (n > MAX_SMALL || _base == null)
+			return largeBlock(n);
+		return take(n);
+	}
+
+	private address largeBlock(long n) {
+		address p = C.calloc(n, 1);
+		if (p != null)
+			return p;
+		throw OutOfMemoryException(n);
+		return null;
+	}
+
+	private address take(long n) {
+		int c = _classOf[(int(n) + 15) >> 4];
+		ref<ThreadCache> cache = threadCache();
+		pointer<address> b = cache.lists[c];
+		if (b == null) {
+			if (!refill(cache, c))
+				throw OutOfMemoryException(n);
+			b = cache.lists[c];
+		}
+		cache.lists[c] = pointer<address>(*b);
+		cache.counts[c]--;
+		return b;
+	}
+
+	public void free(address p) {
+		if (pointer<byte>(p) < _base || pointer<byte>(p) >= _limit) {
+			C.free(p);
+			return;
+		}
+		ref<Span> s = ref<Span>(long(p) & ~long(SPAN_SIZE - 1));
+		int c = s.sizeClass;
+		ref<ThreadCache> cache = threadCache();
+		pointer<address> b = pointer<address>(p);
+		*b = cache.lists[c];
+		cache.lists[c] = b;
+		if (++cache.counts[c] > 2 * _batches[c])
+			flush(cache, c, _batches[c]);
+	}
+	/**
+	 * @return The number of bytes of entirely free spans that are kept before pages are returned to the
+	 * operating system.
+	 */
+	public long retainedBytes() {
+		return _retainedBytes;
+	}
+	/**
+	 * Sets the number of bytes of entirely free spans that are kept before pages are returned to the
+	 * operating system. Spans that are already being held are not affected.
+	 */
+	public void setRetainedBytes(long amount) {
+		lock (_spanLock) {
+			_retainedBytes = amount;
+		}
+	}
+	/**
+	 * @return The number of spans whose pages have been returned to the operating system since the heap
+	 * was initialized.
+	 */
+	public long releasedSpans() {
+		return _releasedSpans;
+	}
+	/**
+	 * @return The current statistics of each size class, in order of block size. The count of cached blocks
+	 * is approximate while other threads are allocating.
+	 */
+	public SizeClassStatistics[] statistics() {
+		SizeClassStatistics[] results;
+		for (i in _classes) {
+			ref<SizeClass> sc = _classes[i];
+			SizeClassStatistics s;
+			lock (sc.guard) {
+				s.blockSize = sc.blockSize;
+				s.spans = sc.spans;
+				s.blocksInUse = sc.inUse;
+				s.refills = sc.refills;
+				s.returns = sc.returns;
+			}
+			results.append(s);
+		}
+		lock (_spanLock) {
+			for (ref<ThreadCache> tc = _caches; tc != null; tc = tc.next)
+				for (i in results)
+					results[i].blocksCached += tc.counts[i];
+		}
+		return results;
+	}
+
+	private ref<ThreadCache> threadCache() {
+		ref<ThreadCache> first = ref<ThreadCache>(runtime.getRuntimeParameter(runtime.HEAP_CACHE));
+		for (ref<ThreadCache> tc = first; tc != null; tc = tc.nextHeap)
+			if (tc.heap == this)
+				return tc;
+		ref<ThreadCache> tc = ref<ThreadCache>(C.calloc(1, ThreadCache.bytes + CLASS_COUNT * (address.bytes + int.bytes)));
+		tc.heap = this;
+		tc.lists = pointer<pointer<address>>(pointer<ThreadCache>(tc) + 1);
+		tc.counts = pointer<int>(tc.lists + CLASS_COUNT);
+		if (first == null)
+			runtime.setRuntimeParameter(runtime.HEAP_CACHE, tc);
+		else {
+			while (first.nextHeap != null)
+				first = first.nextHeap;
+			first.nextHeap = tc;
+		}
+		lock (_spanLock) {
+			tc.next = _caches;
+			_caches = tc;
+		}
+		return tc;
+	}
+	/*
+	 * Return all the blocks in a thread's cache to their classes and free the cache.
+	 */
+	void dropCache(ref<ThreadCache> tc) {
+		for (int c = 0; c < CLASS_COUNT; c++)
+			if (tc.counts[c] > 0)
+				giveBack(c, tc.lists[c], tc.counts[c]);
+		lock (_spanLock) {
+			if (_caches == tc)
+				_caches = tc.next;
+			else {
+				for (ref<ThreadCache> prev = _caches; prev != null; prev = prev.next)
+					if (prev.next == tc) {
+						prev.next = tc.next;
+						break;
+					}
+			}
+		}
+		C.free(tc);
+	}
+	/*
+	 * Fill the empty list of a thread cache with a batch of blocks of class c.
+	 */
+	private boolean refill(ref<ThreadCache> cache, int c) {
+		ref<SizeClass> sc = _classes[c];
+		pointer<address> list;
+		int n;
+		int batch = _batches[c];
+		lock (sc.guard) {
+			while (n < batch) {
+				ref<Span> s = sc.partial;
+				if (s == null) {
+					s = newSpan(c, sc.blockSize);
+					if (s == null)
+						break;
+					sc.spans++;
+					link(sc, s);
+				}
+				while (n < batch) {
+					pointer<address> b;
+					if (s.freeList != null) {
+						b = s.freeList;
+						s.freeList = pointer<address>(*b);
+					} else if (s.carved < s.capacity) {
+						b = pointer<address>(pointer<byte>(s) + SPAN_HEADER + s.carved * sc.blockSize);
+						s.carved++;
+					} else
+						break;
+					*b = list;
+					list = b;
+					s.inUse++;
+					n++;
+				}
+				if (s.freeList == null && s.carved >= s.capacity)
+					unlink(sc, s);
+			}
+			sc.inUse += n;
+			sc.refills++;
+		}
+		cache.lists[c] = list;
+		cache.counts[c] = n;
+		return n > 0;
+	}
+	/*
+	 * Move count blocks from the front of a thread cache list back to class c.
+	 */
+	private void flush(ref<ThreadCache> cache, int c, int count) {
+		pointer<address> first = cache.lists[c];
+		pointer<address> last = first;
+		for (int i = 1; i < count; i++)
+			last = pointer<address>(*last);
+		cache.lists[c] = pointer<address>(*last);
+		cache.counts[c] -= count;
+		*last = null;
+		giveBack(c, first, count);
+	}
+
+	private void giveBack(int c, pointer<address> list, int count) {
+		ref<SizeClass> sc = _classes[c];
+		lock (sc.guard) {
+			while (list != null) {
+				pointer<address> b = list;
+				list = pointer<address>(*b);
+				ref<Span> s = ref<Span>(long(b) & ~long(SPAN_SIZE - 1));
+				*b = s.freeList;
+				s.freeList = b;
+				if (!s.partial)
+					link(sc, s);
+				if (--s.inUse == 0) {
+					unlink(sc, s);
+					sc.spans--;
+					retire(s);
+				}
+			}
+			sc.inUse -= count;
+			sc.returns++;
+		}
+	}
+
+	private static void link(ref<SizeClass> sc, ref<Span> s) {
+		s.previous = null;
+		s.next = sc.partial;
+		if (s.next != null)
+			s.next.previous = s;
+		sc.partial = s;
+		s.partial = true;
+	}
+
+	private static void unlink(ref<SizeClass> sc, ref<Span> s) {
+		if (s.previous != null)
+			s.previous.next = s.next;
+		else
+			sc.partial = s.next;
+		if (s.next != null)
+			s.next.previous = s.previous;
+		s.partial = false;
+	}
+	/*
+	 * Called with the lock of the class held.
+	 */
+	private ref<Span> newSpan(int c, int blockSize) {
+		ref<Span> s;
+		lock (_spanLock) {
+			if (_emptySpans != null) {
+				s = _emptySpans;
+				_emptySpans = s.next;
+				_emptySpanCount--;
+			} else {
+				if (_nextSpan >= _committed) {
+					if (_committed >= _limit)
+						return null;
+					if (linux.mprotect(_committed, COMMIT_SPANS * SPAN_SIZE, linux.PROT_READ|linux.PROT_WRITE) != 0)
+						return null;
+					_committed += COMMIT_SPANS * SPAN_SIZE;
+				}
+				s = ref<Span>(_nextSpan);
+				_nextSpan += SPAN_SIZE;
+			}
+		}
+		s.next = null;
+		s.previous = null;
+		s.freeList = null;
+		s.sizeClass = c;
+		s.inUse = 0;
+		s.carved = 0;
+		s.capacity = (SPAN_SIZE - SPAN_HEADER) / blockSize;
+		s.partial = false;
+		return s;
+	}
+	/*
+	 * Called with the lock of the span's class held, after every block in the span has been freed.
+	 */
+	private void retire(ref<Span> s) {
+		lock (_spanLock) {
+			if (long(_emptySpanCount) * SPAN_SIZE >= _retainedBytes) {
+				// The header stays in the first page, so the span can still be linked.
+				linux.madvise(pointer<byte>(s) + PAGE_SIZE, SPAN_SIZE - PAGE_SIZE, linux.MADV_DONTNEED);
+				_releasedSpans++;
+			}
+			s.next = _emptySpans;
+			_emptySpans = s;
+			_emptySpanCount++;
+		}
+	}
+}
+/**
+ * The statistics of one size class of a {@link ThreadCachingHeap}.
+ */
+public class SizeClassStatistics {
+	/**
+	 * The size in bytes of each block of the class.
+	 */
+	public int blockSize;
+	/**
+	 * The number of spans currently carved into blocks of the class.
+	 */
+	public int spans;
+	/**
+	 * The number of blocks held by threads, whether allocated or waiting in a thread's cache.
+	 */
+	public long blocksInUse;
+	/**
+	 * The number of blocks waiting in thread caches.
+	 */
+	public long blocksCached;
+	/**
+	 * The number of batches of blocks handed to thread caches.
+	 */
+	public long refills;
+	/**
+	 * The number of batches of blocks returned by thread caches.
+	 */
+	public long returns;
+}
 /**
  * This form of heap provides checking for memory leaks.
  *
@@ -577,7 +1216,8 @@ public class LeakHeap extends Allocator {
 		process.stdin = null;
 		delete process.stdout;
 		process.stdout = null;
-		currentHeap = &heap;		// heap is declared first, so it should still be alive when this destructor is called.
+		if (currentHeap == &leakHeap)
+			currentHeap = &heap;		// heap is declared first, so it should still be alive when this destructor is called.
 		if (_everUsed) {
 			storage.setProcessStreams(true);
 			printf("%,17d allocations\n%,17d frees\n", _allocations, _frees);
@@ -1025,6 +1665,574 @@ public class NoReleasePool extends Allocator {
 	public void free(address p) {
 	}
 }
+/**
+ * An allocator that hands out memory from large blocks and releases it all at once.
+ *
+ * A Region suits work with a clear end, such as the handling of one request by a server, where
+ * most of the objects created are garbage by the time the work is done. Allocation is a pointer
+ * bump. Freeing a block in the Region does nothing; a call to {@link reset} releases everything
+ * allocated since the previous reset, but keeps a few blocks for the next use of the Region.
+ *
+ * A Region can be made the allocator of the new and delete operators on one thread with
+ * {@link setThreadAllocator}. Frees of memory that did not come from the Region are passed on to the
+ * process heap, so objects created before the Region was installed can still be deleted. Nothing
+ * allocated from the Region may be used after the next reset, or be deleted by another thread.
+ */
+public class Region extends Allocator {
+	@Constant
+	private static int BLOCK_SIZE = 64 * 1024;
+	@Constant
+	private static int RETAINED_BLOCKS = 4;
+
+	class Block {
+		ref<Block> next;
+		long size;					// Including this header, which keeps the data 16-byte aligned.
+	}
+
+	private ref<Block> _blocks;		// The block being allocated from is first
+	private ref<Block> _spares;		// Blocks of BLOCK_SIZE kept by reset
+	private ref<Block> _abandoned;	// Blocks given up by abandon, which are never released
+	private int _spareCount;
+	private pointer<byte> _free;
+	private pointer<byte> _end;
+	private long _allocated;
+	private pointer<ref<Block>> _sorted;	// The blocks in _blocks and _abandoned, in address order
+	private int _sortedCount;
+	private int _sortedCapacity;
+
+	public Region() {
+	}
+
+	~Region() {
+		clear();
+		if (_sorted != null)
+			currentHeap.free(_sorted);
+	}
+	/**
+	 * Releases all memory held by the Region, including the blocks kept for reuse. Memory given up by
+	 * {@link abandon} is not released.
+	 */
+	public void clear() {
+		reset();
+		while (_spares != null) {
+			ref<Block> b = _spares;
+			_spares = b.next;
+			currentHeap.free(b);
+		}
+		_spareCount = 0;
+	}
+	/**
+	 * Releases everything allocated from the Region. Up to four blocks are kept for reuse.
+	 */
+	public void reset() {
+		while (_blocks != null) {
+			ref<Block> b = _blocks;
+			_blocks = b.next;
+			removeSorted(b);
+			if (b.size == BLOCK_SIZE && _spareCount < RETAINED_BLOCKS) {
+				b.next = _spares;
+				_spares = b;
+				_spareCount++;
+			} else
+				currentHeap.free(b);
+		}
+		_free = null;
+		_end = null;
+		_allocated = 0;
+	}
+	/**
+	 * Gives up the memory allocated from the Region since the last reset without releasing it, for
+	 * when objects in it are still in use. That memory is never reclaimed. Later frees of it through
+	 * the Region are ignored.
+	 */
+	public void abandon() {
+		while (_blocks != null) {
+			ref<Block> b = _blocks;
+			_blocks = b.next;
+			b.next = _abandoned;
+			_abandoned = b;
+		}
+		_free = null;
+		_end = null;
+		_allocated = 0;
+	}
+	/**
+	 * @return The number of bytes allocated from the Region since the last reset.
+	 */
+	public long allocated() {
+		return _allocated;
+	}
+
+	public address alloc(long n) {
+		address p = allocUninitialized(n);
+		C.memset(p, 0, n);
+		return p;
+	}
+
+	public address allocUninitialized(long n) {
+		n = (n + 15) & ~15;
+		_allocated += n;
+		if (n > _end - _free) {
+			if (n > BLOCK_SIZE / 4) {
+				// Give a large request a block of its own, leaving the current block in use.
+				ref<Block> b = ref<Block>(currentHeap.allocUninitialized(Block.bytes + n));
+				b.size = Block.bytes + n;
+				if (_blocks != null) {
+					b.next = _blocks.next;
+					_blocks.next = b;
+				} else {
+					b.next = null;
+					_blocks = b;
+					_free = _end = pointer<byte>(b) + b.size;
+				}
+				insertSorted(b);
+				return pointer<Block>(b) + 1;
+			}
+			ref<Block> b = _spares;
+			if (b != null) {
+				_spares = b.next;
+				_spareCount--;
+			} else {
+				b = ref<Block>(currentHeap.allocUninitialized(BLOCK_SIZE));
+				b.size = BLOCK_SIZE;
+			}
+			b.next = _blocks;
+			_blocks = b;
+			insertSorted(b);
+			_free = pointer<byte>(pointer<Block>(b) + 1);
+			_end = pointer<byte>(b) + BLOCK_SIZE;
+		}
+		pointer<byte> p = _free;
+		_free += n;
+		return p;
+	}
+	/**
+	 * Memory allocated from the Region, including memory given up by {@link abandon}, is only released
+	 * by {@link reset}. Other memory is freed by the process heap.
+	 */
+	public void free(address p) {
+		if (p == null)
+			return;
+		int i = lastBlockAtOrBelow(p);
+		if (i >= 0 && pointer<byte>(p) < pointer<byte>(_sorted[i]) + _sorted[i].size)
+			return;
+		currentHeap.free(p);
+	}
+	/*
+	 * The sorted table is allocated from the process heap, since the Region may be the allocator of
+	 * the thread that changes it.
+	 *
+	 * Returns the index of the last block starting at or below p, or -1 if there is none.
+	 */
+	private int lastBlockAtOrBelow(address p) {
+		int low = 0;
+		int high = _sortedCount;
+		while (low < high) {
+			int middle = (low + high) / 2;
+			if (pointer<byte>(_sorted[middle]) <= pointer<byte>(p))
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		return low - 1;
+	}
+
+	private void insertSorted(ref<Block> b) {
+		if (_sortedCount == _sortedCapacity) {
+			int capacity = _sortedCapacity == 0 ? 16 : _sortedCapacity * 2;
+			pointer<ref<Block>> sorted = pointer<ref<Block>>(currentHeap.allocUninitialized(capacity * address.bytes));
+			if (_sorted != null) {
+				C.memcpy(sorted, _sorted, _sortedCount * address.bytes);
+				currentHeap.free(_sorted);
+			}
+			_sorted = sorted;
+			_sortedCapacity = capacity;
+		}
+		int i = lastBlockAtOrBelow(b) + 1;
+		if (i < _sortedCount)
+			C.memmove(_sorted + i + 1, _sorted + i, (_sortedCount - i) * address.bytes);
+		_sorted[i] = b;
+		_sortedCount++;
+	}
+
+	private void removeSorted(ref<Block> b) {
+		int i = lastBlockAtOrBelow(b);
+		if (i < 0 || _sorted[i] != b)
+			return;
+		_sortedCount--;
+		if (i < _sortedCount)
+			C.memmove(_sorted + i, _sorted + i + 1, (_sortedCount - i) * address.bytes);
+	}
+}
+
+/**
+ * An Allocator that counts the blocks and bytes allocated through it and passes every request on to
+ * another Allocator.
+ *
+ * @threading The counts are updated with atomic adds, so they are exact when several threads allocate
+ * at once.
+ */
+public class AllocationCounter extends Allocator {
+	private ref<Allocator> _allocator;
+	private long _allocatedBytes;
+	private long _allocations;
+	/**
+	 * @param allocator The Allocator that satisfies every request.
+	 */
+	public AllocationCounter(ref<Allocator> allocator) {
+		_allocator = allocator;
+	}
+
+	public void clear() {
+		_allocator.clear();
+	}
+
+	public address alloc(long n) {
+		thread.fetchAdd(&_allocatedBytes, n);
+		thread.fetchAdd(&_allocations, 1);
+		return _allocator.alloc(n);
+	}
+
+	public address allocUninitialized(long n) {
+		thread.fetchAdd(&_allocatedBytes, n);
+		thread.fetchAdd(&_allocations, 1);
+		return _allocator.allocUninitialized(n);
+	}
+
+	public void free(address p) {
+		_allocator.free(p);
+	}
+	/**
+	 * @return The Allocator that satisfies every request.
+	 */
+	public ref<Allocator> allocator() {
+		return _allocator;
+	}
+	/**
+	 * @return The number of bytes requested so far.
+	 */
+	public long allocatedBytes() {
+		return thread.atomicLoad(&_allocatedBytes);
+	}
+	/**
+	 * @return The number of blocks allocated so far.
+	 */
+	public long allocations() {
+		return thread.atomicLoad(&_allocations);
+	}
+}
+
+/**
+ * A sampling allocation profiler.
+ *
+ * When allocation profiling is enabled (by the pc --alloc-profile option, or by setting the
+ * PARASOL_ALLOC_PROFILE environment variable when running a pxi file), the process heap is wrapped in
+ * an AllocationProfiler as the image starts. It passes every request through to the wrapped Allocator,
+ * and records the stack of one allocation per {@link interval} bytes allocated (PARASOL_ALLOC_PROFILE_INTERVAL,
+ * default 512KB). Each sample stands for the bytes allocated since the previous one, so the totals are
+ * estimates. Only frees of sampled blocks take a lock.
+ *
+ * The profile is written to the given path when the main thread finishes, when the process exits through
+ * {@link parasol:process.exit}, and, while samples are being taken, every PARASOL_ALLOC_PROFILE_PERIOD seconds
+ * (default 60, 0 to only write at exit). Each call site is listed with its estimated live and allocated
+ * bytes, largest live bytes first, followed by its stack.
+ *
+ * A leak-detecting heap already records every allocation, so it is never wrapped.
+ */
+public class AllocationProfiler extends Allocator {
+	@Constant
+	private static long DEFAULT_INTERVAL = 512 * 1024;
+	@Constant
+	private static long DEFAULT_PERIOD = 60;
+	@Constant
+	private static int FILTER_SIZE = 65536;		// A power of two
+	@Constant
+	private static int MAX_DEPTH = 32;
+	@Constant
+	private static int SKIP_FRAMES = 2;			// The frames of alloc and memory.alloc
+
+	class AllocationSite {
+		ref<AllocationSite> next;		// Another site whose stack has the same hash
+		long[] frames;					// Return addresses, innermost first
+		long liveBytes;
+		long liveBlocks;
+		long allocatedBytes;
+		long allocations;
+
+		static int compare(ref<AllocationSite> a, ref<AllocationSite> b) {
+			if (a.liveBytes != b.liveBytes)
+				return a.liveBytes < b.liveBytes ? -1 : 1;
+			if (a.allocatedBytes != b.allocatedBytes)
+				return a.allocatedBytes < b.allocatedBytes ? -1 : 1;
+			return 0;
+		}
+	}
+
+	class LiveSample {
+		ref<AllocationSite> site;
+		long weight;
+		long blocks;
+	}
+
+	private ref<Allocator> _allocator;
+	private string _path;
+	private long _interval;
+	private long _countdown;				// Updated without a lock. A lost update only moves the next sample.
+	private long _period;					// In nanoseconds
+	private long _nextWrite;
+	private pointer<int> _filter;			// The number of live samples in each hash slot
+	private Monitor _lock;					// Guards the fields below
+	private boolean _busy;					// The profiler itself is allocating, so don't sample
+	private pointer<address> _frames;
+	private long _samples;
+	private map<ref<AllocationSite>, long> _sites;
+	private map<ref<LiveSample>, long> _live;
+
+	/**
+	 * Wrap an Allocator.
+	 *
+	 * @param allocator The Allocator that satisfies every request.
+	 * @param path The path the profile is written to.
+	 * @param interval The average number of bytes allocated for each sample.
+	 * @param periodSeconds The number of seconds between writes of the profile while samples are being
+	 * taken, or zero to only write the profile when {@link write} is called.
+	 */
+	public AllocationProfiler(ref<Allocator> allocator, string path, long interval, long periodSeconds) {
+		_allocator = allocator;
+		_path = path;
+		_interval = interval > 0 ? interval : DEFAULT_INTERVAL;
+		_countdown = _interval;
+		_period = periodSeconds * 1000000000;
+		_nextWrite = now() + _period;
+		_filter = pointer<int>(C.calloc(FILTER_SIZE, int.bytes));
+		_frames = pointer<address>(C.calloc(MAX_DEPTH, address.bytes));
+	}
+	/*
+	 * Creates the profiler configured by the runtime parameter or environment variables, if any.
+	 */
+	static ref<AllocationProfiler> configured(ref<Allocator> allocator) {
+		if (runtime.compileTarget != runtime.Target.X86_64_LNX)
+			return null;
+		pointer<byte> path = runtime.allocationProfilePath();
+		if (path == null)
+			path = C.getenv("PARASOL_ALLOC_PROFILE".c_str());
+		if (path == null || path[0] == 0)
+			return null;
+		return new AllocationProfiler(allocator, string(path), environmentValue("PARASOL_ALLOC_PROFILE_INTERVAL", DEFAULT_INTERVAL),
+									  environmentValue("PARASOL_ALLOC_PROFILE_PERIOD", DEFAULT_PERIOD));
+	}
+
+	private static long environmentValue(string name, long defaultValue) {
+		pointer<byte> value = C.getenv(name.c_str());
+		if (value == null)
+			return defaultValue;
+		long result;
+		boolean success;
+		(result, success) = long.parse(string(value));
+		if (success && result >= 0)
+			return result;
+		else
+			return defaultValue;
+	}
+	/**
+	 * @return The average number of bytes allocated for each sample.
+	 */
+	public long interval() {
+		return _interval;
+	}
+	/**
+	 * @return The path the profile is written to.
+	 */
+	public string path() {
+		return _path;
+	}
+
+	public void clear() {
+		_allocator.clear();
+	}
+
+	public address alloc(long n) {
+		address p = _allocator.alloc(n);
+		_countdown -= n;
+		if (_countdown <= 0)
+			sample(p, n);
+		return p;
+	}
+
+	public address allocUninitialized(long n) {
+		address p = _allocator.allocUninitialized(n);
+		_countdown -= n;
+		if (_countdown <= 0)
+			sample(p, n);
+		return p;
+	}
+
+	public void free(address p) {
+		if (p != null && _filter[filterSlot(p)] != 0)
+			forget(p);
+		_allocator.free(p);
+	}
+
+	private static int filterSlot(address p) {
+		long x = long(p) >> 4;
+		return int((x ^ (x >> 16)) & (FILTER_SIZE - 1));
+	}
+
+	private void sample(address p, long n) {
+		lock (_lock) {
+			if (_busy)
+				return;
+			_busy = true;
+			_countdown = _interval;
+			int depth = 0;
+			int skip = SKIP_FRAMES;
+			address frame = runtime.framePointer();
+			address top = runtime.stackTop();
+			if (long(frame) <= long(top)) {
+				while (frame != null && depth < MAX_DEPTH) {
+					pointer<address> lastFrame = pointer<address>(frame);
+					frame = lastFrame[0];
+					if (long(frame) > long(top))
+						break;
+					if (skip > 0)
+						skip--;
+					else
+						_frames[depth++] = lastFrame[1];
+				}
+			}
+			ref<AllocationSite> site = findSite(depth);
+			ref<LiveSample> ls = new LiveSample;
+			ls.site = site;
+			ls.weight = n > _interval ? n : _interval;
+			ls.blocks = n > 0 ? ls.weight / n : 1;
+			site.liveBytes += ls.weight;
+			site.liveBlocks += ls.blocks;
+			site.allocatedBytes += ls.weight;
+			site.allocations += ls.blocks;
+			_live[long(p)] = ls;
+			_filter[filterSlot(p)]++;
+			_samples++;
+			if (_period > 0) {
+				long t = now();
+				if (t >= _nextWrite) {
+					_nextWrite = t + _period;
+					writeProfile();
+				}
+			}
+			_busy = false;
+		}
+	}
+
+	private ref<AllocationSite> findSite(int depth) {
+		long hash = depth;
+		for (int i = 0; i < depth; i++)
+			hash = hash * 31 + long(_frames[i]);
+		ref<AllocationSite> first = _sites.get(hash);
+		for (ref<AllocationSite> s = first; s != null; s = s.next) {
+			if (s.frames.length() != depth)
+				continue;
+			boolean same = true;
+			for (int i = 0; i < depth; i++)
+				if (s.frames[i] != long(_frames[i])) {
+					same = false;
+					break;
+				}
+			if (same)
+				return s;
+		}
+		ref<AllocationSite> s = new AllocationSite;
+		for (int i = 0; i < depth; i++)
+			s.frames.append(long(_frames[i]));
+		s.next = first;
+		_sites[hash] = s;
+		return s;
+	}
+
+	private void forget(address p) {
+		lock (_lock) {
+			if (_busy)				// Only the profiler's own blocks are freed while it is busy.
+				return;
+			ref<LiveSample> ls = _live.get(long(p));
+			if (ls == null)
+				return;
+			_busy = true;
+			_live.remove(long(p));
+			_filter[filterSlot(p)]--;
+			ls.site.liveBytes -= ls.weight;
+			ls.site.liveBlocks -= ls.blocks;
+			delete ls;
+			_busy = false;
+		}
+	}
+	/**
+	 * Write the profile to its path, replacing any profile written earlier.
+	 */
+	public void write() {
+		lock (_lock) {
+			boolean wasBusy = _busy;
+			_busy = true;
+			writeProfile();
+			_busy = wasBusy;
+		}
+	}
+	/*
+	 * Called with the lock held and _busy set.
+	 */
+	private void writeProfile() {
+		string temp = _path + ".tmp";
+		ref<Writer> w = storage.createTextFile(temp);
+		if (w == null)
+			return;
+		ref<AllocationSite>[] sites;
+		long liveBytes;
+		long liveBlocks;
+		long allocatedBytes;
+		long allocations;
+		for (key in _sites) {
+			for (ref<AllocationSite> s = _sites[key]; s != null; s = s.next) {
+				sites.append(s);
+				liveBytes += s.liveBytes;
+				liveBlocks += s.liveBlocks;
+				allocatedBytes += s.allocatedBytes;
+				allocations += s.allocations;
+			}
+		}
+		sites.sort(AllocationSite.compare, false);
+		// The profile may be written by a static destructor, after the locale needed to format numbers
+		// is gone, so only plain integers are formatted.
+		w.printf("%d samples, one per %d bytes allocated\n", _samples, _interval);
+		w.printf("%d live bytes in %d blocks, %d bytes allocated in %d blocks (estimated)\n\n", liveBytes, liveBlocks,
+					allocatedBytes, allocations);
+		w.printf("%14s %12s %14s %12s  %s\n", "live bytes", "live blocks", "allocated", "allocations", "call site");
+		map<string, long> locations;
+		for (i in sites) {
+			ref<AllocationSite> s = sites[i];
+			w.printf("%14d %12d %14d %12d", s.liveBytes, s.liveBlocks, s.allocatedBytes, s.allocations);
+			if (s.frames.length() == 0)
+				w.printf("  [unknown]\n");
+			for (j in s.frames) {
+				long ra = s.frames[j];
+				string location = locations.get(ra);
+				if (location == null) {
+					location = runtime.image.formattedLocation(ra - 1, 0);
+					locations[ra] = location;
+				}
+				if (j == 0)
+					w.printf("  %s\n", location);
+				else
+					w.printf("%58s%s\n", "", location);
+			}
+		}
+		delete w;
+		storage.rename(temp, _path);
+	}
+
+	private static long now() {
+		linux.timespec ts;
+		linux.clock_gettime(linux.CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+}
 
 private pointer<address> getRBP(var v) {
 	return pointer<pointer<address>>(&v)[-2];
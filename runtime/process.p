@@ -1105,6 +1105,16 @@ private void executeDone(int exitStatus, address arg) {
  * Terminate the current process.
  */
 public void exit(int code) {
+	// Static destructors do not run, so write any profile or coverage being collected now.
+	ref<runtime.ProfileTables> tables = runtime.ProfileTables.current();
+	if (tables != null)
+		tables.write();
+	ref<runtime.Coverage> coverage = runtime.Coverage.current();
+	if (coverage != null)
+		coverage.write();
+	ref<memory.AllocationProfiler> allocationProfiler = memory.allocationProfiler();
+	if (allocationProfiler != null)
+		allocationProfiler.write();
 	C.exit(code);
 }
 
@@ -98,19 +98,26 @@ public class Pxi {
 			return false;
 
 		long offset = header.bytes + _sections.length() * SectionEntry.bytes;
+		long[] offsets;
 		for (int i = 0; i < _sections.length(); i++) {
 			ref<Section> s = _sections[i];
 			SectionEntry se;
+			long alignment = s.alignment();
+			offset = (offset + alignment - 1) & ~(alignment - 1);
 			se.sectionType = byte(int(s.sectionType()));
 			se.offset = offset;
 			se.length = s.length();
+			offsets.append(offset);
 			offset += se.length;
 			if (f.write(&se, se.bytes) < 0)
 				return false;
 		}
-		for (int i = 0; i < _sections.length(); i++)
+		for (int i = 0; i < _sections.length(); i++) {
+			if (f.seek(offsets[i], storage.Seek.START) != offsets[i])
+				return false;
 			if (!_sections[i].write(f))
 				return false;
+		}
 		return true;
 	}
 
@@ -204,6 +211,14 @@ public class Section {
 	}
 	
 	public abstract long length();
+	/**
+	 * The required alignment of the section's offset in the file.
+	 *
+	 * @return The alignment in bytes, which must be a power of two.
+	 */
+	public long alignment() {
+		return 1;
+	}
 	
 	public abstract boolean write(storage.File pxiFile);
 }
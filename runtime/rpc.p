@@ -15,6 +15,7 @@
  */
 namespace parasol:rpc;
 
+import native:C;
 import parasol:exception.IllegalArgumentException;
 import parasol:exception.IllegalOperationException;
 import parasol:exception.IOException;
@@ -22,13 +23,48 @@ import parasol:http;
 import parasol:log;
 import parasol:net;
 import parasol:runtime;
+import parasol:stream;
 import parasol:text;
 import parasol:thread;
 
 private ref<log.Logger> logger = log.getLogger("parasol.rpc");
 
+/**
+ * The base class of the objects that carry the calls made through a proxy to the object
+ * that implements the interface.
+ *
+ * Only internally generated code calls these methods. A proxy method makes one call to
+ * {@link startCall}, marshals its arguments into the returned buffer, calls {@link call} and,
+ * once it has unmarshalled the returns, calls {@link endCall}. If unmarshalling the returns throws,
+ * {@link endCall} is called before the exception reaches the caller of the proxy method.
+ */
 public class ClientTransport {
-	public abstract string call(string serializedArguments);
+	/**
+	 * Begin a call.
+	 *
+	 * @param methodID The method id of the called method, followed by a semi-colon.
+	 *
+	 * @return A buffer holding the method id, to which the caller appends the serialized arguments.
+	 * The buffer belongs to the transport and keeps its capacity from call to call.
+	 */
+	public abstract ref<byte[]> startCall(substring methodID);
+	/**
+	 * Make the call.
+	 *
+	 * @param serializedArguments The buffer returned by {@link startCall}.
+	 *
+	 * @return The serialized returns of the call. They remain valid until {@link endCall} is called.
+	 *
+	 * @exception IOException Thrown if the call could not be made or no reply arrived. The call is
+	 * ended before the exception is thrown.
+	 */
+	public abstract pointer<byte> call(ref<byte[]> serializedArguments);
+	/**
+	 * Finish a call, releasing its buffers.
+	 *
+	 * @param serializedArguments The buffer returned by {@link startCall}.
+	 */
+	public abstract void endCall(ref<byte[]> serializedArguments);
 
 	void dispose() {
 	}
@@ -36,37 +72,105 @@ public class ClientTransport {
 
 class HttpTransport extends ClientTransport {
 	protected ref<http.Client> _client;
+	private byte[] _arguments;
+	private string _reply;
 
 	HttpTransport() {}
 
-	string call(string serializedArguments) {
-		http.ConnectStatus status = _client.post(serializedArguments);
+	ref<byte[]> startCall(substring methodID) {
+		_arguments.resize(methodID.length());
+		C.memcpy(&_arguments[0], methodID.c_str(), methodID.length());
+		return &_arguments;
+	}
+
+	pointer<byte> call(ref<byte[]> serializedArguments) {
+		stream.BufferReader body(&(*serializedArguments)[0], serializedArguments.length());
+		http.ConnectStatus status = _client.post(&body);
 		if (status != http.ConnectStatus.OK)
 			throw IOException(string(status));
 
-		string reply;
 		int contentLength;
 
-		(reply, contentLength) = _client.readContent();
-		if (reply == null || reply.length() < contentLength)
+		(_reply, contentLength) = _client.readContent();
+		if (_reply == null || _reply.length() < contentLength)
 			throw IOException("Content missing or malformed");
 
 		// Shut her down and await the next call.
 		_client.reset();
-		return reply;
+		return _reply.c_str();
+	}
+
+	void endCall(ref<byte[]> serializedArguments) {
+	}
+}
+/*
+ * The messages of an rpc Web Socket are binary. A call message is a 'C', a four byte request id, the method id,
+ * a semi-colon and the serialized arguments. The reply is an 'R', the request id of the call and the serialized
+ * returns, or an 'E' and the request id if the call could not be made. Any number of calls can be waiting for
+ * replies, which may arrive in any order.
+ */
+@Constant
+private int MESSAGE_HEADER_LENGTH = 1 + int.bytes;
+
+private enum CallOutcome {
+	WAITING,
+	RETURNED,
+	FAILED,
+	ABANDONED
+}
+/*
+ * A call made on a WebSocketTransport. The request id of a call is the index of its slot in the transport.
+ * Slots are reused, so their buffers keep whatever capacity earlier calls gave them.
+ */
+class PendingCall {
+	int id;
+	ref<PendingCall> next;			// While the slot is free, the next free slot, guarded by the transport's lock
+	boolean waiting;				// Sent and not yet answered, guarded by the transport's lock
+	byte[] message;
+	byte[] returns;
+	private Monitor _reply;
+	private CallOutcome _outcome;	// guarded by _reply
+
+	PendingCall(int id) {
+		this.id = id;
+	}
+
+	void reset() {
+		lock (_reply) {
+			_outcome = CallOutcome.WAITING;
+		}
+	}
+
+	CallOutcome await() {
+		lock (_reply) {
+			while (_outcome == CallOutcome.WAITING)
+				wait();
+			return _outcome;
+		}
+	}
+
+	void answer(CallOutcome outcome) {
+		lock (_reply) {
+			_outcome = outcome;
+			notify();
+		}
 	}
 }
 
 class WebSocketTransport extends ClientTransport {
 	ref<http.WebSocket> socket;
 	ref<AbstractWebSocketReader> reader;
-	http.RendezvousManager manager;
-	int serial;
 	ref<WebSocketVolatileData> rpcWebSocket;
+	private Monitor _lock;
+	private ref<PendingCall>[] _calls;		// indexed by request id, guarded by _lock
+	private ref<PendingCall> _free;			// guarded by _lock
+	private boolean _closed;				// guarded by _lock
 
 	~WebSocketTransport() {
-		delete reader;
+		// The socket's destructor waits until the reader has seen the last message.
 		delete socket;
+		delete reader;
+		_calls.deleteAll();
 	}
 
 	void dispose() {
@@ -83,43 +187,106 @@ class WebSocketTransport extends ClientTransport {
 		this.rpcWebSocket = rpcWebSocket;
 	}
 
-	string call(string serializedArguments) {
-		string s;
-		s.printf("C%d;", manager.getNextMessageID());
-		ref<http.Rendezvous> r = manager.createRendezvous(s);
-		if (r == null)
-			return null;
-		s.append(serializedArguments);
+	ref<byte[]> startCall(substring methodID) {
+		ref<PendingCall> pc;
+		lock (_lock) {
+			pc = _free;
+			if (pc != null)
+				_free = pc.next;
+			else {
+				pc = new PendingCall(_calls.length());
+				_calls.append(pc);
+			}
+		}
+		pc.reset();
+		pc.message.resize(MESSAGE_HEADER_LENGTH + methodID.length());
+		pc.message[0] = byte('C');
+		*ref<int>(&pc.message[1]) = pc.id;
+		C.memcpy(&pc.message[MESSAGE_HEADER_LENGTH], methodID.c_str(), methodID.length());
+		return &pc.message;
+	}
+
+	pointer<byte> call(ref<byte[]> serializedArguments) {
+		ref<PendingCall> pc;
+		boolean closed;
+		lock (_lock) {
+			pc = _calls[*ref<int>(&(*serializedArguments)[1])];
+			closed = _closed;
+			pc.waiting = !closed;
+		}
+		if (closed) {
+			endCall(serializedArguments);
+			throw IOException("Connection closed");
+		}
 		rpcWebSocket.refer();
-//		logger.memDump(log.DEBUG, "rpc.ws.call", &s[0], s.length(), 0);
-		socket.write(http.WebSocket.OP_BINARY, s);
-		s = null;
+//		logger.memDump(log.DEBUG, "rpc.ws.call", &pc.message[0], pc.message.length(), 0);
+		socket.write(http.WebSocket.OP_BINARY, &pc.message[0], pc.message.length());
+		CallOutcome outcome = pc.await();
+		rpcWebSocket.release();
+		switch (outcome) {
+		case FAILED:
+			endCall(serializedArguments);
+			throw IOException("Call failed");
 
-		boolean shouldThrow;
-		lock (*r) {
-			wait();
+		case ABANDONED:
+			endCall(serializedArguments);
+			throw IOException("Connection closed before reply");
+		}
+		return pc.returns.length() > 0 ? &pc.returns[0] : null;
+	}
 
-			if (success) {
-				s.resize(replyMessage.length());
-				for (int i = 0; i < s.length(); i++)
-					s[i] = replyMessage[i];
-			} else
-				shouldThrow = true;
+	void endCall(ref<byte[]> serializedArguments) {
+		lock (_lock) {
+			ref<PendingCall> pc = _calls[*ref<int>(&(*serializedArguments)[1])];
+			pc.next = _free;
+			_free = pc;
 		}
-		delete r;
-		rpcWebSocket.release();
-		if (shouldThrow)
-			throw IOException("Connection closed before reply");
-		return s;
 	}
 
-	void postReturns(string key, byte[] body) {
-//		logger.memDump(log.DEBUG, "rpc.ws.return " + key, &body[0], body.length(), 0);
-		ref<http.Rendezvous> r = manager.extractRendezvous(key);
-		if (r != null)
-			r.postResult(body);
-		else
-			logger.error("no rendezvous for '%s'", key);
+	void postReturns(ref<byte[]> message) {
+//		logger.memDump(log.DEBUG, "rpc.ws.return", &(*message)[0], message.length(), 0);
+		if (message.length() < MESSAGE_HEADER_LENGTH) {
+			logger.memDump(log.ERROR, "Return message too short", &(*message)[0], message.length(), 0);
+			return;
+		}
+		int id = *ref<int>(&(*message)[1]);
+		ref<PendingCall> pc;
+		lock (_lock) {
+			if (id >= 0 && id < _calls.length() && _calls[id].waiting) {
+				pc = _calls[id];
+				pc.waiting = false;
+			}
+		}
+		if (pc == null) {
+			logger.error("No call waiting for reply %d", id);
+			return;
+		}
+		if ((*message)[0] == 'E') {
+			pc.answer(CallOutcome.FAILED);
+			return;
+		}
+		int length = message.length() - MESSAGE_HEADER_LENGTH;
+		pc.returns.resize(length);
+		if (length > 0)
+			C.memcpy(&pc.returns[0], &(*message)[MESSAGE_HEADER_LENGTH], length);
+		pc.answer(CallOutcome.RETURNED);
+	}
+	/*
+	 * Called once no more replies can arrive. Every call still waiting for a reply is abandoned, as is any later call.
+	 */
+	void abandonCalls() {
+		ref<PendingCall>[] waiting;
+		lock (_lock) {
+			_closed = true;
+			for (i in _calls) {
+				if (_calls[i].waiting) {
+					_calls[i].waiting = false;
+					waiting.append(_calls[i]);
+				}
+			}
+		}
+		for (i in waiting)
+			waiting[i].answer(CallOutcome.ABANDONED);
 	}
 }
 /**
@@ -431,7 +598,8 @@ public class WebSocket<class OBJECT, class PROXY> extends WebSocketVolatileData
 
 	void startReader() {
 		_transport.reader = new WebSocketReader<OBJECT, PROXY>(&_transport, _upstreamObject, _downstreamProxy);
-		_transport.socket.startReader(_transport.reader, "RPC Reader");
+		refer();					// Released when the reader sees the end of the messages.
+		_transport.socket.startListening(_transport.reader);
 	}
 
 	public void shutdown() {
@@ -473,8 +641,8 @@ public class WebSocket<class OBJECT, class PROXY> extends WebSocketVolatileData
 		return _upstreamObject;
 	}
 
-	void postReturns(string key, byte[] body) {
-		_transport.postReturns(key, body);
+	void postReturns(ref<byte[]> message) {
+		_transport.postReturns(message);
 	}
 
 	public ref<http.WebSocket> socket() {
@@ -482,92 +650,140 @@ public class WebSocket<class OBJECT, class PROXY> extends WebSocketVolatileData
 	}
 }
 
-class AbstractWebSocketReader implements http.WebSocketReader {
-	public abstract boolean readMessages();
+class AbstractWebSocketReader implements http.WebSocketListener {
+	public abstract void message(ref<byte[]> message);
+
+	public abstract void endOfMessages(boolean sawClose);
+}
+/*
+ * The threads that run the calls arriving on all rpc Web Sockets. They are started by the first call. Each call
+ * holds a reference to its Web Socket, so closing a socket need not wait for the pool. At exit the pool is only
+ * stopped: a call that is still blocked must not keep the process from exiting, so the pool is not joined or
+ * deleted.
+ */
+private monitor class CallerThreads {
+	@Constant
+	private static int THREADS_PER_CPU = 4;
+
+	ref<thread.ThreadPool<int>> _pool;
+
+	ref<thread.ThreadPool<int>> pool() {
+		if (_pool == null)
+			_pool = new thread.ThreadPool<int>(THREADS_PER_CPU * thread.cpuCount());
+		return _pool;
+	}
+
+	void stop() {
+		if (_pool != null)
+			_pool.stop();
+	}
+}
+
+class CallerThreadsShutDown {
+	~CallerThreadsShutDown() {
+		callerThreads.stop();
+	}
 }
 
+private CallerThreads callerThreads;
+
+private CallerThreadsShutDown callerThreadsShutDown;
+
 class WebSocketReader<class OBJECT, class PROXY> extends AbstractWebSocketReader {
 	private CallProcessor<OBJECT> _processor;
 	private ref<WebSocketTransport> _transport;
 	private PROXY _proxy;
-	private ref<thread.ThreadPool<int>> _callerThreads;
+	private Monitor _lock;
+	private ref<CallParameters> _free;		// guarded by _lock
 
 	WebSocketReader(ref<WebSocketTransport> transport, OBJECT object, PROXY proxy) {
 		_processor = CallProcessor<OBJECT>(object);
 		_transport = transport;
 		_proxy = proxy;
-		_callerThreads = new thread.ThreadPool<int>(4);
 	}
 
 	~WebSocketReader() {
-		_callerThreads.shutdown();
-		delete _callerThreads;
+		while (_free != null) {
+			ref<CallParameters> cp = _free;
+			_free = cp.next;
+			delete cp;
+		}
 	}
-
 	/**
-	 * readMessages
+	 * message
 	 *
-	 * This method is called from the read thread for a WebSocket. It continues
-	 * reading messages until the protocol fails or a close is detected.
+	 * This method is called from the thread reading the WebSocket for each message that arrives.
 	 *
-	 * The message format consists of a prefix, either C or R followed by a serial number (in decimal)
-	 * and a semi-colon. For C messages, the prefix is followed by a method ID and serialized
-	 * arguments. For R messages, the prefix is followed by serialized return values.
+	 * The message format consists of a prefix, either C, R or E followed by a four byte request id.
+	 * For C messages, the prefix is followed by a method ID, a semi-colon and serialized
+	 * arguments. For R messages, the prefix is followed by serialized return values. An E message
+	 * reports a call that could not be made.
 	 *
 	 * The body of C messages must be passed to the stub
 	 */
-	public boolean readMessages() {
-		_transport.rpcWebSocket.refer();
-		for (;;) {
-			byte[] message;
-			boolean success;
-			boolean sawClose;
-		
-			(success, sawClose) = _transport.socket.readWholeMessage(&message);
-			if (success) {
-				if (message.length() == 0)
-					continue;
-				switch (message[0]) {
-				case 'C':
-					ref<CallParameters> cp = new CallParameters;
-					cp.message = message;
-					cp.reader = this;
-					_transport.rpcWebSocket.refer();
-					// _callerThreads is the pool that makes the actual call, so that
-					// this thread can see if another call is coming in right behind this one.
-					_callerThreads.execute(callStubWrapper, cp);
-					break;
-
-				case 'R':
-					int index = message.find(';');
-					if (index < 0) {
-						logger.memDump(log.ERROR, "No prefix separator for return message", &message[0], message.length(), 0);
-						break;
-					}
-					message[0] = 'C';
-					byte[] body;
-					body.slice(message, index + 1, message.length());
-					_transport.postReturns(string(&message[0], index + 1), body);
-					break;
-
-				default:
-					logger.error("Received unknown message direction: %c (%x)", message[0], message[0]);
-				}
-			} else {
-				// After we have received all responses and the socket has shut down, we need to clear all the calling
-				// threads waiting for responses.
-				ref<http.Rendezvous>[] pending = _transport.manager.extractAllRendezvous();
-				for (int i = 0; i < pending.length(); i++)
-					pending[i].abandon();
+	public void message(ref<byte[]> message) {
+		if (message.length() == 0)
+			return;
+		switch ((*message)[0]) {
+		case 'C':
+			ref<CallParameters> cp = takeParameters();
+			cp.message.resize(message.length());
+			C.memcpy(&cp.message[0], &(*message)[0], message.length());
+			_transport.rpcWebSocket.refer();
+			// The caller threads make the actual call, so that the reading thread can go on to
+			// the next message, which may be another call or a reply. Once the process is exiting,
+			// the call is dropped.
+			if (!callerThreads.pool().execute(callStubWrapper, cp)) {
+				releaseParameters(cp);
 				_transport.rpcWebSocket.release();
-				return sawClose;
 			}
+			break;
+
+		case 'R':
+		case 'E':
+			_transport.postReturns(message);
+			break;
+
+		default:
+			logger.error("Received unknown message direction: %c (%x)", (*message)[0], (*message)[0]);
 		}
 	}
 
+	public void endOfMessages(boolean sawClose) {
+		// After we have received all responses and the socket has shut down, we need to clear all the calling
+		// threads waiting for responses.
+		_transport.abandonCalls();
+		_transport.rpcWebSocket.release();
+	}
+	/*
+	 * The buffers of a call arriving on the socket. They are recycled, so that a steady stream of calls
+	 * does not allocate memory.
+	 */
 	private class CallParameters {
 		byte[] message;
+		byte[] reply;
 		ref<WebSocketReader<OBJECT, PROXY>> reader;
+		ref<CallParameters> next;
+	}
+
+	private ref<CallParameters> takeParameters() {
+		lock (_lock) {
+			ref<CallParameters> cp = _free;
+			if (cp != null)
+				_free = cp.next;
+			else {
+				cp = new CallParameters;
+				cp.reader = this;
+			}
+			return cp;
+		}
+	}
+
+	private void releaseParameters(ref<CallParameters> cp) {
+		lock (_lock) {
+			cp.next = _free;
+			_free = cp;
+		}
 	}
 
 	private static void callStubWrapper(address arg) {
@@ -576,26 +792,28 @@ class WebSocketReader<class OBJECT, class PROXY> extends AbstractWebSocketReader
 	}
 
 	private void callStub(ref<CallParameters> cp) {
-		int index = cp.message.find(';');
-		if (index < 0) {
-			logger.memDump(log.ERROR, "Message has no prefix separator.", &cp.message[0], cp.message.length(), 0);
-			return;
-		}
-		int methodEnd = cp.message.find(';', index + 1);
+		int methodEnd = cp.message.find(';', MESSAGE_HEADER_LENGTH);
 		if (methodEnd < 0) {
 			logger.memDump(log.ERROR, "Message has no method id.", &cp.message[0], cp.message.length(), 0);
+			releaseParameters(cp);
+			_transport.rpcWebSocket.release();
 			return;
 		}
 		StubParams params;
-		params.methodID = substring(&cp.message[index + 1], methodEnd - (index + 1));
+		params.methodID = substring(&cp.message[MESSAGE_HEADER_LENGTH], methodEnd - MESSAGE_HEADER_LENGTH);
 		pointer<byte> pb = &cp.message[methodEnd + 1];
 		params.arguments = &pb;
-		string returns = _processor.call(&params);
-		string reply;
-		reply.printf("R%s%s", substring(&cp.message[1], index), returns);
-		_transport.socket.write(reply);
+		cp.reply.resize(MESSAGE_HEADER_LENGTH);
+		cp.reply[0] = byte('R');
+		C.memcpy(&cp.reply[1], &cp.message[1], int.bytes);
+		params.output = &cp.reply;
+		if (!_processor.call(&params)) {
+			cp.reply.resize(MESSAGE_HEADER_LENGTH);
+			cp.reply[0] = byte('E');
+		}
+		_transport.socket.write(http.WebSocket.OP_BINARY, &cp.reply[0], cp.reply.length());
+		releaseParameters(cp);
 		_transport.rpcWebSocket.release();
-		delete cp;
 	}
 }
 
@@ -632,17 +850,20 @@ public class Service<class I> extends http.Service {
 			releasedCaller = true;
 		}
 		// Now do the call locally
-		string returns = _processor.call(&params);
+		byte[] returns;
+		params.output = &returns;
+		boolean success = _processor.call(&params);
 		if (releasedCaller)
 			return false;
 		// There should be returns for this method, check and respond accordingly.
-		if (returns == null)
+		if (!success)
 			response.error(500);
 		else {
 			response.ok();
 			response.header("Content-Length", string(returns.length()));
 			response.endOfHeaders();
-			response.write(returns);
+			if (returns.length() > 0)
+				response.write(&returns[0], returns.length());
 		}
 		return false;
 	}
@@ -674,8 +895,15 @@ class CallProcessor<class I> {
 		return false;
 	}
 	/**
+	 * Unmarshal the arguments, call the method and marshal its returns.
+	 *
+	 * @param params The method id and serialized arguments of the call, and the buffer
+	 * the returns are appended to.
+	 *
+	 * @return true if the call was made, false if the method id was not recognized or
+	 * the arguments could not be unmarshalled.
 	 */
-	public string call(ref<StubParams> params) {
+	public boolean call(ref<StubParams> params) {
 		return I.stub(_object, params);
 	}
 
@@ -698,6 +926,7 @@ string hexify(string argument) {
 class StubParams {
 	substring methodID;
 	ref<pointer<byte>> arguments;
+	ref<byte[]> output;
 }
 
 
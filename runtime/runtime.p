@@ -50,9 +50,10 @@ public enum Target {
 	 */
 	X86_64_LNX_NEW,
 	/**
-	 * @ignore RESERVED - DO NOT USE
+	 * This is an Intel x86-64 machine instruction set running the Linux operating system,
+	 * where the image has been prelinked to run at a preferred load address.
 	 */
-	NOT_USED_1,
+	X86_64_LNX_PRELINKED,
 	/**
 	 * This is an Intel x64-64 machine instruction set running the Linux operating system.
 	 */
@@ -111,6 +112,57 @@ public abstract address framePointer();
 @Linux("libparasol.so.1", "getFsSegment")
 @Windows("parasol.dll", "getFsSegment")
 public abstract address getFsSegment(long offset);
+/**
+ * @ignore - The compiler calls this from the entry point of an image, after the static initializers have
+ * run and just before main is called. It ends the start-up trace that parasolrt writes when the
+ * PARASOLRT_STARTUP_TRACE environment variable is set.
+ */
+@Linux("libparasol.so.1", "startupComplete")
+@Windows("parasol.dll", "startupComplete")
+public abstract void startupComplete();
+/**
+ * @ignore - The element types of the vectors that vectorArithmetic and vectorReduce can process.
+ */
+@Header("VE_")
+public enum VectorElement {
+	SIGNED_32,
+	SIGNED_64,
+	FLOAT_32,
+	FLOAT_64
+}
+/**
+ * @ignore - The operations vectorArithmetic can perform. DIVIDE is only valid for floating point elements.
+ */
+@Header("VO_")
+public enum VectorOperation {
+	ADD,
+	SUBTRACT,
+	MULTIPLY,
+	DIVIDE
+}
+/**
+ * @ignore - The compiler calls this from the code generated for a vector assignment like a = b + c. It computes
+ * destination[i] = left[i] operation right[i] for each element with packed SIMD instructions. An operand with a
+ * length of 1 is combined with every element of the other.
+ *
+ * @return The number of elements computed. The generated code finishes the rest of the vector one element
+ * at a time, so a result of 0 leaves the vector to that code, for example when the operand lengths differ.
+ */
+@Linux("libparasol.so.1", "vectorArithmetic")
+@Windows("parasol.dll", "vectorArithmetic")
+public abstract int vectorArithmetic(int element, int operation, address destination, address left, int leftLength,
+									 address right, int rightLength, int length);
+/**
+ * @ignore - The compiler calls this from the code generated for a sum reduction like +=a or +=(a * b). It
+ * stores the sum of left[i], or of left[i] * right[i] if right is not null, in result.
+ *
+ * @return The number of elements summed. The generated code adds in the rest of the vector one element
+ * at a time, so a result of 0 (with a zero stored in result) leaves the whole sum to that code.
+ */
+@Linux("libparasol.so.1", "vectorReduce")
+@Windows("parasol.dll", "vectorReduce")
+public abstract int vectorReduce(int element, address result, address left, int leftLength,
+								 address right, int rightLength, int length);
 
 /**
  * Allocate a large page-aligned region of storage, outside the Heap.
@@ -194,6 +246,11 @@ public class Image {
 	private pointer<int> _linesCounts;
 	private pointer<int> _baseLineNumbers;
 	private pointer<int> _lineFileOffsets;
+	private thread.Monitor _returnLocationsLock;
+	private map<string, long> _returnLocations;
+
+	@Constant
+	private static int MAX_RETURN_LOCATIONS = 4096;		// The cache is emptied when it reaches this size
 
 	Image() {
 		_pxiHeader = pxiHeader();
@@ -260,6 +317,36 @@ public class Image {
 		}
 	}
 
+	/**
+	 * Construct a string representing the location of a return address found on a stack, as
+	 * {@link formattedLocation} would for the call instruction just before it.
+	 *
+	 * Results are cached, so repeated traces through the same code paths only pay for a map lookup
+	 * per frame.
+	 *
+	 * @param returnAddress The return address.
+	 *
+	 * @return The formatted string.
+	 *
+	 * @threading This method is thread safe.
+	 */
+	public string formattedReturnLocation(long returnAddress) {
+		string result;
+		lock (_returnLocationsLock) {
+			if (_returnLocations.contains(returnAddress))
+				result = _returnLocations[returnAddress];
+		}
+		if (result != null)
+			return result;
+		result = formattedLocation(returnAddress - 1, int(returnAddress - codeAddress()));
+		lock (_returnLocationsLock) {
+			if (_returnLocations.size() >= MAX_RETURN_LOCATIONS)
+				_returnLocations.clear();
+			_returnLocations[returnAddress] = result;
+		}
+		return result;
+	}
+
 	private static string formattedExternalLocation(long ip) {
 		string result;
 		if (compileTarget == Target.X86_64_WIN) {
@@ -306,6 +393,27 @@ public class Image {
 	}
 
 	private string, int getSourceLocation(long ip, boolean exact) {
+		pointer<byte> filename;
+		int lineNumber;
+		(filename, lineNumber) = sourceLocation(ip, exact);
+		if (filename == null)
+			return null, -1;
+		return storage.makeCompactPath(string(filename), "./xyz"), lineNumber;
+	}
+	/**
+	 * @ignore - Like getSourceLocation, but the filename is the one recorded in the image, not a
+	 * compact path. Compacting a path is much slower than looking up the location, so a caller
+	 * looking up many locations can compact each distinct filename once.
+	 *
+	 * @return The source filename, which remains valid as long as the image, or null if the code
+	 * address is not in Parasol code.
+	 * @return The line number, or -1 if the code address is not in Parasol code.
+	 */
+	public pointer<byte>, int getRawSourceLocation(long ip) {
+		return sourceLocation(ip, false);
+	}
+
+	private pointer<byte>, int sourceLocation(long ip, boolean exact) {
 		if (ip < _imageAddr ||
 			highCodeAddress() <= ip)
 			return null, -1;
@@ -332,16 +440,11 @@ public class Image {
 
 		int offset = int(ip - _imageAddr);
 		
-		int[] lookup(_codeAddresses, _sourceMap.codeLocationsCount);
-			
-		int index;
-
-		if (exact) {
-			index = lookup.binarySearch(offset);
-			if (index < 0)
-				return null, -1;
-		} else
-			index = lookup.binarySearchClosestNotGreater(offset);
+		int index = closestNotGreater(_codeAddresses, _sourceMap.codeLocationsCount, offset);
+		if (index < 0)
+			return null, -1;
+		if (exact && _codeAddresses[index] != offset)
+			return null, -1;
 //		printf("offset = %x index = %d\n", offset, index);
 //		printf("bucket offset %x\n", _codeAddresses[index]);
 //		printf("  next offset %x\n", _codeAddresses[index + 1]);
@@ -350,21 +453,47 @@ public class Image {
 		if (fileIndex < 0)
 			return null, -1;
 		int fileOffset = _fileOffsets[index];
-		string filename = string(_image + _filenames[fileIndex]);
+		pointer<byte> filename = _image + _filenames[fileIndex];
 
 
 //		printf("File %d. %s offset %d\n", fileIndex, filename, fileOffset);
 
 		int lineEntryOffset = _firstLineNumbers[fileIndex];
 
-		int[] lookupLine(pointer<int>(pointer<byte>(_lineFileOffsets) + lineEntryOffset),
-							_linesCounts[fileIndex]);
- 		filename = storage.makeCompactPath(filename, "./xyz");
-		int lineNumber = lookupLine.binarySearchClosestGreater(fileOffset) + 1 + _baseLineNumbers[fileIndex];
+		pointer<int> lineOffsets = pointer<int>(pointer<byte>(_lineFileOffsets) + lineEntryOffset);
+		int lineNumber = closestGreater(lineOffsets, _linesCounts[fileIndex], fileOffset) + 1 + _baseLineNumbers[fileIndex];
 //		printf("lineNumber = %d base line number %d\n", lineNumber, _baseLineNumbers[fileIndex]);
 		return filename, lineNumber;
 	}
 
+	/*
+	 * The source map tables are sorted arrays in the image. These searches work on them in place,
+	 * since wrapping one in a vector costs time proportional to its length.
+	 *
+	 * Returns the index of the last value not greater than key, or -1 if there is none.
+	 */
+	private static int closestNotGreater(pointer<int> values, int length, int key) {
+		int low = 0;
+		int high = length;
+		while (low < high) {
+			int middle = (low + high) / 2;
+			if (values[middle] <= key)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		return low - 1;
+	}
+	/*
+	 * Returns the index of the first value greater than key, length if there is none, or -1 if
+	 * there are no values.
+	 */
+	private static int closestGreater(pointer<int> values, int length, int key) {
+		if (length == 0)
+			return -1;
+		return closestNotGreater(values, length, key) + 1;
+	}
+
 	/** @ignore */
 	public long codeAddress() {
 		return _imageAddr;
@@ -502,6 +631,36 @@ public int imageLength() {
 public void setImageLength(int newLength) {
 	setRuntimeParameter(IMAGE_LENGTH, address(long(newLength)));
 }
+/**
+ * @ignore - The path given to the pc --profile option, or null if the image is not being profiled by
+ * the compiler.
+ */
+public pointer<byte> profilePath() {
+	return pointer<byte>(getRuntimeParameter(PROFILE_PATH));
+}
+/** @ignore */
+public void setProfilePath(pointer<byte> path) {
+	setRuntimeParameter(PROFILE_PATH, path);
+}
+/**
+ * @ignore - The path given to the pc --alloc-profile option, or null if the image is not having its
+ * allocations profiled by the compiler.
+ */
+public pointer<byte> allocationProfilePath() {
+	return pointer<byte>(getRuntimeParameter(ALLOC_PROFILE_PATH));
+}
+/** @ignore */
+public void setAllocationProfilePath(pointer<byte> path) {
+	setRuntimeParameter(ALLOC_PROFILE_PATH, path);
+}
+/** @ignore */
+public ref<FunctionNames> functionNames() {
+	return ref<FunctionNames>(getRuntimeParameter(FUNCTION_NAMES));
+}
+/** @ignore */
+public void setFunctionNames(ref<FunctionNames> names) {
+	setRuntimeParameter(FUNCTION_NAMES, names);
+}
 /*	Runtime Parameters
  *
  *	These are context parameters passed from the enclosing environment, either
@@ -529,6 +688,27 @@ int IMAGE = 6;
 @Constant
 int IMAGE_LENGTH = 7;
 /** @ignore */
+@Constant
+int PROFILE_PATH = 8;
+/** @ignore */
+@Constant
+int FUNCTION_NAMES = 9;
+/** @ignore - The running Profiler of a thread */
+@Constant
+int PROFILER = 10;
+/** @ignore - The ExceptionIndex of the running image (see runtime/exception.p) */
+@Constant
+public int EXCEPTION_INDEX = 11;
+/** @ignore - The thread caches of the running thread (see runtime/memory.p) */
+@Constant
+public int HEAP_CACHE = 12;
+/** @ignore */
+@Constant
+int ALLOC_PROFILE_PATH = 13;
+/** @ignore - The Allocator of the running thread (see memory.setThreadAllocator) */
+@Constant
+public int THREAD_ALLOCATOR = 14;
+/** @ignore */
 @Linux("libparasol.so.1", "getRuntimeParameter")
 @Windows("parasol.dll", "getRuntimeParameter")
 public abstract address getRuntimeParameter(int i);
@@ -538,26 +718,822 @@ public abstract address getRuntimeParameter(int i);
 @Windows("parasol.dll", "setRuntimeParameter")
 public abstract void setRuntimeParameter(int i, address newValue);
 
+/**
+ * A sampling CPU profiler for one thread.
+ *
+ * When profiling is enabled (by the pc --profile option, or by setting the PARASOL_PROFILE
+ * environment variable when running a pxi file), each Parasol thread creates a Profiler as it starts.
+ * A per-thread CPU-time timer delivers SIGPROF to the thread about once a millisecond of running time.
+ * The signal handler walks the frame pointer chain of the interrupted code, the same way {@link stackTrace}
+ * does, and counts each distinct stack. The handler does not allocate memory or take locks.
+ *
+ * When the thread exits, the samples are symbolized and merged into the process's {@link ProfileTables}.
+ *
+ * Profiling is currently only supported on Linux.
+ */
 public class Profiler {
+	@Constant
+	private static int SLOTS = 16384;				// Size of the stack hash table, a power of two
+	@Constant
+	private static int RECORD_SPACE = 1024 * 1024;	// Number of longs of space for distinct stacks
+	@Constant
+	private static int MAX_DEPTH = 128;				// Deeper stacks are truncated at the root end
+	@Constant
+	private static long INTERVAL_NANOS = 1000000;	// Sampling interval, in nanoseconds of thread CPU time
+
 	ref<ProfileTables> _tables;
+	private address _region;
+	private pointer<int> _slots;			// Each slot is zero, or one plus the index in _records of a stack
+	private pointer<long> _records;			// Each stack is stored as: count, depth, frames (leaf first)
+	private int _recordsUsed;
+	private long _samples;
+	private long _dropped;
+	private address _stackTop;
+	private linux.pid_t _tid;
+	private linux.timer_t _timer;
+	private boolean _running;
+	boolean _merged;
 
 	public Profiler(ref<ProfileTables> tables) {
 		_tables = tables;
 	}
+
+	~Profiler() {
+		stop();
+		if (_region != null)
+			freeRegion(_region, SLOTS * int.bytes + RECORD_SPACE * long.bytes);
+	}
+	/**
+	 * Start sampling the calling thread.
+	 *
+	 * @return true if the sampling timer could be started, false otherwise.
+	 */
+	public boolean start() {
+		if (compileTarget != Target.X86_64_LNX || _running)
+			return false;
+		if (_region == null) {
+			_region = allocateRegion(SLOTS * int.bytes + RECORD_SPACE * long.bytes);
+			if (_region == null)
+				return false;
+			C.memset(_region, 0, SLOTS * int.bytes);
+			_slots = pointer<int>(_region);
+			_records = pointer<long>(_slots + SLOTS);
+		}
+		_stackTop = stackTop();
+		_tid = linux.gettid();
+		linux.sigevent event;
+		event.sigev_notify = linux.SIGEV_THREAD_ID;
+		event.sigev_signo = linux.SIGPROF;
+		event.sigev_notify_thread_id = _tid;
+		if (linux.timer_create(linux.CLOCK_THREAD_CPUTIME_ID, &event, &_timer) != 0)
+			return false;
+		setRuntimeParameter(PROFILER, this);
+		_running = true;
+		linux.itimerspec interval;
+		interval.it_interval.tv_nsec = INTERVAL_NANOS;
+		interval.it_value.tv_nsec = INTERVAL_NANOS;
+		if (linux.timer_settime(_timer, 0, &interval, null) != 0) {
+			stop();
+			return false;
+		}
+		return true;
+	}
+	/**
+	 * Stop sampling. Samples already taken are kept.
+	 *
+	 * This may be called from a thread other than the one being sampled.
+	 */
+	public void stop() {
+		if (compileTarget != Target.X86_64_LNX)
+			return;
+		if (_tid == linux.gettid() && getRuntimeParameter(PROFILER) == this)
+			setRuntimeParameter(PROFILER, null);
+		if (_running) {
+			_running = false;
+			linux.timer_delete(_timer);
+		}
+	}
+
+	public ref<ProfileTables> tables() {
+		return _tables;
+	}
+	/**
+	 * @return The number of samples counted.
+	 */
+	public long samples() {
+		return _samples;
+	}
+	/**
+	 * @return The number of samples discarded because the stack tables were full.
+	 */
+	public long dropped() {
+		return _dropped;
+	}
+
+	static void installSignalHandler() {
+		if (compileTarget == Target.X86_64_LNX) {
+			linux.struct_sigaction action;
+
+			action.set_sa_sigaction(profileSignalHandler);
+			action.sa_flags = linux.SA_SIGINFO|linux.SA_RESTART;
+			linux.sigaction(linux.SIGPROF, &action, null);
+		}
+	}
+
+	private static void profileSignalHandler(int signum, ref<linux.siginfo_t> info, ref<linux.ucontext_t> uContext) {
+		ref<Profiler> p = ref<Profiler>(getRuntimeParameter(PROFILER));
+		if (p == null || !p._running || p._tid != linux.gettid())
+			return;
+		p.sample(uContext.uc_mcontext.gregs.rip, uContext.uc_mcontext.gregs.rbp, uContext.uc_mcontext.gregs.rsp);
+	}
+	/*
+	 * Called from the signal handler, so it must not allocate memory, take locks or throw exceptions.
+	 * The new stack is written past the end of the used records and only kept if it is new.
+	 */
+	private void sample(long ip, long fp, long sp) {
+		pointer<long> record = _records + _recordsUsed;
+		int available = RECORD_SPACE - _recordsUsed - 2;
+		if (available < MAX_DEPTH + 1) {
+			_dropped++;
+			return;
+		}
+		long top = long(_stackTop);
+		record[2] = ip;
+		int depth = 1;
+		long hash = ip;
+		// A frame pointer must lie in the stack above the interrupted stack pointer and each
+		// saved frame pointer must be above the last one. Anything else (such as C code that uses
+		// rbp for other purposes) ends the walk.
+		while ((fp & 7) == 0 && fp >= sp && fp + 16 <= top) {
+			pointer<long> frame = pointer<long>(fp);
+			long returnAddress = frame[1];
+			if (returnAddress == 0)
+				break;
+			if (depth >= MAX_DEPTH) {
+				record[2 + depth] = 0;			// Marks a truncated stack
+				depth++;
+				break;
+			}
+			record[2 + depth] = returnAddress;
+			depth++;
+			hash = hash * 31 + returnAddress;
+			sp = fp;
+			fp = frame[0];
+			if (fp <= sp)
+				break;
+		}
+		hash ^= hash >> 23;
+		int slot = int(hash & (SLOTS - 1));
+		for (int i = 0; i < SLOTS; i++) {
+			int index = _slots[slot];
+			if (index == 0) {
+				record[0] = 1;
+				record[1] = depth;
+				_slots[slot] = _recordsUsed + 1;
+				_recordsUsed += 2 + depth;
+				_samples++;
+				return;
+			}
+			pointer<long> r = _records + (index - 1);
+			if (r[1] == depth) {
+				int j;
+				for (j = 0; j < depth; j++)
+					if (r[2 + j] != record[2 + j])
+						break;
+				if (j == depth) {
+					r[0]++;
+					_samples++;
+					return;
+				}
+			}
+			slot = (slot + 1) & (SLOTS - 1);
+		}
+		_dropped++;
+	}
+	/*
+	 * Called by ProfileTables with its lock held. The records below _recordsUsed are complete, even if the
+	 * sampled thread is still running.
+	 */
+	void forEachStack(void callback(ref<ProfileTables> tables, long count, pointer<long> frames, int depth)) {
+		int i = 0;
+		while (i < _recordsUsed) {
+			pointer<long> r = _records + i;
+			int depth = int(r[1]);
+			callback(_tables, r[0], r + 2, depth);
+			i += 2 + depth;
+		}
+	}
 }
-/** @ignore */
+/**
+ * The collected profile of a running image.
+ *
+ * There is at most one ProfileTables object in an image. It is created when the first
+ * Parasol thread starts, if profiling is enabled.
+ *
+ * The profile is written when the main thread finishes, or when the process exits through
+ * {@link parasol:process.exit}. Two files are written:
+ *
+ * <ul>
+ *     <li>The path given to pc --profile (or in PARASOL_PROFILE) gets the stacks in 'folded'
+ *         format, one line per distinct stack, with frames from the root to the leaf separated by
+ *         semi-colons, followed by the sample count. This is the input format of flamegraph.pl and
+ *         similar tools.
+ *     <li>The same path with .report appended gets a flat report listing, for each function, the
+ *         samples in which it was running (self) and in which it was on the stack (total).
+ * </ul>
+ *
+ * Frames are labeled with the function name when the image was run in-process by pc. Images loaded
+ * from pxi files do not carry function names, so their frames are labeled with the source file and line.
+ * Frames outside Parasol code are labeled with the nearest native symbol, if there is one.
+ */
 public class ProfileTables {
+	private static thread.Monitor _currentLock;		// Guards _current and _checked
+	private static ref<ProfileTables> _current;
+	private static boolean _checked;
+
+	private string _path;
+	private ref<FunctionNames> _functionNames;
+	private thread.Monitor _lock;
+	private ref<Profiler>[] _active;
+	private boolean _written;
+	private long _samples;
+	private long _dropped;
+	private map<string, long> _labels;
+	private long[string] _stacks;
+	private long[string] _self;
+	private long[string] _total;
+
+	/**
+	 * Create a set of profile tables. Most programs do not need to do this, since pc --profile and
+	 * PARASOL_PROFILE create the tables of an image and profile every thread.
+	 *
+	 * @param path The path the folded stacks are written to.
+	 */
+	public ProfileTables(string path) {
+		_path = path;
+		_functionNames = functionNames();
+		Profiler.installSignalHandler();
+	}
+	/**
+	 * @return The profile tables of this image, or null if profiling is not enabled.
+	 */
+	public static ref<ProfileTables> current() {
+		lock (_currentLock) {
+			if (!_checked) {
+				_checked = true;
+				if (compileTarget == Target.X86_64_LNX) {
+					pointer<byte> path = profilePath();
+					if (path == null)
+						path = C.getenv("PARASOL_PROFILE".c_str());
+					if (path != null && path[0] != 0)
+						_current = new ProfileTables(string(path));
+				}
+			}
+			return _current;
+		}
+	}
+	/**
+	 * Create and start a Profiler for the calling thread.
+	 *
+	 * @return The running Profiler, or null if the profile has already been written or sampling
+	 * could not be started.
+	 */
+	public ref<Profiler> startProfiler() {
+		lock (_lock) {
+			if (_written)
+				return null;
+			ref<Profiler> p = new Profiler(this);
+			if (!p.start()) {
+				delete p;
+				return null;
+			}
+			_active.append(p);
+			return p;
+		}
+	}
+	/**
+	 * Stop a Profiler and merge its samples into these tables.
+	 *
+	 * The Profiler is deleted.
+	 */
+	public void finishProfiler(ref<Profiler> p) {
+		p.stop();
+		lock (_lock) {
+			for (i in _active)
+				if (_active[i] == p) {
+					_active.remove(i);
+					break;
+				}
+			if (!p._merged)
+				merge(p);
+		}
+		delete p;
+	}
+	/**
+	 * Stop any running profilers, merge their samples and write the profile.
+	 *
+	 * Only the first call writes anything.
+	 */
+	public void write() {
+		lock (_lock) {
+			if (_written)
+				return;
+			_written = true;
+			for (i in _active) {
+				_active[i].stop();
+				merge(_active[i]);
+			}
+			_active.clear();
+			ref<Writer> w = storage.createTextFile(_path);
+			if (w == null) {
+				printf("Could not write profile to %s\n", _path);
+				return;
+			}
+			for (key in _stacks)
+				w.printf("%s %d\n", key, _stacks[key]);
+			delete w;
+			writeReport(_path + ".report");
+		}
+	}
+
+	private void writeReport(string filename) {
+		ref<Writer> w = storage.createTextFile(filename);
+		if (w == null) {
+			printf("Could not write profile report to %s\n", filename);
+			return;
+		}
+		ref<ProfileEntry>[] entries;
+		for (key in _total) {
+			ref<ProfileEntry> e = new ProfileEntry;
+			e.label = key;
+			e.totalSamples = _total[key];
+			if (_self.contains(key))
+				e.selfSamples = _self[key];
+			entries.append(e);
+		}
+		entries.sort(ProfileEntry.compare, false);
+		// The report may be written by a static destructor, after the locale needed to format numbers
+		// is gone, so only plain integers are formatted.
+		w.printf("%d samples", _samples);
+		if (_dropped > 0)
+			w.printf(" (%d dropped)", _dropped);
+		w.printf("\n\n%12s %7s %12s %7s  %s\n", "self", "", "total", "", "function");
+		for (i in entries) {
+			ref<ProfileEntry> e = entries[i];
+			w.printf("%12d %7s %12d %7s  %s\n", e.selfSamples, percentage(e.selfSamples, _samples),
+							e.totalSamples, percentage(e.totalSamples, _samples), e.label);
+		}
+		entries.deleteAll();
+		delete w;
+	}
+
+	private void merge(ref<Profiler> p) {
+		p._merged = true;
+		_samples += p.samples();
+		_dropped += p.dropped();
+		p.forEachStack(addStack);
+	}
+
+	private static void addStack(ref<ProfileTables> tables, long count, pointer<long> frames, int depth) {
+		string[] labels;
+		string stack;
+
+		for (int i = depth - 1; i >= 0; i--) {
+			// frames[0] is the interrupted instruction, the others are return addresses
+			string label = tables.label(i == 0 ? frames[i] : frames[i] - 1);
+			if (i < depth - 1)
+				stack.append(';');
+			stack.append(label);
+			boolean seen;
+			for (j in labels)
+				if (labels[j] == label) {
+					seen = true;
+					break;
+				}
+			if (!seen) {
+				labels.append(label);
+				if (!tables._total.contains(label))
+					tables._total[label] = 0;
+				tables._total[label] += count;
+			}
+		}
+		if (depth > 0) {
+			string leaf = tables.label(frames[0]);
+			if (!tables._self.contains(leaf))
+				tables._self[leaf] = 0;
+			tables._self[leaf] += count;
+		}
+		if (!tables._stacks.contains(stack))
+			tables._stacks[stack] = 0;
+		tables._stacks[stack] += count;
+	}
+
+	private string label(long ip) {
+		if (_labels.contains(ip))
+			return _labels[ip];
+		string result;
+		if (ip == 0)
+			result = "[truncated]";
+		else {
+			pointer<byte> name;
+			if (_functionNames != null && ip >= image.codeAddress() && ip < image.highCodeAddress())
+				name = _functionNames.find(int(ip - image.codeAddress()));
+			if (name != null)
+				result = string(name);
+			else {
+				string filename;
+				int lineNumber;
+				(filename, lineNumber) = image.getSourceLocation(ip);
+				if (filename != null)
+					result.printf("%s:%d", filename, lineNumber);
+				else {
+					linux.Dl_info info;
+		
+					if (linux.dladdr(address(ip), &info) != 0) {
+						if (info.dli_sname != null)
+							result = string(info.dli_sname);
+						else
+							result.printf("%s@%x", storage.filename(string(info.dli_fname)), ip - long(info.dli_fbase));
+					} else
+						result.printf("@%x", ip);
+				}
+			}
+			result = result.replaceAll(";", ":");
+		}
+		_labels[ip] = result;
+		return result;
+	}
+}
+/*
+ * Formats part as a percentage of whole, to two decimal places, without consulting the locale.
+ */
+string percentage(long part, long whole) {
+	long hundredths = whole > 0 ? (part * 10000 + whole / 2) / whole : 0;
+	string s;
+	s.printf("%d.%02d%%", hundredths / 100, hundredths % 100);
+	return s;
 }
 
+class ProfileEntry {
+	string label;
+	long selfSamples;
+	long totalSamples;
+
+	static int compare(ref<ProfileEntry> a, ref<ProfileEntry> b) {
+		if (a.selfSamples != b.selfSamples)
+			return a.selfSamples < b.selfSamples ? -1 : 1;
+		if (a.totalSamples != b.totalSamples)
+			return a.totalSamples < b.totalSamples ? -1 : 1;
+		if (a.label < b.label)
+			return 1;
+		else if (a.label > b.label)
+			return -1;
+		else
+			return 0;
+	}
+}
+/**
+ * @ignore - A table of the function entry points of an image, sorted by image offset. The compiler
+ * passes one to an image it runs in-process so that a profile can be labeled with function names.
+ */
+public class FunctionNames {
+	public int length;
+	public pointer<int> offsets;
+	public pointer<pointer<byte>> names;
+	/**
+	 * @return The name of the function containing the given image offset, or null if the offset
+	 * precedes the first function.
+	 */
+	public pointer<byte> find(int offset) {
+		int low = 0;
+		int high = length;
+		while (low < high) {
+			int middle = (low + high) / 2;
+			if (offsets[middle] <= offset)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		if (low == 0)
+			return null;
+		return names[low - 1];
+	}
+}
+
+/**
+ * @ignore - Called from the entry function of an image compiled with coverage enabled, before
+ * the static initializers of the main unit run.
+ */
+public void registerCoverage(address table) {
+	if (Coverage._current == null)
+		Coverage._current = new Coverage(ref<pxi.X86_64CoverageTable>(table));
+}
+/**
+ * The coverage counters of a running image compiled with pc --cover.
+ *
+ * The compiler places a counter at the first statement of each basic block of the image. When
+ * the main thread finishes, or the process exits, the counts are merged by source line into the
+ * file named when the image was compiled, and a report is written next to it.
+ */
 public class Coverage {
-	ref<CoverageTables> _tables;
+	static ref<Coverage> _current;
 
-	public Coverage(ref<CoverageTables> tables) {
-		_tables = tables;
+	private ref<pxi.X86_64CoverageTable> _table;
+	private pointer<long> _counters;
+	private pointer<int> _locations;
+	private thread.Monitor _lock;
+	private boolean _written;
+
+	Coverage(ref<pxi.X86_64CoverageTable> table) {
+		_table = table;
+		_counters = pointer<long>(pointer<byte>(table) + pxi.X86_64CoverageTable.bytes);
+		_locations = pointer<int>(_counters + table.counterCount);
+	}
+	/**
+	 * @return The coverage counters of this image, or null if it was not compiled with coverage enabled.
+	 */
+	public static ref<Coverage> current() {
+		return _current;
+	}
+	/**
+	 * @return The path of the file the counts accumulate in.
+	 */
+	public string path() {
+		return string(pointer<byte>(_table) + _table.pathOffset);
+	}
+	/**
+	 * Record the counts of this image in a set of tables, by source file and line.
+	 *
+	 * A line counts the executions of the most often run basic block that starts a statement on it.
+	 */
+	public void collect(ref<CoverageTables> tables) {
+		long base = image.codeAddress();
+		pointer<byte> lastFile;
+		string filename;
+		for (int i = 0; i < _table.locationCount; i++) {
+			pointer<byte> file;
+			int lineNumber;
+			(file, lineNumber) = image.getRawSourceLocation(base + _locations[2 * i]);
+			if (file == null)
+				continue;
+			if (file != lastFile) {
+				lastFile = file;
+				filename = storage.makeCompactPath(string(file), "./xyz");
+			}
+			tables.record(filename, lineNumber, _counters[_locations[2 * i + 1]]);
+		}
+	}
+	/**
+	 * Merge the counts into the accumulating file and write the report.
+	 *
+	 * Only the first call writes anything. Processes writing the same file take turns, so a test
+	 * suite can run many covered processes at once.
+	 */
+	public void write() {
+		lock (_lock) {
+			if (_written)
+				return;
+			_written = true;
+			string filename = path();
+			int lockFd = -1;
+			if (compileTarget == Target.X86_64_LNX) {
+				string lockPath = filename + ".lock";
+				lockFd = linux.open(lockPath.c_str(), linux.O_RDWR|linux.O_CREATE|linux.O_CLOEXEC, 0644);
+				if (lockFd >= 0)
+					linux.flock(lockFd, linux.LOCK_EX);
+			}
+			CoverageTables run;
+			collect(&run);
+			CoverageTables accumulated;
+			accumulated.read(filename);
+			accumulated.add(&run);
+			if (!accumulated.write(filename))
+				printf("Could not write coverage to %s\n", filename);
+			else if (!accumulated.writeReport(filename + ".report"))
+				printf("Could not write coverage report to %s.report\n", filename);
+			if (lockFd >= 0)
+				linux.close(lockFd);
+		}
 	}
 }
-/** @ignore */
+/**
+ * Execution counts by source file and line.
+ *
+ * The accumulating file written by covered images has one line for each instrumented source line:
+ * the filename, the line number and the count, separated by tabs.
+ */
 public class CoverageTables {
+	private ref<CoverageFile>[string] _files;
+	private string _lastFilename;				// Consecutive lookups are nearly always for the same file
+	private ref<CoverageFile> _lastFile;
+
+	~CoverageTables() {
+		for (key in _files)
+			delete _files[key];
+	}
+	/**
+	 * Record a count for a source line. If the line already has a larger count, it is kept.
+	 */
+	public void record(string filename, int lineNumber, long count) {
+		pointer<long> c = file(filename).line(lineNumber);
+		if (*c < count)
+			*c = count;
+	}
+	/**
+	 * Add the counts of another set of tables to these.
+	 */
+	public void add(ref<CoverageTables> other) {
+		for (key in other._files) {
+			ref<CoverageFile> f = other._files[key];
+			ref<CoverageFile> target = file(key);
+			for (i in f.counts)
+				if (f.counts[i] >= 0)
+					*target.line(i) += f.counts[i];
+		}
+	}
+	/**
+	 * Read an accumulating file into these tables, adding its counts. A missing file is empty.
+	 *
+	 * @return true if the file did not exist or was read successfully, false if it was malformed.
+	 */
+	public boolean read(string path) {
+		if (!storage.exists(path))
+			return true;
+		ref<Reader> r = storage.openTextFile(path);
+		if (r == null)
+			return false;
+		string content = r.readAll();
+		delete r;
+		boolean success = true;
+		string[] lines = content.split('\n');
+		for (i in lines) {
+			if (lines[i].length() == 0)
+				continue;
+			string[] fields = lines[i].split('\t');
+			if (fields.length() != 3) {
+				success = false;
+				continue;
+			}
+			long lineNumber, count;
+			boolean lineOk, countOk;
+			(lineNumber, lineOk) = long.parse(fields[1]);
+			(count, countOk) = long.parse(fields[2]);
+			if (!lineOk || !countOk || lineNumber < 0 || count < 0) {
+				success = false;
+				continue;
+			}
+			*file(fields[0]).line(int(lineNumber)) += count;
+		}
+		return success;
+	}
+	/**
+	 * Write these tables as an accumulating file.
+	 */
+	public boolean write(string path) {
+		ref<Writer> w = storage.createTextFile(path);
+		if (w == null)
+			return false;
+		string[] filenames = sortedFilenames();
+		for (i in filenames) {
+			ref<CoverageFile> f = _files[filenames[i]];
+			for (j in f.counts)
+				if (f.counts[j] >= 0)
+					w.printf("%s\t%d\t%d\n", filenames[i], j, f.counts[j]);
+		}
+		delete w;
+		return true;
+	}
+	/**
+	 * Write a report of the lines run at least once in each file, followed by the lines of
+	 * each file that never ran.
+	 */
+	public boolean writeReport(string path) {
+		ref<Writer> w = storage.createTextFile(path);
+		if (w == null)
+			return false;
+		string[] filenames = sortedFilenames();
+		long totalLines, totalCovered;
+		for (i in filenames) {
+			int lines, covered;
+			(lines, covered) = _files[filenames[i]].summary();
+			totalLines += lines;
+			totalCovered += covered;
+		}
+		// As with the profile report, only plain integers are formatted.
+		w.printf("%d of %d lines covered (%s) in %d files\n\n", totalCovered, totalLines,
+							percentage(totalCovered, totalLines), filenames.length());
+		w.printf("%10s %10s %7s  %s\n", "lines", "covered", "", "file");
+		for (i in filenames) {
+			int lines, covered;
+			(lines, covered) = _files[filenames[i]].summary();
+			w.printf("%10d %10d %7s  %s\n", lines, covered, percentage(covered, lines), filenames[i]);
+		}
+		for (i in filenames) {
+			string missed = _files[filenames[i]].missedLines();
+			if (missed.length() > 0)
+				w.printf("\n%s not covered: %s\n", filenames[i], missed);
+		}
+		delete w;
+		return true;
+	}
+	/**
+	 * @return The number of instrumented lines in the file, or 0 if it has none.
+	 * @return The number of those lines run at least once.
+	 */
+	public int, int summary(string filename) {
+		if (!_files.contains(filename))
+			return 0, 0;
+		return _files[filename].summary();
+	}
+	/**
+	 * @return The count for a source line, or -1 if the line is not instrumented.
+	 */
+	public long count(string filename, int lineNumber) {
+		if (!_files.contains(filename))
+			return -1;
+		ref<CoverageFile> f = _files[filename];
+		if (lineNumber >= f.counts.length())
+			return -1;
+		return f.counts[lineNumber];
+	}
+
+	private ref<CoverageFile> file(string filename) {
+		if (_lastFile != null && filename == _lastFilename)
+			return _lastFile;
+		ref<CoverageFile> f;
+		if (_files.contains(filename))
+			f = _files[filename];
+		else {
+			f = new CoverageFile;
+			_files[filename] = f;
+		}
+		_lastFilename = filename;
+		_lastFile = f;
+		return f;
+	}
+
+	private string[] sortedFilenames() {
+		string[] filenames;
+		for (key in _files)
+			filenames.append(key);
+		filenames.sort();
+		return filenames;
+	}
+}
+
+class CoverageFile {
+	long[] counts;					// Indexed by line number, -1 for lines that are not instrumented.
+
+	pointer<long> line(int lineNumber) {
+		if (lineNumber >= counts.length()) {
+			int i = counts.length();
+			counts.resize(lineNumber + 1);
+			for (; i < counts.length(); i++)
+				counts[i] = -1;
+		}
+		if (counts[lineNumber] < 0)
+			counts[lineNumber] = 0;
+		return &counts[lineNumber];
+	}
+
+	int, int summary() {
+		int lines, covered;
+		for (i in counts)
+			if (counts[i] >= 0) {
+				lines++;
+				if (counts[i] > 0)
+					covered++;
+			}
+		return lines, covered;
+	}
+
+	string missedLines() {
+		string result;
+		int first = -1;
+		int last;
+		for (i in counts) {
+			if (counts[i] == 0) {
+				if (first < 0)
+					first = i;
+				last = i;
+			} else if (counts[i] > 0 && first >= 0) {
+				appendRange(&result, first, last);
+				first = -1;
+			}
+		}
+		if (first >= 0)
+			appendRange(&result, first, last);
+		return result;
+	}
+
+	private static void appendRange(ref<string> result, int first, int last) {
+		if (result.length() > 0)
+			result.append(", ");
+		if (first == last)
+			result.printf("%d", first);
+		else
+			result.printf("%d-%d", first, last);
+	}
 }
 /**
  * Return a text stack trace for the code location of the call to this function.
@@ -580,27 +1556,67 @@ public string stackTrace() {
  * @return The stack trace of the current running thread.
  */
 public string stackTrace(int skipFrames) {
-	string output;
-	long lowCode = image.codeAddress();
-	address ip = returnAddress();
-	address frame = framePointer();
-	address top = stackTop();
-	if (long(frame) > long(top))
-		return output;		
-	while (frame != null) {
-		pointer<address> lastFrame = pointer<address>(frame);
-		frame = lastFrame[0];
+	StackTrace trace;
+	trace.capture(skipFrames + 1);
+	return trace.text();
+}
+/**
+ * The return addresses of the frames on a thread's stack.
+ *
+ * Capturing a trace only records the return addresses. They are turned into source locations
+ * only when the text of the trace is requested, so code that captures traces that it seldom prints
+ * does not pay for symbolizing them.
+ */
+public class StackTrace {
+	private long[] _returnAddresses;
+	/**
+	 * Capture the stack of the calling thread, replacing any previously captured frames.
+	 *
+	 * @param skipFrames Skip that many frames. If the value is zero, all frames, starting with
+	 * the caller, are included. A value of 1 will exclude the caller's frame, and so on.
+	 */
+	public void capture(int skipFrames) {
+		_returnAddresses.clear();
+		address frame = framePointer();
+		address top = stackTop();
 		if (long(frame) > long(top))
-			break;		
-		ip = lastFrame[1];
-		int relative = int(long(ip) - lowCode);
-		string locationLabel = image.formattedLocation(long(ip) - 1, relative);
-		if (skipFrames <= 0)
-			output.printf("%s\n", locationLabel);
-		else
-			skipFrames--;
+			return;
+		while (frame != null) {
+			pointer<address> lastFrame = pointer<address>(frame);
+			frame = lastFrame[0];
+			if (long(frame) > long(top))
+				break;
+			if (skipFrames <= 0)
+				_returnAddresses.append(long(lastFrame[1]));
+			else
+				skipFrames--;
+		}
+	}
+	/**
+	 * @return The number of frames captured.
+	 */
+	public int length() {
+		return _returnAddresses.length();
+	}
+	/**
+	 * @param index The index of a frame, with the innermost frame at index zero.
+	 *
+	 * @return The return address of that frame.
+	 */
+	public long returnAddress(int index) {
+		return _returnAddresses[index];
+	}
+	/**
+	 * Compose the text of the trace.
+	 *
+	 * @return The source location of each frame, innermost first, one per line.
+	 */
+	public string text() {
+		string output;
+		for (i in _returnAddresses)
+			output.printf("%s\n", image.formattedReturnLocation(_returnAddresses[i]));
+		return output;
 	}
-	return output;
 }
 /**
  * A Virtual Hardware Stack.
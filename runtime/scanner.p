@@ -19,7 +19,6 @@ import parasol:context;
 import parasol:runtime;
 import parasol:storage;
 import parasol:text;
-import parasol:stream.EOF;
 import parasol:unicode;
 
 public enum Token {
@@ -158,8 +157,14 @@ public enum Token {
 	MAX_TOKEN //= EMPTY
 }
 
+/*
+ * Bytes are taken from spans borrowed from the FileReader's buffer, so the Reader is only called once per buffer.
+ */
 class FileScanner extends Scanner {
 	private ref<storage.FileReader> _file;
+	private pointer<byte> _next;			// The next byte of the borrowed span
+	private int _available;					// The bytes left in the borrowed span
+	private int _borrowed;					// The length of the borrowed span
 	
 	public FileScanner(ref<Unit> fileInfo) {
 		super(0, fileInfo);
@@ -171,17 +176,23 @@ class FileScanner extends Scanner {
 	}
 	
 	int getByte() {
-		if (_file == null)
-			return -1;			// Should be a throw, maybe?
-		int b = _file.read();
-		if (b != EOF)
-			return b;
-		else
-			return -1;
+		if (_available == 0) {
+			if (_file == null)
+				return -1;			// Should be a throw, maybe?
+			_file.consume(_borrowed);
+			substring span = _file.peek();
+			_borrowed = _available = span.length();
+			if (_available == 0)
+				return -1;
+			_next = span.c_str();
+		}
+		_available--;
+		return *_next++;
 	}
 
 	public void seek(SourceOffset location) {
 		_file.seek(location, storage.Seek.START);
+		_available = _borrowed = 0;
 		super.seek(location);
 	}
 
@@ -192,6 +203,7 @@ class FileScanner extends Scanner {
 	public void close() {
 		delete _file;
 		_file = null;
+		_available = _borrowed = 0;
 	}	
 }
 
@@ -240,6 +252,7 @@ public class Scanner {
 	private boolean _utfError;
 	private boolean _paradoc;			// Parse paradoc doclet's and make them available to the parser.
 	private ref<Doclet> _doclet;		// The last successfully parsed doclet during a scan.
+	private ref<CompileTimings> _timings;
 	/*
 	 * Location of the last token read.
 	 */
@@ -327,6 +340,12 @@ public class Scanner {
 	public void restoreSemiColonElision(boolean priorState) {
 		_enableSemiColonElision = priorState;
 	}
+	/**
+	 * @param timings If not null, the time spent reading tokens is charged to {@link CompilePhase.SCAN}.
+	 */
+	public void setTimings(ref<CompileTimings> timings) {
+		_timings = timings;
+	}
 
 	public boolean opened() {
 		return true;
@@ -344,7 +363,12 @@ public class Scanner {
 			_location = e.location;
 			return e.token;
 		}
-		t = nextToken();
+		if (_timings != null) {
+			_timings.enter(CompilePhase.SCAN);
+			t = nextToken();
+			_timings.exit();
+		} else
+			t = nextToken();
 		if (_possiblyElidedSemiLocation != SourceOffset.MIN_VALUE) {
 			if (isElidedSemicolon(_lastToken, t)) {
 				pushBack(t);
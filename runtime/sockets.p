@@ -220,6 +220,16 @@ public class in6_addr {
 
 public class socklen_t = unsigned;
 
+public class msghdr {
+	public address msg_name;
+	public socklen_t msg_namelen;
+	public address msg_iov;				// An array of msg_iovlen linux.iovec objects
+	public long msg_iovlen;
+	public address msg_control;
+	public long msg_controllen;
+	public int msg_flags;
+}
+
 // Note: there is only one C function, but the most convenient way to get some semblance of type-safety (that is restricting
 // the function calls to one of the sockaddr types) is to overload the various allowed signatures.
 @Windows("ws2_32.dll", "accept")
@@ -328,6 +338,9 @@ public abstract int recv(int fd, pointer<byte> buf, int len, int recvflags);
 @Linux("libc.so.6", "send")
 public abstract int send(int fd, pointer<byte> buf, int len, int sendflags);
 
+@Linux("libc.so.6", "sendmsg")
+public abstract long sendmsg(int fd, ref<msghdr> msg, int sendflags);
+
 @Windows("ws2_32.dll", "WSAGetLastError")
 public abstract int WSAGetLastError();
 
@@ -355,6 +368,20 @@ public class WSADATA {
 public int SOL_SOCKET = 1;
 @Constant
 public int SO_REUSEADDR = 2;
+@Constant
+public int SO_SNDBUF = 7;
+@Constant
+public int SO_RCVBUF = 8;
+@Constant
+public int SO_REUSEPORT = 15;
+
+@Constant
+public int TCP_NODELAY = 1;
+
+@Constant
+public int MSG_DONTWAIT = 0x40;
+@Constant
+public int MSG_NOSIGNAL = 0x4000;
 
 @Constant
 public unsigned INADDR_ANY = 0;
@@ -315,6 +315,106 @@ public long, boolean size(string filename) {
 	}
 	return -1, false;
 }
+/**
+ * A hash of a sequence of bytes, computed incrementally.
+ *
+ * The hash is the 64-bit FNV-1a hash of the bytes. It is meant for telling whether the contents of
+ * a file have changed, for example to decide whether a build step can be skipped. It is not a
+ * cryptographic hash and must not be used where someone could choose the content to force a collision.
+ */
+public class ContentHash {
+	private long _value;
+
+	@Constant
+	private static long OFFSET_BASIS = 0xcbf29ce484222325;
+	@Constant
+	private static long PRIME = 0x100000001b3;
+
+	public ContentHash() {
+		_value = OFFSET_BASIS;
+	}
+	/**
+	 * Add bytes to the hash.
+	 *
+	 * @param data The address of the first byte.
+	 * @param length The number of bytes.
+	 */
+	public void add(address data, long length) {
+		pointer<byte> b = pointer<byte>(data);
+		long h = _value;
+		for (long i = 0; i < length; i++) {
+			h ^= b[i];
+			h *= PRIME;
+		}
+		_value = h;
+	}
+	/**
+	 * Add the bytes of a string to the hash.
+	 *
+	 * A string is followed by a zero byte, so that adding "ab" then "c" is different from adding "a"
+	 * then "bc".
+	 *
+	 * @param s The string.
+	 */
+	public void add(string s) {
+		if (s != null)
+			add(&s[0], s.length());
+		byte zero;
+		add(&zero, 1);
+	}
+	/**
+	 * Add a long to the hash, as 8 bytes.
+	 *
+	 * @param x The value to add.
+	 */
+	public void add(long x) {
+		add(&x, long.bytes);
+	}
+	/**
+	 * @return The hash of the bytes added so far.
+	 */
+	public long value() {
+		return _value;
+	}
+	/**
+	 * @return The hash of the bytes added so far, as 16 hexadecimal digits.
+	 */
+	public string toString() {
+		string s;
+		s.printf("%16.16x", _value);
+		return s;
+	}
+}
+/**
+ * Compute a hash of the contents of a file.
+ *
+ * @param filename The path of the file.
+ *
+ * @return The {@link ContentHash} value of the bytes of the file. If the file could not be read, zero.
+ *
+ * @return true if the file could be read, false otherwise.
+ */
+public long, boolean contentHash(string filename) {
+	File f;
+
+	if (!f.open(filename))
+		return 0, false;
+	ContentHash hash;
+	byte[] buffer;
+	buffer.resize(65536);
+	for (;;) {
+		long n = f.read(&buffer[0], buffer.length());
+		if (n < 0) {
+			f.close();
+			return 0, false;
+		}
+		if (n == 0)
+			break;
+		hash.add(&buffer[0], n);
+	}
+	f.close();
+	return hash.value(), true;
+}
 /**
  * Check whether any files under a path are newer than some reference time.
  *
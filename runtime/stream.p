@@ -99,6 +99,7 @@ public int EOF = -1;
  * one optimized for the specific source of the Reader.
  */
 public class Reader {
+	private byte _peeked;
 	/**
 	 * Read the next byte from the input stream.
 	 *
@@ -248,6 +249,82 @@ public class Reader {
 			line.append(byte(c));
 		}
 	}
+	/**
+	 * Borrow the bytes at the current position of the Reader without consuming them.
+	 *
+	 * The bytes belong to the Reader. They remain valid until the next call to a method of
+	 * the Reader other than {@link consume}.
+	 *
+	 * The default implementation returns a single byte. Readers that hold their data in memory
+	 * return as much of it as they can, so that a caller can scan the input without a call per byte.
+	 *
+	 * @return The bytes available at the current position. The span is empty only at end-of-file.
+	 *
+	 * @exception parasol:exception.IOException Thrown if any error condition was encountered reading from the stream.
+	 */
+	public substring peek() {
+		int c = _read();
+		if (c == EOF)
+			return substring();
+		unread();
+		_peeked = byte(c);
+		return substring(pointer<byte>(&_peeked), 1);
+	}
+	/**
+	 * Consume bytes returned by {@link peek}.
+	 *
+	 * @param count The number of bytes to consume. It must not be more than the length of the span
+	 * returned by the last call to {@link peek}.
+	 *
+	 * @exception parasol:exception.IOException Thrown if any error condition was encountered reading from the stream.
+	 */
+	public void consume(int count) {
+		for (int i = 0; i < count; i++)
+			_read();
+	}
+	/**
+	 * Read a line of text using {@link peek} and {@link consume}.
+	 *
+	 * Readers that override peek to return more than one byte at a time use this to implement
+	 * {@link readLine}. The result is the same as that of the default implementation.
+	 *
+	 * @exception parasol:exception.IOException Thrown if any error condition was encountered reading from the stream.
+	 */
+	protected string readLineFromSpans() {
+		string line = "";
+
+		for (;;) {
+			substring span = peek();
+			if (span.length() == 0) {
+				if (line.length() == 0)
+					return null;
+				else
+					return line;
+			}
+			pointer<byte> data = span.c_str();
+			pointer<byte> newline = C.memchr(data, '\n', span.length());
+			int i = newline != null ? int(newline - data) : span.length();
+			int start = 0;
+			for (;;) {
+				pointer<byte> cr = C.memchr(data + start, '\r', i - start);
+				if (cr == null)
+					break;
+				line.append(substring(data + start, int(cr - data) - start));
+				start = int(cr - data) + 1;
+			}
+			if (newline != null && start == 0 && line.length() == 0) {
+				string result(data, i);
+				consume(i + 1);
+				return result;
+			}
+			line.append(substring(data + start, i - start));
+			if (newline != null) {
+				consume(i + 1);
+				return line;
+			}
+			consume(i);
+		}
+	}
 	/**
 	 * Close any external connection associated with the Reader and rekease
 	 * any buffered data held by the Reader.
@@ -353,6 +430,31 @@ public class BufferReader extends Reader {
 			--_index;
 	}
 
+	public long read(address buffer, long length) {
+		if (length > _length - _index)
+			length = _length - _index;
+		C.memcpy(buffer, _buffer + _index, length);
+		_index += length;
+		return length;
+	}
+
+	public string readLine() {
+		return readLineFromSpans();
+	}
+
+	public substring peek() {
+		if (_index >= _length)
+			return substring();
+		long n = _length - _index;
+		if (n > int.MAX_VALUE)
+			n = int.MAX_VALUE;
+		return substring(_buffer + _index, int(n));
+	}
+
+	public void consume(int count) {
+		_index += count;
+	}
+
 	public boolean hasLength() {
 		return true;
 	}
@@ -1419,6 +1419,31 @@ public class SubstringReader extends Reader {
 			--_cursor;
 	}
 
+	public long read(address buffer, long length) {
+		int remaining = _source.length() - _cursor;
+		if (length > remaining)
+			length = remaining;
+		if (length > 0) {
+			C.memcpy(buffer, _source.c_str() + _cursor, length);
+			_cursor += int(length);
+		}
+		return length;
+	}
+
+	public string readLine() {
+		return readLineFromSpans();
+	}
+
+	public substring peek() {
+		if (_cursor >= _source.length())
+			return substring();
+		return substring(_source.c_str() + _cursor, _source.length() - _cursor);
+	}
+
+	public void consume(int count) {
+		_cursor += count;
+	}
+
 	public boolean hasLength() {
 		return true;
 	}
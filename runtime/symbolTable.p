@@ -903,6 +903,8 @@ public class ParameterScope extends Scope {
 	public ref<FunctionType> type;	
 	public address value;				// scratch area for use by code generators
 	public boolean nativeBinding;		// true if this is an nativebinding-annotated external function
+	public ref<Node> inlineExpression;	// the expression that replaces a call to this function, if any
+	public boolean inlineChecked;		// true once the body has been examined for inlineExpression
 	
 	public ParameterScope(ref<Scope> enclosing, ref<Node> definition, Kind kind) {
 		super(enclosing, definition, 
@@ -1836,6 +1838,24 @@ public class Scope {
 	}
 
 	protected void visitAll(ref<Target> target, int offset, ref<CompileContext> compileContext) {
+		if (_storageClass == StorageClass.AUTO) {
+			// Lay out locals from the most strictly aligned to the least, so that small ones pack together
+			// without padding.
+			ref<Symbol>[] locals;
+			for (i in _symbols) {
+				ref<Symbol> sym = _symbols[i];
+				if (sym.class == PlainSymbol) {
+					ref<Type> type = sym.assignType(compileContext);
+					if (type != null)
+						type.assignSize(target, compileContext);
+				}
+				locals.append(sym);
+			}
+			locals.sort(compareLocalAlignment, false);
+			for (i in locals)
+				target.assignStorageToObject(locals[i], this, offset, compileContext);
+			return;
+		}
 		for (i in _symbols) {
 			ref<Symbol> sym = _symbols[i];
 			target.assignStorageToObject(sym, this, offset, compileContext);
@@ -2045,6 +2065,22 @@ public class Scope {
 		return 0;
 	}
 	
+	private static int compareLocalAlignment(ref<Symbol> a, ref<Symbol> b) {
+		int difference = localAlignment(a) - localAlignment(b);
+		if (difference != 0)
+			return difference;
+		// Keep the order stable from one compile to the next.
+		substring aName = a.name();
+		substring bName = b.name();
+		return aName.compare(&bName);
+	}
+
+	private static int localAlignment(ref<Symbol> sym) {
+		if (sym.class != PlainSymbol || sym.type() == null)
+			return 0;
+		return sym.type().alignment();
+	}
+
 	public int maximumAlignment() {
 		int max = 1;
 		for (ref<Symbol>[SymbolKey].iterator i = _symbols.begin(); i.hasNext(); i.next()) {
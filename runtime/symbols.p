@@ -618,7 +618,7 @@ public class StubOverload extends OverloadInstance {
 
 	public ref<Type> assignThisType(ref<CompileContext> compileContext) {
 		if (_type == null) {
-			ref<Type>[] returns = [ compileContext.builtInType(TypeFamily.STRING) ];
+			ref<Type>[] returns = [ compileContext.builtInType(TypeFamily.BOOLEAN) ];
 			ref<ClassType> rpcStubParams = compileContext.getClassType("rpc.StubParams");
 			ref<Type>[] parameters = [ _interfaceType, compileContext.newRef(rpcStubParams) ];
 
@@ -275,6 +275,7 @@ public class SyntaxTree {
 			scanner = file.scanner();
 		if (scanner.opened()) {
 			_scanner = scanner;
+			_scanner.setTimings(compileContext.timings);
 			Parser parser(this, _scanner);
 			_root = parser.parseFile();
 		} else {
@@ -3461,11 +3462,15 @@ public class Node {
 	Node(Operator op, SourceOffset location) {
 		_op = op;
 		_location = location;
+		if (timedCompiles > 0)
+			thread.fetchAdd(&nodesCreated, 1);
 	}
 
 	protected Node(byte register, ref<Type> type) {
 		this.register = register;
 		this.type = type;
+		if (timedCompiles > 0)
+			thread.fetchAdd(&nodesCreated, 1);
 	}
 	
 	public Operator op() { 
@@ -30,12 +30,15 @@ public class CodegenContext {
 	private memory.StartingHeap _startingHeap;
 	private string _profilePath;
 	private string _coveragePath;
+	private string _allocationProfilePath;
 
-	CodegenContext(boolean verbose, memory.StartingHeap startingHeap, string profilePath, string coveragePath) {
+	CodegenContext(boolean verbose, memory.StartingHeap startingHeap, string profilePath, string coveragePath,
+				   string allocationProfilePath) {
 		_verbose = verbose;
 		_startingHeap = startingHeap;
 		_profilePath = profilePath;
 		_coveragePath = coveragePath;
+		_allocationProfilePath = allocationProfilePath;
 	}
 
 	public boolean verbose() {
@@ -50,13 +53,17 @@ public class CodegenContext {
 		return _startingHeap;
 	}
 
-	string profilePath() {
+	public string profilePath() {
 		return _profilePath;
 	}
 
-	string coveragePath() {
+	public string coveragePath() {
 		return _coveragePath;
 	}
+
+	public string allocationProfilePath() {
+		return _allocationProfilePath;
+	}
 }
 
 /**
@@ -162,6 +169,14 @@ public class Target {
 	public abstract int, boolean run(string[] args);
 
 	public abstract void writePxi(ref<Pxi> output);
+	/*
+	 * Write the target as an image prelinked to run at the given base address.
+	 *
+	 * Returns false if the target cannot produce a prelinked image.
+	 */
+	public boolean writePrelinkedPxi(ref<Pxi> output, long baseAddress) {
+		return false;
+	}
 
 	public abstract runtime.Target sectionType();
 	
@@ -2478,11 +2478,16 @@ class String<class T> {
 				return;
 			}
 		}
-		ref<allocation> a = ref<allocation>(memory.alloc(newSize));
+		// Only the bytes that are not copied from the old contents need to be cleared.
+		ref<allocation> a = ref<allocation>(memory.allocUninitialized(newSize));
+		long copied = 0;
 		if (_contents != null) {
-			C.memcpy(&a.data, &_contents.data, (_contents.length + 1) * T.bytes);
+			copied = (_contents.length + 1) * T.bytes;
+			C.memcpy(&a.data, &_contents.data, copied);
 			memory.free(_contents);
 		}
+		long cleared = newSize - (pointer<byte>(&a.data) - pointer<byte>(a)) - copied;
+		C.memset(pointer<byte>(&a.data) + copied, 0, cleared);
 		a.length = newLength;
 		*(pointer<T>(&a.data) + newLength) = 0;
 		_contents = a;
@@ -2646,6 +2651,31 @@ public class StringReader extends Reader {
 			--_cursor;
 	}
 
+	public long read(address buffer, long length) {
+		int remaining = _source.length() - _cursor;
+		if (length > remaining)
+			length = remaining;
+		if (length > 0) {
+			C.memcpy(buffer, &(*_source)[_cursor], length);
+			_cursor += int(length);
+		}
+		return length;
+	}
+
+	public string readLine() {
+		return readLineFromSpans();
+	}
+
+	public substring peek() {
+		if (_cursor >= _source.length())
+			return substring();
+		return substring(&(*_source)[_cursor], _source.length() - _cursor);
+	}
+
+	public void consume(int count) {
+		_cursor += count;
+	}
+
 	public boolean hasLength() {
 		return true;
 	}
@@ -36,11 +36,14 @@ import native:windows.WAIT_FAILED;
 import native:windows.WAIT_TIMEOUT;
 import native:windows.INFINITE;
 import native:windows.GetLastError;
+import native:windows.GetModuleHandle;
+import native:windows.GetProcAddress;
 import native:linux;
 import native:C;
 import parasol:exception;
 import parasol:exception.IllegalArgumentException;
 import parasol:exception.IllegalOperationException;
+import parasol:memory;
 import parasol:runtime;
 import parasol:process;
 import parasol:international.Locale;
@@ -132,7 +135,6 @@ public int cpuCount() {
 public class Thread {
 	public ref<Locale> locale;
 	public ref<runtime.Profiler> profiler;
-	public ref<runtime.Coverage> coverage;
 	private string _name;
 	private HANDLE _threadHandle;
 	private linux.pthread_t _threadId;
@@ -141,6 +143,8 @@ public class Thread {
 	private address _parameter;
 	private address _context;
 	int _index;
+	address _pool;				// The ThreadPool this thread works for, if any
+	address _workDeque;			// The thread's work queue in that pool
 	/**
 	 * The default constructor.
 	 *
@@ -193,6 +197,7 @@ public class Thread {
 	 * Initialize a Thread object for the 'main' thread of the process.
 	 */
 	public static void init() {
+		resolveAtomics();
 		mainThread = new Thread();
 		mainThread._name = "TID-" + getCurrentThreadId();
 		if (runtime.compileTarget == runtime.Target.X86_64_WIN)
@@ -291,6 +296,7 @@ public class Thread {
 	 */
 	private static void nested(ref<Thread> t) {
 		enterThread(t._context, pointer<byte>(&t) + 32);
+		memory.threadStarted();
 		threads.enlist(t);
 		runtime.setParasolThread(t);
 		t.initializeInstrumentation();
@@ -301,13 +307,34 @@ public class Thread {
 		}
 		t.checkpointInstrumentation();
 		threads.delist(t);
+		memory.threadFinished();
 		exitThread();
 	}
 
 	private void initializeInstrumentation() {
+		ref<runtime.ProfileTables> tables = runtime.ProfileTables.current();
+		if (tables != null)
+			profiler = tables.startProfiler();
 	}
 
 	private void checkpointInstrumentation() {
+		ref<runtime.ProfileTables> tables = runtime.ProfileTables.current();
+		if (tables != null) {
+			if (profiler != null) {
+				tables.finishProfiler(profiler);
+				profiler = null;
+			}
+			if (this == mainThread)
+				tables.write();
+		}
+		if (this == mainThread) {
+			ref<runtime.Coverage> coverage = runtime.Coverage.current();
+			if (coverage != null)
+				coverage.write();
+			ref<memory.AllocationProfiler> allocationProfiler = memory.allocationProfiler();
+			if (allocationProfiler != null)
+				allocationProfiler.write();
+		}
 	}
 	/**
 	 * Suspend this Thread.
@@ -677,30 +704,19 @@ public class RefCounted extends RefCountedBase {
 	 * Add a reference to an object.
 	 */
 	public void refer() {
-		lock(*this) {
-			_refCount++;
-		}
+		fetchAdd(&_refCount, 1);
 	}
 	/**
 	 * This method may delete the object being called, so never count on the object being
 	 * alive after a call to release.
 	 */
 	public void release() {
-		boolean timeToDelete;
-
-		lock (*this) {
-			_refCount--;
-			if (_refCount < 0)
-				timeToDelete = true;
-		}
-		if (timeToDelete)
+		if (fetchAdd(&_refCount, -1) == 0)
 			delete this;
 	}
 
 	public int references() {
-		lock (*this) {
-			return _refCount + 1;
-		}
+		return atomicLoad(&_refCount) + 1;
 	}
 }
 /*
@@ -775,33 +791,301 @@ monitor class Derived extends BaseMost {
 Here, the notify, etc methods would have to mask any defined in the BaseMost class, but otherwise allow
 visible members from BaseMost to be accessed through anywhere in Derived and any other classes that extend it.
  */
+/*
+ * The atomic operations are implemented in libparasol. They are looked up when the first Thread is
+ * initialized, rather than bound like other natives, so that this file still loads with an older
+ * libparasol. With an older library each operation takes a single process-wide lock instead, and a
+ * warning is written to stderr when the lookup fails.
+ */
+private int(ref<int>) nativeLoad32;
+private long(ref<long>) nativeLoad64;
+private void(ref<int>, int) nativeStore32;
+private void(ref<long>, long) nativeStore64;
+private int(ref<int>, int, int) nativeCompareAndSwap32;
+private long(ref<long>, long, long) nativeCompareAndSwap64;
+private int(ref<int>, int) nativeFetchAdd32;
+private long(ref<long>, long) nativeFetchAdd64;
+private int(ref<int>, int) nativeExchange32;
+private long(ref<long>, long) nativeExchange64;
+private void() nativeFence;
+private linux.pthread_mutex_t emulationLock;		// All zeros is PTHREAD_MUTEX_INITIALIZER
+
+private void resolveAtomics() {
+	if (nativeFence != null)
+		return;
+	nativeLoad32 = int(ref<int>)(atomicFunction("atomicLoad32"));
+	nativeLoad64 = long(ref<long>)(atomicFunction("atomicLoad64"));
+	nativeStore32 = void(ref<int>, int)(atomicFunction("atomicStore32"));
+	nativeStore64 = void(ref<long>, long)(atomicFunction("atomicStore64"));
+	nativeCompareAndSwap32 = int(ref<int>, int, int)(atomicFunction("atomicCompareAndSwap32"));
+	nativeCompareAndSwap64 = long(ref<long>, long, long)(atomicFunction("atomicCompareAndSwap64"));
+	nativeFetchAdd32 = int(ref<int>, int)(atomicFunction("atomicFetchAdd32"));
+	nativeFetchAdd64 = long(ref<long>, long)(atomicFunction("atomicFetchAdd64"));
+	nativeExchange32 = int(ref<int>, int)(atomicFunction("atomicExchange32"));
+	nativeExchange64 = long(ref<long>, long)(atomicFunction("atomicExchange64"));
+	address fence = atomicFunction("atomicFence");
+	if (nativeLoad32 == null || nativeLoad64 == null || nativeStore32 == null || nativeStore64 == null ||
+		nativeCompareAndSwap32 == null || nativeCompareAndSwap64 == null || nativeFetchAdd32 == null ||
+		nativeFetchAdd64 == null || nativeExchange32 == null || nativeExchange64 == null || fence == null) {
+		nativeLoad32 = null;
+		nativeLoad64 = null;
+		nativeStore32 = null;
+		nativeStore64 = null;
+		nativeCompareAndSwap32 = null;
+		nativeCompareAndSwap64 = null;
+		nativeFetchAdd32 = null;
+		nativeFetchAdd64 = null;
+		nativeExchange32 = null;
+		nativeExchange64 = null;
+		if (runtime.compileTarget == runtime.Target.X86_64_LNX) {
+			string message = "warning: libparasol has no atomic operations, each one takes a process-wide lock\n";
+			linux.write(2, &message[0], message.length());
+		}
+	} else
+		nativeFence = void()(fence);
+}
+/**
+ * Report whether the atomic operations, and the Mutex under every Monitor, use the processor's atomic
+ * instructions.
+ *
+ * They do unless the libparasol the program runs with is too old to provide them. Then each
+ * operation takes a single process-wide lock.
+ *
+ * @return true if the atomic operations are native, false if they take a process-wide lock.
+ */
+public boolean nativeAtomics() {
+	return nativeFence != null;
+}
+
+private address atomicFunction(string name) {
+	if (runtime.compileTarget == runtime.Target.X86_64_WIN)
+		return GetProcAddress(GetModuleHandle("parasol.dll".c_str()), name.c_str());
+	else if (runtime.compileTarget == runtime.Target.X86_64_LNX)
+		return linux.dlsym(null, name.c_str());
+	else
+		return null;
+}
+
+private void takeEmulationLock() {
+	if (runtime.compileTarget == runtime.Target.X86_64_LNX)
+		linux.pthread_mutex_lock(&emulationLock);
+}
+
+private void releaseEmulationLock() {
+	if (runtime.compileTarget == runtime.Target.X86_64_LNX)
+		linux.pthread_mutex_unlock(&emulationLock);
+}
+/**
+ * Read an int, as an atomic operation.
+ *
+ * This and the other atomic operations are sequentially consistent: every memory access made by the
+ * calling thread before the operation is seen by other threads before any access made after it.
+ *
+ * @param location The int to read.
+ *
+ * @return The value of the int.
+ */
+public int atomicLoad(ref<int> location) {
+	if (nativeLoad32 != null)
+		return nativeLoad32(location);
+	takeEmulationLock();
+	int value = *location;
+	releaseEmulationLock();
+	return value;
+}
+/**
+ * Read a long, as an atomic operation.
+ *
+ * @param location The long to read.
+ *
+ * @return The value of the long.
+ */
+public long atomicLoad(ref<long> location) {
+	if (nativeLoad64 != null)
+		return nativeLoad64(location);
+	takeEmulationLock();
+	long value = *location;
+	releaseEmulationLock();
+	return value;
+}
+/**
+ * Write an int, as an atomic operation.
+ *
+ * @param location The int to write.
+ * @param value The value to store.
+ */
+public void atomicStore(ref<int> location, int value) {
+	if (nativeStore32 != null) {
+		nativeStore32(location, value);
+		return;
+	}
+	takeEmulationLock();
+	*location = value;
+	releaseEmulationLock();
+}
+/**
+ * Write a long, as an atomic operation.
+ *
+ * @param location The long to write.
+ * @param value The value to store.
+ */
+public void atomicStore(ref<long> location, long value) {
+	if (nativeStore64 != null) {
+		nativeStore64(location, value);
+		return;
+	}
+	takeEmulationLock();
+	*location = value;
+	releaseEmulationLock();
+}
+/**
+ * Replace an int if it has an expected value, as an atomic operation.
+ *
+ * @param location The int to change.
+ * @param expected The value the int must have for it to be changed.
+ * @param replacement The new value of the int.
+ *
+ * @return The value of the int before the call. The int was changed if and only if this is equal to expected.
+ */
+public int compareAndSwap(ref<int> location, int expected, int replacement) {
+	if (nativeCompareAndSwap32 != null)
+		return nativeCompareAndSwap32(location, expected, replacement);
+	takeEmulationLock();
+	int prior = *location;
+	if (prior == expected)
+		*location = replacement;
+	releaseEmulationLock();
+	return prior;
+}
+/**
+ * Replace a long if it has an expected value, as an atomic operation.
+ *
+ * @param location The long to change.
+ * @param expected The value the long must have for it to be changed.
+ * @param replacement The new value of the long.
+ *
+ * @return The value of the long before the call. The long was changed if and only if this is equal to expected.
+ */
+public long compareAndSwap(ref<long> location, long expected, long replacement) {
+	if (nativeCompareAndSwap64 != null)
+		return nativeCompareAndSwap64(location, expected, replacement);
+	takeEmulationLock();
+	long prior = *location;
+	if (prior == expected)
+		*location = replacement;
+	releaseEmulationLock();
+	return prior;
+}
+/**
+ * Add to an int, as an atomic operation.
+ *
+ * @param location The int to change.
+ * @param delta The amount to add. This may be negative.
+ *
+ * @return The value of the int before the call.
+ */
+public int fetchAdd(ref<int> location, int delta) {
+	if (nativeFetchAdd32 != null)
+		return nativeFetchAdd32(location, delta);
+	takeEmulationLock();
+	int prior = *location;
+	*location = prior + delta;
+	releaseEmulationLock();
+	return prior;
+}
+/**
+ * Add to a long, as an atomic operation.
+ *
+ * @param location The long to change.
+ * @param delta The amount to add. This may be negative.
+ *
+ * @return The value of the long before the call.
+ */
+public long fetchAdd(ref<long> location, long delta) {
+	if (nativeFetchAdd64 != null)
+		return nativeFetchAdd64(location, delta);
+	takeEmulationLock();
+	long prior = *location;
+	*location = prior + delta;
+	releaseEmulationLock();
+	return prior;
+}
+/**
+ * Replace an int, as an atomic operation.
+ *
+ * @param location The int to change.
+ * @param value The new value of the int.
+ *
+ * @return The value of the int before the call.
+ */
+public int exchange(ref<int> location, int value) {
+	if (nativeExchange32 != null)
+		return nativeExchange32(location, value);
+	takeEmulationLock();
+	int prior = *location;
+	*location = value;
+	releaseEmulationLock();
+	return prior;
+}
+/**
+ * Replace a long, as an atomic operation.
+ *
+ * @param location The long to change.
+ * @param value The new value of the long.
+ *
+ * @return The value of the long before the call.
+ */
+public long exchange(ref<long> location, long value) {
+	if (nativeExchange64 != null)
+		return nativeExchange64(location, value);
+	takeEmulationLock();
+	long prior = *location;
+	*location = value;
+	releaseEmulationLock();
+	return prior;
+}
+/**
+ * A full memory fence.
+ *
+ * Every memory access made by the calling thread before the fence is seen by other threads before
+ * any access made after it.
+ */
+public void fence() {
+	if (nativeFence != null)
+		nativeFence();
+	else {
+		takeEmulationLock();
+		releaseEmulationLock();
+	}
+}
+/*
+ * On Linux, a Mutex is a futex. The _state is 0 when the Mutex is free, 1 when it is held and 2 when it is held
+ * and another thread may be waiting for it. Taking and releasing a Mutex no other thread wants is then a single
+ * atomic operation, with no system call.
+ */
 class Mutex {
 	private int _level;
+	private int _state;
 	private HANDLE _mutex;
 	private ref<Thread> _owner;
-	private linux.pthread_mutex_t _linuxMutex;
+	private linux.pthread_t _ownerId;
 	private static boolean _alreadySet;
 	
 	public Mutex() {
 		if (runtime.compileTarget == runtime.Target.X86_64_WIN) {
 			_mutex = HANDLE(CreateMutex(null, 0, null));
 		} else if (runtime.compileTarget == runtime.Target.X86_64_LNX) {
-			linux.pthread_mutexattr_t attr;
-			linux.pthread_mutexattr_settype(&attr, linux.PTHREAD_MUTEX_RECURSIVE);
 			if (long(this) == long(&threads) + 8) {
 				if (_alreadySet)
 					assert(false);
 				_alreadySet = true;
 			}
-			linux.pthread_mutex_init(&_linuxMutex, &attr);
 		}
 	}
 	
 	~Mutex() {
 		if (runtime.compileTarget == runtime.Target.X86_64_WIN) {
 			CloseHandle(_mutex);
-		} else if (runtime.compileTarget == runtime.Target.X86_64_LNX) {
-			linux.pthread_mutex_destroy(&_linuxMutex);
 		}
 	}
 	
@@ -813,16 +1097,9 @@ class Mutex {
 			else if (code == 0)
 				ReleaseMutex(_mutex);
 			return false;
-		} else if (runtime.compileTarget == runtime.Target.X86_64_LNX) {
-			int result = linux.pthread_mutex_trylock(&_linuxMutex);
-			if (result == 0) {
-				int level = _level;
-				linux.pthread_mutex_unlock(&_linuxMutex);
-				if (level > 0)
-					return true;
-			}
-			return result == linux.EBUSY;
-		} else
+		} else if (runtime.compileTarget == runtime.Target.X86_64_LNX)
+			return atomicLoad(&_state) != 0;
+		else
 			return false;
 	}
 	
@@ -835,13 +1112,7 @@ class Mutex {
 				ReleaseMutex(_mutex);
 			return null;
 		} else if (runtime.compileTarget == runtime.Target.X86_64_LNX) {
-			int result = linux.pthread_mutex_trylock(&_linuxMutex);
-			if (result == 0) {
-				linux.pthread_mutex_unlock(&_linuxMutex);
-				if (_level > 0)
-					return _owner;
-			}
-			if (result == linux.EBUSY)
+			if (atomicLoad(&_state) != 0)
 				return _owner;
 		}
 		return null;
@@ -851,32 +1122,37 @@ class Mutex {
 		if (runtime.compileTarget == runtime.Target.X86_64_WIN) {
 			WaitForSingleObject(_mutex, INFINITE);
 		} else if (runtime.compileTarget == runtime.Target.X86_64_LNX) {
-//			string s;
-//			s.printf("%p try lock by %s (level = %d)\n", this, currentThread() != null ? currentThread().name() : "?", _level);
-//			print(s);
-			int x = linux.pthread_mutex_lock(&_linuxMutex);
-			if (x != 0) {
-				printf("mutex_lock returned %s\n%s", linux.strerror(x), runtime.stackTrace());
-				linux._exit(1);
+			linux.pthread_t me = linux.pthread_self();
+			if (compareAndSwap(&_state, 0, 1) != 0) {
+				// Only this thread ever sets _ownerId to its own id, so this test is safe without the lock.
+				if (_ownerId == me) {
+					_level++;
+					return;
+				}
+				int c = exchange(&_state, 2);
+				while (c != 0) {
+					linux.futexWait(&_state, 2);
+					c = exchange(&_state, 2);
+				}
 			}
+			_ownerId = me;
 		}
 		_level++;
 		_owner = currentThread();
-//		string s;
-//		s.printf("%p take by %s (level = %d)\n", this, _owner != null ? _owner.name() : "?", _level);
-//		print(s);
 	}
 	
 	void release() {
-//		printf("%p release by %s (level = %d)\n", this, _owner.name(), _level);
 		_level--;
 		if (runtime.compileTarget == runtime.Target.X86_64_WIN) {
 			ReleaseMutex(_mutex);
 		} else if (runtime.compileTarget == runtime.Target.X86_64_LNX) {
-			int x = linux.pthread_mutex_unlock(&_linuxMutex);
-			if (x != 0)
-				printf("mutex_unlock returned %d (%s)\n", x, linux.strerror(x));
-			assert(x == 0);
+			if (_level == 0) {
+				_ownerId = null;
+				if (fetchAdd(&_state, -1) != 1) {
+					atomicStore(&_state, 0);
+					linux.futexWake(&_state, 1);
+				}
+			}
 		}
 	}
 	
@@ -894,16 +1170,72 @@ class Mutex {
 }
 
 private class WorkItem<class T> {
-	public ref<WorkItem<T>> next;
 	public ref<Future<T>> result;
 	public T(address) valueGenerator;
 	public address parameter;
 }
+/*
+ * The queue of work items held by one worker thread of a ThreadPool.
+ *
+ * The worker pushes and pops items at the bottom, so it runs the work it queued most recently, whose data is
+ * most likely still in its cache, first. Other workers steal from the top, taking the oldest items, which tend
+ * to be the largest pieces of a divided job. Work queued by threads outside the pool goes into a shared
+ * WorkDeque that the workers only take from the top.
+ *
+ * The guard must be held to change the deque. The _count may be read without it, as a hint.
+ */
+private class WorkDeque<class T> {
+	Monitor guard;
+	ref<ThreadPool<T>> pool;
+	ref<WorkDeque<T>> next;			// The next worker of the pool
+	WorkItem<T>[] _items;			// A ring buffer, its length is zero or a power of two
+	int _top;						// The index of the oldest item
+	int _count;
+	long _seed;
+
+	WorkDeque() {
+	}
+
+	WorkDeque(ref<ThreadPool<T>> pool, int index) {
+		this.pool = pool;
+		_seed = index * 2654435761 + 1;
+	}
+
+	void push(ref<WorkItem<T>> item) {
+		int length = _items.length();
+		if (_count == length) {
+			_items.resize(length == 0 ? 64 : 2 * length);
+			for (int i = 0; i < _top; i++)		// unwrap the ring
+				_items[length + i] = _items[i];
+		}
+		_items[(_top + _count) & (_items.length() - 1)] = *item;
+		_count++;
+	}
+
+	boolean takeNewest(ref<WorkItem<T>> item) {
+		if (_count == 0)
+			return false;
+		_count--;
+		*item = _items[(_top + _count) & (_items.length() - 1)];
+		return true;
+	}
+
+	boolean takeOldest(ref<WorkItem<T>> item) {
+		if (_count == 0)
+			return false;
+		*item = _items[_top];
+		_top = (_top + 1) & (_items.length() - 1);
+		_count--;
+		return true;
+	}
+
+	int random(int n) {
+		_seed = _seed * 6364136223846793005 + 1442695040888963407;
+		return int((_seed >>> 33) % n);
+	}
+}
 
 private monitor class ThreadPoolData<class T> {
-	ref<WorkItem<T>> _first;
-	ref<WorkItem<T>> _last;
-	boolean _shutdownRequested;
 	int _waitingOnIdle;
 }
 /**
@@ -915,16 +1247,28 @@ private monitor class ThreadPoolData<class T> {
  * allocated to doing work at one time. Additional threads will consume more memory and 
  * overhead as well as contention for available CPU's.
  *
- * Calls to the {@link execute} method add work items to the pool, forming a queue. Idle
- * threads each take one work item at a time from the queue and return when that work item
- * is completed.
+ * Calls to the {@link execute} method add work items to the pool. Each thread in the pool keeps
+ * its own queue of work items. Work submitted from outside the pool goes to a shared queue, while
+ * work submitted by a pool thread goes to that thread's own queue and is run newest first. A thread
+ * that runs out of work takes the oldest item from the shared queue, or failing that steals the oldest
+ * item from the queue of another thread, picked at random. Threads only sleep when there is no
+ * work anywhere in the pool.
+ *
+ * The {@link executeAll} methods queue many work items and wake the threads needed to run them with
+ * one call. The {@link parallelFor} method divides a loop among the pool's threads and the caller.
  *
  * @threading ThreadPool objects are thread-safe and can be called from any number of threads.
  */
 public class ThreadPool<class T> extends ThreadPoolData<T> {
 	ref<Thread>[] _threads;
 	Monitor _idleSignal;
-	int _idle;
+	WorkDeque<T> _shared;
+	ref<WorkDeque<T>> _workers;			// A list, new workers are linked at the end
+	int _workerCount;
+	// These are changed with the pool locked, but are read without the lock as hints.
+	boolean _shutdownRequested;
+	int _sleeping;						// Workers waiting for work
+	int _signals;						// Calls to notify not yet answered by a worker
 	/**
 	 * Construct a pool of N threads.
 	 *
@@ -936,6 +1280,11 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 	
 	~ThreadPool() {
 		shutdown();
+		while (_workers != null) {
+			ref<WorkDeque<T>> d = _workers;
+			_workers = d.next;
+			delete d;
+		}
 	}
 	/**
 	 * Shut down all of the threads in the pool.
@@ -943,20 +1292,35 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 	 * Any unstarted work items are cancelled.
 	 */
 	public void shutdown() {
+		stop();
+		for (i in _threads)
+			_threads[i].join();
+		_threads.deleteAll();
+	}
+	/**
+	 * Ask the threads in the pool to stop, without waiting for them.
+	 *
+	 * Any unstarted work items are cancelled. An idle thread exits at once, a busy one when its work item
+	 * finishes. The pool must not be deleted while any of its threads are running, so this is for a pool that
+	 * lasts as long as the process, where a work item that never finishes must not keep the process from exiting.
+	 */
+	public void stop() {
 		lock (*this) {
-			while (_first != null) {
-				ref<WorkItem<T>> wi = _first;
-				_first = wi.next;
-				if (wi.result != null)
-					wi.result.cancel();
-				delete wi;
-			}
 			_shutdownRequested = true;
+			cancelAll(&_shared);
+			for (ref<WorkDeque<T>> d = _workers; d != null; d = d.next)
+				cancelAll(d);
 			notifyAll();
 		}
-		for (i in _threads)
-			_threads[i].join();
-		_threads.deleteAll();
+	}
+
+	private static void cancelAll(ref<WorkDeque<T>> deque) {
+		WorkItem<T> wi;
+		lock (deque.guard) {
+			while (deque.takeOldest(&wi))
+				if (wi.result != null)
+					wi.result.cancel();
+		}
 	}
 	/**
 	 * Wait for all running threads and pending work items to finish.
@@ -967,7 +1331,7 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 	 */
 	public void waitForIdle() {
 		lock (*this) {
-			if (_threads.length() == _idle)
+			if (_threads.length() == _sleeping && !hasWork())
 				return;
 			_waitingOnIdle++;
 		}
@@ -988,25 +1352,7 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 	 * If the pool is being shut down null is returned.
 	 */
 	public ref<Future<T>> execute(T f(address p), address parameter) {
-		ref<Future<T>> future = new Future<T>;
-		ref<WorkItem<T>> wi = new WorkItem<T>;
-		wi.result = future;
-		wi.valueGenerator = f;
-		wi.parameter = parameter;
-		lock (*this) {
-			if (_shutdownRequested) {
-				delete wi;
-				delete future;
-				return null;
-			}
-			if (_first == null)
-				_first = wi;
-			else
-				_last.next = wi;
-			_last = wi;
-			notify();
-		}
-		return future;
+		return execute(new Future<T>, f, parameter);
 	}
 	/**
 	 * Execute some work and use an existing {@link Future} to track completion
@@ -1027,22 +1373,13 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 	 * If the pool is being shut down null is returned.
 	 */
 	public ref<Future<T>> execute(ref<Future<T>> future, T f(address p), address parameter) {
-		ref<WorkItem<T>> wi = new WorkItem<T>;
+		WorkItem<T> wi;
 		wi.result = future;
 		wi.valueGenerator = f;
 		wi.parameter = parameter;
-		lock (*this) {
-			if (_shutdownRequested) {
-				delete wi;
-				delete future;
-				return null;
-			}
-			if (_first == null)
-				_first = wi;
-			else
-				_last.next = wi;
-			_last = wi;
-			notify();
+		if (!enqueue(pointer<WorkItem<T>>(&wi), 1)) {
+			delete future;
+			return null;
 		}
 		return future;
 	}
@@ -1060,23 +1397,110 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 	 * pool is being shut down.
 	 */
 	public boolean execute(void f(address p), address parameter) {
-		ref<WorkItem<T>> wi = new WorkItem<T>;
-		wi.result = null;
+		WorkItem<T> wi;
 		wi.valueGenerator = T(address)(f);
 		wi.parameter = parameter;
-		lock (*this) {
-			if (_shutdownRequested) {
-				delete wi;
-				return false;
+		return enqueue(pointer<WorkItem<T>>(&wi), 1);
+	}
+	/**
+	 * Execute a function once for each of a set of parameters, creating a {@link Future} to
+	 * track the completion of each call.
+	 *
+	 * All of the work items are queued together, and only as many threads as are needed to run
+	 * them are woken. If the pool is being shut down, no work item is queued.
+	 *
+	 * @param f A function to call to perform the work.
+	 *
+	 * @param parameters The values to be passed to the function, one per work item.
+	 *
+	 * @return An array of references to the Futures allocated to track the work, in the order of
+	 * the parameters. If the pool is being shut down, the array is empty.
+	 */
+	public ref<Future<T>>[] executeAll(T f(address p), address[] parameters) {
+		ref<Future<T>>[] futures;
+		WorkItem<T>[] items;
+		items.resize(parameters.length());
+		for (i in parameters) {
+			ref<Future<T>> future = new Future<T>;
+			futures.append(future);
+			items[i].result = future;
+			items[i].valueGenerator = f;
+			items[i].parameter = parameters[i];
+		}
+		if (items.length() > 0 && !enqueue(pointer<WorkItem<T>>(&items[0]), items.length())) {
+			futures.deleteAll();
+			futures.clear();
+		}
+		return futures;
+	}
+	/**
+	 * Execute a function once for each of a set of parameters.
+	 *
+	 * All of the work items are queued together, and only as many threads as are needed to run
+	 * them are woken. If the pool is being shut down, no work item is queued.
+	 *
+	 * @param f A function to call to perform the work.
+	 *
+	 * @param parameters The values to be passed to the function, one per work item.
+	 *
+	 * @return true if the work was queued successfully, or false if the
+	 * pool is being shut down.
+	 */
+	public boolean executeAll(void f(address p), address[] parameters) {
+		if (parameters.length() == 0)
+			return !_shutdownRequested;
+		WorkItem<T>[] items;
+		items.resize(parameters.length());
+		for (i in parameters) {
+			items[i].valueGenerator = T(address)(f);
+			items[i].parameter = parameters[i];
+		}
+		return enqueue(pointer<WorkItem<T>>(&items[0]), items.length());
+	}
+	/**
+	 * Call a function for each index in a range, dividing the calls among the threads of the pool.
+	 *
+	 * The range is split into chunks of consecutive indices. The calling thread runs chunks as well,
+	 * so the loop finishes even if every thread in the pool is busy, and a parallelFor may be called
+	 * from a function that is itself running in the pool. The calls for different indices may run
+	 * in any order and at the same time.
+	 *
+	 * If a call throws an uncaught exception, the rest of its chunk is skipped, but the other chunks
+	 * still run.
+	 *
+	 * @param count The number of indices. The body is called with each index from 0 through count - 1.
+	 *
+	 * @param body The function to call for each index.
+	 *
+	 * @param context A value passed to each call of the body.
+	 *
+	 * @return true if every call returned normally, false if any threw an uncaught exception.
+	 */
+	public boolean parallelFor(int count, void body(address context, int index), address context) {
+		if (count <= 0)
+			return true;
+		int threads = _workerCount;
+		int grain = count / (8 * (threads + 1));
+		if (grain < 1)
+			grain = 1;
+		int helpers = (count + grain - 1) / grain - 1;
+		if (helpers > threads)
+			helpers = threads;
+		ref<ParallelFor> job = new ParallelFor(count, grain, body, context, helpers + 1);
+		if (helpers > 0) {
+			WorkItem<T>[] items;
+			items.resize(helpers);
+			for (i in items) {
+				items[i].valueGenerator = T(address)(helpParallelFor);
+				items[i].parameter = job;
+			}
+			if (!enqueue(pointer<WorkItem<T>>(&items[0]), helpers)) {
+				for (int i = 0; i < helpers; i++)
+					job.release();
 			}
-			if (_first == null)
-				_first = wi;
-			else
-				_last.next = wi;
-			_last = wi;
-			notify();
 		}
-		return true;
+		job.work();
+		return job.finish();
 	}
 	/**
 	 * Increase the number of threads in the pool.
@@ -1091,10 +1515,22 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 			if (newThreadCount < _threads.length())
 				throw IllegalArgumentException("new threads < " + _threads.length());
 			else {
+				ref<WorkDeque<T>> last = _workers;
+				while (last != null && last.next != null)
+					last = last.next;
 				while (newThreadCount > _threads.length()) {
+					ref<WorkDeque<T>> d = new WorkDeque<T>(this, _threads.length());
+					// Workers looking for work to steal walk the list without a lock, so link the new
+					// worker in before counting it.
+					if (last == null)
+						_workers = d;
+					else
+						last.next = d;
+					last = d;
+					_workerCount++;
 					ref<Thread> t = new Thread();
 					_threads.append(t);
-					t.start(workLoop, this);
+					t.start(workLoop, d);
 				}
 			}
 		}
@@ -1116,7 +1552,7 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 	 */
 	public int idleThreads() {
 		lock (*this) {
-			return _idle;
+			return _sleeping;
 		}
 	}
 	/**
@@ -1126,39 +1562,129 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 	 */
 	public int busyThreads() {
 		lock (*this) {
-			return _threads.length() - _idle;
+			return _threads.length() - _sleeping;
+		}
+	}
+	/*
+	 * Queue work items on the calling thread's own deque if it is in this pool, otherwise on the shared
+	 * deque, then wake enough sleeping workers to run them.
+	 */
+	private boolean enqueue(pointer<WorkItem<T>> items, int count) {
+		ref<Thread> t = currentThread();
+		ref<WorkDeque<T>> deque;
+		if (t != null && t._pool == this)
+			deque = ref<WorkDeque<T>>(t._workDeque);
+		else
+			deque = &_shared;
+		lock (deque.guard) {
+			// Shutdown sets the flag before it empties each deque, so an item pushed here is either
+			// seen and cancelled by shutdown or never pushed.
+			if (_shutdownRequested)
+				return false;
+			for (int i = 0; i < count; i++)
+				deque.push(&items[i]);
+		}
+		// A worker counts itself as sleeping before it looks at the deques a last time, and the lock
+		// just released orders the push above before this read, so a worker cannot miss the new items.
+		if (_sleeping > _signals) {
+			lock (*this) {
+				while (count > 0 && _sleeping > _signals) {
+					_signals++;
+					notify();
+					count--;
+				}
+			}
 		}
+		return true;
 	}
 
 	private static void workLoop(address p) {
-		ref<ThreadPool<T>> pool = ref<ThreadPool<T>>(p);
-		while (pool.getEvent())
-			;
+		ref<WorkDeque<T>> deque = ref<WorkDeque<T>>(p);
+		ref<ThreadPool<T>> pool = deque.pool;
+		ref<Thread> t = currentThread();
+		t._pool = pool;
+		t._workDeque = deque;
+		WorkItem<T> wi;
+		while (pool.nextItem(deque, &wi))
+			pool.run(&wi);
 	}
 
-	private boolean getEvent() {
-		ref<WorkItem<T>> wi;
-
-		lock(*this) {
+	private boolean nextItem(ref<WorkDeque<T>> deque, ref<WorkItem<T>> wi) {
+		for (;;) {
 			if (_shutdownRequested)
 				return false;
-			_idle++;
-			// If the pool is idle,
-			if (_threads.length() == _idle) {
-				if (_first == null) {
-					while (_waitingOnIdle > 0) {
-						_idleSignal.notify();
-						_waitingOnIdle--;
+			if (findItem(deque, wi))
+				return true;
+			lock (*this) {
+				if (_shutdownRequested)
+					return false;
+				_sleeping++;
+				if (!hasWork()) {
+					// If the pool is idle,
+					if (_threads.length() == _sleeping) {
+						while (_waitingOnIdle > 0) {
+							_idleSignal.notify();
+							_waitingOnIdle--;
+						}
 					}
+					wait();
+					if (_signals > 0)
+						_signals--;
 				}
+				_sleeping--;
+			}
+		}
+	}
+
+	private boolean findItem(ref<WorkDeque<T>> deque, ref<WorkItem<T>> wi) {
+		if (deque._count > 0) {
+			lock (deque.guard) {
+				if (deque.takeNewest(wi))
+					return true;
+			}
+		}
+		if (_shared._count > 0) {
+			lock (_shared.guard) {
+				if (_shared.takeOldest(wi))
+					return true;
+			}
+		}
+		int n = _workerCount;
+		if (n < 2)
+			return false;
+		ref<WorkDeque<T>> victim = _workers;
+		for (int i = deque.random(n); i > 0; i--)
+			victim = victim.next;
+		for (int i = 0; i < n; i++) {
+			if (victim != deque && victim._count > 0) {
+				lock (victim.guard) {
+					if (victim.takeOldest(wi))
+						return true;
+				}
+			}
+			victim = victim.next;
+			if (victim == null)
+				victim = _workers;
+		}
+		return false;
+	}
+	/*
+	 * Called with the pool locked. Taking each deque's lock makes sure a push that finished before this
+	 * call is seen.
+	 */
+	private boolean hasWork() {
+		for (ref<WorkDeque<T>> d = _workers; d != null; d = d.next) {
+			lock (d.guard) {
+				if (d._count > 0)
+					return true;
 			}
-			wait();
-			_idle--;
-			if (_shutdownRequested)		// Note: _first will be null
-				return false;
-			wi = _first;
-			_first = wi.next;
 		}
+		lock (_shared.guard) {
+			return _shared._count > 0;
+		}
+	}
+
+	private void run(ref<WorkItem<T>> wi) {
 		if (wi.result != null) {
 			try {
 				if (wi.result.calculating())
@@ -1179,9 +1705,99 @@ public class ThreadPool<class T> extends ThreadPoolData<T> {
 				process.stdout.flush();
 			}
 		}
-		delete wi;
+	}
+}
+/*
+ * The shared state of one call to ThreadPool.parallelFor. The caller and each queued helper hold a
+ * reference. Helpers that start after the loop is done find nothing to do.
+ */
+private class ParallelFor {
+	Monitor guard;
+	private void(address, int) _body;
+	private address _context;
+	private int _count;
+	private int _grain;
+	private int _next;				// The first index not yet claimed
+	private int _done;				// The number of indices finished
+	private int _references;
+	private boolean _failed;
+
+	ParallelFor(int count, int grain, void body(address context, int index), address context, int references) {
+		_count = count;
+		_grain = grain;
+		_body = body;
+		_context = context;
+		_references = references;
+	}
+
+	void work() {
+		for (;;) {
+			int start;
+			lock (guard) {
+				start = _next;
+				if (start < _count)
+					_next += _grain;
+			}
+			if (start >= _count)
+				return;
+			int end = start + _grain;
+			if (end > _count)
+				end = _count;
+			boolean success = runChunk(start, end);
+			lock (guard) {
+				if (!success)
+					_failed = true;
+				_done += end - start;
+				if (_done == _count)
+					guard.notifyAll();
+			}
+		}
+	}
+	/*
+	 * The try is kept out of work, since the locals of work that are held in registers would not survive
+	 * a caught exception.
+	 */
+	private boolean runChunk(int start, int end) {
+		try {
+			for (int i = start; i < end; i++)
+				_body(_context, i);
+		} catch (Exception e) {
+			printf("Failed ThreadPool parallelFor: Uncaught exception! %s\n%s", 
+							e.message(), e.textStackTrace());
+			process.stdout.flush();
+			return false;
+		}
 		return true;
 	}
+	/*
+	 * Wait for every index to be done, then drop the caller's reference.
+	 */
+	boolean finish() {
+		boolean success;
+		lock (guard) {
+			while (_done < _count)
+				guard.wait();
+			success = !_failed;
+		}
+		release();
+		return success;
+	}
+
+	void release() {
+		boolean last;
+		lock (guard) {
+			_references--;
+			last = _references == 0;
+		}
+		if (last)
+			delete this;
+	}
+}
+
+private void helpParallelFor(address p) {
+	ref<ParallelFor> job = ref<ParallelFor>(p);
+	job.work();
+	job.release();
 }
 /**
  * A 'future' value.
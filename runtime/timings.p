@@ -0,0 +1,266 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+namespace parasol:compiler;
+
+import parasol:memory;
+import parasol:thread;
+import parasol:time;
+/*
+ * The number of syntax tree nodes constructed while any compile was being timed. Nodes are only counted
+ * while timedCompiles is not zero.
+ */
+long nodesCreated;
+int timedCompiles;
+/**
+ * The phases of a compile that {@link CompileTimings} tells apart.
+ *
+ * Each phase is charged only for the time spent in it and not in a phase it calls. For example, the
+ * parser pulls tokens from the scanner as it goes, so PARSE excludes the time charged to SCAN.
+ */
+public enum CompilePhase {
+	SCAN,				// Reading tokens from the source.
+	PARSE,				// Building syntax trees from the tokens.
+	BUILD_SCOPES,		// Creating the scopes and symbols of each unit.
+	RESOLVE_IMPORTS,	// Binding import statements, including reading the units they name.
+	ASSIGN_TYPES,		// Type checking, including the template functions checked during code generation.
+	FOLD,				// The tree rewrites done on each function before code generation.
+	ASSIGN_TEMPS,		// Choosing the registers of each expression (X86_64AssignTemps).
+	GENERATE,			// Instruction selection and the rest of code generation.
+	OPTIMIZE_JUMPS,		// Jump shortening and code layout of each function.
+	OTHER,				// Everything else: loading the root scope, storage allocation, the checks between phases.
+	MAX_PHASE
+}
+/**
+ * Records where a compile spends its time.
+ *
+ * Set {@link CompileContext.timings} to an instance before calling {@link CompileContext.loadRoot}
+ * and call {@link finish} after the compile returns. The wall time, the bytes allocated from the
+ * process heap and the number of syntax tree nodes created are charged to the innermost phase that is
+ * running, and to the unit that phase is working on, if any.
+ *
+ * While a compile is being timed, units are parsed one at a time so that each allocation can be
+ * charged to the unit that made it. A timed compile is therefore a little slower than an untimed one on
+ * a machine with more than one processor.
+ */
+public class CompileTimings {
+	/**
+	 * The totals charged to one phase or one unit.
+	 */
+	public class Counts {
+		public long nanoseconds;
+		public long allocated;
+		public long nodes;
+
+		void add(long ns, long b, long n) {
+			nanoseconds += ns;
+			allocated += b;
+			nodes += n;
+		}
+	}
+
+	private class Frame {
+		CompilePhase phase;
+		ref<Unit> unit;
+	}
+
+	private class UnitCounts {
+		ref<Unit> unit;
+		Counts counts;
+	}
+
+	private Counts[CompilePhase] _phases;
+	private ref<UnitCounts>[] _units;
+	private map<int, long> _unitIndex;		// Indexed by the address of the unit
+	private Frame[] _stack;
+	private ref<memory.AllocationCounter> _counter;
+	private long _start;
+	private long _mark;
+	private long _markAllocated;
+	private long _markNodes;
+	private long _elapsed;
+	private boolean _finished;
+
+	public CompileTimings() {
+		_counter = memory.countAllocations();
+		thread.fetchAdd(&timedCompiles, 1);
+		_start = _mark = now();
+		_markAllocated = _counter.allocatedBytes();
+		_markNodes = thread.atomicLoad(&nodesCreated);
+		Frame f = { phase: CompilePhase.OTHER };
+		_stack.append(f);
+		_phases.resize(CompilePhase.MAX_PHASE);
+	}
+
+	~CompileTimings() {
+		stopCounting();
+		_units.deleteAll();
+	}
+	/**
+	 * Start a phase, nested in whatever phase is running. The new phase works on the same unit as the
+	 * enclosing one until {@link setUnit} is called.
+	 */
+	public void enter(CompilePhase phase) {
+		charge();
+		Frame f = { phase: phase, unit: _stack[_stack.length() - 1].unit };
+		_stack.append(f);
+	}
+	/**
+	 * Start a phase that works on one unit.
+	 */
+	public void enter(CompilePhase phase, ref<Unit> unit) {
+		charge();
+		Frame f = { phase: phase, unit: unit };
+		_stack.append(f);
+	}
+	/**
+	 * End the innermost phase and go back to the one it was nested in.
+	 */
+	public void exit() {
+		charge();
+		if (_stack.length() > 1)
+			_stack.resize(_stack.length() - 1);
+	}
+	/**
+	 * Charge the running phase's work from now on to a different unit.
+	 */
+	public void setUnit(ref<Unit> unit) {
+		charge();
+		_stack[_stack.length() - 1].unit = unit;
+	}
+	/**
+	 * Stop the clock and stop counting allocations and nodes. Phases still running are closed.
+	 */
+	public void finish() {
+		if (_finished)
+			return;
+		charge();
+		_stack.resize(1);
+		_elapsed = _mark - _start;
+		stopCounting();
+	}
+
+	private void stopCounting() {
+		if (_finished)
+			return;
+		_finished = true;
+		thread.fetchAdd(&timedCompiles, -1);
+		memory.stopCountingAllocations();
+	}
+
+	private void charge() {
+		long t = now();
+		long allocated = _counter.allocatedBytes();
+		long nodes = thread.atomicLoad(&nodesCreated);
+		ref<Frame> f = &_stack[_stack.length() - 1];
+		_phases[f.phase].add(t - _mark, allocated - _markAllocated, nodes - _markNodes);
+		if (f.unit != null)
+			unitCounts(f.unit).counts.add(t - _mark, allocated - _markAllocated, nodes - _markNodes);
+		_mark = t;
+		_markAllocated = allocated;
+		_markNodes = nodes;
+	}
+
+	private ref<UnitCounts> unitCounts(ref<Unit> unit) {
+		ref<UnitCounts> uc;
+		if (_unitIndex.contains(long(unit)))
+			uc = _units[_unitIndex[long(unit)]];
+		else {
+			uc = new UnitCounts;
+			uc.unit = unit;
+			_unitIndex[long(unit)] = _units.length();
+			_units.append(uc);
+		}
+		return uc;
+	}
+	/**
+	 * @return The totals charged to a phase.
+	 */
+	public Counts phase(CompilePhase phase) {
+		return _phases[phase];
+	}
+	/**
+	 * @return The units charged with any work, in the order they were first charged.
+	 */
+	public ref<Unit>[] units() {
+		ref<Unit>[] units;
+		for (i in _units)
+			units.append(_units[i].unit);
+		return units;
+	}
+	/**
+	 * @return The totals charged to a unit.
+	 */
+	public Counts unit(ref<Unit> unit) {
+		if (_unitIndex.contains(long(unit)))
+			return _units[_unitIndex[long(unit)]].counts;
+		Counts none;
+		return none;
+	}
+	/**
+	 * @return The totals of every phase. The elapsed time is from construction to the call to
+	 * {@link finish}.
+	 */
+	public Counts total() {
+		Counts t;
+		for (i in _phases)
+			t.add(0, _phases[i].allocated, _phases[i].nodes);
+		t.nanoseconds = _elapsed;
+		return t;
+	}
+	/**
+	 * Print a table of the phases followed by a table of the units, slowest first. Units taking less
+	 * than a millisecond are summed on one line.
+	 */
+	public void print() {
+		Counts t = total();
+		printf("\n%-16s %10s %6s %12s %10s\n", "phase", "ms", "%", "KB allocated", "nodes");
+		for (i in _phases) {
+			ref<Counts> c = &_phases[i];
+			printf("%-16s %10.1f %6.1f %12d %10d\n", string(i).toLowerCase(), c.nanoseconds / 1000000.0,
+						t.nanoseconds > 0 ? 100.0 * c.nanoseconds / t.nanoseconds : 0.0, c.allocated / 1024, c.nodes);
+		}
+		printf("%-16s %10.1f %6s %12d %10d\n", "total", t.nanoseconds / 1000000.0, "", t.allocated / 1024, t.nodes);
+
+		ref<UnitCounts>[] units = _units;
+		units.sort(compareUnits, false);
+		printf("\n%10s %12s %10s  %s\n", "ms", "KB allocated", "nodes", "unit");
+		Counts rest;
+		int restCount;
+		for (i in units) {
+			ref<Counts> c = &units[i].counts;
+			if (c.nanoseconds < 1000000) {
+				rest.add(c.nanoseconds, c.allocated, c.nodes);
+				restCount++;
+			} else
+				printf("%10.1f %12d %10d  %s\n", c.nanoseconds / 1000000.0, c.allocated / 1024, c.nodes, units[i].unit.filename());
+		}
+		if (restCount > 0)
+			printf("%10.1f %12d %10d  (%d other units)\n", rest.nanoseconds / 1000000.0, rest.allocated / 1024, rest.nodes, restCount);
+	}
+
+	private static int compareUnits(ref<UnitCounts> left, ref<UnitCounts> right) {
+		long l = left.counts.nanoseconds;
+		long r = right.counts.nanoseconds;
+		if (l != r)
+			return l < r ? -1 : 1;
+		return 0;
+	}
+
+	private static long now() {
+		time.Instant t = time.Clock.MONOTONIC.get();
+		return t.seconds() * 1000000000 + t.nanoseconds();
+	}
+}
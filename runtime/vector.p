@@ -561,7 +561,7 @@ public class vector<class E, class I> {
 					return;
 				}
 				newSize = reservedSize(newLength);
-				if (_capacity == newSize) {
+				if (int(_capacity) >= int(newSize)) {
 					for (int i = int(_length); i < int(newLength); i++)
 						new (&_data[i]) E();
 					_length = newLength;
@@ -609,7 +609,7 @@ public class vector<class E, class I> {
 					return;
 				}
 				newSize = reservedSize(newLength);
-				if (_capacity == newSize) {
+				if (int(_capacity) >= int(newSize)) {
 					_length = newLength;
 					return;
 				}
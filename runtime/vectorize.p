@@ -95,6 +95,12 @@ ref<Node> reduce(Operator op, ref<SyntaxTree> tree, ref<Node> vectorExpression,
 		vectorExpression.print(0);
 		assert(false);
 	}
+	ref<Node> kernel = reduceKernel(op, tree, vectorExpression, accumulator, vectorSize, compileContext);
+	if (kernel != null) {
+		ref<Reference> skip = tree.newReference(iterator, true, vectorExpression.location());
+		kernel = tree.newBinary(Operator.ASSIGN, skip, kernel, vectorExpression.location());
+		start = tree.newBinary(Operator.SEQUENCE, start, kernel, vectorExpression.location());
+	}
 	ref<Node> limit = tree.newReference(vectorSize, false, vectorExpression.location());
 	ref<Node> v  = tree.newReference(iterator, false, vectorExpression.location());
 	ref<Node> test = tree.newBinary(Operator.LESS, v, limit, vectorExpression.location());
@@ -181,6 +187,12 @@ ref<Node> vectorize(ref<SyntaxTree> tree, ref<Node> vectorExpression, ref<Compil
 			ref<NodeList> args = tree.newNodeList(tree.newReference(vectorSize, false, vectorExpression.location()));
 			ref<Call> call = tree.newCall(oi.parameterScope(), null,  method, args, vectorExpression.location(), compileContext);
 			start = tree.newBinary(Operator.SEQUENCE, start, call, vectorExpression.location());
+			ref<Node> kernel = arithmeticKernel(tree, b, vectorSize, compileContext);
+			if (kernel != null) {
+				ref<Reference> skip = tree.newReference(iterator, true, vectorExpression.location());
+				kernel = tree.newBinary(Operator.ASSIGN, skip, kernel, vectorExpression.location());
+				start = tree.newBinary(Operator.SEQUENCE, start, kernel, vectorExpression.location());
+			}
 		} else {
 			printf("Only 1 lvalue per expression allowed\n");
 			vectorExpression.print(0);
@@ -207,6 +219,177 @@ ref<Node> vectorize(ref<SyntaxTree> tree, ref<Node> vectorExpression, ref<Compil
 	return loop.fold(tree, false, compileContext);
 }
 
+/*
+ * The loops built by reduce and vectorize call getModulo and setModulo for each element. For the common
+ * cases, sums and element-wise arithmetic over vectors of int, long, float or double, the generated code
+ * first calls a kernel in libparasol that processes the vectors with packed SIMD instructions. The kernel
+ * returns the number of elements it handled and the loop starts from there, so the loop still does any
+ * work the kernel declines, such as operands that have to be repeated because their lengths differ.
+ */
+private ref<Node> arithmeticKernel(ref<SyntaxTree> tree, ref<Binary> assignment, ref<Variable> vectorSize, ref<CompileContext> compileContext) {
+	ref<Type> vectorType = assignment.type;
+	int element = kernelElement(vectorType, compileContext);
+	if (element < 0)
+		return null;
+	if (assignment.op() != Operator.ASSIGN || !isKernelVector(assignment.left(), vectorType))
+		return null;
+	runtime.VectorOperation operation;
+	ref<Node> expression = assignment.right();
+	switch (expression.op()) {
+	case	ADD:
+		operation = runtime.VectorOperation.ADD;
+		break;
+
+	case	SUBTRACT:
+		operation = runtime.VectorOperation.SUBTRACT;
+		break;
+
+	case	MULTIPLY:
+		operation = runtime.VectorOperation.MULTIPLY;
+		break;
+
+	case	DIVIDE:
+		// Integer division has to check for zero divisors, so leave that to the loop.
+		if (element != int(runtime.VectorElement.FLOAT_32) && element != int(runtime.VectorElement.FLOAT_64))
+			return null;
+		operation = runtime.VectorOperation.DIVIDE;
+		break;
+
+	default:
+		return null;
+	}
+	ref<Binary> b = ref<Binary>(expression);
+	ref<Node> left = b.left();
+	ref<Node> right = b.right();
+	if (!isKernelOperand(left, vectorType) || !isKernelOperand(right, vectorType))
+		return null;
+	ref<Node> kernel = runtimeFunction(tree, "runtime.vectorArithmetic", expression.location(), compileContext);
+	if (kernel == null)
+		return null;
+	ref<NodeList> args = tree.newNodeList(intConstant(tree, element, expression.location(), compileContext),
+										  intConstant(tree, int(operation), expression.location(), compileContext),
+										  kernelAddress(tree, assignment.left(), vectorType, compileContext),
+										  kernelAddress(tree, left, vectorType, compileContext),
+										  kernelLength(tree, left, vectorType, compileContext),
+										  kernelAddress(tree, right, vectorType, compileContext),
+										  kernelLength(tree, right, vectorType, compileContext),
+										  tree.newReference(vectorSize, false, expression.location()));
+	return tree.newCall(ref<ParameterScope>(kernel.type.scope()), CallCategory.FUNCTION_CALL, kernel, args, expression.location(), compileContext);
+}
+
+private ref<Node> reduceKernel(Operator op, ref<SyntaxTree> tree, ref<Node> vectorExpression, ref<Variable> accumulator, ref<Variable> vectorSize, ref<CompileContext> compileContext) {
+	ref<Type> vectorType = vectorExpression.type;
+	int element = kernelElement(vectorType, compileContext);
+	if (op != Operator.ADD_REDUCE || element < 0)
+		return null;
+	ref<Node> left;
+	ref<Node> right;
+	if (vectorExpression.op() == Operator.MULTIPLY) {
+		ref<Binary> b = ref<Binary>(vectorExpression);
+		left = b.left();
+		right = b.right();
+		if (!isKernelVector(left, vectorType) || !isKernelVector(right, vectorType))
+			return null;
+	} else if (isKernelVector(vectorExpression, vectorType))
+		left = vectorExpression;
+	else
+		return null;
+	SourceOffset location = vectorExpression.location();
+	ref<Node> kernel = runtimeFunction(tree, "runtime.vectorReduce", location, compileContext);
+	if (kernel == null)
+		return null;
+	ref<Node> result = tree.newUnary(Operator.ADDRESS, tree.newReference(accumulator, false, location), location);
+	ref<Node> rightAddress;
+	ref<Node> rightLength;
+	if (right != null) {
+		rightAddress = kernelAddress(tree, right, vectorType, compileContext);
+		rightLength = kernelLength(tree, right, vectorType, compileContext);
+	} else {
+		rightAddress = tree.newLeaf(Operator.NULL, location);
+		rightLength = intConstant(tree, 0, location, compileContext);
+	}
+	ref<NodeList> args = tree.newNodeList(intConstant(tree, element, location, compileContext),
+										  result,
+										  kernelAddress(tree, left, vectorType, compileContext),
+										  kernelLength(tree, left, vectorType, compileContext),
+										  rightAddress,
+										  rightLength,
+										  tree.newReference(vectorSize, false, location));
+	return tree.newCall(ref<ParameterScope>(kernel.type.scope()), CallCategory.FUNCTION_CALL, kernel, args, location, compileContext);
+}
+/*
+ * The kernel's code for the elements of a vector type, or -1 if the kernels cannot process it.
+ */
+private int kernelElement(ref<Type> vectorType, ref<CompileContext> compileContext) {
+	if (!vectorType.isVector(compileContext) || vectorType.indexType().family() != runtime.TypeFamily.SIGNED_32)
+		return -1;
+	switch (vectorType.elementType().family()) {
+	case	SIGNED_32:
+		return int(runtime.VectorElement.SIGNED_32);
+
+	case	SIGNED_64:
+		return int(runtime.VectorElement.SIGNED_64);
+
+	case	FLOAT_32:
+		return int(runtime.VectorElement.FLOAT_32);
+
+	case	FLOAT_64:
+		return int(runtime.VectorElement.FLOAT_64);
+	}
+	return -1;
+}
+
+private boolean isKernelVector(ref<Node> operand, ref<Type> vectorType) {
+	return operand.isSimpleLvalue() && operand.type.equals(vectorType);
+}
+/*
+ * A kernel operand is either a vector or a single element, which is passed as a vector of length 1.
+ */
+private boolean isKernelOperand(ref<Node> operand, ref<Type> vectorType) {
+	return operand.isSimpleLvalue() &&
+		   (operand.type.equals(vectorType) || operand.type.equals(vectorType.elementType()));
+}
+
+private ref<Node> kernelAddress(ref<SyntaxTree> tree, ref<Node> operand, ref<Type> vectorType, ref<CompileContext> compileContext) {
+	if (!operand.type.equals(vectorType))
+		return tree.newUnary(Operator.ADDRESS, operand.clone(tree), operand.location());
+	ref<OverloadInstance> oi = getMethodSymbol(operand, "elementAddress", vectorType, compileContext);
+	ref<Selection> method = tree.newSelection(operand.clone(tree), oi, false, operand.location());
+	method.type = oi.type();
+	ref<NodeList> args = tree.newNodeList(intConstant(tree, 0, operand.location(), compileContext));
+	return tree.newCall(oi.parameterScope(), null, method, args, operand.location(), compileContext);
+}
+
+private ref<Node> kernelLength(ref<SyntaxTree> tree, ref<Node> operand, ref<Type> vectorType, ref<CompileContext> compileContext) {
+	if (!operand.type.equals(vectorType))
+		return intConstant(tree, 1, operand.location(), compileContext);
+	ref<OverloadInstance> oi = getMethodSymbol(operand, "length", vectorType, compileContext);
+	ref<Selection> method = tree.newSelection(operand.clone(tree), oi, false, operand.location());
+	method.type = oi.type();
+	return tree.newCall(oi.parameterScope(), null, method, null, operand.location(), compileContext);
+}
+
+private ref<Node> intConstant(ref<SyntaxTree> tree, int value, SourceOffset location, ref<CompileContext> compileContext) {
+	ref<Node> n = tree.newConstant(value, location);
+	n.type = compileContext.builtInType(runtime.TypeFamily.SIGNED_32);
+	return n;
+}
+/*
+ * A reference to a function in the parasol:runtime namespace, or null if this runtime does not have it.
+ */
+private ref<Node> runtimeFunction(ref<SyntaxTree> tree, string name, SourceOffset location, ref<CompileContext> compileContext) {
+	ref<Symbol> sym = compileContext.forest().getSymbol("parasol", name, compileContext);
+	if (sym == null || sym.class != Overload)
+		return null;
+	ref<OverloadInstance> oi = (*ref<Overload>(sym).instances())[0];
+	ref<Type> tp = oi.assignType(compileContext);
+	if (tp.deferAnalysis())
+		return null;
+	ref<Node> target = tree.newIdentifier(oi, location);
+	target.type = tp;
+	return target;
+}
+
 private ref<Node> rewriteVectorTree(ref<SyntaxTree> tree, ref<Node> vectorStuff, ref<Variable> iterator, ref<Variable> vectorSize, ref<CompileContext> compileContext) {
 	if ((vectorStuff.nodeFlags & VECTOR_OPERAND) != 0) {
 		ref<Node> index = tree.newReference(iterator, false, vectorStuff.location());
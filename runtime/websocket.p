@@ -15,13 +15,12 @@
  */
 namespace parasol:http;
 
-import native:net.closesocket;
-import native:net.recv;
-import native:net.send;
+import native:net;
 import native:linux;
 import native:C;
 import openssl.org:crypto.SHA1;
 import parasol:log;
+import parasol:memory;
 import parasol:net.base64encode;
 import parasol:net.Connection;
 import parasol:random;
@@ -30,7 +29,6 @@ import parasol:text;
 import parasol:thread;
 import parasol:thread.Thread;
 import parasol:thread.currentThread;
-import parasol:types.Queue;
 
 private ref<log.Logger> logger = log.getLogger("parasol.http.websocket");
 
@@ -173,10 +171,18 @@ private monitor class WebSocketVolatileData {
 	private boolean _shuttingDown;
 	private ref<Thread>	_readerThread;
 	private WebSocketReader _reader;
+	private WebSocketListener _listener;
+	private boolean _listening;			// From startListening until the reactor has delivered the disconnect event
 	private boolean _sentClose;
+	private boolean _owesClose;			// A close arrived and the reply waits for the disconnect event
+	private boolean _writeFailed;
+	private string[] _outgoing;			// Encoded messages waiting to be sent
+	private boolean _flushing;			// Some thread is sending the _outgoing messages
+	private boolean _handedOff;			// The thread sending is the writer, which waits for room in the socket buffer
+	private random.Random _random;		// For masking
 
 	public boolean startReader(WebSocketReader reader, string threadName) {
-		if (_readerThread != null)
+		if (_readerThread != null || _listener != null)
 			return false;
 		_reader = reader;
 		_readerThread = new Thread(threadName);
@@ -184,71 +190,145 @@ private monitor class WebSocketVolatileData {
 		return true;
 	}
 
+	boolean beginListening(WebSocketListener listener, boolean reactor) {
+		if (_readerThread != null || _listener != null)
+			return false;
+		_listener = listener;
+		_listening = reactor;
+		return true;
+	}
+
+	void startListenerThread(string threadName) {
+		_readerThread = new Thread(threadName);
+		_readerThread.start(listenWrapper, this);
+	}
+
 	public void discardReader() {
 		_reader = null;
 	}
 
+	void discardListener() {
+		_listener = null;
+	}
+
 	public WebSocketReader reader() {
 		return _reader;
 	}
 
-	public ref<Thread> stopReading() {
+	public ref<Thread>, boolean stopReading() {
 		ref<Thread> t = _readerThread;
-		if (_readerThread != null) {
-			// I am counting on this being in a race with the readWrapper below, but that I don't care
-			// if I lose. There are two scenarios to trigger a destructor call:
-			//	a. We got an EOF on the reader thread. If that's the case, then _reader should be null
-			//	   by the time we get here.
-			// 	b. The creator of this web socket has decided that they are done with the object, so
-			//	   there is no need for any further message exchange, except an OP_CLOSE from us.
-			//	   The catch with this case is that any number of issues could drop the connection and
-			//	   cause the reader thread to stop the moment the _reader test is applied. Thus, any effort
-			//	   to transmit an OP_CLOSE control frame will be pointless. That's fortunately the key
-			//	   phrase: pointless, not harmful.
-			
-			if (_reader != null) {
-//				logger.debug("stopReading... _waitingWrites %d _shuttingDown %s", _waitingWrites, _shuttingDown ? "true" : "false");
-				ref<WebSocket>(this).shutDown(WebSocket.CLOSE_NORMAL, "normal close");
-				_sentClose = true;
-			}
+		// I am counting on this being in a race with the reader thread or reactor, but that I don't care
+		// if I lose. There are two scenarios to trigger a destructor call:
+		//	a. We got an EOF while reading. If that's the case, then _reader and _listener should be null
+		//	   by the time we get here.
+		// 	b. The creator of this web socket has decided that they are done with the object, so
+		//	   there is no need for any further message exchange, except an OP_CLOSE from us.
+		//	   The catch with this case is that any number of issues could drop the connection and
+		//	   cause reading to stop the moment the _reader test is applied. Thus, any effort
+		//	   to transmit an OP_CLOSE control frame will be pointless. That's fortunately the key
+		//	   phrase: pointless, not harmful.
+		boolean sendClose = (_reader != null || _listener != null || _owesClose) && !_sentClose;
 
-			// We're passing the thread out so that the caller can join it. If we did it here, we'd be 
-			// holding a lock that one of the background threads might need to briefly take.
-			_readerThread = null;
-		}
-		return t;
+		// We're passing the thread out so that the caller can join it and send the OP_CLOSE. If we did it here,
+		// we'd be holding a lock that one of the background threads might need to briefly take.
+		_readerThread = null;
+		return t, sendClose;
+	}
+
+	void waitForListener() {
+		while (_listening)
+			wait();
+	}
+
+	void listeningDone() {
+		_listening = false;
+		notifyAll();
 	}
 
 	public boolean stopWriting() {
 		if (_shuttingDown)
 			return false;
 		_shuttingDown = true;
-//		logger.format(log.DEBUG, "stopWriting... _waitingWrites %d _shuttingDown %s", _waitingWrites, _shuttingDown ? "true" : "false");
-		if (_waitingWrites > 0)
+		// The writer may wait a long time for room to send. The bytes it holds are adopted, not waited for.
+		while (_waitingWrites > 0 && !_handedOff)
 			wait();
 		return true;
 	}
-
-	public boolean enqueueWrite() {
-//		logger.format(log.DEBUG, "enqueueWrite... _waitingWrites %d _shuttingDown %s", _waitingWrites, _shuttingDown ? "true" : "false");
-		if (_shuttingDown)
+	/*
+	 * Returns true if the caller should send the queued messages, false if they will be sent by the thread
+	 * already doing so, or dropped because the socket can no longer be written.
+	 */
+	boolean queueOutgoing(string frames, boolean close) {
+		if (_shuttingDown || _writeFailed)
 			return false;
+		if (close) {
+			// Nothing may follow a close frame, including another close frame.
+			if (_sentClose)
+				return false;
+			_sentClose = true;
+		}
+		_outgoing.append(frames);
 		_waitingWrites++;
+		if (_flushing)
+			return false;
+		_flushing = true;
+		return true;
+	}
+
+	boolean takeOutgoing(ref<string[]> batch) {
+		batch.clear();
+		if (_outgoing.length() == 0) {
+			_flushing = false;
+			_handedOff = false;
+			return false;
+		}
+		for (i in _outgoing)
+			batch.append(_outgoing[i]);
+		_outgoing.clear();
 		return true;
 	}
 
-	public void writeFinished() {
-//		logger.format(log.DEBUG, "writeFinished... _waitingWrites %d _shuttingDown %s", _waitingWrites, _shuttingDown ? "true" : "false");
-		if (_waitingWrites <= 0)
-			assert(false);
-		_waitingWrites--;
-		if (_shuttingDown && _waitingWrites == 0)
-			notify();
+	void outgoingSent(int count, boolean success) {
+		_waitingWrites -= count;
+		if (!success) {
+			_writeFailed = true;
+			_waitingWrites -= _outgoing.length();
+			_outgoing.clear();
+			_flushing = false;
+			_handedOff = false;
+		}
+		if (_waitingWrites == 0)
+			notifyAll();
+	}
+
+	void writerTookOver() {
+		_handedOff = true;
+		notifyAll();
+	}
+
+	boolean handedOff() {
+		return _handedOff;
+	}
+
+	public boolean writeFailed() {
+		return _writeFailed;
 	}
 
 	public boolean sentClose() {
 		return _sentClose;
 	}
+
+	void oweClose() {
+		_owesClose = true;
+	}
+
+	boolean owesClose() {
+		return _owesClose && !_sentClose;
+	}
+
+	unsigned nextMask() {
+		return unsigned(_random.next());
+	}
 }
 
 private void readWrapper(address arg) {
@@ -272,6 +352,10 @@ private void readWrapper(address arg) {
 //	if (socket.server())
 	socket.disconnect(sawClose);
 }
+
+private void listenWrapper(address arg) {
+	ref<WebSocket>(arg).listen();
+}
 /**
  * A Client can choose to implement the DisconnectListener interface.
  * Doing so will enable the 'disconnect' notification event. This event
@@ -286,6 +370,25 @@ public interface DisconnectListener {
 	 */
 	void disconnect(boolean normalClose);
 }
+
+private enum FrameStatus {
+	INCOMPLETE,			// The buffer ends before the message does.
+	MESSAGE,			// A whole message has been parsed.
+	CLOSE,				// A close frame has been parsed.
+	ERROR,				// The data violates the protocol and the connection is being shut down.
+}
+
+private enum Delivery {
+	MORE,				// The connection is open and more messages may follow.
+	ENDED,				// The message stream has ended.
+	DELETED,			// A listener deleted the Web Socket, which must not be touched again.
+}
+
+private enum SendStatus {
+	SENT,				// All of the batch was sent.
+	HANDED_OFF,			// The socket buffer filled, and the writer thread has the rest of the batch.
+	FAILED,				// The connection can no longer be written.
+}
 /**
  * An object that implements the Web Socket message frame protocol once an HTTP message has determined
  * that a usccessful Web Socket request has been sent or received.
@@ -294,6 +397,18 @@ public interface DisconnectListener {
  * Socket protocol is symmetric and once the connection has been established, subsequent message transmission
  * and reception is the same regardless of role.
  *
+ * Incoming messages can be consumed in one of two ways. A {@link WebSocketListener} passed to {@link startListening}
+ * is called with each message as it arrives. Unencrypted Web Sockets are read by a small set of reactor threads
+ * shared by all Web Sockets in the process, so an idle Web Socket holds no thread. Alternatively, a
+ * {@link WebSocketReader} passed to {@link startReader} gets a thread of its own, which reads messages by
+ * calling {@link readWholeMessage}.
+ *
+ * Outgoing messages are queued on the Web Socket. The thread that queues a message while no other thread is
+ * sending sends it, along with any messages that other threads queue in the meantime, in as few system calls as
+ * possible. Sends on an unencrypted Web Socket never wait: once the socket buffer fills, the rest is passed to a
+ * writer thread shared by all Web Sockets, which sends it as room becomes available. A reactor thread, or a
+ * listener running on one, can therefore write without stalling the other Web Sockets it serves.
+ *
  * Shutting down a conversation with a web socket requires a handshake. Whichever end of the conversation
  * that wants to discontinue the connection may call the {@link shutDown} method to inform the other end
  * of the connection. The shutDown includes a cause number and a reason string.
@@ -331,8 +446,6 @@ public class WebSocket extends WebSocketVolatileData {
 	 */
 	@Constant
 	public static byte OP_PONG = 10;
-	@Constant
-	static byte OP_SHUTDOWN = 255;			// Not really a Web Socket operation - used internally
 	/**
 	 * A normal, non-error close
 	 */
@@ -353,6 +466,10 @@ public class WebSocket extends WebSocketVolatileData {
 	 */
 	@Constant
 	public static short CLOSE_BAD_DATA = 1003;
+	@Constant
+	private static int INCOMING_BUFFER_SIZE = 4096;
+	@Constant
+	private static int MAX_IOVECS = 64;			// The most buffers passed to one sendmsg call
 	/**
 	 * The maximum size for a frame this object will write.
 	 *
@@ -365,10 +482,16 @@ public class WebSocket extends WebSocketVolatileData {
 	
 	private ref<Connection> _connection;
 	private boolean _server;
-	private random.Random _random;				// For masking
-	private byte[] _incomingData;		// A buffer of data being read from the websocket.
+	private byte[] _incomingData;		// Data read from the connection.
 	private int _incomingLength;		// The number of bytes in the buffer.
-	private int _incomingCursor;		// The index of the next byte to be read from the buffer.
+	private int _incomingCursor;		// The index of the first byte not yet parsed.
+	private int _frameLength;			// The length of a frame that has only partly arrived, or 0.
+	private boolean _fragmented;		// The frames of a message have begun arriving, but not the last one.
+	private byte[] _message;			// The message being assembled for the listener.
+	private boolean _sawClose;
+	private WebSocketListener _messageListener;	// Set before reading starts, so it can be read without the lock.
+	private ref<boolean> _deleted;		// While a listener is called, set by a destructor running in the listener
+	private ref<WebSocketReactor> _reactor;
 	private DisconnectListener _disconnectListener;
 	/**
 	 * Constructor.
@@ -390,20 +513,205 @@ public class WebSocket extends WebSocketVolatileData {
 //			logger.debug("Creating Web socket for socket %d", connection.requestFd());
 //		else if (connection != null)
 //			logger.debug("Creating client wb socket for socket %d", connection.requestFd());
-		_incomingData.resize(1024);
+		if (connection != null) {
+			// Frames that arrived with the end of the HTTP exchange are already in the connection's buffer.
+			string pending = connection.takeReadBuffer();
+			if (pending.length() > 0) {
+				_incomingData.resize(pending.length() > INCOMING_BUFFER_SIZE ? pending.length() : INCOMING_BUFFER_SIZE);
+				C.memcpy(&_incomingData[0], &pending[0], pending.length());
+				_incomingLength = pending.length();
+			}
+		}
 	}
 
 	~WebSocket() {
-		ref<Thread> readerThread = stopReading();
-		
+		ref<Thread> readerThread;
+		boolean sendClose;
+
+		(readerThread, sendClose) = stopReading();
+		if (sendClose)
+			shutDown(CLOSE_NORMAL, "normal close");
 		if (readerThread != null) {
 //			logger.debug("about to join...\n");
-			readerThread.join();
-		}
+			if (readerThread != currentThread())
+				readerThread.join();
+			else if (_deleted != null)
+				*_deleted = true;
+		} else if (_reactor != null) {
+			// A listener that deletes its Web Socket is running on the reactor thread, which cannot wait for itself.
+			if (_reactor.onReactorThread()) {
+				_reactor.detach(this, _connection.requestFd());
+				if (_deleted != null)
+					*_deleted = true;
+			} else
+				waitForListener();
+		} else if (_deleted != null)
+			*_deleted = true;				// Deleted while startListening delivered the first messages
+
 //		logger.debug("about to stop writing...\n");
 		stopWriting();
 //		logger.debug("Socket %d cleaned up!\n", _connection.requestFd());
-		delete _connection;
+		// If the writer still has bytes to send, it closes the connection when it is done with them.
+		boolean adopted;
+		if (handedOff()) {
+			ref<WebSocketWriter> writer = reactors.currentWriter();
+			adopted = writer != null && writer.adopt(this, _connection);
+		}
+		if (!adopted)
+			delete _connection;
+	}
+	/**
+	 * Start delivering incoming messages to a listener.
+	 *
+	 * An unencrypted Web Socket is read by one of a small set of reactor threads shared by all Web Sockets in
+	 * the process. An encrypted Web Socket gets a thread of its own. Either way, frames are parsed as their
+	 * data arrives and each whole message is passed to the listener's {@link WebSocketListener.message message}
+	 * method. Ping frames are answered without involving the listener.
+	 *
+	 * Listener methods run on the reading thread, which may be serving many other Web Sockets, so they should
+	 * pass any lengthy work to another thread.
+	 *
+	 * @threading This method is thread-safe. Any messages that arrived with the end of the HTTP exchange are
+	 * delivered before this method returns, on the calling thread. On a server-side Web Socket created while the
+	 * upgrade request is being answered, as by {@link WebSocketFactory.start}, nothing is delivered until the
+	 * response has been sent and the server has let go of the connection. The request thread then delivers
+	 * those messages.
+	 *
+	 * @param listener The object that receives incoming messages.
+	 *
+	 * @return true if the listener was started, false if a listener or a {@link WebSocketReader} was already
+	 * started.
+	 */
+	public boolean startListening(WebSocketListener listener) {
+		boolean secured = _connection.secured();
+		if (!beginListening(listener, !secured))
+			return false;
+		_messageListener = listener;
+		if (!_server || !upgrades.hold(_connection.requestFd(), this))
+			startDelivery();
+		return true;
+	}
+
+	void startDelivery() {
+		if (_connection.secured()) {
+			startListenerThread("WebSocketListener");
+			return;
+		}
+		switch (deliverMessages()) {
+		case DELETED:
+			return;
+
+		case ENDED:
+			finishListening(false);
+			listeningDone();
+			return;
+		}
+		_reactor = reactors.pick();
+		if (_reactor == null || !_reactor.add(this, _connection.requestFd())) {
+			finishListening(false);
+			listeningDone();
+		}
+	}
+	/*
+	 * The main loop of an encrypted Web Socket's listener thread.
+	 */
+	void listen() {
+		for (;;) {
+			Delivery d = deliverMessages();
+			if (d == Delivery.DELETED)
+				return;
+			if (d == Delivery.ENDED || !fillIncoming())
+				break;
+		}
+		finishListening(false);
+	}
+	/*
+	 * Called on a reactor thread when the connection is readable.
+	 *
+	 * @return Whether more data may follow, the connection has been closed or the Web Socket has been deleted.
+	 */
+	Delivery receive() {
+		for (;;) {
+			int space = incomingSpace();
+			int n = net.recv(_connection.requestFd(), &_incomingData[_incomingLength], space, net.MSG_DONTWAIT);
+			if (n <= 0) {
+				if (n < 0 && (linux.errno() == linux.EAGAIN || linux.errno() == linux.EINTR))
+					return Delivery.MORE;
+				readFailed(n);
+				return Delivery.ENDED;
+			}
+			_incomingLength += n;
+			Delivery d = deliverMessages();
+			if (d != Delivery.MORE)
+				return d;
+			if (n < space) {
+				// An idle Web Socket does not need to keep a read buffer.
+				if (_incomingCursor == _incomingLength && _frameLength == 0) {
+					_incomingData.clear();
+					_incomingLength = 0;
+					_incomingCursor = 0;
+				}
+				return Delivery.MORE;
+			}
+		}
+	}
+	/*
+	 * The end of the incoming message stream: tell the listener, answer a close and deliver the disconnect event.
+	 *
+	 * A reactor defers the answer to a close until the disconnect event has been delivered, so the other end
+	 * does not see the connection finish before this end has. It then calls answerClose, unless the disconnect
+	 * listener deleted the Web Socket, in which case the destructor sent the answer.
+	 */
+	void finishListening(boolean deferClose) {
+		try {
+			_messageListener.endOfMessages(_sawClose);
+		} catch (Exception e) {
+			logger.error("Unexpected exception ending WebSocket messages: %s\n%s", e.message(), e.textStackTrace());
+		}
+		if (_sawClose) {
+			if (deferClose)
+				oweClose();
+			else if (!sentClose())
+				shutDown(CLOSE_NORMAL, "normal close");
+		}
+		discardListener();
+		disconnect(_sawClose);
+	}
+
+	void answerClose() {
+		if (owesClose())
+			shutDown(CLOSE_NORMAL, "normal close");
+	}
+
+	private Delivery deliverMessages() {
+		for (;;) {
+			switch (nextMessage(&_message)) {
+			case INCOMPLETE:
+				return Delivery.MORE;
+
+			case MESSAGE:
+				// The listener may delete this Web Socket, so nothing of it can be touched until that is ruled out.
+				boolean deleted;
+				_deleted = &deleted;
+				try {
+					_messageListener.message(&_message);
+				} catch (Exception e) {
+					logger.error("Unexpected exception handling WebSocket message: %s\n%s", e.message(), e.textStackTrace());
+				}
+				if (deleted)
+					return Delivery.DELETED;
+				_deleted = null;
+				_message.clear();
+				break;
+
+			case CLOSE:
+				_sawClose = true;
+				return Delivery.ENDED;
+
+			case ERROR:
+				return Delivery.ENDED;
+			}
+		}
 	}
 	/**
 	 * readWholeMessage
@@ -424,221 +732,169 @@ public class WebSocket extends WebSocketVolatileData {
 	 * @threading This method is not thread safe.
 	 */
 	public boolean, boolean readWholeMessage(ref<byte[]> buffer) {
-		boolean initialFrame = true;
 		for (;;) {
-			boolean lastFrame, success;
-			int opcode;
-			
-			(lastFrame, opcode, success) = readFrame(buffer, initialFrame); 
-			if (!success)
-				break;
-			if (lastFrame) {
-				// If we got a close and this is not the initial frame, we might see a partial message in buffer. Do we care? 
-				if (opcode == 8)
-					return false, true;
-				else
-					return true, false;
+			switch (nextMessage(buffer)) {
+			case MESSAGE:
+				return true, false;
+
+			case CLOSE:
+				// If we got a close in the middle of a message, we might see a partial message in buffer. Do we care? 
+				return false, true;
+
+			case ERROR:
+				return false, false;
 			}
-			if (opcode < 8)
-				initialFrame = false;
+			if (!fillIncoming())
+				return false, false;
 		}
-		return false, false;
 	}
-	/**
-	 * @return true if this is the last frame of the message or false if more frames follow.
-	 * @return The opcode of the message.
+	/*
+	 * Parse the frames in the incoming buffer, appending the payload of data frames to buffer, until a message is
+	 * complete, a close frame is seen or the buffer runs out. Ping frames are answered as they are parsed.
 	 */
-	boolean, int, boolean readFrame(ref<byte[]> buffer, boolean initialFrame) {
-		boolean lastFrame;
-		
-		int opcode = getc();
-		if (opcode < 0)
-			return false, 0, false;
-		int payloadLengthByte = getc();
-		if (payloadLengthByte < 0)
-			return false, 0, false;
-		
-		long payloadLength;
-		
-		boolean success;
-		switch (payloadLengthByte & 0x7f) {
-		case 126:
-			short s;
-			(s, success) = readShort();
-			payloadLength = char(s);
-			if (!success)
-				return false, 0, false;
-			break;
-			
-		case 127:
-			(payloadLength, success) = readLong();
-			if (!success)
-				return false, 0, false;
-			break;
-			
-		default:
-			payloadLength = payloadLengthByte & 0x7f;
-		}
-		
-		unsigned mask;
-
-		if ((payloadLengthByte & 0x80) != 0) {		// It is a masked frame
-			(mask, success) = readMask();
-			if (!success)
-				return false, 0, false;
-		}
-		
-		int offset = buffer.length();
-		buffer.resize(int(offset + payloadLength));
-		
-//		logger.format(log.DEBUG, "offset = %d payloadLength = %d buffer = %p", offset, payloadLength, buffer);
-		int copied = drainBuffer(&(*buffer)[offset], int(payloadLength));
-		
-		while (copied < payloadLength) {
-			int received = _connection.read(&(*buffer)[offset + copied], int(payloadLength - copied));
-			if (received >= int(payloadLength - copied))
-				break;
-			copied += received;
-//			logger.format(log.DEBUG, "received = %d copied = %d payloadLength= %d", received, copied, payloadLength);
-		}
-		// Unmask the frame data if necessary
-		if (mask != 0) {
-			int part = 24;
-			for (int i = offset; i < offset + payloadLength; i++, part = (part - 8) & 0x1f) {
-				(*buffer)[i] = byte((*buffer)[i] ^ byte(mask >> part)); 
+	private FrameStatus nextMessage(ref<byte[]> buffer) {
+		for (;;) {
+			int available = _incomingLength - _incomingCursor;
+			if (available < 2)
+				return FrameStatus.INCOMPLETE;
+			pointer<byte> frame = &_incomingData[_incomingCursor];
+			int opcode = frame[0];
+			int payloadLengthByte = frame[1];
+			long payloadLength = payloadLengthByte & 0x7f;
+			int headerLength = 2;
+			if (payloadLength == 126)
+				headerLength += 2;
+			else if (payloadLength == 127)
+				headerLength += 8;
+			if ((payloadLengthByte & 0x80) != 0)		// It is a masked frame
+				headerLength += 4;
+			if (available < headerLength)
+				return FrameStatus.INCOMPLETE;
+			if (payloadLength == 126)
+				payloadLength = (frame[2] << 8) + frame[3];
+			else if (payloadLength == 127) {
+				payloadLength = 0;
+				for (int i = 2; i < 10; i++)
+					payloadLength = (payloadLength << 8) + frame[i];
 			}
-		}
-		if (initialFrame) {
+			if (payloadLength < 0 || payloadLength > int.MAX_VALUE - headerLength) {
+				logger.error("frame length %d is too large", payloadLength);
+				shutDown(CLOSE_BAD_DATA, "Frame too large");
+				return FrameStatus.ERROR;
+			}
+			int frameLength = headerLength + int(payloadLength);
+			if (available < frameLength) {
+				_frameLength = frameLength;
+				return FrameStatus.INCOMPLETE;
+			}
+			_frameLength = 0;
+			_incomingCursor += frameLength;
+			unsigned mask;
+			if ((payloadLengthByte & 0x80) != 0)
+				mask = unsigned((frame[headerLength - 4] << 24) + (frame[headerLength - 3] << 16) + 
+								(frame[headerLength - 2] << 8) + frame[headerLength - 1]);
+			pointer<byte> payload = frame + headerLength;
 			switch (opcode & 0x7f) {
 			case 1:
 			case 2:
-				return (opcode & 0x80) != 0, opcode & 0x7f, true;
-				
-			default:					// Not valid in an initial frame
-				buffer.resize(offset);
-				logger.error("initial opcode == %d", opcode & 0x7f);
-				shutDown(CLOSE_BAD_DATA, "Unexpected opcode");
-				return false, opcode & 0x7f, false;
-				
-			case 8:				// connection close
-			case 9:				// ping
-			case 10:			// pong
+				if (_fragmented) {					// Not valid in a non-initial frame
+					logger.error("Unexpected non-zero opcode (%d) on non-initial frame", opcode & 0x7f);
+					shutDown(CLOSE_PROTOCOL_ERROR, "Unexpected opcode");
+					return FrameStatus.ERROR;
+				}
+				appendPayload(buffer, payload, int(payloadLength), mask);
+				if ((opcode & 0x80) != 0)
+					return FrameStatus.MESSAGE;
+				_fragmented = true;
 				break;
-			}
-		} else {
-			switch (opcode & 0x7f) {
+
 			case 0:
-				return (opcode & 0x80) != 0, opcode & 0x7f, true;
-
-			default:					// Not valid in a non-initial frame
-				buffer.resize(offset);
-				logger.error("Unexpected non-zero opcode (%d) on non-initial frame", opcode & 0x7f);
-				shutDown(CLOSE_PROTOCOL_ERROR, "Unexpected opcode");
-				return false, opcode & 0x7f, false;
-				
-			case 8:				// connection close				
+				if (!_fragmented) {					// Not valid in an initial frame
+					logger.error("initial opcode == %d", opcode & 0x7f);
+					shutDown(CLOSE_BAD_DATA, "Unexpected opcode");
+					return FrameStatus.ERROR;
+				}
+				appendPayload(buffer, payload, int(payloadLength), mask);
+				if ((opcode & 0x80) != 0) {
+					_fragmented = false;
+					return FrameStatus.MESSAGE;
+				}
+				break;
+
+			case 8:				// connection close
+				return FrameStatus.CLOSE;
+
 			case 9:				// ping
+				byte[] pong;
+				appendPayload(&pong, payload, int(payloadLength), mask);
+				queue(encode(OP_PONG, pong.length() > 0 ? &pong[0] : null, pong.length()), false);
+				break;
+
 			case 10:			// pong
 				break;
+
+			default:
+				logger.error("%s opcode == %d", _fragmented ? "non-initial" : "initial", opcode & 0x7f);
+				shutDown(_fragmented ? CLOSE_PROTOCOL_ERROR : CLOSE_BAD_DATA, "Unexpected opcode");
+				return FrameStatus.ERROR;
 			}
 		}
-		switch (opcode & 0x7f) {
-		case 8:				// connection close
-			buffer.resize(offset);
-			return true, OP_CLOSE, true;
-			
-		case 9:				// ping
-			string pong(&(*buffer)[offset], int(payloadLength));
-
-			writer.write(new Operation(this, OP_PONG, pong));
-			buffer.resize(offset);
-			return false, OP_PING, true;
-			
-		case 10:			// pong
-			buffer.resize(offset);
-			return false, OP_PONG, true;
-		}
-		// Should never get here.
-		buffer.resize(offset);
-		return false, opcode & 0x7f, true;
 	}
 
-	private short, boolean readShort() {
-		int high = getc();
-		if (high < 0)
-			return 0, false;
-		int low = getc();
-		if (low < 0)
-			return 0, false;
-		return short((high << 8) + low), true;
-	}
-	
-	private unsigned, boolean readMask() {
-		int bits24 = getc();
-		if (bits24 < 0)
-			return 0, false;
-		int bits16 = getc();
-		if (bits16 < 0)
-			return 0, false;
-		int bits8 = getc();
-		if (bits8 < 0)
-			return 0, false;
-		int bits0 = getc();
-		if (bits0 < 0)
-			return 0, false;
-		return unsigned((bits24 << 24) + (bits16 << 16) + (bits8 << 8) + bits0), true;
-	}
-	
-	private long, boolean readLong() {
-		int bits56 = getc();
-		if (bits56 < 0)
-			return 0, false;
-		int bits48 = getc();
-		if (bits48 < 0)
-			return 0, false;
-		int bits40 = getc();
-		if (bits40 < 0)
-			return 0, false;
-		int bits32 = getc();
-		if (bits32 < 0)
-			return 0, false;
-		int bits24 = getc();
-		if (bits24 < 0)
-			return 0, false;
-		int bits16 = getc();
-		if (bits16 < 0)
-			return 0, false;
-		int bits8 = getc();
-		if (bits8 < 0)
-			return 0, false;
-		int bits0 = getc();
-		if (bits0 < 0)
-			return 0, false;
-		return (long(bits56) << 56) + (long(bits48) << 48) + (long(bits40) << 40) + (long(bits32) << 32) + (bits24 << 24) + (bits16 << 16) + (bits8 << 8) + bits0, true;
-	}
-	
-	private int drainBuffer(pointer<byte> loc, int count) {
-		int remaining = _incomingLength - _incomingCursor;
-		if (remaining > count)
-			remaining = count;
-		C.memcpy(loc, &_incomingData[_incomingCursor], remaining);
-		_incomingCursor += remaining;
-		return remaining;
+	private static void appendPayload(ref<byte[]> buffer, pointer<byte> payload, int length, unsigned mask) {
+		int offset = buffer.length();
+		buffer.resize(offset + length);
+		if (length == 0)
+			return;
+		pointer<byte> output = &(*buffer)[offset];
+		if (mask == 0) {
+			C.memcpy(output, payload, length);
+			return;
+		}
+		int part = 24;
+		for (int i = 0; i < length; i++, part = (part - 8) & 0x1f)
+			output[i] = byte(payload[i] ^ byte(mask >> part));
 	}
-	
-	private int getc() {
-		if (_incomingCursor >= _incomingLength) {
-			_incomingLength = _connection.read(&_incomingData[0], _incomingData.length());
-			if (_incomingLength <= 0) {
-				if (_incomingLength < 0)
-					logger.error("connection read failed: %s", linux.strerror(linux.errno()));
-//				logger.debug("CLOSE_BAD_DATA - recv failed");
-				shutDown(CLOSE_BAD_DATA, "recv failed");
-				return -1;
-			}
+	/*
+	 * Discard the parsed bytes at the front of the incoming buffer, and make room behind the unparsed ones for
+	 * at least a full buffer or the rest of a partly arrived frame.
+	 *
+	 * @return The number of bytes that can be read into the buffer at _incomingLength.
+	 */
+	private int incomingSpace() {
+		if (_incomingCursor > 0) {
+			int remaining = _incomingLength - _incomingCursor;
+			if (remaining > 0)
+				C.memmove(&_incomingData[0], &_incomingData[_incomingCursor], remaining);
+			_incomingLength = remaining;
 			_incomingCursor = 0;
 		}
-		return _incomingData[_incomingCursor++];
+		int size = _incomingLength + INCOMING_BUFFER_SIZE;
+		if (size < _frameLength)
+			size = _frameLength;
+		if (_incomingData.length() == _incomingLength || _incomingData.length() < _frameLength)
+			_incomingData.resize(size);
+		return _incomingData.length() - _incomingLength;
+	}
+	/*
+	 * Do a blocking read into the incoming buffer.
+	 */
+	private boolean fillIncoming() {
+		int space = incomingSpace();
+		int n = _connection.read(&_incomingData[_incomingLength], space);
+		if (n <= 0) {
+			readFailed(n);
+			return false;
+		}
+		_incomingLength += n;
+		return true;
+	}
+
+	private void readFailed(int n) {
+		if (n < 0)
+			logger.error("connection read failed: %s", linux.strerror(linux.errno()));
+//		logger.debug("CLOSE_BAD_DATA - recv failed");
+		shutDown(CLOSE_BAD_DATA, "recv failed");
 	}
 	/**
 	 * Write a string message.
@@ -651,18 +907,38 @@ public class WebSocket extends WebSocketVolatileData {
 	 * @param message The message text.
 	 */
 	public void write(string message) {
-		writer.write(new Operation(this, OP_STRING, message));
+		write(OP_STRING, message);
 	}
 	/**
 	 * Write a message with an arbitrary opcode.
 	 *
+	 * The message is queued. If no other thread is sending messages on this Web Socket, the calling thread sends
+	 * it, together with any messages other threads queue while it does so. Otherwise, the call returns at once
+	 * and the thread that is sending will send the message. On an unencrypted Web Socket the call does not wait
+	 * for room in the socket buffer.
+	 *
 	 * @threading This method is thread-safe.
 	 *
 	 * @param opcode One of the defined opcodes ({@link OP_STRING}, {@link OP_BINARY}, {@link OP_CLOSE},
 	 * {@link OP_PING} or {@link OP_PONG}. Passing any other value for the opcode is undefined.
 	 */
 	public void write(byte opcode, string message) {
-		writer.write(new Operation(this, opcode, message));
+		queue(encode(opcode, message.length() > 0 ? &message[0] : null, message.length()), opcode == OP_CLOSE);
+	}
+	/**
+	 * Write a message held in a buffer.
+	 *
+	 * The message is queued as with the {@link write(byte, string)} method. The frame is encoded before the call
+	 * returns, so the caller may reuse the buffer at once.
+	 *
+	 * @threading This method is thread-safe.
+	 *
+	 * @param opcode One of the defined opcodes.
+	 * @param message The address of the first byte of the message.
+	 * @param length The number of bytes in the message.
+	 */
+	public void write(byte opcode, pointer<byte> message, int length) {
+		queue(encode(opcode, message, length), opcode == OP_CLOSE);
 	}
 	/**
 	 * Write a shutdown message.
@@ -677,20 +953,20 @@ public class WebSocket extends WebSocketVolatileData {
 	 * @param reason A reason string that provides additional details about the cause.
 	 */
 	public void shutDown(short cause, string reason) {
-		writer.write(new Operation(this, cause, reason));
-//		if (_readerThread != null) {
-//			printf("%s %p Waiting on reader thread...\n", currentThread().name(), this);
-//			_readerThread.join();
-//			printf("%s %p Reader thread joined.\n", currentThread().name(), this);
-//		}
+		string closeFrame;
+
+		closeFrame.append(byte(cause >> 8));
+		closeFrame.append(byte(cause));
+		closeFrame.append(reason);
+		queue(encode(OP_CLOSE, &closeFrame[0], closeFrame.length()), true);
 	}
 	/**
 	 * A server calls this method on the web socket to register a client
 	 * disconnect event handler.
 	 *
 	 * @threading This method is not thread-safe. It is recommended that this method
-	 * is called before calling {@link readWholeMessage}, since a client-disconnect can be
-	 * triggered when that method reads from the connection.
+	 * is called before calling {@link readWholeMessage} or {@link startListening}, since a client-disconnect
+	 * can be triggered when the connection is read.
 	 *
 	 * @param func The function to call when the client disconnect event occurs.
 	 * It takes the param value as its first argument and a boolean indicating
@@ -737,62 +1013,135 @@ public class WebSocket extends WebSocketVolatileData {
 	 * messages.
 	 */
 	boolean send(byte opcode, pointer<byte> message, int length) {
+		queue(encode(opcode, message, length), opcode == OP_CLOSE);
+		return !writeFailed();
+	}
+
+	private void queue(string frames, boolean close) {
+		// Queued messages, and any the writer thread takes over, outlive the Region of a request being served.
+		ref<memory.Allocator> allocator = memory.setThreadAllocator(null);
+		if (queueOutgoing(frames, close)) {
+			string[] batch;
+			while (takeOutgoing(&batch)) {
+				SendStatus status = sendBatch(&batch);
+				if (status == SendStatus.HANDED_OFF)
+					break;
+				outgoingSent(batch.length(), status == SendStatus.SENT);
+			}
+		}
+		memory.setThreadAllocator(allocator);
+	}
+	/*
+	 * Send a batch of encoded messages. On an unencrypted connection they go out in a single sendmsg call, unless
+	 * the socket buffer fills, in which case the writer thread is given the rest.
+	 */
+	private SendStatus sendBatch(ref<string[]> batch) {
+		int fd = _connection.requestFd();
+		if (_connection.secured()) {
+			string data;
+			for (int i = 0; i < batch.length(); i++)
+				data.append((*batch)[i]);
+			if (_connection.write(&data[0], data.length()) == data.length())
+				return SendStatus.SENT;
+		} else {
+			linux.iovec[] iov;
+			iov.resize(batch.length());
+			for (int i = 0; i < batch.length(); i++) {
+				iov[i].iov_base = &(*batch)[i][0];
+				iov[i].iov_len = (*batch)[i].length();
+			}
+			int first;
+			while (first < iov.length()) {
+				net.msghdr msg;
+				int count = iov.length() - first;
+				msg.msg_iov = &iov[first];
+				msg.msg_iovlen = count < MAX_IOVECS ? count : MAX_IOVECS;
+				long n = net.sendmsg(fd, &msg, net.MSG_NOSIGNAL | net.MSG_DONTWAIT);
+				if (n < 0) {
+					if (linux.errno() == linux.EINTR)
+						continue;
+					if (linux.errno() == linux.EAGAIN) {
+						string rest;
+						for (int i = first; i < iov.length(); i++)
+							rest.append(pointer<byte>(iov[i].iov_base), int(iov[i].iov_len));
+						ref<WebSocketWriter> writer = reactors.writer();
+						if (writer != null && writer.handOff(this, rest, batch.length()))
+							return SendStatus.HANDED_OFF;
+					}
+					break;
+				}
+				while (first < iov.length() && n >= iov[first].iov_len) {
+					n -= iov[first].iov_len;
+					first++;
+				}
+				if (n > 0) {
+					iov[first].iov_base = pointer<byte>(iov[first].iov_base) + n;
+					iov[first].iov_len -= n;
+				}
+			}
+			if (first >= iov.length())
+				return SendStatus.SENT;
+		}
+		// Wake up whatever is reading the connection, so the Web Socket gets shut down.
+		net.shutdown(fd, net.SHUT_RDWR);
+		return SendStatus.FAILED;
+	}
+	/*
+	 * Encode a message as a sequence of frames, none with more than maxFrameSize bytes of payload.
+	 */
+	private string encode(byte opcode, pointer<byte> message, int length) {
+		string frames;
 		do {
 			int frameLength = maxFrameSize <= length ? maxFrameSize : length;
 			boolean lastFrame = frameLength >= length;
-			if (!sendFrame(opcode, lastFrame, message, frameLength))
-				return false;
+			appendFrame(&frames, opcode, lastFrame, message, frameLength);
 			length -= frameLength;
 			message += frameLength;
 			opcode = 0;
 		} while (length > 0);
-		return true;
+		return frames;
 	}
 	
-	private boolean sendFrame(byte opcode, boolean lastFrame, pointer<byte> data, int length) {
-		byte[] frame;
+	private void appendFrame(ref<string> frames, byte opcode, boolean lastFrame, pointer<byte> data, int length) {
 		byte maskBit;
 
 		if (!_server)
 			maskBit = 0x80;
 		if (lastFrame)
 			opcode |= 0x80;
-		frame.append(opcode);
+		frames.append(opcode);
 		
 		if (length > 65535) {
-			frame.append(byte(maskBit | 127));
-			frame.append(0);
-			frame.append(0);
-			frame.append(0);
-			frame.append(0);
-			frame.append(byte(length >> 24));
-			frame.append(byte(length >> 16));
-			frame.append(byte(length >> 8));
-			frame.append(byte(length));			
+			frames.append(byte(maskBit | 127));
+			frames.append(byte(0));
+			frames.append(byte(0));
+			frames.append(byte(0));
+			frames.append(byte(0));
+			frames.append(byte(length >> 24));
+			frames.append(byte(length >> 16));
+			frames.append(byte(length >> 8));
+			frames.append(byte(length));			
 		} else if (length > 125) {
-			frame.append(byte(maskBit | 126));
-			frame.append(byte(length >> 8));
-			frame.append(byte(length));			
+			frames.append(byte(maskBit | 126));
+			frames.append(byte(length >> 8));
+			frames.append(byte(length));			
 		} else
-			frame.append(byte(maskBit | length));
+			frames.append(byte(maskBit | length));
 		if (!_server) {
-			unsigned mask = _random.next();
-			frame.append(byte(mask >> 24));
-			frame.append(byte(mask >> 16));
-			frame.append(byte(mask >> 8));
-			frame.append(byte(mask));
+			unsigned mask = nextMask();
+			frames.append(byte(mask >> 24));
+			frames.append(byte(mask >> 16));
+			frames.append(byte(mask >> 8));
+			frames.append(byte(mask));
+			int offset = frames.length();
+			frames.resize(offset + length);
 			int part = 24;
 			for (int i = 0; i < length; i++, part = (part - 8) & 0x1f)
-				data[i] = byte(data[i] ^ byte(mask >> part)); 
-		}
-		frame.append(data, length);
+				(*frames)[offset + i] = byte(data[i] ^ byte(mask >> part)); 
+		} else if (length > 0)
+			frames.append(data, length);
 //		printf("Sending:\n");
-//		text.memDump(&frame[0], frame.length(), 0);
-		int result = _connection.write(&frame[0], frame.length());
-		if (result == frame.length())
-			return true;
-		_connection.close();
-		return false;
+//		text.memDump(&(*frames)[0], frames.length(), 0);
 	}
 	/**
 	 * Retrieve the underlying connection for this WebSocket.
@@ -812,15 +1161,6 @@ public class WebSocket extends WebSocketVolatileData {
 	}
 }
 
-private void networkOrder(ref<byte[]> output, short x) {
-	output.append(byte(x >> 8));
-	output.append(byte(x));
-}
-
-private void networkOrder(ref<byte[]> output, string x) {
-	for (int i = 0; i < x.length(); i++)
-		output.append(x[i]);
-}
 /**
  * A class that is serving as either a proxy or stub connected to a Web Socket will
  * implement this interface.
@@ -845,6 +1185,31 @@ public interface WebSocketReader {
 	 */
 	boolean readMessages();
 }
+/**
+ * An object that consumes the messages arriving on a Web Socket without a thread of its own implements
+ * this interface.
+ *
+ * Pass the object to {@link parasol:http.WebSocket.startListening}. Its methods are called on the thread
+ * reading the Web Socket, which may be serving many other Web Sockets, so they should pass any lengthy work,
+ * or anything that waits on the network, to another thread.
+ */
+public interface WebSocketListener {
+	/**
+	 * A whole message has arrived.
+	 *
+	 * @param message The message contents. The array is cleared when this method returns, so copy anything that
+	 * must be kept.
+	 */
+	void message(ref<byte[]> message);
+	/**
+	 * No more messages will arrive.
+	 *
+	 * This is called before the Web Socket's disconnect event.
+	 *
+	 * @param sawClose true if the other end sent a close frame, false if the connection failed or carried bad data.
+	 */
+	void endOfMessages(boolean sawClose);
+}
 /**
  * An object generated by each send-half of a message pair and matched by a response-half of the pair.
  *
@@ -1027,102 +1392,448 @@ public monitor class RendezvousManager {
 	}
 }
 
-class Operation {
-	ref<WebSocket> webSocket;
-	byte opcode;
-	string message;
-	short cause;
+/*
+ * A reactor thread: an epoll event loop that reads the unencrypted Web Sockets assigned to it.
+ *
+ * Only the reactor's own thread reads its sockets, so they are registered level-triggered and each socket's
+ * messages are delivered in order. A byte written to a pipe stops the loop.
+ */
+private class WebSocketReactor {
+	@Constant
+	private static int EVENTS_PER_WAIT = 256;
 
-	Operation(ref<WebSocket> webSocket, byte opcode, string message) {
-		this.webSocket = webSocket;
-		this.opcode = opcode;
-		this.message = message;
-	}
+	private int _epollfd;
+	private int[] _wake;					// A pipe: the read end is in the epoll set
+	private ref<Thread> _thread;
+	private Monitor _lock;
+	private ref<WebSocket>[] _sockets;		// indexed by file descriptor, guarded by _lock
+	private ref<WebSocket> _finishing;		// The socket whose disconnect event is being delivered, guarded by _lock
 
-	Operation(ref<WebSocket> webSocket, short cause, string reason) {
-		this.webSocket = webSocket;
-		this.opcode = WebSocket.OP_CLOSE;
-		this.cause = cause;
-		this.message = reason;
+	WebSocketReactor(string name) {
+		_wake.resize(2);
+		_epollfd = linux.epoll_create1(linux.EPOLL_CLOEXEC);
+		if (_epollfd < 0 || linux.pipe(&_wake[0]) != 0) {
+			logger.error("Could not create a WebSocket reactor: %s", linux.strerror(linux.errno()));
+			return;
+		}
+		linux.epoll_event e;
+		e.events = linux.EPOLLIN;
+		e.fd = _wake[0];
+		linux.epoll_ctl(_epollfd, linux.EPOLL_CTL_ADD, _wake[0], &e);
+		_thread = new Thread(name);
+		_thread.start(reactorEntry, this);
 	}
-}
 
-monitor class MessageWriter {
-	ref<Thread> _writeThread;
+	~WebSocketReactor() {
+		delete _thread;
+		if (_epollfd >= 0) {
+			linux.close(_epollfd);
+			linux.close(_wake[0]);
+			linux.close(_wake[1]);
+		}
+	}
 
-	Queue<ref<Operation>> _q;
+	private static void reactorEntry(address param) {
+		ref<WebSocketReactor>(param).run();
+	}
 
-	void write(ref<Operation> op) {
-//		printf("%s %p writer.write\n", currentThread().name(), this);
-		if (_writeThread == null) {
-			_writeThread = new Thread("WebSocketWriter");
-			_writeThread.start(writeWrapper, null);
+	boolean add(ref<WebSocket> socket, int fd) {
+		if (_thread == null)
+			return false;
+		int fileFlags = linux.fcntl(fd, linux.F_GETFL, 0);
+		if (fileFlags < 0 || linux.fcntl(fd, linux.F_SETFL, fileFlags | linux.O_NONBLOCK) != 0) {
+			logger.error("Could not make WebSocket %d non-blocking: %s", fd, linux.strerror(linux.errno()));
+			return false;
 		}
-		if (op.webSocket == null || op.webSocket.enqueueWrite()) {
-			_q.enqueue(op);
-			notify();
-		} else
-			delete op;
+		lock (_lock) {
+			if (fd >= _sockets.length())
+				_sockets.resize(fd + 1);
+			_sockets[fd] = socket;
+		}
+		linux.epoll_event e;
+		e.events = linux.EPOLLIN | linux.EPOLLRDHUP;
+		e.fd = fd;
+		if (linux.epoll_ctl(_epollfd, linux.EPOLL_CTL_ADD, fd, &e) == 0)
+			return true;
+		logger.error("epoll_ctl failed for WebSocket %d: %s", fd, linux.strerror(linux.errno()));
+		lock (_lock) {
+			_sockets[fd] = null;
+		}
+		return false;
+	}
+	/*
+	 * A socket is being deleted on the reactor thread, from one of the calls the reactor makes to a listener.
+	 * The reactor must not touch it again.
+	 */
+	void detach(ref<WebSocket> socket, int fd) {
+		lock (_lock) {
+			if (_finishing == socket)
+				_finishing = null;
+			if (fd >= 0 && fd < _sockets.length() && _sockets[fd] == socket) {
+				_sockets[fd] = null;
+				linux.epoll_ctl(_epollfd, linux.EPOLL_CTL_DEL, fd, null);
+			}
+		}
+	}
+
+	boolean onReactorThread() {
+		return currentThread() == _thread;
 	}
 
-	ref<Operation> dequeue() {
-//		printf("%s %p dequeue...\n", currentThread().name(), this);
-		wait();
-//		printf("%s %p un-waited...\n", currentThread().name(), this);
-		return _q.dequeue();
+	void stop() {
+		if (_thread == null)
+			return;
+		byte b;
+		linux.write(_wake[1], &b, 1);
+		_thread.join();
 	}
 
-	ref<Thread> active() {
-//		printf("%s %p trying to shutdown! writeThread = %p\n", currentThread().name(), this, _writeThread);
-		return _writeThread;
+	private void run() {
+		linux.epoll_event[] events;
+		events.resize(EVENTS_PER_WAIT);
+		for (;;) {
+			int n = linux.epoll_wait(_epollfd, &events[0], events.length(), -1);
+			for (int i = 0; i < n; i++) {
+				int fd = events[i].fd;
+				if (fd == _wake[0])
+					return;
+				ref<WebSocket> socket;
+				lock (_lock) {
+					if (fd < _sockets.length())
+						socket = _sockets[fd];
+				}
+				// A socket deleted by its listener during the receive has already been detached.
+				if (socket == null || socket.receive() != Delivery.ENDED)
+					continue;
+				lock (_lock) {
+					_sockets[fd] = null;
+					linux.epoll_ctl(_epollfd, linux.EPOLL_CTL_DEL, fd, null);
+					_finishing = socket;
+				}
+				socket.finishListening(true);
+				lock (_lock) {
+					// A disconnect listener may have deleted the socket, in which case its destructor sent any reply.
+					socket = _finishing;
+					_finishing = null;
+				}
+				if (socket != null) {
+					socket.answerClose();
+					socket.listeningDone();
+				}
+			}
+		}
 	}
 }
+/*
+ * The connections whose upgrade request is being answered, indexed by file descriptor.
+ *
+ * A Web Socket that starts listening on one of them waits until the request thread has sent the response and
+ * let go of the connection. Otherwise a reply from its listener could overtake the response, or the listener
+ * could delete the Web Socket, and close the connection, while the request thread is still using it.
+ */
+private monitor class Upgrades {
+	boolean[] _answering;
+	ref<WebSocket>[] _waiting;
 
-class MessageWriterShutDown {
-	~MessageWriterShutDown() {
-//		printf("destructor!\n");
-		ref<Thread> t = writer.active();
-		if (t != null) {
-			writer.write(new Operation(null, WebSocket.OP_SHUTDOWN, null));
-			t.join();
-			delete t;
+	void begin(int fd) {
+		if (fd >= _answering.length()) {
+			_answering.resize(fd + 1);
+			_waiting.resize(fd + 1);
 		}
+		_answering[fd] = true;
+		_waiting[fd] = null;
+	}
+
+	boolean hold(int fd, ref<WebSocket> socket) {
+		if (fd < 0 || fd >= _answering.length() || !_answering[fd])
+			return false;
+		_waiting[fd] = socket;
+		return true;
+	}
+
+	ref<WebSocket> end(int fd) {
+		if (fd < 0 || fd >= _answering.length())
+			return null;
+		ref<WebSocket> socket = _waiting[fd];
+		_answering[fd] = false;
+		_waiting[fd] = null;
+		return socket;
 	}
-	
 }
 
-/**
- * writeWrapper
+private Upgrades upgrades;
+/*
+ * Called by the server before a request with an Upgrade header is dispatched. The request may be running
+ * in a Region, so the table is grown from the heap.
+ */
+void beginUpgrade(int fd) {
+	ref<memory.Allocator> allocator = memory.setThreadAllocator(null);
+	upgrades.begin(fd);
+	memory.setThreadAllocator(allocator);
+}
+/*
+ * Called by the server once it has answered the upgrade request and no longer uses the connection.
+ */
+void finishUpgrade(int fd) {
+	ref<WebSocket> socket = upgrades.end(fd);
+	if (socket != null) {
+		ref<memory.Allocator> allocator = memory.setThreadAllocator(null);
+		socket.startDelivery();
+		memory.setThreadAllocator(allocator);
+	}
+}
+/*
+ * The bytes of one Web Socket that are waiting for room in its socket buffer.
+ */
+private class PendingWrite {
+	ref<WebSocket> socket;			// null once the Web Socket has been deleted
+	ref<Connection> connection;		// set once the Web Socket has been deleted, and closed when the bytes are sent
+	string unsent;
+	int sent;						// The number of bytes of unsent already sent
+	int messages;					// The number of messages in unsent, while the Web Socket exists
+}
+/*
+ * The writer: an epoll event loop that finishes the sends on unencrypted Web Sockets that found the socket
+ * buffer full.
  *
- *	This method is the main loop of the WebSocket writer thread. Once started, it remains running waiting for
- *	some WebSocket to write some data.
+ * A thread that fills the buffer hands the rest of its batch to the writer and goes on with its own work. While
+ * the writer holds a Web Socket's bytes, messages queued on the Web Socket wait for the writer to send them, in
+ * order. If the Web Socket is deleted first, the writer adopts its connection, sends what was queued and then
+ * closes the connection.
  */
-void writeWrapper(address arg) {
-	for (;;) {
-//		printf("%s writer waiting...\n", currentThread().name());
-		ref<Operation> op = writer.dequeue();
-//		logger.debug("Socket %d web write opcode %d len %d", op.webSocket != null && op.webSocket.connection() != null ? op.webSocket.connection().requestFd() : -1, op.opcode, op.message.length());
-//		logger.dumpMemory(log.DEBUG, "message", &op.message[0], op.message.length(), 0);
-		if (op.opcode == WebSocket.OP_CLOSE) {
-//			logger.debug("%d Sending OP_CLOSE message: %d %s", op.webSocket.connection().requestFd(),
-//									op.cause, op.message);
-			byte[] closeFrame;
-
-			networkOrder(&closeFrame, op.cause);
-			networkOrder(&closeFrame, op.message);
-			op.webSocket.send(WebSocket.OP_CLOSE, &closeFrame[0], closeFrame.length());
-		} else if (op.opcode == WebSocket.OP_SHUTDOWN) {
-//			printf("%s shutting down...\n", currentThread().name());
-			delete op;
-			break;
-		} else
-			op.webSocket.send(op.opcode, &op.message[0], op.message.length());
-		op.webSocket.writeFinished();
-		delete op;
+private class WebSocketWriter {
+	@Constant
+	private static int EVENTS_PER_WAIT = 256;
+
+	private int _epollfd;
+	private int[] _wake;					// A pipe: the read end is in the epoll set
+	private ref<Thread> _thread;
+	private Monitor _lock;
+	private ref<PendingWrite>[] _pending;	// indexed by file descriptor, guarded by _lock
+
+	WebSocketWriter(string name) {
+		_wake.resize(2);
+		_epollfd = linux.epoll_create1(linux.EPOLL_CLOEXEC);
+		if (_epollfd < 0 || linux.pipe(&_wake[0]) != 0) {
+			logger.error("Could not create a WebSocket writer: %s", linux.strerror(linux.errno()));
+			return;
+		}
+		linux.epoll_event e;
+		e.events = linux.EPOLLIN;
+		e.fd = _wake[0];
+		linux.epoll_ctl(_epollfd, linux.EPOLL_CTL_ADD, _wake[0], &e);
+		_thread = new Thread(name);
+		_thread.start(writerEntry, this);
+	}
+
+	~WebSocketWriter() {
+		delete _thread;
+		for (i in _pending) {
+			if (_pending[i] != null) {
+				delete _pending[i].connection;
+				delete _pending[i];
+			}
+		}
+		if (_epollfd >= 0) {
+			linux.close(_epollfd);
+			linux.close(_wake[0]);
+			linux.close(_wake[1]);
+		}
+	}
+
+	private static void writerEntry(address param) {
+		ref<WebSocketWriter>(param).run();
+	}
+	/*
+	 * Take over sending a Web Socket's outgoing messages. The caller was sending them and holds no lock.
+	 *
+	 * @return true if the writer will send the bytes and then any messages queued after them, false if the
+	 * bytes could not be handed over.
+	 */
+	boolean handOff(ref<WebSocket> socket, string unsent, int messages) {
+		if (_thread == null)
+			return false;
+		int fd = socket.connection().requestFd();
+		lock (_lock) {
+			if (fd >= _pending.length())
+				_pending.resize(fd + 1);
+			ref<PendingWrite> p = new PendingWrite;
+			p.socket = socket;
+			p.unsent = unsent;
+			p.messages = messages;
+			_pending[fd] = p;
+			socket.writerTookOver();
+			linux.epoll_event e;
+			e.events = linux.EPOLLOUT;
+			e.fd = fd;
+			if (linux.epoll_ctl(_epollfd, linux.EPOLL_CTL_ADD, fd, &e) == 0)
+				return true;
+			logger.error("epoll_ctl failed for WebSocket %d: %s", fd, linux.strerror(linux.errno()));
+			_pending[fd] = null;
+			delete p;
+		}
+		return false;
+	}
+	/*
+	 * A Web Socket that handed its bytes to the writer is being deleted.
+	 *
+	 * @return true if the writer now owns the connection and will delete it, false if the writer had already
+	 * finished with the Web Socket.
+	 */
+	boolean adopt(ref<WebSocket> socket, ref<Connection> connection) {
+		ref<memory.Allocator> allocator = memory.setThreadAllocator(null);
+		boolean adopted;
+		lock (_lock) {
+			int fd = connection.requestFd();
+			if (fd >= 0 && fd < _pending.length() && _pending[fd] != null && _pending[fd].socket == socket) {
+				ref<PendingWrite> p = _pending[fd];
+				string[] batch;
+				if (socket.takeOutgoing(&batch)) {
+					string rest = p.unsent.substr(p.sent);
+					for (i in batch)
+						rest.append(batch[i]);
+					p.unsent = rest;
+					p.sent = 0;
+				}
+				p.socket = null;
+				p.connection = connection;
+				adopted = true;
+			}
+		}
+		memory.setThreadAllocator(allocator);
+		return adopted;
+	}
+
+	void stop() {
+		if (_thread == null)
+			return;
+		byte b;
+		linux.write(_wake[1], &b, 1);
+		_thread.join();
+	}
+
+	private void run() {
+		linux.epoll_event[] events;
+		events.resize(EVENTS_PER_WAIT);
+		for (;;) {
+			int n = linux.epoll_wait(_epollfd, &events[0], events.length(), -1);
+			for (int i = 0; i < n; i++) {
+				int fd = events[i].fd;
+				if (fd == _wake[0])
+					return;
+				lock (_lock) {
+					if (fd < _pending.length() && _pending[fd] != null && !flush(fd, _pending[fd])) {
+						linux.epoll_ctl(_epollfd, linux.EPOLL_CTL_DEL, fd, null);
+						delete _pending[fd].connection;
+						delete _pending[fd];
+						_pending[fd] = null;
+					}
+				}
+			}
+		}
+	}
+	/*
+	 * Send as much as the socket buffer takes. The caller holds _lock.
+	 *
+	 * @return true if there is more to send, false if the writer is done with the file descriptor. The caller then
+	 * deletes any adopted connection.
+	 */
+	private boolean flush(int fd, ref<PendingWrite> p) {
+		for (;;) {
+			while (p.sent < p.unsent.length()) {
+				int n = net.send(fd, &p.unsent[p.sent], p.unsent.length() - p.sent, net.MSG_NOSIGNAL | net.MSG_DONTWAIT);
+				if (n < 0) {
+					if (linux.errno() == linux.EINTR)
+						continue;
+					if (linux.errno() == linux.EAGAIN)
+						return true;
+					if (p.socket != null) {
+						// Wake up whatever is reading the connection, so the Web Socket gets shut down.
+						net.shutdown(fd, net.SHUT_RDWR);
+						p.socket.outgoingSent(p.messages, false);
+					}
+					return false;
+				}
+				p.sent += n;
+			}
+			if (p.socket == null)
+				return false;
+			p.socket.outgoingSent(p.messages, true);
+			string[] batch;
+			if (!p.socket.takeOutgoing(&batch))
+				return false;
+			p.unsent.clear();
+			for (i in batch)
+				p.unsent.append(batch[i]);
+			p.sent = 0;
+			p.messages = batch.length();
+		}
+	}
+}
+/*
+ * The reactors shared by all unencrypted Web Sockets. They are started when the first Web Socket starts listening,
+ * and each new Web Socket goes to the next reactor in turn.
+ */
+private monitor class WebSocketReactors {
+	@Constant
+	private static int MAX_REACTORS = 4;
+
+	ref<WebSocketReactor>[] _reactors;
+	ref<WebSocketWriter> _writer;
+	int _next;
+	boolean _stopped;
+
+	ref<WebSocketReactor> pick() {
+		if (_stopped)
+			return null;
+		if (_reactors.length() == 0) {
+			int count = thread.cpuCount();
+			if (count > MAX_REACTORS)
+				count = MAX_REACTORS;
+			for (int i = 0; i < count; i++)
+				_reactors.append(new WebSocketReactor("WebSocketReactor-" + string(i)));
+		}
+		ref<WebSocketReactor> r = _reactors[_next];
+		_next = (_next + 1) % _reactors.length();
+		return r;
+	}
+
+	ref<WebSocketWriter> writer() {
+		if (_writer == null && !_stopped)
+			_writer = new WebSocketWriter("WebSocketWriter");
+		return _writer;
+	}
+
+	ref<WebSocketWriter> currentWriter() {
+		return _writer;
+	}
+
+	ref<WebSocketReactor>[], ref<WebSocketWriter> stop() {
+		_stopped = true;
+		ref<WebSocketReactor>[] results;
+		for (i in _reactors)
+			results.append(_reactors[i]);
+		_reactors.clear();
+		ref<WebSocketWriter> writer = _writer;
+		_writer = null;
+		return results, writer;
 	}
 }
 
-MessageWriter writer;
+class WebSocketReactorsShutDown {
+	~WebSocketReactorsShutDown() {
+		ref<WebSocketReactor>[] r;
+		ref<WebSocketWriter> writer;
+		(r, writer) = reactors.stop();
+		for (i in r)
+			r[i].stop();
+		r.deleteAll();
+		if (writer != null)
+			writer.stop();
+		delete writer;
+	}
+}
 
-private MessageWriterShutDown writerShutDown;
+private WebSocketReactors reactors;
 
+private WebSocketReactorsShutDown reactorsShutDown;
@@ -199,6 +199,11 @@ public class X86_64Lnx extends X86_64 {
 		ref<X86_64LnxSection> s = new X86_64LnxSection(this);
 		output.declareSection(s);
 	}
+
+	public boolean writePrelinkedPxi(ref<pxi.Pxi> output, long baseAddress) {
+		output.declareSection(new pxi.X86_64PrelinkedSection(_staticMemory, _staticMemoryLength, baseAddress));
+		return true;
+	}
 	
 	public int, boolean run(string[] args) {
 		if (runtime.compileTarget == runtime.Target.X86_64_WIN) {
@@ -303,6 +308,8 @@ public class X86_64 extends X86_64AssignTemps {
 	private ref<ParameterScope> _releaseMethod;
 	
 	private ref<ParameterScope> _rpcClientCall;
+	private ref<Type> _clientTransport;
+	private ref<Symbol> _exceptionClass;
 	private ref<Symbol> _floatSignMask;
 	private ref<Symbol> _floatOne;
 	private ref<Symbol> _floatZero;
@@ -313,6 +320,13 @@ public class X86_64 extends X86_64AssignTemps {
 	public int maxTypeOrdinal;
 	private int _stackLocalVariables;
 	private memory.StartingHeap _startingHeap;
+	private int[string] _dllNameOffsets;					// Each shared object name is stored once
+	private string _profilePath;
+	private string _allocationProfilePath;
+	private int[] _functionOffsets;							// The function names table passed to a profiled image
+	private string[] _functionNameStrings;
+	private pointer<byte>[] _functionNamePointers;
+	private runtime.FunctionNames _functionNames;
 
 	public X86_64(ref<compiler.Arena> arena) {
 		_arena = arena;
@@ -325,6 +339,8 @@ public class X86_64 extends X86_64AssignTemps {
 	boolean generateCode(ref<compiler.Unit> mainFile, ref<CompileContext> compileContext) {
 		cacheCodegenObjects(compileContext);
 		_startingHeap = compileContext.startingHeap();
+		_profilePath = compileContext.profilePath();
+		_allocationProfilePath = compileContext.allocationProfilePath();
 //		if (mainFile == null) {
 //			printf("We are about to die...\n");
 //		}
@@ -353,26 +369,63 @@ public class X86_64 extends X86_64AssignTemps {
 	public abstract void writePxi(ref<pxi.Pxi> output);
 	
 	public int, boolean run(string[] args) {
+		ref<runtime.FunctionNames> functionNames;
+		if (_profilePath != null) {
+			if (_functionNames.length == 0) {
+				collectFunctionNames(&_functionOffsets, &_functionNameStrings);
+				for (i in _functionNameStrings)
+					_functionNamePointers.append(_functionNameStrings[i].c_str());
+				_functionNames.length = _functionOffsets.length();
+				_functionNames.offsets = &_functionOffsets[0];
+				_functionNames.names = &_functionNamePointers[0];
+			}
+			functionNames = &_functionNames;
+		}
+		return runImage(&_pxiHeader, _staticMemory, _staticMemoryLength, _startingHeap, _profilePath, functionNames,
+						_allocationProfilePath, args);
+	}
+	/**
+	 * Run an X86-64 image in this process, as parasolrt would run it from a pxi file.
+	 *
+	 * The image is relocated and its native bindings are resolved in place, so it can only be run once.
+	 *
+	 * @param header The header of the image.
+	 * @param image The image, as written to a pxi file, in memory allocated with runtime.allocateRegion.
+	 * @param imageLength The length of the image in bytes.
+	 * @param heap The heap the image runs with.
+	 * @param profilePath If not null, the path to write a profile of the run to.
+	 * @param functionNames If profilePath is not null, the names of the functions in the image.
+	 * @param allocationProfilePath If not null, the path to write an allocation profile of the run to.
+	 * @param args The command line. The first element is the name of the program, the rest are passed to it.
+	 *
+	 * @return The value returned by the program's main function, or 0 if it did not return normally.
+	 * @return true if the program returned normally, false if it failed to start or threw an uncaught exception.
+	 */
+	public static int, boolean runImage(ref<pxi.X86_64SectionHeader> header, pointer<byte> image, int imageLength,
+										memory.StartingHeap heap, string profilePath,
+										ref<runtime.FunctionNames> functionNames, string allocationProfilePath,
+										string[] args) {
 		pointer<byte>[] runArgs;
 		for (int i = 1; i < args.length(); i++)
 			runArgs.append(args[i].c_str());
 		int returnValue;
 		process.stdout.flush();
-		if (!runtime.makeRegionExecutable(_staticMemory, _staticMemoryLength)) {
+		if (!runtime.makeRegionExecutable(image, imageLength)) {
 			assert(false);
 			return 0, false;
 		}
-		pointer<int> pxiFixups = pointer<int>(&_staticMemory[_pxiHeader.relocationOffset]);
+		pointer<int> pxiFixups = pointer<int>(&image[header.relocationOffset]);
 		pointer<long> vp;
-		for (int i = 0; i < _pxiHeader.relocationCount; i++) {
-			vp = pointer<long>(_staticMemory + pxiFixups[i]);
-			*vp += long(address(_staticMemory));
+		for (int i = 0; i < header.relocationCount; i++) {
+			vp = pointer<long>(image + pxiFixups[i]);
+			*vp += long(address(image));
 		}
-		vp = pointer<long>(_staticMemory + _pxiHeader.vtablesOffset);
-		for (int i = 0; i < _pxiHeader.vtableData; i++, vp++)
-			*vp += long(address(_staticMemory));
-		pointer<NativeBinding> nativeBindings = pointer<NativeBinding>(_staticMemory + _pxiHeader.nativeBindingsOffset);
-		for (int i = 0; i < _pxiHeader.nativeBindingsCount; i++) {
+		vp = pointer<long>(image + header.vtablesOffset);
+		for (int i = 0; i < header.vtableData; i++, vp++)
+			*vp += long(address(image));
+		pointer<NativeBinding> nativeBindings = pointer<NativeBinding>(image + header.nativeBindingsOffset);
+		address[string] handles;
+		for (int i = 0; i < header.nativeBindingsCount; i++) {
 			if (runtime.compileTarget == runtime.Target.X86_64_WIN) {
 				windows.HMODULE dll = windows.GetModuleHandle(nativeBindings[i].dllName);
 				if (dll == null) {
@@ -389,7 +442,13 @@ public class X86_64 extends X86_64AssignTemps {
 				if (soName == "libparasol.so.1") {
 					soName = "libparasol.so";
 				}
-				address handle = linux.dlopen(soName.c_str(), linux.RTLD_LAZY);
+				address handle;
+				if (handles.contains(soName))
+					handle = handles[soName];
+				else {
+					handle = linux.dlopen(soName.c_str(), linux.RTLD_LAZY);
+					handles[soName] = handle;
+				}
 				if (handle == null) {
 					printf("Unable to locate shared object %s (%s)\n", soName, linux.dlerror());
 					assert(false);
@@ -411,17 +470,28 @@ public class X86_64 extends X86_64AssignTemps {
 		address outerImage = runtime.imageAddress();
 		int outerImageLength = runtime.imageLength();
 		runtime.setSectionType();
-		runtime.setStartingHeap(_startingHeap);
-		runtime.setPxiHeader(&_pxiHeader);
-		runtime.setImageAddress(_staticMemory);
-		runtime.setImageLength(_staticMemoryLength);
+		runtime.setStartingHeap(heap);
+		runtime.setPxiHeader(header);
+		runtime.setImageAddress(image);
+		runtime.setImageLength(imageLength);
+		pointer<byte> outerProfilePath = runtime.profilePath();
+		ref<runtime.FunctionNames> outerFunctionNames = runtime.functionNames();
+		if (profilePath != null) {
+			runtime.setProfilePath(profilePath.c_str());
+			runtime.setFunctionNames(functionNames);
+		}
+		pointer<byte> outerAllocationProfilePath = runtime.allocationProfilePath();
+		runtime.setAllocationProfilePath(allocationProfilePath != null ? allocationProfilePath.c_str() : null);
 
-		returnValue = runtime.eval(&_pxiHeader, _staticMemory, &runArgs[0], runArgs.length());
+		returnValue = runtime.eval(header, image, &runArgs[0], runArgs.length());
 
 		runtime.setStartingHeap(outerHeap);
 		runtime.setPxiHeader(outerPxiHeader);
 		runtime.setImageAddress(outerImage);
 		runtime.setImageLength(outerImageLength);
+		runtime.setProfilePath(outerProfilePath);
+		runtime.setFunctionNames(outerFunctionNames);
+		runtime.setAllocationProfilePath(outerAllocationProfilePath);
 		if (exception.fetchExposedException() == null)
 			return returnValue, true;
 		else
@@ -475,9 +545,18 @@ public class X86_64 extends X86_64AssignTemps {
 						}
 						substring dllName = ref<Constant>(dll).value();
 						substring symbolName = ref<Constant>(symbol).value();
-						int dllNameOffset = _segments[Segments.BUILT_INS_TEXT].reserve(dllName.length() + 1);
+						// Bindings to the same shared object share its name, so a loader can recognize them
+						// by comparing pointers.
+						int dllNameOffset;
+						string dllKey(dllName);
+						if (_dllNameOffsets.contains(dllKey))
+							dllNameOffset = _dllNameOffsets[dllKey];
+						else {
+							dllNameOffset = _segments[Segments.BUILT_INS_TEXT].reserve(dllName.length() + 1);
+							C.memcpy(_segments[Segments.BUILT_INS_TEXT].at(dllNameOffset), dllName.c_str(), dllName.length());
+							_dllNameOffsets[dllKey] = dllNameOffset;
+						}
 						int symbolNameOffset = _segments[Segments.BUILT_INS_TEXT].reserve(symbolName.length() + 1);
-						C.memcpy(_segments[Segments.BUILT_INS_TEXT].at(dllNameOffset), dllName.c_str(), dllName.length());
 						C.memcpy(_segments[Segments.BUILT_INS_TEXT].at(symbolNameOffset), symbolName.c_str(), symbolName.length());
 						int offset = _segments[Segments.NATIVE_BINDINGS].reserve(NativeBinding.bytes);
 						_segments[Segments.NATIVE_BINDINGS].fixup(offset, byte(Segments.BUILT_INS_TEXT), true);
@@ -568,8 +647,10 @@ public class X86_64 extends X86_64AssignTemps {
 				if (verbose()) {
 					printf("=====  folding %s:%s  =========\n", file.filename(), func != null && func.name() != null ? string(func.name().identifier()) : "<anonymous>");
 				}
+				if (compileContext.inlineFunctions())
+					compiler.captureInlineExpression(parameterScope, compileContext);
 				node = ref<Block>(compileContext.fold(node, file));
-				allocateStackForLocalVariables(compileContext);
+				allocateStackForFunctionVariables(node, compileContext);
 				
 				if (parameterScope.functionCategory() == FunctionDeclaration.Category.CONSTRUCTOR)
 					generateConstructorPreamble(node, parameterScope, compileContext);
@@ -661,7 +742,8 @@ public class X86_64 extends X86_64AssignTemps {
 				if (file.scope() != null)
 					globalFrame.collectAutoScopesUnderUnitScope(file.scope());
 			}
-			f().autoSize = globalFrame.autoStorage(this, 0, compileContext);
+			int size = globalFrame.autoStorage(this, 0, compileContext);
+			f().autoSize = (size + address.bytes - 1) & ~(address.bytes - 1);
 			if (_arena.verbose)
 				printf("Static initializers:\n");
 //			printf("staticBlocks %d\n", staticBlocks().length());
@@ -688,6 +770,18 @@ public class X86_64 extends X86_64AssignTemps {
 					foldAndGenerateStaticInitializers(file.tree(), nl.node, compileContext);
 				}
 			}
+			if (compileContext.coveragePath() != null) {
+				// The counters of the main unit must be registered before any of its code
+				// runs, since top-level code may call process.exit.
+				ref<Symbol> rc = compileContext.forest().getSymbol("parasol", "runtime.registerCoverage", compileContext);
+				if (rc != null && rc.class == Overload) {
+					ref<Type> tp = (*ref<Overload>(rc).instances())[0].assignType(compileContext);
+					if (!tp.deferAnalysis()) {
+						instLoadCoverageTable(firstRegisterArgument());
+						instCall(ref<ParameterScope>(tp.scope()), compileContext);
+					}
+				}
+			}
 			if (_arena.verbose)
 				printf("   %s\n", scope.unit().filename());
 			generateStaticBlock(scope.unit(), compileContext);
@@ -698,6 +792,12 @@ public class X86_64 extends X86_64AssignTemps {
 			if (main != null &&
 				main.class == Overload) {
 				ref<Overload> m = ref<Overload>(main);
+				ref<Symbol> sc = compileContext.forest().getSymbol("parasol", "runtime.startupComplete", compileContext);
+				if (sc != null && sc.class == Overload) {
+					ref<Type> tp = (*ref<Overload>(sc).instances())[0].assignType(compileContext);
+					if (!tp.deferAnalysis())
+						instCall(ref<ParameterScope>(tp.scope()), compileContext);
+				}
 				// Confirm that it has 'function int(string[])' type
 				// generate call to main
 				// MOV RCX,input - find some place to put it.
@@ -956,19 +1056,21 @@ public class X86_64 extends X86_64AssignTemps {
 			ft.assignRegisterArguments(compileContext);
 			ref<ref<Symbol>[]> parameters = parameterScope.parameters();
 
-			// we will need a string to hold the marshalled parameters.
+			// The transport supplies the buffer that holds the marshalled call. It is reused from call to call.
 
-			ref<Variable> serializedArguments = compileContext.newVariable(compileContext.builtInType(runtime.TypeFamily.STRING));
+			ref<Type> byteVector = compileContext.newVectorType(compileContext.builtInType(runtime.TypeFamily.UNSIGNED_8), null);
+			ref<Variable> serializedArguments = compileContext.newVariable(compileContext.newRef(byteVector));
 
-			// 1. marshal the method id (method + func type sig)
+			// 1. start the call with the method id (method + func type sig)
 
 			ref<Node> methodID = tree.newConstant(Operator.STRING, rpcEscape(method.rpcMethod()) + ";", loc);
+			ref<Node> call = transportCall("startCall", methodID, tree, loc);
 			ref<Reference> r = tree.newReference(serializedArguments, 0, true, loc);
-			ref<Node> asg = tree.newBinary(Operator.ASSIGN, r, methodID, loc);
+			ref<Node> asg = tree.newBinary(Operator.ASSIGN, r, call, loc);
 			ref<Node> x = tree.newUnary(Operator.EXPRESSION, asg, loc);
 			block.statement(tree.newNodeList(x));
 
-			// 2. marshal parameters from where they landed to the marshalled parameters string.
+			// 2. marshal parameters from where they landed to the marshalled parameters buffer.
 
 			for (i in *parameters) {
 				ref<Symbol> param = (*parameters)[i];
@@ -977,49 +1079,78 @@ public class X86_64 extends X86_64AssignTemps {
 				marshal(p, serializedArguments, block, tree, loc, compileContext);
 			}
 
-			// 3. call base class 'call' method
+			// 3. call the transport's 'call' method
 
 			r = tree.newReference(serializedArguments, 0, false, loc);
-			ref<Node> me = tree.newLeaf(Operator.THIS, loc);
-			ref<Node> transport = tree.newSelection(me, "_transport", loc);
-			ref<Node> callMethod = tree.newSelection(transport, "call", loc);
-			ref<Node> call = tree.newCall(Operator.CALL, callMethod, tree.newNodeList(r), loc);
+			call = transportCall("call", r, tree, loc);
 			int rCount = ft.returnCount();
+			ref<Node>[] returnExprs;
 			if (rCount == 0) {
 				x = tree.newUnary(Operator.EXPRESSION, call, loc);
 				block.statement(tree.newNodeList(x));
 			} else {
-				ref<Variable> serializedReturns = compileContext.newVariable(compileContext.builtInType(runtime.TypeFamily.STRING));
-				r = tree.newReference(serializedReturns, 0, true, loc);
-				asg = tree.newBinary(Operator.ASSIGN, r, call, loc);
-				x = tree.newUnary(Operator.EXPRESSION, asg, loc);
-				block.statement(tree.newNodeList(x));
 				ref<Type> t = compileContext.newPointer(compileContext.builtInType(runtime.TypeFamily.UNSIGNED_8));
 				ref<Variable> marshalledData = compileContext.newVariable(t);
 				ref<Node> mdr = tree.newReference(marshalledData, 0, true, loc);
-				r = tree.newReference(serializedReturns, 0, false, loc);
-				ref<Node> zero = tree.newInternalLiteral(0, loc);
-				ref<Node> n = tree.newBinary(Operator.SUBSCRIPT, r, zero, loc);
-				n = tree.newUnary(Operator.ADDRESS, n, loc);
-				asg = tree.newBinary(Operator.ASSIGN, mdr, n, loc);
+				asg = tree.newBinary(Operator.ASSIGN, mdr, call, loc);
 				x = tree.newUnary(Operator.EXPRESSION, asg, loc);
 				block.statement(tree.newNodeList(x));
 
-				// 4. unmarshal return expressions from 'call' return value to outputs.
-
-				ref<Node>[] returnExprs;
-
+				// 4. unmarshal return expressions from 'call' return value to outputs. If an unmarshaller
+				// throws, the call is ended before the exception goes on to the caller. A catch handler
+				// cannot rely on the 'this' register, so the transport is copied to a local first:
+
+				//	transport = this._transport;
+				//	try {
+				//		unmarshal...
+				//	} catch (Exception e) {
+				//		transport.endCall(serializedArguments);
+				//		throw e;
+				//	}
+
+				ref<Type> transportType = clientTransport(compileContext);
+				ref<Variable> transport = compileContext.newVariable(compileContext.newRef(transportType));
+				ref<Node> me = tree.newLeaf(Operator.THIS, loc);
+				ref<Node> tr = tree.newReference(transport, 0, true, loc);
+				asg = tree.newBinary(Operator.ASSIGN, tr, tree.newSelection(me, "_transport", loc), loc);
+				block.statement(tree.newNodeList(tree.newUnary(Operator.EXPRESSION, asg, loc)));
+				ref<Block> unmarshalBody = tree.newBlock(Operator.BLOCK, false, loc);
+				ref<Scope> unmarshalScope = compileContext.arena().createScope(outerBlock, unmarshalBody, StorageClass.AUTO);
+				unmarshalBody.scope = unmarshalScope;
 				pointer<ref<Type>> returns = ft.returnTypes();
 				for (int i = 0; i < rCount; i++) {
 					ref<Variable> v = compileContext.newVariable(returns[i]);
 					returnExprs.append(tree.newReference(v, 0, false, loc));
 					ref<Reference> sr = tree.newReference(marshalledData, 0, false, loc);
 					ref<Node> adrSR = tree.newUnary(Operator.ADDRESS, sr, loc);
-					unmarshal(v, 0, returns[i], adrSR, block, tree, loc, compileContext);
+					unmarshal(v, 0, returns[i], adrSR, unmarshalBody, tree, loc, compileContext);
 				}
+				ref<Block> handler = tree.newBlock(Operator.BLOCK, false, loc);
+				ref<Node> typeExpr = exceptionClass(tree, loc, compileContext);
+				ref<Identifier> name = tree.newIdentifier("e", loc);
+				ref<Ternary> catchClause = tree.newTernary(Operator.CATCH, typeExpr, name, handler, loc);
+				ref<Scope> s = compileContext.arena().createScope(outerBlock, catchClause, StorageClass.AUTO);
+				name.bind(s, typeExpr, null, compileContext);
+				ref<Scope> handlerScope = compileContext.arena().createScope(s, handler, StorageClass.AUTO);
+				handler.scope = handlerScope;
+				r = tree.newReference(serializedArguments, 0, false, loc);
+				ref<Node> endCall = tree.newSelection(tree.newReference(transport, 0, false, loc), "endCall", loc);
+				x = tree.newUnary(Operator.EXPRESSION, tree.newCall(Operator.CALL, endCall, tree.newNodeList(r), loc), loc);
+				handler.statement(tree.newNodeList(x));
+				x = tree.newUnary(Operator.THROW, tree.newIdentifier("e", loc), loc);
+				handler.statement(tree.newNodeList(x));
+				block.statement(tree.newNodeList(tree.newTry(unmarshalBody, null, tree.newNodeList(catchClause), loc)));
+			}
+
+			// 5. release the call's buffers
 
-				// 5. return. 
+			r = tree.newReference(serializedArguments, 0, false, loc);
+			x = tree.newUnary(Operator.EXPRESSION, transportCall("endCall", r, tree, loc), loc);
+			block.statement(tree.newNodeList(x));
+
+			// 6. return.
 
+			if (rCount > 0) {
 				x = tree.newReturn(tree.newNodeList(returnExprs), loc);
 				block.statement(tree.newNodeList(x));
 			}
@@ -1041,15 +1172,19 @@ public class X86_64 extends X86_64AssignTemps {
 /*
 				interface I
 
-				public static string stub(I object, ref<rpc.StubParams> params) {
+				public static boolean stub(I object, ref<rpc.StubParams> params) {
  */
 			ref<Block> block = tree.newBlock(Operator.BLOCK, false, loc);
 			ref<Scope> outerBlock = compileContext.arena().createScope(parameterScope, block, StorageClass.AUTO);
 			block.scope = outerBlock;
 /*
-					string output;
+					ref<byte[]> output = params.output;
  */
-			ref<Variable> output = compileContext.newVariable(compileContext.builtInType(runtime.TypeFamily.STRING));
+			ref<Type> byteVector = compileContext.newVectorType(compileContext.builtInType(runtime.TypeFamily.UNSIGNED_8), null);
+			ref<Variable> output = compileContext.newVariable(compileContext.newRef(byteVector));
+			ref<Node> n = tree.newSelection(tree.newIdentifier("params", loc), "output", loc);
+			n = tree.newBinary(Operator.ASSIGN, tree.newReference(output, true, loc), n, loc);
+			block.statement(tree.newNodeList(tree.newUnary(Operator.EXPRESSION, n, loc)));
 /*
 				try {
 					switch (params.methodID) {
@@ -1131,7 +1266,7 @@ public class X86_64 extends X86_64AssignTemps {
 						methodCall = tree.newBinary(Operator.ASSIGN, returns, methodCall, loc);
 					switchBody.statement(tree.newNodeList(tree.newUnary(Operator.EXPRESSION, methodCall, loc)));
 /*
-							rpc.marshalT(&output, &r);
+							rpc.marshalT(output, &r);
  */
 					for (i in returnVars)
 						marshal(tree.newReference(returnVars[i], 0, false, loc), output, switchBody, tree, loc, compileContext);
@@ -1143,12 +1278,12 @@ public class X86_64 extends X86_64AssignTemps {
 
 /*	
 						default:
-							return null;
+							return false;
  */
-			n = tree.newLeaf(Operator.NULL, loc);
-			n.type = output.type;
-			ref<Node> retnNull = tree.newReturn(tree.newNodeList(n), loc);
-			ref<Node> defaultCase = tree.newUnary(Operator.DEFAULT, retnNull, loc);
+			n = tree.newLeaf(Operator.FALSE, loc);
+			n.type = compileContext.builtInType(runtime.TypeFamily.BOOLEAN);
+			ref<Node> retnFalse = tree.newReturn(tree.newNodeList(n), loc);
+			ref<Node> defaultCase = tree.newUnary(Operator.DEFAULT, retnFalse, loc);
 			switchBody.statement(tree.newNodeList(defaultCase));
 /*
 						}
@@ -1160,24 +1295,25 @@ public class X86_64 extends X86_64AssignTemps {
 					} catch (Exception e) {
  */
 
-			ref<Node> typeExpr = tree.newIdentifier("Exception", loc);
+			ref<Node> typeExpr = exceptionClass(tree, loc, compileContext);
 			ref<Identifier> name = tree.newIdentifier("e", loc);
-			ref<Node> n = tree.newLeaf(Operator.NULL, loc);
-			n.type = output.type;
+			n = tree.newLeaf(Operator.FALSE, loc);
+			n.type = compileContext.builtInType(runtime.TypeFamily.BOOLEAN);
 			ref<Node> clause = tree.newReturn(tree.newNodeList(n), loc);
 			ref<Ternary> catchClause = tree.newTernary(Operator.CATCH, typeExpr, name, clause, loc);
 			ref<Scope> s = compileContext.arena().createScope(outerBlock, catchClause, StorageClass.AUTO);
 			name.bind(s, typeExpr, null, compileContext);
 /*
-						return null;
+						return false;
 					}
  */
 			block.statement(tree.newNodeList(tree.newTry(tryBody, null, tree.newNodeList(catchClause), loc)));
 /*				
-					return output;
+					return true;
 				}
  */
-			n = tree.newReference(output, false, loc);
+			n = tree.newLeaf(Operator.TRUE, loc);
+			n.type = compileContext.builtInType(runtime.TypeFamily.BOOLEAN);
 			block.statement(tree.newNodeList(tree.newReturn(tree.newNodeList(n), loc)));
 			compileContext.exemptScopes();
 			return block;
@@ -1191,6 +1327,16 @@ public class X86_64 extends X86_64AssignTemps {
 		return null;
 	}
 
+	/*
+	 * Build a call of a method of the ClientTransport of a proxy object: this._transport.name(argument).
+	 */
+	private ref<Node> transportCall(string name, ref<Node> argument, ref<SyntaxTree> tree, compiler.SourceOffset loc) {
+		ref<Node> me = tree.newLeaf(Operator.THIS, loc);
+		ref<Node> transport = tree.newSelection(me, "_transport", loc);
+		ref<Node> method = tree.newSelection(transport, name, loc);
+		return tree.newCall(Operator.CALL, method, tree.newNodeList(argument), loc);
+	}
+
 	private void marshal(ref<Node> value, ref<Variable> output, ref<Block> block, ref<SyntaxTree> tree, compiler.SourceOffset loc, ref<CompileContext> compileContext) {
 		ref<Type> t = value.type;
 		switch (t.family()) {
@@ -1310,9 +1456,8 @@ public class X86_64 extends X86_64AssignTemps {
 			ref<Node> method = tree.newIdentifier(ref<FunctionDeclaration>(marsh.definition()).name().symbol(), loc);
 			method.type = marsh.type;
 			ref<Reference> outputRef = tree.newReference(output, 0, false, loc);
-			ref<Node> adr1 = tree.newUnary(Operator.ADDRESS, outputRef, loc);
-			ref<Node> adr2 = tree.newUnary(Operator.ADDRESS, value, loc);
-			ref<Node> call = tree.newCall(marsh, CallCategory.FUNCTION_CALL, method, tree.newNodeList(adr1, adr2), loc, compileContext); 
+			ref<Node> adr = tree.newUnary(Operator.ADDRESS, value, loc);
+			ref<Node> call = tree.newCall(marsh, CallCategory.FUNCTION_CALL, method, tree.newNodeList(outputRef, adr), loc, compileContext); 
 			block.statement(tree.newNodeList(tree.newUnary(Operator.EXPRESSION, call, loc)));
 		}
 	}
@@ -1488,6 +1633,29 @@ public class X86_64 extends X86_64AssignTemps {
 		return _rpcClientCall;
 	}
 
+	/*
+	 * Build a reference to parasol:exception.Exception for the catch clause of generated code. It is bound to
+	 * the symbol, so a unit that declares or imports some other Exception does not change what is caught.
+	 */
+	private ref<Node> exceptionClass(ref<SyntaxTree> tree, compiler.SourceOffset loc, ref<CompileContext> compileContext) {
+		if (_exceptionClass == null) {
+			_exceptionClass = compileContext.forest().getSymbol("parasol", "exception.Exception", compileContext);
+			assert(_exceptionClass != null && _exceptionClass.class == PlainSymbol);
+		}
+		ref<Node> n = tree.newIdentifier(_exceptionClass, loc);
+		n.type = _exceptionClass.assignType(compileContext);
+		return n;
+	}
+
+	private ref<Type> clientTransport(ref<CompileContext> compileContext) {
+		if (_clientTransport == null) {
+			ref<Symbol> sym = compileContext.forest().getSymbol("parasol", "rpc.ClientTransport", compileContext);
+			assert(sym != null && sym.class == PlainSymbol);
+			_clientTransport = ref<PlainSymbol>(sym).assignType(compileContext).wrappedType();
+		}
+		return _clientTransport;
+	}
+
 	private void generateDestructorShutdown(ref<ParameterScope> parameterScope, ref<CompileContext> compileContext) {
 		ref<ClassScope> classScope = ref<ClassScope>(parameterScope.enclosing());
 		assert(classScope.storageClass() == StorageClass.MEMBER);
@@ -1632,6 +1800,19 @@ public class X86_64 extends X86_64AssignTemps {
 		_stackLocalVariables = v.length();
 	}
 	
+	/*
+	 * Like allocateStackForLocalVariables, but temporaries whose lifetimes in the folded body do not
+	 * overlap share stack slots.
+	 */
+	private void allocateStackForFunctionVariables(ref<Node> body, ref<CompileContext> compileContext) {
+		ref<ref<Variable>[]> v = compileContext.variables();
+		if (_stackLocalVariables >= v.length())
+			return;
+		FrameLayout layout(v, _stackLocalVariables);
+		f().autoSize = layout.allocate(body, f().autoSize);
+		_stackLocalVariables = v.length();
+	}
+
 	private void generateConstructorPreamble(ref<Block> constructorBody, ref<ParameterScope> scope, ref<CompileContext> compileContext) {
 		int firstMemberOffset = scope.enclosing().firstMemberOffset(compileContext);
 		if (scope.enclosing().variableStorage > firstMemberOffset) {
@@ -4290,9 +4471,12 @@ public class X86_64 extends X86_64AssignTemps {
 			}
 			
 		case	FUNCTION_CALL:
-			if (overload != null)
+			if (overload != null) {
 				instCall(overload, compileContext);
-			else {
+				// A Parasol function removes its stack arguments when it returns, a native function does not.
+				if (overload.nativeBinding)
+					cleanup += stackPushes;
+			} else {
 				ref<Node> func = call.target();
 				assert(func != null);
 				if (func.type.family() == runtime.TypeFamily.VAR) {
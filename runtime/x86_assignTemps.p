@@ -25,6 +25,7 @@ import parasol:compiler.Binary;
 import parasol:compiler.Call;
 import parasol:compiler.CallCategory;
 import parasol:compiler.CompileContext;
+import parasol:compiler.CompilePhase;
 import parasol:compiler.EllipsisArguments;
 import parasol:compiler.FunctionType;
 import parasol:compiler.Node;
@@ -46,7 +47,47 @@ import parasol:compiler.USE_COMPARE_METHOD;
 import parasol:runtime;
 
 class X86_64AssignTemps extends X86_64AddressModes {
+	/*
+	 * The entry points used by the code generator. The work of each is charged to ASSIGN_TEMPS when the
+	 * compile is being timed.
+	 */
 	void assignVoidContext(ref<Node> node, ref<CompileContext> compileContext) {
+		if (compileContext.timings != null) {
+			compileContext.timings.enter(CompilePhase.ASSIGN_TEMPS);
+			assignVoidContextCore(node, compileContext);
+			compileContext.timings.exit();
+		} else
+			assignVoidContextCore(node, compileContext);
+	}
+
+	void assignConditionCode(ref<Node> node, ref<CompileContext> compileContext) {
+		if (compileContext.timings != null) {
+			compileContext.timings.enter(CompilePhase.ASSIGN_TEMPS);
+			assignConditionCodeCore(node, compileContext);
+			compileContext.timings.exit();
+		} else
+			assignConditionCodeCore(node, compileContext);
+	}
+
+	void assignSingleReturn(ref<Return> retn, ref<Node> value, ref<CompileContext> compileContext) {
+		if (compileContext.timings != null) {
+			compileContext.timings.enter(CompilePhase.ASSIGN_TEMPS);
+			assignSingleReturnCore(retn, value, compileContext);
+			compileContext.timings.exit();
+		} else
+			assignSingleReturnCore(retn, value, compileContext);
+	}
+
+	void assignMultiReturn(ref<Return> retn, ref<Node> value, ref<CompileContext> compileContext) {
+		if (compileContext.timings != null) {
+			compileContext.timings.enter(CompilePhase.ASSIGN_TEMPS);
+			assignMultiReturnCore(retn, value, compileContext);
+			compileContext.timings.exit();
+		} else
+			assignMultiReturnCore(retn, value, compileContext);
+	}
+
+	private void assignVoidContextCore(ref<Node> node, ref<CompileContext> compileContext) {
 		if	(node.deferGeneration())
 			return;
 //		printf("AssignVoidContext:\n");
@@ -73,8 +114,8 @@ class X86_64AssignTemps extends X86_64AddressModes {
 		case	LOGICAL_OR:
 		case	LOGICAL_AND:
 			b = ref<Binary>(node);
-			assignVoidContext(b.left(), compileContext);
-			assignVoidContext(b.right(), compileContext);
+			assignVoidContextCore(b.left(), compileContext);
+			assignVoidContextCore(b.right(), compileContext);
 			node.register = byte(int(R.NO_REG));
 			break;
 
@@ -228,9 +269,9 @@ class X86_64AssignTemps extends X86_64AddressModes {
 			
 		case	CONDITIONAL:
 			ref<Ternary> cond = ref<Ternary>(node);
-			assignConditionCode(cond.left(), compileContext);
-			assignVoidContext(cond.middle(), compileContext);
-			assignVoidContext(cond.right(), compileContext);
+			assignConditionCodeCore(cond.left(), compileContext);
+			assignVoidContextCore(cond.middle(), compileContext);
+			assignVoidContextCore(cond.right(), compileContext);
 			break;
 
 		case	LEFT_COMMA:
@@ -256,7 +297,7 @@ class X86_64AssignTemps extends X86_64AddressModes {
 		f().r.cleanupTemps(node, depth);
 	}
 
-	void assignConditionCode(ref<Node> node, ref<CompileContext> compileContext) {
+	private void assignConditionCodeCore(ref<Node> node, ref<CompileContext> compileContext) {
 		int depth = tempStackDepth();
 		switch (node.op()) {
 		case	EQUALITY:
@@ -304,19 +345,19 @@ class X86_64AssignTemps extends X86_64AddressModes {
 		case	LOGICAL_OR:
 		case	LOGICAL_AND:
 			b = ref<Binary>(node);
-			assignConditionCode(b.left(), compileContext);
-			assignConditionCode(b.right(), compileContext);
+			assignConditionCodeCore(b.left(), compileContext);
+			assignConditionCodeCore(b.right(), compileContext);
 			break;
 			
 		case	SEQUENCE:
 			b = ref<Binary>(node);
-			assignVoidContext(b.left(), compileContext);
+			assignVoidContextCore(b.left(), compileContext);
 			assignRegisterTemp(b.right(), longMask(), compileContext);
 			break;
 			
 		case	NOT:
 			ref<Unary> u = ref<Unary>(node);
-			assignConditionCode(u.operand(), compileContext);
+			assignConditionCodeCore(u.operand(), compileContext);
 			break;
 
 		case	INDIRECT:
@@ -337,7 +378,7 @@ class X86_64AssignTemps extends X86_64AddressModes {
 			break;
 			
 		case	CALL:
-			assignVoidContext(node, compileContext);
+			assignVoidContextCore(node, compileContext);
 			break;
 			
 		default:
@@ -378,15 +419,15 @@ class X86_64AssignTemps extends X86_64AddressModes {
 		case	LOGICAL_OR:
 		case	LOGICAL_AND:
 			b = ref<Binary>(node);
-			assignConditionCode(b.left(), compileContext);
-			assignConditionCode(b.right(), compileContext);
+			assignConditionCodeCore(b.left(), compileContext);
+			assignConditionCodeCore(b.right(), compileContext);
 			node.register = byte(f().r.getreg(node, regMask, regMask));
 			f().r.cleanupTemps(node, depth);
 			break;
 			
 		case	SEQUENCE:
 			b = ref<Binary>(node);
-			assignVoidContext(b.left(), compileContext);
+			assignVoidContextCore(b.left(), compileContext);
 			assignRegisterTemp(b.right(), regMask, compileContext);
 			f().r.cleanupTemps(node, depth);
 			node.register = b.right().register;
@@ -714,7 +755,7 @@ class X86_64AssignTemps extends X86_64AddressModes {
 //			printf("\n\nbefore test (desired depth=%d current depth=%d):\n", depth, tempStackDepth());
 //			f().r.print();
 			f().r.clobberSomeRegisters(conditional, callMask());
-			assignConditionCode(conditional.left(), compileContext);
+			assignConditionCodeCore(conditional.left(), compileContext);
 //			printf("\n\nbefore first cleanup (desired depth=%d current depth=%d):\n", depth, tempStackDepth());
 //			f().r.print();
 			f().r.cleanupTemps(node, depth);
@@ -1266,7 +1307,7 @@ class X86_64AssignTemps extends X86_64AddressModes {
 		}
 	}
 	
-	void assignSingleReturn(ref<Return> retn, ref<Node> value, ref<CompileContext> compileContext) {
+	private void assignSingleReturnCore(ref<Return> retn, ref<Node> value, ref<CompileContext> compileContext) {
 		ref<ParameterScope> enclosing = f().current.enclosingFunction();
 		ref<FunctionType> functionType = enclosing.type;
 		pointer<ref<Type>> returnTypes = functionType.returnTypes();
@@ -1275,8 +1316,8 @@ class X86_64AssignTemps extends X86_64AddressModes {
 			returnTypes[0].returnsViaOutParameter(compileContext)) {
 			if (value.op() == Operator.SEQUENCE) {
 				ref<Binary> b = ref<Binary>(value);
-				assignVoidContext(b.left(), compileContext);
-				assignSingleReturn(retn, b.right(), compileContext);
+				assignVoidContextCore(b.left(), compileContext);
+				assignSingleReturnCore(retn, b.right(), compileContext);
 			} else {
 				switch (value.type.size()) {
 				case	1:
@@ -1291,7 +1332,7 @@ class X86_64AssignTemps extends X86_64AddressModes {
 						assignLvalueTemps(value, compileContext);
 					else
 						// else this is an rvalue expression and we have to get our value from somewhere else
-						assignVoidContext(value, compileContext);
+						assignVoidContextCore(value, compileContext);
 				}
 			}
 		} else if (retn.type.isFloat())
@@ -1301,12 +1342,12 @@ class X86_64AssignTemps extends X86_64AddressModes {
 		f().r.cleanupTemps(retn, depth);
 	}
 	
-	void assignMultiReturn(ref<Return> retn, ref<Node> value, ref<CompileContext> compileContext) {
+	private void assignMultiReturnCore(ref<Return> retn, ref<Node> value, ref<CompileContext> compileContext) {
 		if (value.op() ==  Operator.SEQUENCE) {
 			ref<Binary> b = ref<Binary>(value);
 
-			assignVoidContext(b.left(), compileContext);
- 			assignMultiReturn(retn, b.right(), compileContext);
+			assignVoidContextCore(b.left(), compileContext);
+ 			assignMultiReturnCore(retn, b.right(), compileContext);
 			return;
 		}
 		int depth = tempStackDepth();
@@ -1346,7 +1387,7 @@ class X86_64AssignTemps extends X86_64AddressModes {
 				
 				// This can happen for a multi-return of a multi-call, where this is the call part.
 				if (args.node.register == 0) {
-					assignVoidContext(args.node, compileContext);
+					assignVoidContextCore(args.node, compileContext);
 					continue;
 				}
 				if (args.node.register == 0xff)
@@ -1396,12 +1437,12 @@ class X86_64AssignTemps extends X86_64AddressModes {
 			switch (arg.op()) {
 			case	SEQUENCE:
 				ref<Binary> b = ref<Binary>(arg);
-				assignVoidContext(b.left(), compileContext);
+				assignVoidContextCore(b.left(), compileContext);
 				assignStackArgument(b.right(), compileContext);
 				break;
 				
 			case	CALL:
-				assignVoidContext(arg, compileContext);
+				assignVoidContextCore(arg, compileContext);
 				break;
 			
 			case	VACATE_ARGUMENT_REGISTERS:
@@ -1508,7 +1549,7 @@ class X86_64AssignTemps extends X86_64AddressModes {
 			
 		case	SEQUENCE:
 			ref<Binary> b = ref<Binary>(node);
-			assignVoidContext(b.left(), compileContext);
+			assignVoidContextCore(b.left(), compileContext);
 			assignLvalueTemps(b.right(), compileContext);
 			break;
 			
@@ -23,6 +23,7 @@ import parasol:compiler.Binary;
 import parasol:compiler.Block;
 import parasol:compiler.ClassScope;
 import parasol:compiler.CompileContext;
+import parasol:compiler.CompilePhase;
 import parasol:compiler.Constant;
 import parasol:compiler.EnumInstanceType;
 import parasol:compiler.EnumType;
@@ -211,6 +212,7 @@ enum Segments {
 	VTABLES,
 
 	DATA_8,
+	COVERAGE,
 	STRINGS,
 	DATA_4,
 	DATA_2,
@@ -257,6 +259,8 @@ class X86_64Encoder extends Target {
 	private ref<JumpContext> _jumpContext;
 	private TempStack _t;
 	private ref<Fixup> _fixups;
+	private string _coveragePath;
+	private int[] _coverageLocations;			// Pairs of code offset, counter index
 	
 	protected X86_64Encoder() {
 		_dataMap.resize(9);
@@ -268,6 +272,7 @@ class X86_64Encoder extends Target {
 		_segments[Segments.VTABLES] = new Segment(8);
 
 		_segments[Segments.DATA_8] = new Segment(8);
+		_segments[Segments.COVERAGE] = new Segment(8);
 		_segments[Segments.STRINGS] = new Segment(4);
 		_segments[Segments.DATA_4] = new Segment(4);
 		_segments[Segments.DATA_2] = new Segment(2);
@@ -293,6 +298,9 @@ class X86_64Encoder extends Target {
 	boolean generateCode(ref<Unit> mainFile, ref<CompileContext> compileContext) {
 		_segments[Segments.CODE].reserve(pxi.X86_64SectionHeader.bytes);
 		_segments[Segments.SOURCE_LOCATIONS].reserve(pxi.X86_64SourceMap.bytes);
+		_coveragePath = compileContext.coveragePath();
+		if (_coveragePath != null)
+			_segments[Segments.COVERAGE].reserve(pxi.X86_64CoverageTable.bytes);
 		if (mainFile != null) {
 			// Storage has been allocated in the derived class for all static objects.
 			// Now we need to generate the executable code for the static initializers,
@@ -325,6 +333,9 @@ class X86_64Encoder extends Target {
 		}
 
 		appendExceptionEntry(int.MAX_VALUE, null);
+
+		if (_coveragePath != null)
+			finishCoverageTable();
 		
 		int segmentsLength = 0;
 
@@ -383,6 +394,10 @@ class X86_64Encoder extends Target {
 //				*ref<int>(&code[f.location]) = _pxiHeader.stringsOffset + int(f.value) - (f.location + int.bytes);
 				break;
 
+			case	RELATIVE32_COVERAGE:			// Fixup value is an int offset into the coverage table
+				codeFixup(f.location, Segments.COVERAGE, int(f.value));
+				break;
+
 			case	RELATIVE32_VTABLE:				// Fixup value is a ref<ClassScope>
 				ref<ClassScope> scope = ref<ClassScope>(f.value);
 				codeFixup(f.location, Segments.VTABLES, int(scope.vtable) - 1);
@@ -490,6 +505,25 @@ class X86_64Encoder extends Target {
 		return true;
 	}
 
+	/*
+	 * The coverage table has a fixed header, followed by the counters allocated while
+	 * generating code. This fills in the header and appends the list of source locations
+	 * covered by each counter, then the path of the file the counts are accumulated in.
+	 */
+	private void finishCoverageTable() {
+		ref<Segment> s = _segments[Segments.COVERAGE];
+		int counters = (s.length() - pxi.X86_64CoverageTable.bytes) / long.bytes;
+		int locations = _coverageLocations.length() / 2;
+		if (locations > 0)
+			s.append(&_coverageLocations[0], _coverageLocations.length() * int.bytes);
+		int pathOffset = s.reserve(_coveragePath.length() + 1, 1);
+		C.memcpy(s.at(pathOffset), _coveragePath.c_str(), _coveragePath.length());
+		ref<pxi.X86_64CoverageTable> table = ref<pxi.X86_64CoverageTable>(s.at(0));
+		table.counterCount = counters;
+		table.locationCount = locations;
+		table.pathOffset = pathOffset;
+	}
+
 	private void codeFixup(int location, Segments segment, int contents) {
 		ref<Segment> s = _segments[Segments.CODE];
 		*ref<int>(s.at(location)) += contents;
@@ -779,9 +813,15 @@ class X86_64Encoder extends Target {
 				break;
 
 			case	AUTO:
-				// Round auto sizes up to next slot size - do not try to optimize stack frame yet.
-				size = type.stackSize();
-				scope.variableStorage += size;
+				// The scope visits its locals in decreasing order of alignment, so aligning each one
+				// packs them without padding.
+				size = type.size();
+				alignment = type.alignment();
+				if (alignment <= 0) {
+					size = type.stackSize();
+					alignment = address.bytes;
+				}
+				scope.variableStorage = (scope.variableStorage + size + alignment - 1) & ~(alignment - 1);
 				symbol.offset = -scope.variableStorage;
 				break;
 
@@ -887,6 +927,26 @@ class X86_64Encoder extends Target {
 		d.setVtablesClasses(&_vtables);
 		return d.disassemble();
 	}
+	/**
+	 * Fill in the image offsets and names of the generated functions, in address order.
+	 */
+	protected void collectFunctionNames(ref<int[]> offsets, ref<string[]> names) {
+		for (i in _functionMap) {
+			ref<Scope> scope = _functionMap[i];
+			int offset = scope.functionAddress();
+			if (offset < 0)
+				offsets.append(_pxiHeader.entryPoint);
+			else
+				offsets.append(offset);
+			if (scope.class <= ParameterScope) {
+				string label = ref<ParameterScope>(scope).label();
+				if (label.startsWith("."))				// Functions declared at file scope
+					label = label.substr(1);
+				names.append(label);
+			} else
+				names.append("<static initializers>");
+		}
+	}
 
 	public abstract ref<ParameterScope>, boolean getFunctionAddress(ref<ParameterScope> functionScope, ref<CompileContext> compileContext);
 	
@@ -915,8 +975,13 @@ class X86_64Encoder extends Target {
 			ref<ParameterScope> parameterScope = ref<ParameterScope>(scope);
 			markRegisterParameters(parameterScope, compileContext);
 		}
+		if (compileContext.timings != null)
+			compileContext.timings.enter(CompilePhase.GENERATE, scope.unit());
 		generateFunctionCore(scope, compileContext);
+		compileContext.enterPhase(CompilePhase.OPTIMIZE_JUMPS);
 		int offset = packFunction();
+		compileContext.exitPhase();
+		compileContext.exitPhase();
 		_f = savedState;
 		_functionMap.append(scope);
 		return offset;
@@ -969,7 +1034,9 @@ class X86_64Encoder extends Target {
 	public abstract void generateFunctionCore(ref<Scope> scope, ref<CompileContext> compileContext);
 
 	void reserveAutoStorage(ref<Scope> scope, ref<CompileContext> compileContext) {
-		_f.autoSize = scope.autoStorage(this, _f.registerSaveSize, compileContext);
+		// Locals are packed by size, so round up to keep temporaries allocated below them aligned.
+		int size = scope.autoStorage(this, _f.registerSaveSize, compileContext);
+		_f.autoSize = (size + address.bytes - 1) & ~(address.bytes - 1);
 	}
 
 	/**
@@ -1070,6 +1137,10 @@ class X86_64Encoder extends Target {
 				} 
 			}
 			_emitting.sourceLocations.append(loc, &encoder._storage);
+			// Each basic block with a source location gets a counter, placed at its first
+			// statement, where the condition codes are not live.
+			if (encoder._coveragePath != null && _emitting.coverageCounter < 0)
+				_emitting.coverageCounter = encoder.instCoverageCounter();
 		}
 	
 		void showCS(ref<X86_64Encoder> encoder) {
@@ -1143,8 +1214,13 @@ class X86_64Encoder extends Target {
 			ref<Segment> seg = encoder._segments[Segments.CODE];
 			pointer<byte> code = seg.at(0);
 			for (ref<CodeSegment> cs = _first; cs != null; cs = cs.next) {
-				for (i in cs.sourceLocations)
+				for (i in cs.sourceLocations) {
 					cs.sourceLocations[i].offset += nextCopy;
+					if (cs.coverageCounter >= 0) {
+						encoder._coverageLocations.append(cs.sourceLocations[i].offset);
+						encoder._coverageLocations.append(cs.coverageCounter);
+					}
+				}
 
 				encoder._sourceLocations.append(cs.sourceLocations);
 				encoder.emitExceptionEntry(nextCopy, cs.exceptionHandler);
@@ -1223,10 +1299,12 @@ class X86_64Encoder extends Target {
 		public int ordinal;
 		public int segmentOffset;
 		public SourceLocation[] sourceLocations;
+		public int coverageCounter;			// index of the coverage counter of this segment, or -1 if none.
 		
 		CodeSegment() {
 			continuation = CC.NOP;
 			jumpDistance = JumpDistance.UNKNOWN;
+			coverageCounter = -1;
 		}
 
 		void start(ref<X86_64Encoder> encoder) {
@@ -2911,6 +2989,32 @@ class X86_64Encoder extends Target {
 		enumAddressModRM(symbol, rmValues[reg], 0, n.type != null ? offset * n.type.size() : 0);
 	}
 
+	/*
+	 * Emit an increment of a newly allocated coverage counter: inc qword ptr [rip+counter].
+	 * The increment is not locked, so a counter may undercount code run concurrently from
+	 * several threads, but it never reads as zero once the code has run.
+	 *
+	 * @return The index of the counter.
+	 */
+	int instCoverageCounter() {
+		ref<Segment> s = _segments[Segments.COVERAGE];
+		int offset = s.reserve(long.bytes);
+		emit(0x48);
+		emit(0xff);
+		modRM(0, 0, 5);
+		fixup(FixupKind.RELATIVE32_COVERAGE, address(offset));
+		emitInt(0);
+		return (offset - pxi.X86_64CoverageTable.bytes) / long.bytes;
+	}
+
+	void instLoadCoverageTable(R reg) {
+		emitRex(runtime.TypeFamily.SIGNED_64, null, reg, R.NO_REG);
+		emit(0x8d);
+		modRM(0, rmValues[reg], 5);
+		fixup(FixupKind.RELATIVE32_COVERAGE, address(0));
+		emitInt(0);
+	}
+
 	void instString(X86 instruction, R left, string literal) {
 		int offset = addStringLiteral(literal);
 		emitRex(runtime.TypeFamily.SIGNED_64, null, left, R.NO_REG);
@@ -4242,6 +4346,7 @@ enum FixupKind {
 	RELATIVE32_STRING,				// Fixup value is an int offset into the string pool
 	RELATIVE32_VTABLE,				// Fixup value is a ref<ClassScope>
 	RELATIVE32_FPDATA,				// Fixup value is a ref<Constant>
+	RELATIVE32_COVERAGE,			// Fixup value is an int offset into the coverage table
 	LOCAL32_CODE,					// Fixup value is a ref<CodeSegment>
 	ABSOLUTE64_JUMP,				// Fixup value is a ref<CodeSegment>
 	ABSOLUTE64_CODE,				// Fixup value is a ref<Scope>
@@ -4267,6 +4372,7 @@ class Fixup {
 		case	RELATIVE32_TYPE:				// Fixup value is a ref<Type>
 		case	RELATIVE32_VTABLE:				// Fixup value is a ref<ClassScope>
 		case	RELATIVE32_FPDATA:				// Fixup value is a ref<Constant>
+		case	RELATIVE32_COVERAGE:			// Fixup value is an int offset into the coverage table
 		case	ABSOLUTE64_JUMP:				// Fixup value is a ref<CodeSegment>
 		case	ABSOLUTE64_CODE:				// Fixup value is a ref<Scope>
 		case	ABSOLUTE64_DATA:				// Fixup value is a ref<Symbol>
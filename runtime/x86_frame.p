@@ -0,0 +1,208 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+namespace parasol:x86_64;
+
+import parasol:compiler.Binary;
+import parasol:compiler.Node;
+import parasol:compiler.Operator;
+import parasol:compiler.Reference;
+import parasol:compiler.TraverseAction;
+import parasol:compiler.Variable;
+/*
+ * Stack slots for the temporary variables of a function.
+ *
+ * Folding a function body creates a Variable for each temporary the generated code needs. Each Variable
+ * is reached only through the Reference nodes of the folded body, so the statements holding those
+ * references bound the lifetime of the Variable. Variables whose lifetimes do not overlap share a slot.
+ *
+ * Statements are numbered in the order they appear. A Variable lives from the first to the last statement
+ * referring to it. A reference made by a compound statement itself, such as the object of a lock or the
+ * control value of a switch, lives until the end of the compound statement. Control can return to the top
+ * of a loop, so the whole of a loop counts as a single statement. Temporaries used by the same statement
+ * never share a slot, so the order in which the parts of an expression are evaluated does not matter.
+ *
+ * The prologue zeroes the frame, and some generated code counts on that, reading a temporary (such as the
+ * output string of an RPC stub) before ever storing to it. Only a Variable whose first reference stores a
+ * whole value into it can take over a slot used earlier in the function.
+ */
+class FrameLayout {
+	private ref<ref<Variable>[]> _variables;
+	private int _firstVariable;
+	private int[] _first;					// indexed by variable - _firstVariable, -1 if never referenced
+	private int[] _last;
+	private boolean[] _storedFirst;			// the first reference overwrites the variable without reading it
+	private int _statement;
+	private ref<Node> _current;				// the statement whose children are being traversed
+	private int[] _pending;					// variables referred to directly by _current
+	private boolean _inLoop;
+	private ref<Node> _storeTarget;			// the left operand of the store being traversed
+
+	FrameLayout(ref<ref<Variable>[]> variables, int firstVariable) {
+		_variables = variables;
+		_firstVariable = firstVariable;
+		for (int i = firstVariable; i < variables.length(); i++) {
+			_first.append(-1);
+			_last.append(-1);
+			_storedFirst.append(false);
+			// Until the variables are allocated, the offset of each is its index here.
+			(*variables)[i].offset = i - firstVariable;
+		}
+	}
+	/**
+	 * Assign a frame offset to each of the variables.
+	 *
+	 * @param body The folded body of the function.
+	 * @param autoSize The size of the frame before any of the variables are allocated.
+	 *
+	 * @return The size of the frame including the variables.
+	 */
+	int allocate(ref<Node> body, int autoSize) {
+		body.traverse(Node.Traversal.PRE_ORDER, collectLiveRange, this);
+		FrameSlot[] slots;
+		// Allocate in order of first use, breaking ties by order of creation.
+		long[] order;
+		for (i in _first)
+			order.append((long(_first[i] + 1) << 32) + i);
+		order.sort();
+		for (i in order) {
+			int index = int(order[i] & 0xffffffff);
+			ref<Variable> v = (*_variables)[_firstVariable + index];
+			int size = v.stackSize();
+			int best = -1;
+			if (_storedFirst[index]) {
+				for (j in slots) {
+					if (slots[j].freeAfter < _first[index] && slots[j].size >= size &&
+						(best < 0 || slots[j].size < slots[best].size))
+						best = j;
+				}
+			}
+			if (best < 0) {
+				FrameSlot s;
+				autoSize += size;
+				s.offset = -autoSize;
+				s.size = size;
+				best = slots.length();
+				slots.append(s);
+			}
+			v.offset = slots[best].offset;
+			// A variable that is never referenced keeps its slot for the whole function.
+			slots[best].freeAfter = _first[index] >= 0 ? _last[index] : int.MAX_VALUE;
+		}
+		return autoSize;
+	}
+
+	private static TraverseAction collectLiveRange(ref<Node> n, address data) {
+		ref<FrameLayout> layout = ref<FrameLayout>(data);
+		if (n == layout._current)
+			return TraverseAction.CONTINUE_TRAVERSAL;
+		switch (n.op()) {
+		case VARIABLE:
+			ref<Variable> v = ref<Reference>(n).variable();
+			if (v == null)
+				break;
+			int index = v.offset;
+			if (index >= 0 && index < layout._first.length() &&
+				(*layout._variables)[layout._firstVariable + index] == v)
+				layout.referenced(index, n == layout._storeTarget);
+			break;
+
+		case STORE_TEMP:
+		case ASSIGN_TEMP:
+		case ASSIGN:
+		case INITIALIZE:
+			layout._storeTarget = ref<Binary>(n).left();
+			break;
+
+		case FUNCTION:
+		case CLASS:
+		case MONITOR_CLASS:
+		case INTERFACE:
+		case ENUM:
+		case FLAGS:
+			// Nested declarations are generated separately.
+			return TraverseAction.SKIP_CHILDREN;
+
+		case LOOP:
+		case FOR:
+		case SCOPED_FOR:
+		case WHILE:
+		case DO_WHILE:
+			if (layout._inLoop)
+				break;
+			layout._statement++;
+			layout._inLoop = true;
+			layout.statement(n);
+			layout._inLoop = false;
+			return TraverseAction.SKIP_CHILDREN;
+
+		case BLOCK:
+		case EXPRESSION:
+		case DECLARATION:
+		case RETURN:
+		case IF:
+		case SWITCH:
+		case CASE:
+		case DEFAULT:
+		case LOCK:
+		case TRY:
+		case CATCH:
+		case THROW:
+		case DESTRUCTOR_LIST:
+		case BREAK:
+		case CONTINUE:
+		case EMPTY:
+			if (layout._inLoop)
+				break;
+			layout._statement++;
+			layout.statement(n);
+			return TraverseAction.SKIP_CHILDREN;
+		}
+		return TraverseAction.CONTINUE_TRAVERSAL;
+	}
+	/*
+	 * Visit the children of a statement, then extend the lifetimes of the variables it refers to
+	 * directly through the end of any statements nested in it.
+	 */
+	private void statement(ref<Node> n) {
+		ref<Node> outer = _current;
+		int[] outerPending = _pending;
+		_current = n;
+		_pending.clear();
+		n.traverse(Node.Traversal.PRE_ORDER, collectLiveRange, this);
+		for (i in _pending)
+			if (_last[_pending[i]] < _statement)
+				_last[_pending[i]] = _statement;
+		_current = outer;
+		_pending = outerPending;
+	}
+
+	private void referenced(int index, boolean store) {
+		if (_first[index] < 0) {
+			_first[index] = _statement;
+			_storedFirst[index] = store;
+		} else if (!store && _first[index] == _statement)
+			_storedFirst[index] = false;		// the store may depend on the old value
+		if (_last[index] < _statement)
+			_last[index] = _statement;
+		_pending.append(index);
+	}
+}
+
+class FrameSlot {
+	int offset;
+	int size;
+	int freeAfter;			// the last statement that uses the slot
+}
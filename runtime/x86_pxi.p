@@ -17,6 +17,7 @@ namespace parasol:pxi;
 
 import parasol:storage;
 import parasol:runtime;
+import native:C;
 
 public class X86_64ExceptionEntry {
 	public int location;
@@ -83,4 +84,101 @@ public class X86_64SourceMap {
 	public int sourceFileCount;
 	public int lineNumberCount;
 }
+/**
+	This describes the coverage table of an image compiled with coverage enabled. The compiler
+	passes its address to the runtime from the image's entry function.
+
+<pre>
+    span<long, counterCount> counters;          // Each incremented by the first statement of a
+                                                // basic block
+    span<int, locationCount * 2> locations;     // Pairs of the image offset of a source location
+                                                // and the index of the counter covering it
+</pre>
+
+	The null-terminated path of the file the counts accumulate in is at pathOffset from the
+	start of the table.
+ */
+public class X86_64CoverageTable {
+	public int counterCount;
+	public int locationCount;
+	public int pathOffset;
+	private int _1;					// must be zero
+}
 
+/**
+ * The alignment, in bytes, of both a prelinked section in the file and the image within
+ * it. This must be a multiple of the page size of any system that runs the image.
+ */
+@Constant
+public long PRELINK_ALIGNMENT = 4096;
+/**
+ * A prelinked x86-64 section starts with this header. The image itself follows at imageOffset
+ * from the start of the section.
+ *
+ * All relocations and vtable entries in the image have already had baseAddress added, so a loader
+ * that can map the image at baseAddress does no relocation at all. A loader that cannot map it
+ * there adds the difference between the actual and preferred address instead of the full image
+ * address.
+ */
+public class X86_64PrelinkHeader {
+	public long baseAddress;		// The preferred load address of the image
+	public long imageOffset;		// Offset of the image from the start of the section, a multiple of PRELINK_ALIGNMENT
+	public long imageLength;		// Length of the image in bytes
+}
+/**
+ * A section that writes a copy of an x86-64 image prelinked to a preferred load address.
+ */
+public class X86_64PrelinkedSection extends Section {
+	private pointer<byte> _image;
+	private long _imageLength;
+	private long _baseAddress;
+
+	public X86_64PrelinkedSection(address image, long imageLength, long baseAddress) {
+		super(runtime.Target.X86_64_LNX_PRELINKED);
+		_image = pointer<byte>(image);
+		_imageLength = imageLength;
+		_baseAddress = baseAddress;
+	}
+
+	public long length() {
+		return PRELINK_ALIGNMENT + _imageLength;
+	}
+
+	public long alignment() {
+		return PRELINK_ALIGNMENT;
+	}
+
+	public boolean write(storage.File pxiFile) {
+		X86_64PrelinkHeader header;
+
+		header.baseAddress = _baseAddress;
+		header.imageOffset = PRELINK_ALIGNMENT;
+		header.imageLength = _imageLength;
+		long start = pxiFile.tell();
+		if (pxiFile.write(&header, header.bytes) != header.bytes)
+			return false;
+		if (pxiFile.seek(start + header.imageOffset, storage.Seek.START) < 0)
+			return false;
+		byte[] copy;
+		copy.resize(int(_imageLength));
+		C.memcpy(&copy[0], _image, int(_imageLength));
+		prelink(&copy[0], _baseAddress);
+		return pxiFile.write(&copy[0], copy.length()) == copy.length();
+	}
+}
+/**
+ * Apply the relocations and vtable fixups of an image, as a loader would, as if the image were
+ * loaded at a given base address.
+ *
+ * @param image The image to be modified. It must not already have been relocated.
+ * @param baseAddress The address to add to each relocated value.
+ */
+public void prelink(pointer<byte> image, long baseAddress) {
+	ref<X86_64SectionHeader> header = ref<X86_64SectionHeader>(image);
+	pointer<int> fixups = pointer<int>(image + header.relocationOffset);
+	for (int i = 0; i < header.relocationCount; i++)
+		*pointer<long>(image + fixups[i]) += baseAddress;
+	pointer<long> vp = pointer<long>(image + header.vtablesOffset);
+	for (int i = 0; i < header.vtableData; i++, vp++)
+		*vp += baseAddress;
+}
@@ -32,10 +32,22 @@ ExecutionContext::ExecutionContext(pxi::X86_64SectionHeader *pxiHeader, void *im
 	_image = image;
 	_runtimeParameters = (void**)calloc(ALLOC_INCREMENT, sizeof (void*));
 	_runtimeParametersCount = ALLOC_INCREMENT;
+	_exceptionIndex = null;
 	if (outer != null) {
 		for (int i = 0; i < outer->_runtimeParametersCount; i++)
 			setRuntimeParameter(i, outer->getRuntimeParameter(i));
 	}
+	// A context for the same image as its outer context (a new thread, or the main context of parasolrt)
+	// shares the outer context's index.
+	if (outer == null || outer->_image != image || outer->getRuntimeParameter(RP_EXCEPTION_INDEX) == null) {
+		_exceptionIndex = new ExceptionIndex((ExceptionEntry*)exceptionsAddress(), exceptionsCount(),
+											 (int)(highCodeAddress() - lowCodeAddress()));
+		setRuntimeParameter(RP_EXCEPTION_INDEX, _exceptionIndex);
+	}
+}
+
+ExecutionContext::~ExecutionContext() {
+	delete _exceptionIndex;
 }
 
 void ExecutionContext::enter() {
@@ -91,6 +103,28 @@ void ExecutionContext::callCatchHandler(Exception *exception, void *framePointer
 	callAndSetFramePtr(framePointer, (void*) h, exception);
 }
 
+ExceptionIndex::ExceptionIndex(ExceptionEntry *entries, int count, int codeLength) {
+	this->entries = entries;
+	this->count = count;
+	// Use the smallest buckets (but at least 16 bytes) that still leave no more buckets than entries.
+	shift = 4;
+	while ((codeLength >> shift) > count)
+		shift++;
+	bucketCount = (codeLength >> shift) + 1;
+	buckets = new int[bucketCount + 1];
+	int e = -1;
+	for (int b = 0; b <= bucketCount; b++) {
+		long long start = (long long)b << shift;
+		while (e + 1 < count && entries[e + 1].location <= start)
+			e++;
+		buckets[b] = e;
+	}
+}
+
+ExceptionIndex::~ExceptionIndex() {
+	delete[] buckets;
+}
+
 #if __linux__
 __thread ExecutionContext *ThreadContext::_threadContextValue;
 #endif
@@ -241,6 +275,56 @@ void *getFsSegment(void *offset) {
 	return 0;
 }
 
+/*
+ * Atomic operations, used by runtime/thread.p. Each returns the value the location held before the operation,
+ * and all of them, like atomicFence, order every memory access before them ahead of every access after them.
+ */
+int atomicLoad32(int *location) {
+	return __atomic_load_n(location, __ATOMIC_SEQ_CST);
+}
+
+long long atomicLoad64(long long *location) {
+	return __atomic_load_n(location, __ATOMIC_SEQ_CST);
+}
+
+void atomicStore32(int *location, int value) {
+	__atomic_store_n(location, value, __ATOMIC_SEQ_CST);
+}
+
+void atomicStore64(long long *location, long long value) {
+	__atomic_store_n(location, value, __ATOMIC_SEQ_CST);
+}
+
+int atomicCompareAndSwap32(int *location, int expected, int replacement) {
+	__atomic_compare_exchange_n(location, &expected, replacement, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return expected;
+}
+
+long long atomicCompareAndSwap64(long long *location, long long expected, long long replacement) {
+	__atomic_compare_exchange_n(location, &expected, replacement, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return expected;
+}
+
+int atomicFetchAdd32(int *location, int delta) {
+	return __atomic_fetch_add(location, delta, __ATOMIC_SEQ_CST);
+}
+
+long long atomicFetchAdd64(long long *location, long long delta) {
+	return __atomic_fetch_add(location, delta, __ATOMIC_SEQ_CST);
+}
+
+int atomicExchange32(int *location, int value) {
+	return __atomic_exchange_n(location, value, __ATOMIC_SEQ_CST);
+}
+
+long long atomicExchange64(long long *location, long long value) {
+	return __atomic_exchange_n(location, value, __ATOMIC_SEQ_CST);
+}
+
+void atomicFence() {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
 byte *stackTop() {
 	ExecutionContext *context = threadContext.get();
 	if (context != 0)
@@ -42,6 +42,27 @@ public:
 	ExceptionEntry *entries;
 };
 
+// An ExceptionIndex narrows the search for the exception table entry covering a code location. The code
+// of an image is divided into buckets of 1 << shift bytes, and buckets[b] is the index of the last entry
+// whose location is at or before the start of bucket b (-1 if there is none). The entry covering a location
+// in bucket b is then one of the entries from buckets[b] through buckets[b + 1].
+//
+// Each image gets one index, built when its first ExecutionContext is created and published through the
+// RP_EXCEPTION_INDEX runtime parameter. The stack unwinding code in runtime/exception.p reads it directly,
+// so the layout of this class must match the ExceptionIndex class declared there.
+class ExceptionIndex {
+public:
+	ExceptionIndex(ExceptionEntry *entries, int count, int codeLength);
+
+	~ExceptionIndex();
+
+	ExceptionEntry *entries;
+	int *buckets;
+	int count;
+	int shift;
+	int bucketCount;
+};
+
 #define ALLOC_INCREMENT 8
 
 class ExecutionContext {
@@ -49,6 +70,8 @@ public:
 
 	ExecutionContext(pxi::X86_64SectionHeader *pxiHeader, void *image, ExecutionContext *outer);
 
+	~ExecutionContext();
+
 	void enter();
 
 	void prepareArgs(char **argv, int argc);
@@ -124,6 +147,7 @@ private:
 	void *_parasolThread;
 	void** _runtimeParameters;
 	int _runtimeParametersCount;
+	ExceptionIndex *_exceptionIndex;	// Not null if this context built the exception index of its image.
 };
 
 class ThreadContext {
@@ -184,6 +208,7 @@ void setRuntimeParameter(int i, void *newValue);
 #define RP_PXI_HEADER	5
 #define RP_IMAGE		6
 #define RP_IMAGE_LENGTH	7
+#define RP_EXCEPTION_INDEX 11
 
 }
 
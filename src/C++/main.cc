@@ -14,6 +14,7 @@
    limitations under the License.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include "pxi.h"
 /*
  * Date and Copyright holder of this code base.
@@ -26,6 +27,18 @@
  *
  * As a result, this executable just does the most basic command line parsing and then loads the PXI argument
  * and runs it.
+ *
+ * Setting the environment variable PARASOLRT_LOADER to 'mmap' maps the PXI file rather than reading it, so
+ * processes running the same PXI share its code pages.
+ *
+ * Setting the environment variable PARASOLRT_BINDINGS to 'lazy' resolves each native binding on its first
+ * call, rather than all of them before the program starts.
+ *
+ * Setting the environment variable PARASOLRT_STARTUP_TRACE (to any value) writes the time spent in each phase
+ * of start-up to stderr, just before the Parasol main function is called.
+ *
+ * Setting the environment variable PARASOLRT_HEAP to 'prod', 'leaks', 'guard' or 'cached' selects the heap the
+ * program starts with, overriding the one this executable was built for (see StartingHeap in runtime/memory.p).
  */
 int main(int argc, char **argv) {
 	int returnValue;
@@ -33,17 +46,35 @@ int main(int argc, char **argv) {
 		printf("Use is: parasolrt <pxi-file> <program arguments>\n");
 		return 1;
 	}
-	pxi::Section* section = pxi::load(argv[1]);
+	pxi::LoadMode mode = pxi::LM_READ;
+	const char *loader = getenv("PARASOLRT_LOADER");
+	if (loader != null && strcmp(loader, "mmap") == 0)
+		mode = pxi::LM_MAP;
+	pxi::BindMode bindMode = pxi::BM_EAGER;
+	const char *bindings = getenv("PARASOLRT_BINDINGS");
+	if (bindings != null && strcmp(bindings, "lazy") == 0)
+		bindMode = pxi::BM_LAZY;
+	if (getenv("PARASOLRT_STARTUP_TRACE") != null)
+		pxi::enableStartupTrace(argv[1]);
+	pxi::Section* section = pxi::load(argv[1], mode);
 	if (section == null) {
 		printf("Failed to load %s\n", argv[1]);
 		return 1;
 	}
+	pxi::endStartupPhase(pxi::SP_LOAD);
 #ifdef PARASOLRT_HEAP
 	int heapValue = PARASOLRT_HEAP;
 #else
 	int heapValue = 0;
 #endif
-	if (section->run(argv, &returnValue, heapValue))
+	const char *heap = getenv("PARASOLRT_HEAP");
+	if (heap != null) {
+		static const char *heapNames[] = { "prod", "leaks", "guard", "cached" };
+		for (int i = 0; i < (int)(sizeof heapNames / sizeof heapNames[0]); i++)
+			if (strcmp(heap, heapNames[i]) == 0)
+				heapValue = i;
+	}
+	if (section->run(argv, &returnValue, heapValue, bindMode))
 		return returnValue;
 	else {
 		printf("Unable to run pxi %s\n", argv[1]);
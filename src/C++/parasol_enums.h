@@ -6,10 +6,22 @@
 enum Target {
         ST_ERROR,
         ST_X86_64_LNX,
-        ST_NOT_USED_1,
+        ST_X86_64_LNX_PRELINKED,
         ST_NOT_USED_2,
         ST_X86_64_WIN,
         ST_X86_64_LNX_SRC,
         ST_MAX_TARGET,
 };
+enum VectorElement {
+        VE_SIGNED_32,
+        VE_SIGNED_64,
+        VE_FLOAT_32,
+        VE_FLOAT_64,
+};
+enum VectorOperation {
+        VO_ADD,
+        VO_SUBTRACT,
+        VO_MULTIPLY,
+        VO_DIVIDE,
+};
 #endif // PARASOL_HEADER_H
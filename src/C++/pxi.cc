@@ -19,6 +19,7 @@
 #include "parasol_enums.h"
 #include "executionContext.h"
 #include <stdio.h>
+#include <time.h>
 #if defined(__WIN64)
 #include <windows.h>
 #elif __linux__
@@ -29,14 +30,22 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <link.h>
+#include <pthread.h>
 #endif
 
 namespace pxi {
 
 static Section *x86_64Reader(Target sectionType, FILE *pxiFile, long long length);
+#if __linux__
+static Section *x86_64Mapper(Target sectionType, FILE *pxiFile, long long offset, long long length);
+static Section *x86_64PrelinkedLoader(FILE *pxiFile, long long offset, long long length);
 
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+#endif
 
-Section *load(const char *filename) {
+Section *load(const char *filename, LoadMode mode) {
 	FILE *pxiFile = fopen(filename, "rb");
 	if (pxiFile == null)
 		return null;
@@ -59,6 +68,17 @@ Section *load(const char *filename) {
 			printf("Could not read section table of pxi file %s\n", filename);
 			return null;
 		}
+#if __linux__
+		if (entry.sectionType == ST_X86_64_LNX_PRELINKED) {
+			Section *section = x86_64PrelinkedLoader(pxiFile, entry.offset, entry.length);
+			fclose(pxiFile);
+			if (section == null) {
+				printf("Loader failed for prelinked section %d of %s\n", i, filename);
+				return null;
+			}
+			return section;
+		}
+#endif
 		if 
 #if defined(__WIN64)
 			(entry.sectionType == ST_X86_64_WIN)
@@ -67,11 +87,18 @@ Section *load(const char *filename) {
 			 entry.sectionType == ST_X86_64_LNX_SRC)
 #endif
 		{
-			if (fseek(pxiFile, (int)entry.offset, SEEK_SET) != 0) {
-				printf("Could not seek to section %d @ %lld\n", i, entry.offset);
-				return null;
+			Section *section = null;
+#if __linux__
+			if (mode == LM_MAP)
+				section = x86_64Mapper((Target)entry.sectionType, pxiFile, entry.offset, entry.length);
+#endif
+			if (section == null) {
+				if (fseek(pxiFile, (int)entry.offset, SEEK_SET) != 0) {
+					printf("Could not seek to section %d @ %lld\n", i, entry.offset);
+					return null;
+				}
+				section = x86_64Reader((Target)entry.sectionType, pxiFile, entry.length);
 			}
-			Section *section = x86_64Reader((Target)entry.sectionType, pxiFile, entry.length);
 			fclose(pxiFile);
 			if (section == null) {
 				printf("Reader failed for section %d of %s\n", i, filename);
@@ -84,6 +111,94 @@ Section *load(const char *filename) {
 	return null;
 }
 
+class StartupTrace {
+public:
+	bool enabled;
+	bool reported;
+	const char *filename;
+	byte *image;					// The image being started, so nested images do not end its phases.
+	double phaseStart;
+	double durations[SP_MAX];
+	int relocations;
+	int vtableSlots;
+	int bindings;
+	int sharedObjects;
+	bool lazyBindings;
+};
+
+static StartupTrace startupTrace;
+
+static const char *phaseNames[] = {
+	"load",
+	"relocate",
+	"bind",
+	"protect",
+	"initialize",
+};
+
+static double seconds() {
+#if defined(__WIN64)
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart / frequency.QuadPart;
+#elif __linux__
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+#endif
+}
+
+/*
+ * An image without a main function runs entirely in its static initializers, so its trace is reported as the
+ * process exits.
+ */
+static void reportAtExit() {
+	if (!startupTrace.reported) {
+		endStartupPhase(SP_INITIALIZE);
+		reportStartupTrace();
+	}
+}
+
+void enableStartupTrace(const char *filename) {
+	startupTrace.enabled = true;
+	startupTrace.filename = filename;
+	startupTrace.phaseStart = seconds();
+	atexit(reportAtExit);
+}
+
+void endStartupPhase(StartupPhase phase) {
+	if (!startupTrace.enabled)
+		return;
+	double t = seconds();
+	startupTrace.durations[phase] += t - startupTrace.phaseStart;
+	startupTrace.phaseStart = t;
+}
+
+void reportStartupTrace() {
+	if (!startupTrace.enabled || startupTrace.reported)
+		return;
+	startupTrace.reported = true;
+	double total = 0;
+	fprintf(stderr, "Startup trace of %s:\n", startupTrace.filename);
+	for (int i = 0; i < SP_MAX; i++) {
+		fprintf(stderr, "    %-12s %10.3f ms", phaseNames[i], startupTrace.durations[i] * 1000);
+		switch (i) {
+		case SP_RELOCATE:
+			fprintf(stderr, "  %d relocations, %d vtable slots", startupTrace.relocations, startupTrace.vtableSlots);
+			break;
+
+		case SP_BIND:
+			fprintf(stderr, "  %d %sbindings, %d shared objects", startupTrace.bindings,
+					startupTrace.lazyBindings ? "lazy " : "", startupTrace.sharedObjects);
+			break;
+		}
+		fprintf(stderr, "\n");
+		total += startupTrace.durations[i];
+	}
+	fprintf(stderr, "    %-12s %10.3f ms\n", "total", total * 1000);
+}
+
 static Section *x86_64Reader(Target sectionType, FILE *pxiFile, long long length) {
 #if defined(__WIN64)
 	byte *image = (byte*)malloc(length);
@@ -111,6 +226,66 @@ static Section *x86_64Reader(Target sectionType, FILE *pxiFile, long long length
 	return new Section(sectionType, image, length);
 }
 
+#if __linux__
+/*
+ * Map the section privately from the file. The mapping must start on a page boundary in the file, so the image
+ * itself starts part way into the first page. Any failure returns null, and the caller falls back to reading the
+ * section.
+ */
+static Section *x86_64Mapper(Target sectionType, FILE *pxiFile, long long offset, long long length) {
+	long pagesize = sysconf(_SC_PAGESIZE);
+	if (pagesize == -1)
+		return null;
+	long long delta = offset & (pagesize - 1);
+	size_t mappingLength = delta + length;
+	void *mapping = mmap(null, mappingLength, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(pxiFile), offset - delta);
+	if (mapping == MAP_FAILED)
+		return null;
+	return new Section(sectionType, (byte*)mapping + delta, length, (byte*)mapping, mappingLength);
+}
+/*
+ * A prelinked image is mapped at its preferred address when that address range is free, and then needs no
+ * relocation. Otherwise it is mapped, or as a last resort read, wherever it fits and relocated by the distance
+ * from its preferred address.
+ */
+static Section *x86_64PrelinkedLoader(FILE *pxiFile, long long offset, long long length) {
+	X86_64PrelinkHeader prelink;
+	if (fseek(pxiFile, offset, SEEK_SET) != 0 || fread(&prelink, 1, sizeof prelink, pxiFile) != sizeof prelink) {
+		printf("Could not read prelink header\n");
+		return null;
+	}
+	if (prelink.imageOffset + prelink.imageLength > length) {
+		printf("Prelinked image extends past the end of its section\n");
+		return null;
+	}
+	void *preferred = (void*)prelink.baseAddress;
+	long long imageFileOffset = offset + prelink.imageOffset;
+	void *mapping = mmap(preferred, prelink.imageLength, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED_NOREPLACE,
+						 fileno(pxiFile), imageFileOffset);
+	if (mapping != MAP_FAILED && mapping != preferred) {	// Kernels before 4.17 treat the address as a hint.
+		munmap(mapping, prelink.imageLength);
+		mapping = MAP_FAILED;
+	}
+	if (mapping == MAP_FAILED)
+		mapping = mmap(null, prelink.imageLength, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(pxiFile), imageFileOffset);
+	Section *section;
+	if (mapping != MAP_FAILED)
+		section = new Section(ST_X86_64_LNX_PRELINKED, (byte*)mapping, prelink.imageLength, (byte*)mapping, 
+							  prelink.imageLength);
+	else {
+		if (fseek(pxiFile, imageFileOffset, SEEK_SET) != 0) {
+			printf("Could not seek to prelinked image @ %lld\n", imageFileOffset);
+			return null;
+		}
+		section = x86_64Reader(ST_X86_64_LNX_PRELINKED, pxiFile, prelink.imageLength);
+		if (section == null)
+			return null;
+	}
+	section->preferredAddress = prelink.baseAddress;
+	return section;
+}
+#endif
+
 class NativeBinding {
 public:
 	char *dllName;
@@ -118,8 +293,169 @@ public:
 	void *address;
 };
 
-Section::Section(Target sectionType, byte *image, size_t imageLength) {
+#if __linux__
+/*
+ * Each shared object named by the native bindings is opened once. The compiler stores each name once per image,
+ * so bindings to the same shared object share a name pointer and the string compare is only needed for images
+ * written by older compilers.
+ */
+class SharedObject {
+public:
+	const char *dllName;
+	void *handle;
+};
+
+static SharedObject *sharedObjects;
+static int sharedObjectsCount;
+static int sharedObjectsCapacity;
+static pthread_mutex_t bindingLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *openSharedObject(const char *dllName) {
+	for (int i = 0; i < sharedObjectsCount; i++)
+		if (sharedObjects[i].dllName == dllName)
+			return sharedObjects[i].handle;
+	for (int i = 0; i < sharedObjectsCount; i++)
+		if (strcmp(sharedObjects[i].dllName, dllName) == 0)
+			return sharedObjects[i].handle;
+	const char *soName = dllName;
+	if (strcmp(soName, "libparasol.so.1") == 0)
+		soName = "libparasol.so";
+	void *handle = dlopen(soName, RTLD_LAZY|RTLD_NODELETE);
+	if (handle == null) {
+		printf("Unable to locate shared object %s (%s)\n", dllName, dlerror());
+		abort();
+	}
+	if (sharedObjectsCount == sharedObjectsCapacity) {
+		sharedObjectsCapacity = sharedObjectsCapacity * 2 + 8;
+		sharedObjects = (SharedObject*)realloc(sharedObjects, sharedObjectsCapacity * sizeof (SharedObject));
+	}
+	sharedObjects[sharedObjectsCount].dllName = dllName;
+	sharedObjects[sharedObjectsCount].handle = handle;
+	sharedObjectsCount++;
+	return handle;
+}
+
+static void bindNative(NativeBinding *binding) {
+	void *handle = openSharedObject(binding->dllName);
+	binding->address = dlsym(handle, binding->symbolName);
+	if (binding->address == null) {
+		printf("Unable to locate symbol %s in %s (%s)\n", binding->symbolName, binding->dllName, dlerror());
+		abort();
+	}
+}
+/*
+ * Called from lazyBindingTrampoline on the first call through a binding. Other threads may be making their
+ * own first calls, so resolution is serialized.
+ */
+extern "C" __attribute__((visibility("hidden"))) void *resolveLazyBinding(NativeBinding *binding) {
+	pthread_mutex_lock(&bindingLock);
+	bindNative(binding);
+	pthread_mutex_unlock(&bindingLock);
+	return binding->address;
+}
+
+extern "C" void lazyBindingTrampoline();
+/*
+ * The stub for a binding loads its address into R11 and jumps here. The argument registers of the call being
+ * made are preserved around resolveLazyBinding, then the call continues at the resolved address. Once the
+ * binding is patched, later calls go straight to the native function.
+ */
+asm(
+	"	.text\n"
+	"	.p2align 4\n"
+	"	.globl lazyBindingTrampoline\n"
+	"	.hidden lazyBindingTrampoline\n"
+	"	.type lazyBindingTrampoline, @function\n"
+	"lazyBindingTrampoline:\n"
+	"	push %rbp\n"
+	"	mov %rsp,%rbp\n"
+	"	sub $192,%rsp\n"
+	"	and $-16,%rsp\n"
+	"	mov %rax,0(%rsp)\n"
+	"	mov %rdi,8(%rsp)\n"
+	"	mov %rsi,16(%rsp)\n"
+	"	mov %rdx,24(%rsp)\n"
+	"	mov %rcx,32(%rsp)\n"
+	"	mov %r8,40(%rsp)\n"
+	"	mov %r9,48(%rsp)\n"
+	"	movdqa %xmm0,64(%rsp)\n"
+	"	movdqa %xmm1,80(%rsp)\n"
+	"	movdqa %xmm2,96(%rsp)\n"
+	"	movdqa %xmm3,112(%rsp)\n"
+	"	movdqa %xmm4,128(%rsp)\n"
+	"	movdqa %xmm5,144(%rsp)\n"
+	"	movdqa %xmm6,160(%rsp)\n"
+	"	movdqa %xmm7,176(%rsp)\n"
+	"	mov %r11,%rdi\n"
+	"	call resolveLazyBinding\n"
+	"	mov %rax,%r11\n"
+	"	mov 0(%rsp),%rax\n"
+	"	mov 8(%rsp),%rdi\n"
+	"	mov 16(%rsp),%rsi\n"
+	"	mov 24(%rsp),%rdx\n"
+	"	mov 32(%rsp),%rcx\n"
+	"	mov 40(%rsp),%r8\n"
+	"	mov 48(%rsp),%r9\n"
+	"	movdqa 64(%rsp),%xmm0\n"
+	"	movdqa 80(%rsp),%xmm1\n"
+	"	movdqa 96(%rsp),%xmm2\n"
+	"	movdqa 112(%rsp),%xmm3\n"
+	"	movdqa 128(%rsp),%xmm4\n"
+	"	movdqa 144(%rsp),%xmm5\n"
+	"	movdqa 160(%rsp),%xmm6\n"
+	"	movdqa 176(%rsp),%xmm7\n"
+	"	mov %rbp,%rsp\n"
+	"	pop %rbp\n"
+	"	jmp *%r11\n"
+	"	.size lazyBindingTrampoline, .-lazyBindingTrampoline\n"
+);
+
+static const int LAZY_STUB_SIZE = 32;
+/*
+ * Point each binding at its own stub:
+ *
+ *		movabs r11, <binding>
+ *		movabs r10, lazyBindingTrampoline
+ *		jmp r10
+ */
+static bool bindLazily(NativeBinding *nativeBindings, int count) {
+	if (count == 0)
+		return true;
+	size_t length = count * LAZY_STUB_SIZE;
+	byte *stubs = (byte*)mmap(null, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (stubs == MAP_FAILED) {
+		printf("Could not allocate lazy binding stubs errno = %d (%s)\n", errno, strerror(errno));
+		return false;
+	}
+	void *trampoline = (void*)lazyBindingTrampoline;
+	for (int i = 0; i < count; i++) {
+		byte *stub = stubs + i * LAZY_STUB_SIZE;
+		NativeBinding *binding = &nativeBindings[i];
+		memset(stub, 0xcc, LAZY_STUB_SIZE);
+		stub[0] = 0x49;
+		stub[1] = 0xbb;
+		memcpy(stub + 2, &binding, sizeof binding);
+		stub[10] = 0x49;
+		stub[11] = 0xba;
+		memcpy(stub + 12, &trampoline, sizeof trampoline);
+		stub[20] = 0x41;
+		stub[21] = 0xff;
+		stub[22] = 0xe2;
+		binding->address = stub;
+	}
+	if (mprotect(stubs, length, PROT_READ|PROT_EXEC) < 0) {
+		printf("Could not protect lazy binding stubs errno = %d (%s)\n", errno, strerror(errno));
+		return false;
+	}
+	return true;
+}
+#endif
+
+Section::Section(Target sectionType, byte *image, size_t imageLength, byte *mapping, size_t mappingLength) {
 	this->sectionType = sectionType;
+	_mapping = mapping;
+	_mappingLength = mappingLength;
+	preferredAddress = 0;
 	if (sectionType == ST_X86_64_LNX_SRC) { // Legacy file type - Header a separate piece before image.
 		this->header = (X86_64SectionHeader*)image;
 		this->image = image + sizeof (X86_64SectionHeader);
@@ -131,7 +467,7 @@ Section::Section(Target sectionType, byte *image, size_t imageLength) {
 	}
 }
 
-bool Section::run(char **args, int *returnValue, int heap_value) {
+bool Section::run(char **args, int *returnValue, int heap_value, BindMode bindMode) {
 	parasol::ExecutionContext ec(header, image, null);
 
 	ec.enter();
@@ -145,16 +481,26 @@ bool Section::run(char **args, int *returnValue, int heap_value) {
 	for (int i = 1; args[i] != null; i++)
 		argc++;
 
-	int *pxiFixups = (int*)(image + header->relocationOffset);
-	for (int i = 0; i < header->relocationCount; i++) {
-		int fx = pxiFixups[i];
-		long long *vp = (long long*)(image + pxiFixups[i]);
-		*vp += (long long)image;
+	// A prelinked image loaded at its preferred address needs no relocation at all.
+	long long relocation = (long long)image - preferredAddress;
+	if (relocation != 0) {
+		int *pxiFixups = (int*)(image + header->relocationOffset);
+		for (int i = 0; i < header->relocationCount; i++) {
+			long long *vp = (long long*)(image + pxiFixups[i]);
+			*vp += relocation;
+		}
+		long long *vp = (long long*)(image + header->vtablesOffset);
+		for (int i = 0; i < header->vtableData; i++, vp++)
+			*vp += relocation;
+		startupTrace.relocations = header->relocationCount;
+		startupTrace.vtableSlots = header->vtableData;
 	}
+	endStartupPhase(SP_RELOCATE);
 
 	NativeBinding *nativeBindings = (NativeBinding*)(image + header->nativeBindingsOffset);
-	for (int i = 0; i < header->nativeBindingsCount; i++) {
+	startupTrace.bindings = header->nativeBindingsCount;
 #if defined(__WIN64)
+	for (int i = 0; i < header->nativeBindingsCount; i++) {
 		HMODULE dll = GetModuleHandle(nativeBindings[i].dllName);
 		if (dll == 0) {
 			printf("Unable to locate DLL %s\n", nativeBindings[i].dllName);
@@ -167,24 +513,19 @@ bool Section::run(char **args, int *returnValue, int heap_value) {
 			}
 		}
 		CloseHandle(dll);
+	}
 #elif __linux__
-		const char *soName = nativeBindings[i].dllName;
-		if (strcmp(soName, "libparasol.so.1") == 0)
-			soName = "libparasol.so";
-		void *handle = dlopen(soName, RTLD_LAZY|RTLD_NODELETE);
-		if (handle == null) {
-			printf("Unable to locate shared object %s (%s)\n", nativeBindings[i].dllName, dlerror());
-			abort();
-		} else {
-			nativeBindings[i].address = dlsym(handle, nativeBindings[i].symbolName);
-			if (nativeBindings[i].address == 0) {
-				printf("Unable to locate symbol %s in %s (%s)\n", nativeBindings[i].symbolName, nativeBindings[i].dllName, dlerror());
-				abort();
-			}
-		}
-		dlclose(handle);
-#endif
+	if (bindMode == BM_LAZY) {
+		startupTrace.lazyBindings = true;
+		if (!bindLazily(nativeBindings, header->nativeBindingsCount))
+			return false;
+	} else {
+		for (int i = 0; i < header->nativeBindingsCount; i++)
+			bindNative(&nativeBindings[i]);
 	}
+	startupTrace.sharedObjects = sharedObjectsCount;
+#endif
+	endStartupPhase(SP_BIND);
 
 #if defined(__WIN64)
 	DWORD oldProtection;
@@ -194,13 +535,15 @@ bool Section::run(char **args, int *returnValue, int heap_value) {
 		*(char*)(long long)argc = 0;	// This should cause a crash.
 	}
 #elif __linux__
-	if (mprotect(image, imageLength, PROT_EXEC|PROT_READ|PROT_WRITE) < 0) {
+	if (_mapping != null) {
+		if (!protectMapping())
+			return false;
+	} else if (mprotect(image, imageLength, PROT_EXEC|PROT_READ|PROT_WRITE) < 0) {
 		printf("Could not protect %p [%lx] errno = %d (%s)\n", image, imageLength, errno, strerror(errno));
 	}
 #endif
-	long long *vp = (long long*)(image + header->vtablesOffset);
-	for (int i = 0; i < header->vtableData; i++, vp++)
-		*vp += (long long)image;
+	endStartupPhase(SP_PROTECT);
+	startupTrace.image = image;
 	int value = parasol::evalNative(header, image, args + 1, argc);
 	*returnValue = value;
 	parasol::Exception *exception = ec.exception();
@@ -210,5 +553,47 @@ bool Section::run(char **args, int *returnValue, int heap_value) {
 	} else
 		return true;
 }
+/*
+ * The code segment is first in the image and nothing in it is written by the loader or by running code, so
+ * all whole pages of code become read-only and executable, keeping them shared with the file. The page
+ * where code ends and type data begins must remain writable as well as executable. Everything after that is
+ * data.
+ */
+bool Section::protectMapping() {
+#if __linux__
+	long pagesize = sysconf(_SC_PAGESIZE);
+	byte *codeEnd = image + header->typeDataOffset;
+	byte *sharedEnd = (byte*)((long)codeEnd & ~(pagesize - 1));
+	byte *dataStart = (byte*)(((long)codeEnd + pagesize - 1) & ~(pagesize - 1));
+
+	if (sharedEnd > _mapping && mprotect(_mapping, sharedEnd - _mapping, PROT_EXEC|PROT_READ) < 0) {
+		printf("Could not protect code %p [%lx] errno = %d (%s)\n", _mapping, sharedEnd - _mapping, errno, strerror(errno));
+		return false;
+	}
+	if (dataStart > sharedEnd && mprotect(sharedEnd, dataStart - sharedEnd, PROT_EXEC|PROT_READ|PROT_WRITE) < 0) {
+		printf("Could not protect %p [%lx] errno = %d (%s)\n", sharedEnd, dataStart - sharedEnd, errno, strerror(errno));
+		return false;
+	}
+	// The mapping was created read-write, so the data pages need no further change.
+#endif
+	return true;
+}
+
+extern "C" {
+/*
+ * startupComplete - The compiler calls this from the entry point of an image after its static initializers
+ * have run, just before it calls main.
+ */
+void startupComplete() {
+	if (!startupTrace.enabled || startupTrace.reported)
+		return;
+	parasol::ExecutionContext *context = parasol::threadContext.get();
+	if (context == null || context->lowCodeAddress() != startupTrace.image)
+		return;
+	endStartupPhase(SP_INITIALIZE);
+	reportStartupTrace();
+}
+
+}
 
 }
@@ -25,8 +25,59 @@ static const unsigned MAGIC_NUMBER = ~0x50584920;
 static const unsigned short CURRENT_VERSION = 1;
 
 class Section;
+/*
+ * LoadMode selects how the executable section of a pxi file is brought into memory.
+ *
+ * LM_READ copies the section into a private, page-aligned buffer. This is the default.
+ *
+ * LM_MAP maps the section directly from the file. Code pages are never written by the loader, so they stay
+ * read-only and are shared through the page cache by every process running the same pxi. Only the pages
+ * touched by relocations, vtable fixups, native bindings and static data are copied on write.
+ * Note that a pxi file that is mapped must be replaced (by rename), not over-written in place, while
+ * any process is running it.
+ */
+enum LoadMode {
+	LM_READ,
+	LM_MAP
+};
 
-Section *load(const char *filename);
+Section *load(const char *filename, LoadMode mode);
+/*
+ * BindMode selects when the native bindings of an image are resolved. Either way, each shared object is
+ * opened only once.
+ *
+ * BM_EAGER resolves every binding before the image starts running. This is the default.
+ *
+ * BM_LAZY points each binding at a small stub that resolves it on its first call and patches the binding
+ * table, much as the PLT does for shared objects. Processes that call only some of their bindings start
+ * faster, but a missing symbol is not reported until it is first called.
+ */
+enum BindMode {
+	BM_EAGER,
+	BM_LAZY
+};
+/*
+ * StartupPhase names the intervals of process start-up that are timed when start-up tracing is enabled
+ * (parasolrt does this when the PARASOLRT_STARTUP_TRACE environment variable is set). Each phase runs from
+ * the end of the previous one, so the phases add up to the time from the start of main to the call of the
+ * Parasol main function.
+ */
+enum StartupPhase {
+	SP_LOAD,				// Reading or mapping the pxi file.
+	SP_RELOCATE,			// Applying relocations and vtable fixups.
+	SP_BIND,				// Resolving native bindings.
+	SP_PROTECT,				// Setting the page protections of the image.
+	SP_INITIALIZE,			// Running static initializers, up to the call of main.
+	SP_MAX
+};
+
+void enableStartupTrace(const char *filename);
+
+void endStartupPhase(StartupPhase phase);
+/*
+ * Writes the start-up trace to stderr. Only the first call after enableStartupTrace writes anything.
+ */
+void reportStartupTrace();
 
 class PxiHeader {
 public:
@@ -67,16 +118,34 @@ public:
 	int nativeBindingsCount;// Number of native bindings
 };
 
+/*
+ * A prelinked section (ST_X86_64_LNX_PRELINKED) starts with this header. The image follows at imageOffset
+ * from the start of the section, with its relocations and vtables already resolved for baseAddress.
+ */
+class X86_64PrelinkHeader {
+public:
+	long long baseAddress;	// The preferred load address of the image
+	long long imageOffset;	// Offset of the image from the start of the section, a multiple of the page size
+	long long imageLength;	// Length of the image in bytes
+};
+
 class Section {
 public:
-	Section(Target sectionType, byte *image, size_t imageLength);
+	Section(Target sectionType, byte *image, size_t imageLength, byte *mapping = null, size_t mappingLength = 0);
 
-	bool run(char **args, int *returnValue, int heap_value);
+	bool run(char **args, int *returnValue, int heap_value, BindMode bindMode);
 
 	Target sectionType;
 	X86_64SectionHeader *header;
 	byte *image;
 	size_t imageLength;
+	long long preferredAddress;	// The address the image was prelinked for, or 0 if it was not prelinked.
+
+private:
+	bool protectMapping();
+
+	byte *_mapping;				// If not null, the page-aligned start of the file mapping containing the image.
+	size_t _mappingLength;
 };
 
 }
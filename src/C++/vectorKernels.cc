@@ -0,0 +1,216 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+#include "vectorKernels.h"
+
+#include <stdlib.h>
+#include <emmintrin.h>
+
+namespace parasol {
+
+namespace {
+
+struct Sse2Int {
+	typedef int Element;
+	typedef __m128i Register;
+	static const int WIDTH = 4;
+
+	static Register load(const int *p) { return _mm_loadu_si128((const __m128i*)p); }
+	static Register loadAligned(const int *p) { return _mm_load_si128((const __m128i*)p); }
+	static void store(int *p, Register r) { _mm_store_si128((__m128i*)p, r); }
+	static Register broadcast(int x) { return _mm_set1_epi32(x); }
+	static Register zero() { return _mm_setzero_si128(); }
+	static Register add(Register a, Register b) { return _mm_add_epi32(a, b); }
+	static Register subtract(Register a, Register b) { return _mm_sub_epi32(a, b); }
+	// SSE2 has no 32-bit multiply that keeps the low halves, so multiply the even and the odd elements
+	// separately and interleave the low halves of the products.
+	static Register multiply(Register a, Register b) {
+		__m128i even = _mm_mul_epu32(a, b);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+								  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+};
+
+struct Sse2Long {
+	typedef long long Element;
+	typedef __m128i Register;
+	static const int WIDTH = 2;
+
+	static Register load(const long long *p) { return _mm_loadu_si128((const __m128i*)p); }
+	static Register loadAligned(const long long *p) { return _mm_load_si128((const __m128i*)p); }
+	static void store(long long *p, Register r) { _mm_store_si128((__m128i*)p, r); }
+	static Register broadcast(long long x) { return _mm_set1_epi64x(x); }
+	static Register zero() { return _mm_setzero_si128(); }
+	static Register add(Register a, Register b) { return _mm_add_epi64(a, b); }
+	static Register subtract(Register a, Register b) { return _mm_sub_epi64(a, b); }
+	// There is no packed 64-bit multiply, so build the low 64 bits of each product from 32-bit pieces.
+	static Register multiply(Register a, Register b) {
+		__m128i low = _mm_mul_epu32(a, b);
+		__m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b),
+									  _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+		return _mm_add_epi64(low, _mm_slli_epi64(cross, 32));
+	}
+};
+
+struct Sse2Float {
+	typedef float Element;
+	typedef __m128 Register;
+	static const int WIDTH = 4;
+
+	static Register load(const float *p) { return _mm_loadu_ps(p); }
+	static Register loadAligned(const float *p) { return _mm_load_ps(p); }
+	static void store(float *p, Register r) { _mm_store_ps(p, r); }
+	static Register broadcast(float x) { return _mm_set1_ps(x); }
+	static Register zero() { return _mm_setzero_ps(); }
+	static Register add(Register a, Register b) { return _mm_add_ps(a, b); }
+	static Register subtract(Register a, Register b) { return _mm_sub_ps(a, b); }
+	static Register multiply(Register a, Register b) { return _mm_mul_ps(a, b); }
+	static Register divide(Register a, Register b) { return _mm_div_ps(a, b); }
+};
+
+struct Sse2Double {
+	typedef double Element;
+	typedef __m128d Register;
+	static const int WIDTH = 2;
+
+	static Register load(const double *p) { return _mm_loadu_pd(p); }
+	static Register loadAligned(const double *p) { return _mm_load_pd(p); }
+	static void store(double *p, Register r) { _mm_store_pd(p, r); }
+	static Register broadcast(double x) { return _mm_set1_pd(x); }
+	static Register zero() { return _mm_setzero_pd(); }
+	static Register add(Register a, Register b) { return _mm_add_pd(a, b); }
+	static Register subtract(Register a, Register b) { return _mm_sub_pd(a, b); }
+	static Register multiply(Register a, Register b) { return _mm_mul_pd(a, b); }
+	static Register divide(Register a, Register b) { return _mm_div_pd(a, b); }
+};
+
+}
+/*
+ * AVX2 is used when the processor has it, unless the PARASOLRT_NO_AVX2 environment variable is set, which
+ * makes it possible to measure the SSE2 code on a machine with AVX2.
+ */
+static bool useAvx2() {
+	static int avx2 = -1;
+
+	if (avx2 < 0) {
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2") && getenv("PARASOLRT_NO_AVX2") == null;
+	}
+	return avx2 != 0;
+}
+/*
+ * The stride of an operand of operandLength elements in a vector expression of length elements, or -1 if
+ * the operand has to be repeated (or is empty) and is left to the generated code.
+ */
+static int stride(int operandLength, int length) {
+	if (operandLength == length)
+		return 1;
+	else if (operandLength == 1)
+		return 0;
+	else
+		return -1;
+}
+
+static bool validOperation(int element, int operation) {
+	switch (operation) {
+	case VO_ADD:
+	case VO_SUBTRACT:
+	case VO_MULTIPLY:
+		return true;
+
+	case VO_DIVIDE:
+		return element == VE_FLOAT_32 || element == VE_FLOAT_64;
+	}
+	return false;
+}
+
+static void clearResult(int element, void *result) {
+	switch (element) {
+	case VE_SIGNED_32:	*static_cast<int*>(result) = 0;			break;
+	case VE_SIGNED_64:	*static_cast<long long*>(result) = 0;	break;
+	case VE_FLOAT_32:	*static_cast<float*>(result) = 0;		break;
+	case VE_FLOAT_64:	*static_cast<double*>(result) = 0;		break;
+	}
+}
+
+extern "C" {
+
+int vectorArithmetic(int element, int operation, void *dest, const void *left, int leftLength,
+					 const void *right, int rightLength, int length) {
+	if (length <= 0 || !validOperation(element, operation))
+		return 0;
+	int leftStride = stride(leftLength, length);
+	int rightStride = stride(rightLength, length);
+	if (leftStride < 0 || rightStride < 0)
+		return 0;
+	if (useAvx2() && avx2Arithmetic(element, operation, dest, left, leftStride, right, rightStride, length))
+		return length;
+	switch (element) {
+	case VE_SIGNED_32:
+		arithmetic<Sse2Int>(operation, dest, left, leftStride, right, rightStride, length);
+		break;
+
+	case VE_SIGNED_64:
+		arithmetic<Sse2Long>(operation, dest, left, leftStride, right, rightStride, length);
+		break;
+
+	case VE_FLOAT_32:
+		floatArithmetic<Sse2Float>(operation, dest, left, leftStride, right, rightStride, length);
+		break;
+
+	case VE_FLOAT_64:
+		floatArithmetic<Sse2Double>(operation, dest, left, leftStride, right, rightStride, length);
+		break;
+
+	default:
+		return 0;
+	}
+	return length;
+}
+
+int vectorReduce(int element, void *result, const void *left, int leftLength,
+				 const void *right, int rightLength, int length) {
+	clearResult(element, result);
+	if (length <= 0 || leftLength != length || (right != null && rightLength != length))
+		return 0;
+	if (useAvx2() && avx2Reduce(element, result, left, right, length))
+		return length;
+	switch (element) {
+	case VE_SIGNED_32:
+		reduce<Sse2Int>(result, left, right, length);
+		break;
+
+	case VE_SIGNED_64:
+		reduce<Sse2Long>(result, left, right, length);
+		break;
+
+	case VE_FLOAT_32:
+		reduce<Sse2Float>(result, left, right, length);
+		break;
+
+	case VE_FLOAT_64:
+		reduce<Sse2Double>(result, left, right, length);
+		break;
+
+	default:
+		return 0;
+	}
+	return length;
+}
+
+}
+
+} // namespace parasol
@@ -0,0 +1,253 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+#ifndef VECTOR_KERNELS_H
+#define VECTOR_KERNELS_H
+
+#include <stdint.h>
+#include "machine.h"
+#include "parasol_enums.h"
+
+namespace parasol {
+/*
+ * The loops behind the vectorArithmetic and vectorReduce entry points. Each loop is written once against
+ * a lane type that describes the packed registers of one instruction set for one element type:
+ *
+ *	Element		The element type.
+ *	Register	The packed register type.
+ *	WIDTH		The number of elements in a Register.
+ *	load		Load a Register from memory of any alignment.
+ *	loadAligned	Load a Register from memory aligned to sizeof(Register).
+ *	store		Store a Register to memory aligned to sizeof(Register).
+ *	broadcast	A Register with every element set to a value.
+ *	zero		A Register of zeroes.
+ *	add, subtract, multiply, divide
+ *				Element-wise arithmetic. Only the floating point lanes have divide.
+ *
+ * vectorKernels.cc instantiates the loops for SSE2, which every x86-64 processor has, and
+ * vectorKernelsAvx2.cc, which is compiled with -mavx2, instantiates them for AVX2.
+ *
+ * Each loop handles the leading elements one at a time until the destination (or the first operand of a
+ * reduction) is aligned for whole registers, runs its main loop over whole registers, then finishes the
+ * elements left over one at a time.
+ *
+ * The loops are in an unnamed namespace so that each file gets its own copies, compiled for its own
+ * instruction set. Otherwise the linker could pick an AVX2 copy of a shared helper for the SSE2 code.
+ */
+bool avx2Arithmetic(int element, int operation, void *dest, const void *left, int leftStride,
+					const void *right, int rightStride, long long length);
+
+bool avx2Reduce(int element, void *result, const void *left, const void *right, long long length);
+
+namespace {
+/*
+ * Arithmetic on single elements. Integer arithmetic wraps around, as it does in Parasol code.
+ */
+template<class T> struct ScalarArithmetic {
+	typedef T Type;
+};
+
+template<> struct ScalarArithmetic<int> {
+	typedef unsigned Type;
+};
+
+template<> struct ScalarArithmetic<long long> {
+	typedef unsigned long long Type;
+};
+
+template<int OP> struct Operation;
+
+template<> struct Operation<VO_ADD> {
+	template<class T> static T scalar(T left, T right) {
+		typedef typename ScalarArithmetic<T>::Type A;
+		return T(A(left) + A(right));
+	}
+
+	template<class L> static typename L::Register packed(typename L::Register left, typename L::Register right) {
+		return L::add(left, right);
+	}
+};
+
+template<> struct Operation<VO_SUBTRACT> {
+	template<class T> static T scalar(T left, T right) {
+		typedef typename ScalarArithmetic<T>::Type A;
+		return T(A(left) - A(right));
+	}
+
+	template<class L> static typename L::Register packed(typename L::Register left, typename L::Register right) {
+		return L::subtract(left, right);
+	}
+};
+
+template<> struct Operation<VO_MULTIPLY> {
+	template<class T> static T scalar(T left, T right) {
+		typedef typename ScalarArithmetic<T>::Type A;
+		return T(A(left) * A(right));
+	}
+
+	template<class L> static typename L::Register packed(typename L::Register left, typename L::Register right) {
+		return L::multiply(left, right);
+	}
+};
+
+template<> struct Operation<VO_DIVIDE> {
+	template<class T> static T scalar(T left, T right) {
+		return left / right;
+	}
+
+	template<class L> static typename L::Register packed(typename L::Register left, typename L::Register right) {
+		return L::divide(left, right);
+	}
+};
+
+template<class L> bool misaligned(const typename L::Element *p) {
+	return (reinterpret_cast<uintptr_t>(p) & (sizeof(typename L::Register) - 1)) != 0;
+}
+/*
+ * dest[i] = left[i] OP right[i] for each of the length elements. An operand with a stride of 0 is a single
+ * element that is combined with every element of the other operand.
+ */
+template<class L, int OP> void packedArithmetic(typename L::Element *dest, const typename L::Element *left, int leftStride,
+												const typename L::Element *right, int rightStride, long long length) {
+	typedef typename L::Register R;
+	typedef Operation<OP> O;
+
+	long long i = 0;
+	while (i < length && misaligned<L>(dest + i)) {
+		dest[i] = O::scalar(left[i * leftStride], right[i * rightStride]);
+		i++;
+	}
+	R leftValue = L::broadcast(left[0]);
+	R rightValue = L::broadcast(right[0]);
+	if (leftStride != 0 && rightStride != 0) {
+		for (; i + L::WIDTH <= length; i += L::WIDTH)
+			L::store(dest + i, O::template packed<L>(L::load(left + i), L::load(right + i)));
+	} else if (leftStride != 0) {
+		for (; i + L::WIDTH <= length; i += L::WIDTH)
+			L::store(dest + i, O::template packed<L>(L::load(left + i), rightValue));
+	} else {
+		for (; i + L::WIDTH <= length; i += L::WIDTH)
+			L::store(dest + i, O::template packed<L>(leftValue, L::load(right + i)));
+	}
+	for (; i < length; i++)
+		dest[i] = O::scalar(left[i * leftStride], right[i * rightStride]);
+}
+
+template<class L> void arithmetic(int operation, void *dest, const void *left, int leftStride,
+								  const void *right, int rightStride, long long length) {
+	typedef typename L::Element T;
+
+	T *d = static_cast<T*>(dest);
+	const T *l = static_cast<const T*>(left);
+	const T *r = static_cast<const T*>(right);
+	switch (operation) {
+	case VO_ADD:
+		packedArithmetic<L, VO_ADD>(d, l, leftStride, r, rightStride, length);
+		break;
+
+	case VO_SUBTRACT:
+		packedArithmetic<L, VO_SUBTRACT>(d, l, leftStride, r, rightStride, length);
+		break;
+
+	case VO_MULTIPLY:
+		packedArithmetic<L, VO_MULTIPLY>(d, l, leftStride, r, rightStride, length);
+		break;
+	}
+}
+
+template<class L> void floatArithmetic(int operation, void *dest, const void *left, int leftStride,
+									   const void *right, int rightStride, long long length) {
+	typedef typename L::Element T;
+
+	if (operation == VO_DIVIDE)
+		packedArithmetic<L, VO_DIVIDE>(static_cast<T*>(dest), static_cast<const T*>(left), leftStride,
+									   static_cast<const T*>(right), rightStride, length);
+	else
+		arithmetic<L>(operation, dest, left, leftStride, right, rightStride, length);
+}
+/*
+ * The sum of the elements of a Register, added in element order.
+ */
+template<class L> typename L::Element sumLanes(typename L::Register r) {
+	typedef typename L::Element T;
+	typedef typename ScalarArithmetic<T>::Type A;
+
+	union {
+		typename L::Register r;
+		T element[L::WIDTH];
+	} lanes;
+	lanes.r = r;
+	A sum = 0;
+	for (int i = 0; i < L::WIDTH; i++)
+		sum += A(lanes.element[i]);
+	return T(sum);
+}
+/*
+ * The sum of left[i], or of left[i] * right[i] when right is not null. Two accumulators hide the latency
+ * of the packed additions. The additions are done in a different order than a loop over the elements would
+ * do them, so a floating point sum may differ from one in the last bits.
+ */
+template<class L> typename L::Element packedSum(const typename L::Element *left, const typename L::Element *right, long long length) {
+	typedef typename L::Element T;
+	typedef typename L::Register R;
+	typedef typename ScalarArithmetic<T>::Type A;
+	typedef Operation<VO_MULTIPLY> M;
+
+	A sum = 0;
+	long long i = 0;
+	if (right == null) {
+		while (i < length && misaligned<L>(left + i))
+			sum += A(left[i++]);
+	} else {
+		while (i < length && misaligned<L>(left + i)) {
+			sum += A(M::scalar(left[i], right[i]));
+			i++;
+		}
+	}
+	R a0 = L::zero();
+	R a1 = L::zero();
+	if (right == null) {
+		for (; i + 2 * L::WIDTH <= length; i += 2 * L::WIDTH) {
+			a0 = L::add(a0, L::loadAligned(left + i));
+			a1 = L::add(a1, L::loadAligned(left + i + L::WIDTH));
+		}
+	} else {
+		for (; i + 2 * L::WIDTH <= length; i += 2 * L::WIDTH) {
+			a0 = L::add(a0, L::multiply(L::loadAligned(left + i), L::load(right + i)));
+			a1 = L::add(a1, L::multiply(L::loadAligned(left + i + L::WIDTH), L::load(right + i + L::WIDTH)));
+		}
+	}
+	sum += A(sumLanes<L>(L::add(a0, a1)));
+	if (right == null) {
+		for (; i < length; i++)
+			sum += A(left[i]);
+	} else {
+		for (; i < length; i++)
+			sum += A(M::scalar(left[i], right[i]));
+	}
+	return T(sum);
+}
+
+template<class L> void reduce(void *result, const void *left, const void *right, long long length) {
+	typedef typename L::Element T;
+
+	*static_cast<T*>(result) = packedSum<L>(static_cast<const T*>(left), static_cast<const T*>(right), length);
+}
+
+} // namespace
+
+} // namespace parasol
+
+#endif // VECTOR_KERNELS_H
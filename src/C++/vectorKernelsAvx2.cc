@@ -0,0 +1,141 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+/*
+ * This file is compiled with -mavx2. Nothing in it may run before vectorKernels.cc has checked that the
+ * processor has AVX2.
+ */
+#include "vectorKernels.h"
+
+#include <immintrin.h>
+
+namespace parasol {
+
+namespace {
+
+struct Avx2Int {
+	typedef int Element;
+	typedef __m256i Register;
+	static const int WIDTH = 8;
+
+	static Register load(const int *p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static Register loadAligned(const int *p) { return _mm256_load_si256((const __m256i*)p); }
+	static void store(int *p, Register r) { _mm256_store_si256((__m256i*)p, r); }
+	static Register broadcast(int x) { return _mm256_set1_epi32(x); }
+	static Register zero() { return _mm256_setzero_si256(); }
+	static Register add(Register a, Register b) { return _mm256_add_epi32(a, b); }
+	static Register subtract(Register a, Register b) { return _mm256_sub_epi32(a, b); }
+	static Register multiply(Register a, Register b) { return _mm256_mullo_epi32(a, b); }
+};
+
+struct Avx2Long {
+	typedef long long Element;
+	typedef __m256i Register;
+	static const int WIDTH = 4;
+
+	static Register load(const long long *p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static Register loadAligned(const long long *p) { return _mm256_load_si256((const __m256i*)p); }
+	static void store(long long *p, Register r) { _mm256_store_si256((__m256i*)p, r); }
+	static Register broadcast(long long x) { return _mm256_set1_epi64x(x); }
+	static Register zero() { return _mm256_setzero_si256(); }
+	static Register add(Register a, Register b) { return _mm256_add_epi64(a, b); }
+	static Register subtract(Register a, Register b) { return _mm256_sub_epi64(a, b); }
+	// As with SSE2, there is no packed 64-bit multiply.
+	static Register multiply(Register a, Register b) {
+		__m256i low = _mm256_mul_epu32(a, b);
+		__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+										 _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+		return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+	}
+};
+
+struct Avx2Float {
+	typedef float Element;
+	typedef __m256 Register;
+	static const int WIDTH = 8;
+
+	static Register load(const float *p) { return _mm256_loadu_ps(p); }
+	static Register loadAligned(const float *p) { return _mm256_load_ps(p); }
+	static void store(float *p, Register r) { _mm256_store_ps(p, r); }
+	static Register broadcast(float x) { return _mm256_set1_ps(x); }
+	static Register zero() { return _mm256_setzero_ps(); }
+	static Register add(Register a, Register b) { return _mm256_add_ps(a, b); }
+	static Register subtract(Register a, Register b) { return _mm256_sub_ps(a, b); }
+	static Register multiply(Register a, Register b) { return _mm256_mul_ps(a, b); }
+	static Register divide(Register a, Register b) { return _mm256_div_ps(a, b); }
+};
+
+struct Avx2Double {
+	typedef double Element;
+	typedef __m256d Register;
+	static const int WIDTH = 4;
+
+	static Register load(const double *p) { return _mm256_loadu_pd(p); }
+	static Register loadAligned(const double *p) { return _mm256_load_pd(p); }
+	static void store(double *p, Register r) { _mm256_store_pd(p, r); }
+	static Register broadcast(double x) { return _mm256_set1_pd(x); }
+	static Register zero() { return _mm256_setzero_pd(); }
+	static Register add(Register a, Register b) { return _mm256_add_pd(a, b); }
+	static Register subtract(Register a, Register b) { return _mm256_sub_pd(a, b); }
+	static Register multiply(Register a, Register b) { return _mm256_mul_pd(a, b); }
+	static Register divide(Register a, Register b) { return _mm256_div_pd(a, b); }
+};
+
+}
+
+bool avx2Arithmetic(int element, int operation, void *dest, const void *left, int leftStride,
+					const void *right, int rightStride, long long length) {
+	switch (element) {
+	case VE_SIGNED_32:
+		arithmetic<Avx2Int>(operation, dest, left, leftStride, right, rightStride, length);
+		return true;
+
+	case VE_SIGNED_64:
+		arithmetic<Avx2Long>(operation, dest, left, leftStride, right, rightStride, length);
+		return true;
+
+	case VE_FLOAT_32:
+		floatArithmetic<Avx2Float>(operation, dest, left, leftStride, right, rightStride, length);
+		return true;
+
+	case VE_FLOAT_64:
+		floatArithmetic<Avx2Double>(operation, dest, left, leftStride, right, rightStride, length);
+		return true;
+	}
+	return false;
+}
+
+bool avx2Reduce(int element, void *result, const void *left, const void *right, long long length) {
+	switch (element) {
+	case VE_SIGNED_32:
+		reduce<Avx2Int>(result, left, right, length);
+		return true;
+
+	case VE_SIGNED_64:
+		reduce<Avx2Long>(result, left, right, length);
+		return true;
+
+	case VE_FLOAT_32:
+		reduce<Avx2Float>(result, left, right, length);
+		return true;
+
+	case VE_FLOAT_64:
+		reduce<Avx2Double>(result, left, right, length);
+		return true;
+	}
+	return false;
+}
+
+} // namespace parasol
@@ -74,6 +74,12 @@ class PBuildCommand extends process.Command {
 		buildOptions.verboseOption = booleanOption('v', null,
 					"Enables verbose output.");
 		buildOptions.traceOption = booleanOption(0, "trace", "Trace the execution of each test.");
+		buildOptions.traceEventsOption = stringOption(0, "trace-events",
+					"Writes the timing of each product built to the given file, in the Chrome trace event format. " +
+					"Default: " + pbuild.TRACE_FILE + " in the output directory.");
+		buildOptions.contentHashOption = booleanOption(0, "content-hash",
+					"Decides whether a product is out of date by comparing a hash of the contents of its inputs " +
+					"with the one recorded when it was last built, rather than by comparing file times.");
 		buildOptions.logImportsOption = booleanOption(0, "logImports",
 					"Log all import processing.");
 		buildOptions.officialBuildOption = booleanOption(0, "official", 
@@ -63,12 +63,26 @@ class ParasolCommand extends process.Command {
 		pxiOption = stringOption(0, "pxi",
 					"Writes compiled output to the given file. " + 
 					"Does not execute the program.");
+		prelinkOption = stringOption(0, "prelink",
+					"With --pxi, writes an image prelinked to run at the given hexadecimal address. " +
+					"The address must be a multiple of the page size. " +
+					"Relocation is skipped at startup when parasolrt can map the image at that address.");
 		profileOption = stringOption('p', "profile",
-					"Produce a profile report, writing the profile data to the " +
-					"path provided as this argument value.");
+					"Profile the program by sampling its stacks while it runs. The stacks are " +
+					"written in folded (flamegraph) format to the path provided as this argument value, " +
+					"and a flat report of the time spent in each function is written to the same path " +
+					"with .report appended.");
 		coverageOption = stringOption(0, "cover",
-					"Produce a code coverage report, accumulating the data in a " +
-					"file at the path provided in the argument value.");
+					"Count the executions of each basic block of the program. When the program exits, " +
+					"the counts are added, by source line, to the file at the path provided as this argument " +
+					"value, and a report of the lines covered so far is written to the same path with " +
+					".report appended. With --pxi, the counts are collected whenever the image runs.");
+		allocationProfileOption = stringOption(0, "alloc-profile",
+					"Profile the memory allocations of the program by recording the stack of one allocation " +
+					"in every PARASOL_ALLOC_PROFILE_INTERVAL bytes (default 524288). The estimated live and " +
+					"allocated bytes of each call site are written to the path provided as this argument value " +
+					"when the program exits, and every PARASOL_ALLOC_PROFILE_PERIOD seconds (default 60) while " +
+					"it allocates. A pxi file can be profiled the same way by setting PARASOL_ALLOC_PROFILE to the path."); 
 		targetOption = stringOption(0, "target",
 					"Selects the target runtime for this execution. " +
 					"Default: " + pxi.sectionTypeName(runtime.Target(runtime.supportedTarget(0))));
@@ -77,15 +91,32 @@ class ParasolCommand extends process.Command {
 					"The default is the parent directory of the runtime binary program.");
 		compileOnlyOption = booleanOption('c', "compile",
 					"Only compile the application, do not run it.");
+		threadsOption = integerOption(0, "threads",
+					"The number of threads used to parse source files. Default: one per CPU.");
+		noCacheOption = booleanOption(0, "no-cache",
+					"Compile the program even if the compile cache holds an image of it built from the same " +
+					"sources, and do not store the new image. The cache is the directory named by the " +
+					compiler.COMPILE_CACHE_ENV + " environment variable, or $HOME/.cache/parasol/pc. " +
+					"Setting the variable to an empty string also disables the cache. The cache is not used " +
+					"with options that change what is compiled or that do not run the program.");
+		noInlineOption = booleanOption(0, "no-inline",
+					"Do not replace calls to small functions with the body of the function. Inlining is also " +
+					"turned off by --profile and --cover.");
+		timingsOption = booleanOption(0, "timings",
+					"After compiling, print the wall time, the memory allocated and the number of syntax tree " +
+					"nodes created by each phase of the compile, and by each unit compiled. Units are parsed " +
+					"on one thread while the compile is being timed.");
 		heapOption = stringOption(0, "heap",
-					"Use a production heap ('prod'), a leak-detecting heap ('leaks') or a " +
-					"guarded heap ('guard'). Defaults to 'prod'. " +
+					"Use a production heap ('prod'), a leak-detecting heap ('leaks'), a " +
+					"guarded heap ('guard') or a production heap with per-thread caches ('cached'). Defaults to 'prod'. " +
 					"The leaks heap option writes a leaks report to leaks.txt when the process terminates " +
 					"normally. " +
 					"The guarded heap writes sentinel bytes before and after each allocated region of memory and checks " +
 					"their value when the block is deleted, or when the program terminates normally. " +
 					"If the guarded heap detects that these guard areas have been modified, it throws a " +
-					"CorruptHeapException.");
+					"CorruptHeapException. " +
+					"The cached heap serves small blocks from a cache kept by each thread. Set PARASOL_HEAP_RETAIN to " +
+					"the number of kilobytes of free memory it keeps before returning memory to the system (default 4096).");
 		elisionOption = booleanOption('e', "elide", "Enables semi-colon elision (default " + string(compiler.semiColonElision) + ")");
 		semiOption = booleanOption(0, "semi-colon", "Disables semi-colon elision (default " + string(compiler.semiColonElision) + ")");
 		versionOption = booleanOption(0, "version", "Displays the compiler version.");
@@ -97,20 +128,27 @@ class ParasolCommand extends process.Command {
 	ref<process.Option<boolean>> verboseOption;
 	ref<process.Option<boolean>> disassemblyOption;
 	ref<process.Option<string>> pxiOption;
+	ref<process.Option<string>> prelinkOption;
 	ref<process.Option<string>> targetOption;
 	ref<process.Option<string>> rootOption;
 	ref<process.Option<string>> profileOption;
+	ref<process.Option<string>> allocationProfileOption;
 	ref<process.Option<string>> coverageOption;
 	ref<process.Option<string>> heapOption;
 	ref<process.Option<string>> includeOption;
 	ref<process.Option<boolean>> logImportsOption;
 	ref<process.Option<boolean>> symbolTableOption;
 	ref<process.Option<boolean>> compileOnlyOption;
+	ref<process.Option<int>> threadsOption;
+	ref<process.Option<boolean>> noInlineOption;
+	ref<process.Option<boolean>> noCacheOption;
+	ref<process.Option<boolean>> timingsOption;
 	ref<process.Option<boolean>> versionOption;
 	ref<process.Option<boolean>> elisionOption;
 	ref<process.Option<boolean>> semiOption;
 	memory.StartingHeap heap;
 	string[] includes;
+	long prelinkAddress;
 
 }
 
@@ -120,8 +158,7 @@ private string[] finalArguments;
 int main(string[] args) {
 	int result;
 	parseCommandLine(args);
-	if (!parasolCommand.coverageOption.set())
-		result = runCommand();
+	result = runCommand();
 	return result;
 }
 
@@ -129,7 +166,8 @@ void parseCommandLine(string[] args) {
 	string[memory.StartingHeap] heapOptionValues = [
 		"prod",
 		"leaks",
-		"guard"
+		"guard",
+		"cached"
 	];
 	
 	if (!parasolCommand.parse(args))
@@ -182,6 +220,23 @@ void parseCommandLine(string[] args) {
 		}
 	}
 
+	if (parasolCommand.prelinkOption.set()) {
+		if (!parasolCommand.pxiOption.set()) {
+			printf("The --prelink option requires the --pxi option\n");
+			parasolCommand.help();
+		}
+		string value = parasolCommand.prelinkOption.value;
+		if (value.startsWith("0x") || value.startsWith("0X"))
+			value = value.substr(2);
+		boolean success;
+		(parasolCommand.prelinkAddress, success) = long.parse(value, 16);
+		if (!success || parasolCommand.prelinkAddress <= 0 || 
+			(parasolCommand.prelinkAddress & (pxi.PRELINK_ALIGNMENT - 1)) != 0) {
+			printf("Invalid value for prelink argument: %s\n", parasolCommand.prelinkOption.value);
+			parasolCommand.help();
+		}
+	}
+
 	if (parasolCommand.targetOption.set()) {
 		if (pxi.sectionType(parasolCommand.targetOption.value) == null) {
 			printf("Invalid value for target argument: %s\n", parasolCommand.targetOption.value);
@@ -217,24 +272,60 @@ int runCommand() {
 		printf("Compiling to %s\n", pxiFile);
 	}
 
+	// The covered program may change its working directory before it writes the counts.
+	string coveragePath;
+	if (parasolCommand.coverageOption.set())
+		coveragePath = storage.absolutePath(parasolCommand.coverageOption.value);
+
 	time.Time start = time.Time.now();
 
+	ref<compiler.CompileCache> cache = openCompileCache(&arena);
+	if (cache != null) {
+		string image = cache.lookup(arena.activeContext());
+		if (image != null) {
+			boolean loaded;
+			(returnValue, result, loaded) = compiler.CompileCache.run(image, finalArguments);
+			if (loaded) {
+				delete cache;
+				if (!result) {
+					if (returnValue != -1)
+						printf("%s failed!\n", finalArguments[0]);
+					returnValue = 1;
+				}
+				return returnValue;
+			}
+		}
+	}
+
 	compiler.CompileContext compileContext(&arena,
 									null,
 									parasolCommand.verboseOption.value,
 									parasolCommand.heap,
 									parasolCommand.profileOption.value,
-									parasolCommand.coverageOption.value,
+									coveragePath,
+									parasolCommand.allocationProfileOption.value,
 									parasolCommand.logImportsOption.value);
 	compileContext.includes = parasolCommand.includes;
+	if (parasolCommand.threadsOption.set())
+		compileContext.threads = parasolCommand.threadsOption.value;
+	compileContext.noInline = parasolCommand.noInlineOption.value;
 
 	if (pxiVersion != null)
 		compileContext.imageVersion = pxiVersion;
+	ref<compiler.CompileTimings> timings;
+	if (parasolCommand.timingsOption.value)
+		compileContext.timings = timings = new compiler.CompileTimings();
 	if (!compileContext.loadRoot(false))
 		return 1;
 
 	string[] args = parasolCommand.finalArguments();
 	ref<compiler.Target> target = compileContext.compile(args[0]);
+	if (timings != null) {
+		timings.finish();
+		timings.print();
+		compileContext.timings = null;
+		delete timings;
+	}
 	if (parasolCommand.symbolTableOption.value)
 		arena.printSymbolTable();
 	if (parasolCommand.verboseOption.value) {
@@ -252,7 +343,15 @@ int runCommand() {
 		returnValue = 1;
 	else if (parasolCommand.pxiOption.set()) {
 		ref<pxi.Pxi> output = pxi.Pxi.create(pxiFile);
-		target.writePxi(output);
+		if (parasolCommand.prelinkOption.set()) {
+			if (!target.writePrelinkedPxi(output, parasolCommand.prelinkAddress)) {
+				printf("The target does not support prelinked images\n");
+				delete output;
+				delete target;
+				return 1;
+			}
+		} else
+			target.writePxi(output);
 		if (!output.write()) {
 			printf("Error writing to %s\n", pxiFile);
 			returnValue = 1;
@@ -261,6 +360,8 @@ int runCommand() {
 		time.Time end = time.Time.now();
 		printf("Done in %d milliseconds\n", end.milliseconds() - start.milliseconds());
 	} else if (!parasolCommand.compileOnlyOption.value) {
+		if (cache != null)
+			cache.store(&arena, target, compileContext.packages());
 		(returnValue, result) = target.run(args);
 		if (!result) {
 			if (returnValue != -1)
@@ -269,8 +370,44 @@ int runCommand() {
 		}
 	}
 	delete target;
+	delete cache;
 	return returnValue;
 }
+/*
+ * The compile cache is only used for a plain compile and run of a program. Options that change the image
+ * or ask for output from the compiler itself bypass it.
+ */
+ref<compiler.CompileCache> openCompileCache(ref<compiler.Arena> arena) {
+	if (parasolCommand.noCacheOption.value ||
+		parasolCommand.pxiOption.set() ||
+		parasolCommand.compileOnlyOption.value ||
+		parasolCommand.verboseOption.value ||
+		parasolCommand.disassemblyOption.value ||
+		parasolCommand.symbolTableOption.value ||
+		parasolCommand.logImportsOption.value ||
+		parasolCommand.timingsOption.value ||
+		parasolCommand.profileOption.set() ||
+		parasolCommand.coverageOption.set() ||
+		parasolCommand.allocationProfileOption.set() ||
+		parasolCommand.heapOption.set() ||
+		parasolCommand.targetOption.set() ||
+		parasolCommand.includes.length() > 0)
+		return null;
+	string directory = compiler.CompileCache.defaultDirectory();
+	if (directory == null)
+		return null;
+	ref<context.Package> corePackage = arena.activeContext().getPackage(context.PARASOL_CORE_PACKAGE_NAME);
+	if (corePackage == null)
+		return null;
+	ref<compiler.CompileCache> cache = new compiler.CompileCache(directory, storage.absolutePath(finalArguments[0]),
+									 arena.activeContext().name(), corePackage.directory(),
+									 string(compiler.semiColonElision), string(parasolCommand.noInlineOption.value));
+	if (!cache.usable()) {
+		delete cache;
+		return null;
+	}
+	return cache;
+}
 
 void configureArena(ref<compiler.Arena> arena) {
 	arena.verbose = parasolCommand.verboseOption.value;
@@ -24,6 +24,7 @@ import parasol:script;
 import parasol:storage;
 import parasol:text.memDump;
 import parasol:thread;
+import parasol:time;
 import parasol:types.Set;
 import native:linux;
 
@@ -38,6 +39,14 @@ ref<Package> installPackage;				// If this maker is building the parasol compile
 
 private monitor class CoordinatorVolatileData {
 	boolean _overallSuccess;
+	ref<BuildHistory> _history;
+	int[string] _scheduleIndex;			// maps product name to its index in _products
+	int[][] _dependents;				// the indices of the products that include each product
+	int[] _unfinishedDependencies;
+	long[] _criticalPath;				// the estimated milliseconds from the start of each product to the end of the build
+	int[] _ready;						// products whose dependencies have all finished, but which have not been started
+	int _running;
+	int _unbuilt;
 }
 
 public class BuildOptions {
@@ -59,6 +68,8 @@ public class BuildOptions {
 	public ref<process.Option<string>> installContextOption;
 	public ref<process.Option<boolean>> elisionOption;
 	public ref<process.Option<boolean>> semiOption;
+	public ref<process.Option<boolean>> contentHashOption;
+	public ref<process.Option<string>> traceEventsOption;
 
 	public void setOptionDefaults() {
 		if (buildDirOption == null)
@@ -97,6 +108,10 @@ public class BuildOptions {
 			elisionOption = process.Command.defaultBooleanOption();
 		if (semiOption == null)
 			semiOption = process.Command.defaultBooleanOption();
+		if (contentHashOption == null)
+			contentHashOption = process.Command.defaultBooleanOption();
+		if (traceEventsOption == null)
+			traceEventsOption = process.Command.defaultStringOption();
 
 		if (!buildThreadsOption.set())
 			buildThreadsOption.value = thread.cpuCount();
@@ -133,6 +148,8 @@ public class Coordinator extends CoordinatorVolatileData {
 	private static Monitor _lock;
 	private static ref<thread.ThreadPool<boolean>> _workers;
 	private Set<string> _uniqueTests;
+	private time.Instant _buildStarted;
+	private time.Instant _buildFinished;
 
 	public Coordinator(ref<BuildOptions> buildOptions, string... components) {
 		_buildOptions = buildOptions;
@@ -480,10 +497,14 @@ public class Coordinator extends CoordinatorVolatileData {
 		
 		_products = sorter.sort()
 		
-		for (i in _products)
-			_products[i].scheduleBuild();
+		buildProducts();
 		for (i in _products)
 			_products[i].waitForBuild();
+		lock (*this) {
+			if (!_history.save())
+				printf("    Could not write build history %s\n", _history.filename());
+		}
+		writeTraceEvents();
 		lock (*this) {
 			success = _overallSuccess;
 		}
@@ -583,6 +604,158 @@ public class Coordinator extends CoordinatorVolatileData {
 		return success ? 0 : 1;
 	}
 
+	/**
+	 * Build every product, starting each one only when all of the products it includes have finished.
+	 *
+	 * Whenever a thread is free, the ready product with the longest critical path is started next. The
+	 * critical path of a product is its own duration plus the longest critical path of any product that
+	 * includes it. Durations come from the build history, so the first build of a tree can only guess.
+	 */
+	private void buildProducts() {
+		ref<BuildHistory> history = new BuildHistory(historyFile());
+		history.load();
+		int[string] scheduleIndex;
+		for (i in _products)
+			scheduleIndex[_products[i].toString()] = i;
+		int[][] dependents;
+		int[] unfinishedDependencies;
+		dependents.resize(_products.length());
+		unfinishedDependencies.resize(_products.length());
+		for (i in _products) {
+			included := _products[i].includedProducts();
+			Set<string> seen;
+			for (j in included) {
+				name := included[j].toString();
+				if (seen.contains(name) || !scheduleIndex.contains(name))
+					continue;
+				seen.add(name);
+				dependents[scheduleIndex[name]].append(i);
+				unfinishedDependencies[i] += 1;
+			}
+		}
+		// _products is sorted by level, so every product follows all the products it includes.
+		long defaultDuration = history.defaultDuration();
+		long[] criticalPath;
+		criticalPath.resize(_products.length());
+		for (int i = _products.length() - 1; i >= 0; i--) {
+			long longest;
+			for (j in dependents[i]) {
+				if (criticalPath[dependents[i][j]] > longest)
+					longest = criticalPath[dependents[i][j]];
+			}
+			long duration;
+			boolean known;
+			(duration, known) = history.duration(_products[i].toString());
+			criticalPath[i] = (known ? duration : defaultDuration) + longest;
+		}
+		int threads = buildThreads() > 0 ? buildThreads() : 1;
+		_buildStarted = time.Clock.MONOTONIC.get();
+		lock (*this) {
+			_history = history;
+			_scheduleIndex = scheduleIndex;
+			_dependents = dependents;
+			_unfinishedDependencies = unfinishedDependencies;
+			_criticalPath = criticalPath;
+			for (i in _products)
+				if (_unfinishedDependencies[i] == 0)
+					_ready.append(i);
+			_unbuilt = _products.length();
+			while (_unbuilt > 0) {
+				while (_running < threads && _ready.length() > 0) {
+					int best = 0;
+					for (j in _ready)
+						if (_criticalPath[_ready[j]] > _criticalPath[_ready[best]])
+							best = j;
+					int next = _ready[best];
+					_ready.remove(best);
+					_running++;
+					// A product that could not be queued has failed, and is finished like any other.
+					if (!_products[next].scheduleBuild())
+						productFinished(_products[next], false);
+				}
+				wait();
+			}
+		}
+		_buildFinished = time.Clock.MONOTONIC.get();
+	}
+	/**
+	 * Called from the worker thread, once a product's build has returned, or with the coordinator's
+	 * lock held, for a product that could not be queued.
+	 */
+	void productFinished(ref<Product> product, boolean success) {
+		lock (*this) {
+			name := product.toString();
+			// A product that stopped because an included product failed was not really built.
+			if (success && !product.componentsFailed()) {
+				if (!product.upToDate())
+					_history.setDuration(name, product.buildMilliseconds());
+				digest := product.inputDigest();
+				if (digest != null)
+					_history.setDigest(name, digest);
+			}
+			i := _scheduleIndex[name];
+			for (j in _dependents[i]) {
+				d := _dependents[i][j];
+				_unfinishedDependencies[d] -= 1;
+				if (_unfinishedDependencies[d] == 0)
+					_ready.append(d);
+			}
+			_running--;
+			_unbuilt--;
+			notify();
+		}
+	}
+	/**
+	 * @return The digest the build history holds for the last successful build of the product, or null.
+	 */
+	string recordedDigest(ref<Product> product) {
+		lock (*this) {
+			return _history.digest(product.toString());
+		}
+	}
+	/**
+	 * Write the products built by this run in the Chrome trace event format.
+	 *
+	 * Each product is a complete event on the thread that built it. Its arguments give the outcome and
+	 * the critical path that decided when it was started.
+	 */
+	private void writeTraceEvents() {
+		string filename = _buildOptions.traceEventsOption.set() ? _buildOptions.traceEventsOption.value :
+											storage.path(storage.directory(historyFile()), TRACE_FILE);
+		string text = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		text.printf("{\"name\":\"build\",\"cat\":\"pbuild\",\"ph\":\"X\",\"ts\":0,\"dur\":%d,\"pid\":1,\"tid\":0," +
+							"\"args\":{\"threads\":%d,\"products\":%d}}",
+							microsecondsBetween(_buildStarted, _buildFinished), buildThreads(), _products.length());
+		Set<int> workers;
+		for (i in _products) {
+			p := _products[i];
+			long criticalPath;
+			lock (*this) {
+				criticalPath = _criticalPath[i];
+			}
+			text.printf(",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%d,\"dur\":%d,\"pid\":1,\"tid\":%d," +
+							"\"args\":{\"outcome\":\"%s\",\"criticalPathMs\":%d}}",
+							p.toString().escapeJSON(), p.upToDate() ? "up to date" : "built",
+							microsecondsBetween(_buildStarted, p.started()),
+							microsecondsBetween(p.started(), p.finished()), p.worker(),
+							p.outcome().trim(), criticalPath);
+			if (!workers.contains(p.worker())) {
+				workers.add(p.worker());
+				text.printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}",
+								p.worker(), p.worker());
+			}
+		}
+		text.append("\n]}\n");
+		storage.File f;
+		if (!storage.ensure(storage.directory(filename)) || !f.create(filename)) {
+			printf("    Could not create trace file %s\n", filename);
+			return;
+		}
+		if (f.write(text) != text.length())
+			printf("    Could not write trace file %s\n", filename);
+		f.close();
+	}
+
 	private static string singleLine(string s) {
 		string output;
 
@@ -605,6 +778,17 @@ public class Coordinator extends CoordinatorVolatileData {
 		return _pseudoContext;
 	}
 
+	public string historyFile() {
+		string dir = outputDir();
+		if (dir == null)
+			dir = storage.path(buildDir(), "build");
+		return storage.path(dir, HISTORY_FILE);
+	}
+
+	public boolean contentHashes() {
+		return _buildOptions.contentHashOption.value;
+	}
+
 	public ref<thread.ThreadPool<boolean>> workers() {
 		return _workers;
 	}
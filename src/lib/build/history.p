@@ -0,0 +1,167 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+namespace parasol:pbuild;
+
+import parasol:storage;
+import parasol:time;
+
+string HISTORY_FILE = "pbuild.history";
+public string TRACE_FILE = "pbuild-trace.json";
+
+private string HISTORY_FORMAT = "parasol build history 1";
+/**
+ * What one build of a tree leaves behind for the next one.
+ *
+ * For each product, the history holds the number of milliseconds the product last took to build
+ * and the digest of its inputs when it was last built successfully. Products that were up to date
+ * do not replace their recorded duration, so the durations describe real builds.
+ *
+ * The file holds a format line, followed by one line per product:
+ *
+ * <pre>
+ *     <i>milliseconds</i> <i>digest</i> <i>product</i>
+ * </pre>
+ *
+ * where an unknown duration is written as -1 and an unknown digest as a dash.
+ */
+class BuildHistory {
+	private string _filename;
+	private long[string] _durations;
+	private string[string] _digests;
+
+	BuildHistory(string filename) {
+		_filename = filename;
+	}
+	/**
+	 * Read the history file. A missing or unreadable file leaves the history empty.
+	 */
+	void load() {
+		ref<storage.FileReader> r = storage.openTextFile(_filename);
+		if (r == null)
+			return;
+		if (r.readLine() == HISTORY_FORMAT) {
+			for (;;) {
+				string line = r.readLine();
+				if (line == null)
+					break;
+				int first = line.indexOf(' ');
+				if (first < 0)
+					continue;
+				int second = line.indexOf(' ', first + 1);
+				if (second < 0)
+					continue;
+				long milliseconds;
+				boolean success;
+				(milliseconds, success) = long.parse(line.substr(0, first));
+				if (!success)
+					continue;
+				string product = line.substr(second + 1);
+				if (milliseconds >= 0)
+					_durations[product] = milliseconds;
+				string digest = line.substr(first + 1, second);
+				if (digest != "-")
+					_digests[product] = digest;
+			}
+		}
+		delete r;
+	}
+	/**
+	 * Write the history file, replacing any previous one.
+	 *
+	 * @return true if the file was written, false otherwise.
+	 */
+	boolean save() {
+		string[] products;
+		for (long[string].iterator i = _durations.begin(); i.hasNext(); i.next())
+			products.append(i.key());
+		for (string[string].iterator i = _digests.begin(); i.hasNext(); i.next())
+			if (!_durations.contains(i.key()))
+				products.append(i.key());
+		products.sort();
+		string text = HISTORY_FORMAT + "\n";
+		for (i in products) {
+			long milliseconds = -1;
+			if (_durations.contains(products[i]))
+				milliseconds = _durations[products[i]];
+			string digest = "-";
+			if (_digests.contains(products[i]))
+				digest = _digests[products[i]];
+			text.printf("%d %s %s\n", milliseconds, digest, products[i]);
+		}
+		if (!storage.ensure(storage.directory(_filename)))
+			return false;
+		storage.File f;
+		if (!f.create(_filename))
+			return false;
+		boolean written = f.write(text) == text.length();
+		f.close();
+		return written;
+	}
+
+	long, boolean duration(string product) {
+		if (_durations.contains(product))
+			return _durations[product], true;
+		else
+			return 0, false;
+	}
+
+	void setDuration(string product, long milliseconds) {
+		_durations[product] = milliseconds;
+	}
+
+	string digest(string product) {
+		if (_digests.contains(product))
+			return _digests[product];
+		else
+			return null;
+	}
+
+	void setDigest(string product, string digest) {
+		_digests[product] = digest;
+	}
+	/**
+	 * The duration to assume for a product that has never been built: the mean of the known
+	 * durations, or one second if there are none.
+	 */
+	long defaultDuration() {
+		long total;
+		int count;
+		for (long[string].iterator i = _durations.begin(); i.hasNext(); i.next()) {
+			total += i.get();
+			count++;
+		}
+		return count > 0 ? total / count : 1000;
+	}
+
+	string filename() {
+		return _filename;
+	}
+}
+/**
+ * Milliseconds from start to end, never less than zero.
+ */
+long millisecondsBetween(time.Instant start, time.Instant end) {
+	time.Duration d = time.Instant.elapsed(start, end);
+	long ms = d.milliseconds();
+	return ms > 0 ? ms : 0;
+}
+/**
+ * Microseconds from start to end, as the trace-event format wants them.
+ */
+long microsecondsBetween(time.Instant start, time.Instant end) {
+	time.Duration d = time.Instant.elapsed(start, end);
+	return d.seconds() * 1000000 + d.nanoseconds() / 1000;
+}
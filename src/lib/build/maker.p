@@ -42,6 +42,13 @@ class Component {
 	}
 
 	public abstract boolean inputsNewer(time.Instant timeStamp);
+	/**
+	 * Append the path of every input file of this component, for a build that compares content
+	 * hashes rather than file times.
+	 *
+	 * @return false if the inputs could not all be found, which forces a rebuild.
+	 */
+	public abstract boolean collectInputs(ref<string[]> inputs);
 
 	public abstract void print(int indent);
 
@@ -192,6 +199,13 @@ class Folder extends Component {
 				return true;
 		return false;
 	}
+
+	public boolean collectInputs(ref<string[]> inputs) {
+		for (i in _components)
+			if (!_components[i].collectInputs(inputs))
+				return false;
+		return true;
+	}
 	/**
 	 * Copy the contents of this folder object to the given targetPath directory.
 	 */
@@ -374,6 +388,15 @@ class File extends Component {
 		return false;
 	}
 
+	public boolean collectInputs(ref<string[]> inputs) {
+		string src = storage.path(_enclosing.buildDir(), _src);
+		if (!checkSrc(src, _enclosing.coordinator().reportOutOfDate()))
+			return false;
+		for (i in _names)
+			inputs.append(storage.path(src, _names[i]));
+		return true;
+	}
+
 	public boolean copy(string targetPath) {
 		string src = storage.path(_enclosing.buildDir(), _src);
 		if (!checkSrc(src, true))
@@ -512,6 +535,11 @@ class Link extends Component {
 		return !storage.exists(linkFile);
 	}
 
+	public boolean collectInputs(ref<string[]> inputs) {
+		string linkFile = storage.path(_enclosing.path(), _name);
+		return storage.exists(linkFile);
+	}
+
 	public boolean copy(string targetPath) {
 		string linkFile = storage.path(targetPath, _name);
 //		printf("Link %s <- %s\n", _target, linkFile);
@@ -34,6 +34,11 @@ class Product extends Folder {
 	private string _outputDir;
 	private ref<Coordinator> _coordinator;
 	private thread.Future<boolean> _future;
+	private ref<Exception> _uncaught;
+	private time.Instant _started;
+	private time.Instant _finished;
+	private int _worker;
+	protected string _inputDigest;
 	protected boolean _compileSkipped;
 	protected boolean _componentFailures;
 	protected ref<Product>[] _includedProducts;
@@ -55,8 +60,19 @@ class Product extends Folder {
 	void resolveNames(ref<BuildFile> buildFile) {
 	}
 
-	void scheduleBuild() {
-		_coordinator.workers().execute(&_future, productBuilder, this);
+	/**
+	 * Queue the build of this product on the coordinator's workers.
+	 *
+	 * @return true if the build was queued. If it was not, the product has failed and its future is posted.
+	 */
+	boolean scheduleBuild() {
+		if (_coordinator.workers().execute(productBuilder, this))
+			return true;
+		printf("    FAIL: could not queue the build of %s\n", toString());
+		_started = time.Clock.MONOTONIC.get();
+		_finished = _started;
+		_future.post(false);
+		return false;
 	}
 
 	void waitForBuild() {
@@ -67,7 +83,9 @@ class Product extends Folder {
 			_coordinator.declareFailure();
 			printf("    FAIL: product %s build failed\n", toString());
 		}
-		e := _future.uncaught();
+		e := _uncaught;
+		if (e == null)
+			e = _future.uncaught();
 		if (e != null) {
 			exception.uncaughtException(e);
 			printf("\n");
@@ -83,9 +101,25 @@ class Product extends Folder {
 		return true;
 	}
 
-	private static boolean productBuilder(address arg) {
+	private static void productBuilder(address arg) {
 		ref<Product> product = ref<Product>(arg);
-		return product.build();
+		product._started = time.Clock.MONOTONIC.get();
+		product._worker = thread.currentThread().id();
+		boolean success = product.guardedBuild();
+		product._finished = time.Clock.MONOTONIC.get();
+		// Post before the products that include this one can be started, since they wait on the future.
+		product._future.post(success);
+		// The coordinator must hear about every product, or it will wait forever for the last ones.
+		product._coordinator.productFinished(product, success);
+	}
+
+	private boolean guardedBuild() {
+		try {
+			return build();
+		} catch (Exception e) {
+			_uncaught = e.clone();
+		}
+		return false;
 	}
 
 	boolean build() {
@@ -113,6 +147,40 @@ class Product extends Folder {
 		return _includedProducts;
 	}
 
+	time.Instant started() {
+		return _started;
+	}
+
+	time.Instant finished() {
+		return _finished;
+	}
+	/**
+	 * @return The id of the thread that built this product.
+	 */
+	int worker() {
+		return _worker;
+	}
+
+	long buildMilliseconds() {
+		return millisecondsBetween(_started, _finished);
+	}
+
+	boolean upToDate() {
+		return _compileSkipped;
+	}
+	/**
+	 * @return true if the build stopped because a product this one includes failed.
+	 */
+	boolean componentsFailed() {
+		return _componentFailures;
+	}
+	/**
+	 * @return The digest of this product's inputs, if the build compared content hashes, or null.
+	 */
+	string inputDigest() {
+		return _inputDigest;
+	}
+
 	void post(boolean outcome) {
 		_future.post(outcome);
 	}
@@ -254,6 +322,11 @@ public class ParasolProduct extends Product {
 	}
 
 	public boolean shouldCompile() {
+		if (coordinator().contentHashes()) {
+			// Compute the digest even for an official build, so the next build can use it.
+			boolean changed = inputsChanged();
+			return changed || coordinator().officialBuild();
+		}
 		if (coordinator().officialBuild())
 			return true;
 		time.Instant accessed, modified, created;
@@ -278,6 +351,51 @@ public class ParasolProduct extends Product {
 		}
 	}
 
+	/**
+	 * The content hash counterpart of the file time checks in shouldCompile.
+	 *
+	 * The digest covers the path and contents of every input and the digests of the included products,
+	 * which have all finished building by now. It is compared with the digest the build history recorded
+	 * for the last successful build of this product.
+	 */
+	private boolean inputsChanged() {
+		string[] inputs;
+		boolean complete = collectInputs(&inputs);
+		inputs.sort();
+		storage.ContentHash digest;
+		for (i in inputs) {
+			long hash;
+			boolean success;
+			(hash, success) = storage.contentHash(inputs[i]);
+			if (!success) {
+				if (coordinator().reportOutOfDate())
+					printf("            %s doesn't exist in %s, building\n", herePath(inputs[i]), toString());
+				complete = false;
+				break;
+			}
+			digest.add(inputs[i]);
+			digest.add(hash);
+		}
+		if (!complete)
+			return true;
+		for (i in _includedProducts) {
+			digest.add(_includedProducts[i].toString());
+			digest.add(_includedProducts[i].inputDigest());
+		}
+		_inputDigest = digest.toString();
+		if (!storage.exists(sentinelFileName())) {
+			if (coordinator().reportOutOfDate())
+				printf("            %s hasn't been built, building\n", toString());
+			return true;
+		}
+		if (coordinator().recordedDigest(this) != _inputDigest) {
+			if (coordinator().reportOutOfDate())
+				printf("            %s inputs changed, building\n", toString());
+			return true;
+		}
+		return false;
+	}
+
 	public boolean openCompiler() {
 		_arena = new compiler.Arena(coordinator().activeContext());
 
@@ -550,6 +668,19 @@ public class Package extends ParasolProduct {
 		return false;
 	}
 
+	public boolean collectInputs(ref<string[]> inputs) {
+		if (!super.collectInputs(inputs))
+			return false;
+		for (i in _usedPackages) {
+			p := _usedPackages[i];
+			// A package built here (including the core package) is an included product, and its digest
+			// is already part of ours.
+			if (p.class != context.PseudoPackage)
+				inputs.append(storage.path(p.directory(), context.PACKAGE_MANIFEST));
+		}
+		return true;
+	}
+
 	public ref<compiler.Target>, boolean compile() {
 		if (!openCompiler())
 			return null, false;			
@@ -733,6 +864,45 @@ class RunnableProduct extends ParasolProduct {
 			return false;
 		}
 	}
+
+	public boolean collectInputs(ref<string[]> inputs) {
+		string mainFile = storage.path(buildDir(), _main, null);
+		inputs.append(mainFile);
+
+		string dir = storage.directory(mainFile);
+		// Products are written while other products are hashing their inputs, so the output directory
+		// must not be scanned, wherever it is.
+		string output = storage.absolutePath(outputDir());
+
+		storage.Directory d(dir);
+		if (d.first()) {
+			do {
+				file := d.filename();
+				if (file == "." || file == "..")
+					continue;
+				path := d.path();
+				if (storage.isDirectory(path) && storage.absolutePath(path) != output)
+					collectSubDirectory(path, output, inputs);
+			} while (d.next());
+		}
+		return super.collectInputs(inputs);
+
+		void collectSubDirectory(string dirPath, string output, ref<string[]> inputs) {
+			storage.Directory d(dirPath);
+			if (d.first()) {
+				do {
+					file := d.filename();
+					if (file == "." || file == "..")
+						continue;
+					path := d.path();
+					if (file.endsWith(".p"))
+						inputs.append(path);
+					if (storage.isDirectory(path) && storage.absolutePath(path) != output)
+						collectSubDirectory(path, output, inputs);
+				} while (d.next());
+			}
+		}
+	}
 }
 
 public class Application extends RunnableProduct {
@@ -1240,6 +1410,13 @@ class IncludePackage extends Product {
 			return true;
 	}
 
+	public boolean collectInputs(ref<string[]> inputs) {
+		if (_package != null)
+			return _package.collectInputs(inputs);
+		else
+			return false;
+	}
+
 	public string toString() {
 		string s;
 		s.printf("include %s", name());
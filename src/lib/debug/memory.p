@@ -165,7 +165,13 @@ public class MemoryMap {
 //			logger.info("    Target address is not in mapped memory (%p)", addr);
 			return null, null, null, -10;
 		}
-		if (seg.file != null) {
+		if (seg.file != null && seg.file.isPxi()) {
+//			logger.info("    Target address %p is in a mapped Parasol image %s", addr, seg.filename);
+			image := seg.file.loadImage(_process.id());
+			if (image == null)
+				return null, null, null, -14;
+			return seg, null, sourceLocation(image, addr), 0;
+		} else if (seg.file != null) {
 			e := seg.file.reader();
 			if (e == null) {
 //				logger.info("    Target address %x is in a non-ELF file, %s. (%s)", addr, seg.filename, string(seg.file.type()));
@@ -219,16 +225,7 @@ public class MemoryMap {
 			image := seg.loadImage(_process.id());
 			if (image == null)
 				return null, null, null, -14;
-			string filename;
-			int lineno;
-			string result;
-
-			(filename, lineno) = image.getSourceLocation(addr);
-			if (filename == null)
-				result = null;
-			else
-				result.printf("%s %d", filename, lineno);
-			return seg, null, result, 0;
+			return seg, null, sourceLocation(image, addr), 0;
 /*
 			addr = threadContextAddress();
 			if (addr != 0) {
@@ -270,6 +267,19 @@ public class MemoryMap {
 		return null, null, null, -12;
 	}
 
+	private static string sourceLocation(ref<runtime.Image> image, long addr) {
+		string filename;
+		int lineno;
+		string result;
+
+		(filename, lineno) = image.getSourceLocation(addr);
+		if (filename == null)
+			result = null;
+		else
+			result.printf("%s %d", filename, lineno);
+		return result;
+	}
+
 	public long threadContextAddress() {
 		if (!_threadContextResolved) {
 			_threadContextResolved = true;
@@ -489,6 +499,8 @@ class File {
 	FileType _type;
 	ref<MemorySegment>[] _segments;
 	ref<elf.Reader> _reader;
+	address _imageData;
+	ref<runtime.Image> _image;
 
 	File(string filename) {
 		_filename = filename;
@@ -496,6 +508,8 @@ class File {
 
 	~File() {
 		delete _reader;
+		delete _imageData;
+		delete _image;
 	}
 
 	string filename() {
@@ -517,6 +531,63 @@ class File {
 			return null;
 	}
 
+	boolean isPxi() {
+		return _filename.endsWith(".pxi");
+	}
+	/**
+	 * Load a copy of the image of a pxi file that parasolrt mapped rather than read.
+	 *
+	 * The executable section does not start on a page boundary in the file, so the image
+	 * address is found from the section offset and the file offset of the first mapped segment.
+	 */
+	ref<runtime.Image> loadImage(int pid) {
+		if (_image == null && _segments.length() > 0) {
+			p := pxi.Pxi.load(_filename);
+			if (p == null)
+				return null;
+			long sectionOffset = -1;
+			long length;
+			for (int i = 0; i < p.sectionCount(); i++) {
+				if (p.sectionType(i) == runtime.Target.X86_64_LNX_NEW) {
+					entry := p.entry(i);
+					sectionOffset = entry.offset;
+					length = entry.length;
+					break;
+				} else if (p.sectionType(i) == runtime.Target.X86_64_LNX_PRELINKED) {
+					entry := p.entry(i);
+					pxi.X86_64PrelinkHeader header;
+					storage.File f;
+					if (f.open(_filename)) {
+						if (f.seek(entry.offset, storage.Seek.START) == entry.offset &&
+							f.read(&header, header.bytes) == header.bytes) {
+							sectionOffset = entry.offset + header.imageOffset;
+							length = header.imageLength;
+						}
+						f.close();
+					}
+					break;
+				}
+			}
+			delete p;
+			if (sectionOffset < 0)
+				return null;
+			start := _segments[0].start + sectionOffset - _segments[0].offset;
+			_imageData = memory.alloc(length);
+			if (_imageData == null) {
+				logger.error("    No memory for image");
+				return null;
+			}
+			if (!tracer.copy(pid, start, _imageData, int(length))) {
+				delete _imageData;
+				_imageData = null;
+				logger.error("    Couldn't copy image data @ %x from pid %d length %,d", start, pid, length);
+				return null;
+			}
+			_image = new runtime.Image(start, _imageData, int(length));
+		}
+		return _image;
+	}
+
 	ref<elf.Reader> reader() {
 		if (_reader == null) {
 			if (_type == FileType.INACCESSIBLE)
@@ -585,6 +656,8 @@ public class DebugStack extends runtime.VirtualStack {
 		seg := mm.findSegment(addr);
 		if (seg == null)
 			return false;
+		if (seg.file != null && seg.file.isPxi())
+			return seg.prot == Protections.EXECUTE || seg.prot == Protections.ALL;
 		return seg.prot == Protections.ALL;
 	}
 
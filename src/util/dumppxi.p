@@ -67,6 +67,7 @@ int main(string[] args) {
 	pxi.registerSectionReader(runtime.Target.X86_64_LNX, x86_64NextReader);
 	pxi.registerSectionReader(runtime.Target.X86_64_LNX_SRC, x86_64NextReader);
 	pxi.registerSectionReader(runtime.Target.X86_64_WIN, x86_64NextReader);
+	pxi.registerSectionReader(runtime.Target.X86_64_LNX_PRELINKED, x86_64PrelinkedReader);
 	for (int i = 0; i < files.length(); i++)
 		if (!dump(files[i]))
 			anyFailed = true;
@@ -94,7 +95,9 @@ boolean dump(string filename) {
 		string offset;
 		offset.printf("@%x", entry.offset);
 		printf("  %c %4s %16s %10s [%d bytes]\n", i == best ? '*' : ' ', label, type, offset, entry.length);
-		if (verbose == st || assembly == st || (command.relocationsOption.set() && st == runtime.Target.X86_64_LNX_SRC)) {
+		if (verbose == st || assembly == st || 
+			(command.relocationsOption.set() && 
+				(st == runtime.Target.X86_64_LNX_SRC || st == runtime.Target.X86_64_LNX_PRELINKED))) {
 			ref<pxi.Section> s = p.readSection(i);
 			if (s == null)
 				printf("      <<- ERROR ->>\n");
@@ -147,6 +150,23 @@ ref<pxi.Section> x86_64NextReader(storage.File pxiFile, long length) {
 	return new PlaceHolder();
 }
 
+ref<pxi.Section> x86_64PrelinkedReader(storage.File pxiFile, long length) {
+	pxi.X86_64PrelinkHeader prelink;
+
+	long sectionOffset = pxiFile.tell();
+	if (pxiFile.read(&prelink, prelink.bytes) != prelink.bytes) {
+		printf("          Could not read prelink header\n");
+		return null;
+	}
+	printf("\n        prelinked base       %8x\n", prelink.baseAddress);
+	printf("        prelinked image      %8x (file offset %x)\n", prelink.imageOffset, sectionOffset + prelink.imageOffset);
+	if (pxiFile.seek(sectionOffset + prelink.imageOffset, storage.Seek.START) < 0) {
+		printf("          Could not seek to prelinked image\n");
+		return null;
+	}
+	return x86_64NextReader(pxiFile, prelink.imageLength);
+}
+
 class PlaceHolder extends pxi.Section {
 	PlaceHolder() {
 		super(runtime.Target.MAX_TARGET);
@@ -0,0 +1,279 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// Compiler benchmark: compiles a fixed corpus of Parasol sources several times in this process, timing each
+// phase of each compile, and reports the fastest run of each corpus. The times of every phase and unit of every
+// run can be written to a CSV file, so that runs from different versions of the compiler can be compared.
+import parasol:compiler;
+import parasol:context;
+import parasol:process;
+import parasol:storage;
+
+class CompilerBenchCommand extends process.Command {
+	public CompilerBenchCommand() {
+		finalArguments(0, int.MAX_VALUE, "[ corpus ... ]");
+		description("Compiles each corpus, without running it, and reports the fastest of the runs. " +
+					"The corpora are core (the core package), pc, pcontext, pbuild, paradoc and pbug (the commands " +
+					"in src/cmd) and tests (each of the library tests in test/src/library, compiled separately). " +
+					"By default all of them are compiled. " +
+					"Each run of a corpus is timed with the same phases that pc --timings reports.");
+		directoryOption = stringOption('d', "dir",
+					"The root of the Parasol source tree. Default: the current directory.");
+		repeatOption = integerOption('r', "repeat",
+					"The number of times each corpus is compiled. Default: 3.");
+		csvOption = stringOption('o', "output",
+					"Write the time, allocated kilobytes and nodes created by each phase and each unit of every " +
+					"run to the given file, as comma-separated values with a header line.");
+		helpOption('?', "help",
+					"Displays this help.");
+	}
+
+	ref<process.Option<string>> directoryOption;
+	ref<process.Option<int>> repeatOption;
+	ref<process.Option<string>> csvOption;
+}
+/*
+ * A corpus is either the core package or a list of main files, each compiled separately with the same
+ * include directories.
+ */
+class Corpus {
+	string name;
+	boolean corePackage;
+	string[] mainFiles;
+	string[] includes;
+}
+
+class Run {
+	string corpus;
+	int run;
+	boolean success;
+	compiler.CompileTimings.Counts total;
+	compiler.CompileTimings.Counts[compiler.CompilePhase] phases;
+	compiler.CompileTimings.Counts[] units;
+	string[] unitNames;
+	int[string] unitIndex;
+
+	Run() {
+		phases.resize(compiler.CompilePhase.MAX_PHASE);
+	}
+
+	void add(ref<compiler.CompileTimings> timings) {
+		for (i in phases)
+			accumulate(&phases[i], timings.phase(i));
+		accumulate(&total, timings.total());
+		ref<compiler.Unit>[] compiled = timings.units();
+		for (i in compiled) {
+			string name = compiled[i].filename();
+			if (!unitIndex.contains(name)) {
+				unitIndex[name] = units.length();
+				unitNames.append(name);
+				units.resize(units.length() + 1);
+			}
+			accumulate(&units[unitIndex[name]], timings.unit(compiled[i]));
+		}
+	}
+}
+
+CompilerBenchCommand command;
+ref<Corpus>[] corpora;
+
+int main(string[] args) {
+	defineCorpora();
+	if (!command.parse(args))
+		command.help();
+	int repeat = command.repeatOption.set() ? command.repeatOption.value : 3;
+	if (repeat <= 0) {
+		printf("Repeat must be positive\n");
+		return 1;
+	}
+	string directory = command.directoryOption.set() ? command.directoryOption.value : ".";
+	ref<Corpus>[] selected;
+	string[] names = command.finalArguments();
+	if (names.length() == 0)
+		selected = corpora;
+	else {
+		for (i in names) {
+			ref<Corpus> c = findCorpus(names[i]);
+			if (c == null) {
+				printf("Unknown corpus '%s', expecting one of: %s\n", names[i], corpusNames());
+				return 1;
+			}
+			selected.append(c);
+		}
+	}
+	ref<Run>[] runs;
+	boolean success = true;
+	printf("%-10s %5s %10s %10s %12s %10s\n", "corpus", "runs", "best ms", "median ms", "KB allocated", "nodes");
+	for (i in selected) {
+		ref<Corpus> c = selected[i];
+		long[] times;
+		ref<Run> best;
+		for (int r = 1; r <= repeat; r++) {
+			ref<Run> run = compileCorpus(c, directory, r);
+			runs.append(run);
+			if (!run.success)
+				success = false;
+			times.append(run.total.nanoseconds);
+			if (best == null || run.total.nanoseconds < best.total.nanoseconds)
+				best = run;
+		}
+		times.sort();
+		printf("%-10s %5d %10.1f %10.1f %12d %10d%s\n", c.name, repeat, best.total.nanoseconds / 1000000.0,
+					times[times.length() / 2] / 1000000.0, best.total.allocated / 1024, best.total.nodes,
+					best.success ? "" : "  (failed)");
+	}
+	if (command.csvOption.set() && !writeCsv(command.csvOption.value, runs))
+		success = false;
+	runs.deleteAll();
+	return success ? 0 : 1;
+}
+
+void defineCorpora() {
+	ref<Corpus> c = new Corpus;
+	c.name = "core";
+	c.corePackage = true;
+	corpora.append(c);
+	addCorpus("pc", "src/cmd/pc.p");
+	addCorpus("pcontext", "src/cmd/pcontext.p");
+	addCorpus("pbuild", "src/cmd/pbuild.p", "src/lib/build");
+	addCorpus("paradoc", "src/cmd/paradoc.p", "src/lib/documentation");
+	addCorpus("pbug", "src/cmd/pbug.p", "src/lib/build", "src/lib/debug", "src/lib/tty");
+	// The library tests exercise most of the runtime. Many of the language tests are expected to fail to compile.
+	addCorpus("tests", null);
+}
+
+void addCorpus(string name, string mainFile, string... includes) {
+	ref<Corpus> c = new Corpus;
+	c.name = name;
+	if (mainFile != null)
+		c.mainFiles.append(mainFile);
+	c.includes = includes;
+	corpora.append(c);
+}
+
+ref<Corpus> findCorpus(string name) {
+	for (i in corpora)
+		if (corpora[i].name == name)
+			return corpora[i];
+	return null;
+}
+
+string corpusNames() {
+	string s;
+	for (i in corpora) {
+		if (i > 0)
+			s += ", ";
+		s += corpora[i].name;
+	}
+	return s;
+}
+
+ref<Run> compileCorpus(ref<Corpus> c, string directory, int runNumber) {
+	ref<Run> run = new Run;
+	run.corpus = c.name;
+	run.run = runNumber;
+	run.success = true;
+	if (c.corePackage)
+		run.success = compileOnce(run, directory, null, c.includes);
+	else {
+		string[] mainFiles = c.mainFiles;
+		if (mainFiles.length() == 0)
+			mainFiles = testFiles(directory);
+		for (i in mainFiles)
+			run.success &= compileOnce(run, directory, mainFiles[i], c.includes);
+	}
+	return run;
+}
+/*
+ * Compile one main file, or the core package if mainFile is null, and add its timings to the run.
+ */
+boolean compileOnce(ref<Run> run, string directory, string mainFile, string[] includes) {
+	compiler.Arena arena;
+	compiler.CompileContext compileContext(&arena, false, false);
+	for (i in includes)
+		compileContext.includes.append(storage.path(directory, includes[i]));
+	ref<compiler.CompileTimings> timings = new compiler.CompileTimings();
+	compileContext.timings = timings;
+	ref<compiler.Target> target;
+	boolean success = compileContext.loadRoot(mainFile == null);
+	if (success) {
+		if (mainFile == null) {
+			ref<context.Package> core = arena.activeContext().getPackage(context.PARASOL_CORE_PACKAGE_NAME);
+			string[] units;
+			(units, success) = core.getUnitFilenames();
+			if (success)
+				target = compileContext.compilePackage(true, units, core.directory());
+		} else
+			target = compileContext.compile(storage.path(directory, mainFile));
+	}
+	timings.finish();
+	compileContext.timings = null;
+	run.add(timings);
+	delete timings;
+	if (!success || target == null || arena.countMessages() > 0) {
+		printf("%s failed to compile\n", mainFile != null ? mainFile : "The core package");
+		arena.printMessages();
+		success = false;
+	}
+	delete target;
+	return success;
+}
+
+/*
+ * The main files of the library tests. runtime_parameters.p is not part of the test suite and does not compile
+ * on its own.
+ */
+string[] testFiles(string directory) {
+	string[] files;
+	storage.Directory d(storage.path(directory, "test/src/library"));
+	if (d.first()) {
+		do {
+			if (d.filename().endsWith(".p") && d.filename() != "runtime_parameters.p")
+				files.append("test/src/library/" + d.filename());
+		} while (d.next());
+	}
+	files.sort();
+	return files;
+}
+
+boolean writeCsv(string path, ref<Run>[] runs) {
+	ref<Writer> w = storage.createTextFile(path);
+	if (w == null) {
+		printf("Could not create %s\n", path);
+		return false;
+	}
+	w.printf("corpus,run,kind,name,ms,kb_allocated,nodes\n");
+	for (i in runs) {
+		ref<Run> run = runs[i];
+		for (j in run.phases)
+			writeRow(w, run, "phase", string(j).toLowerCase(), run.phases[j]);
+		writeRow(w, run, "total", run.success ? "success" : "failed", run.total);
+		for (j in run.units)
+			writeRow(w, run, "unit", run.unitNames[j], run.units[j]);
+	}
+	delete w;
+	return true;
+}
+
+void writeRow(ref<Writer> w, ref<Run> run, string kind, string name, compiler.CompileTimings.Counts counts) {
+	w.printf("%s,%d,%s,%s,%.3f,%d,%d\n", run.corpus, run.run, kind, name, counts.nanoseconds / 1000000.0,
+				counts.allocated / 1024, counts.nodes);
+}
+
+void accumulate(ref<compiler.CompileTimings.Counts> sum, compiler.CompileTimings.Counts c) {
+	sum.nanoseconds += c.nanoseconds;
+	sum.allocated += c.allocated;
+	sum.nodes += c.nodes;
+}
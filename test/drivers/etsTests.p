@@ -78,6 +78,9 @@ class TestCommand extends process.Command {
 		targetOption = stringOption(0, "target",
 					"Selects the target runtime for this execution. " +
 					"Default: " + pxi.sectionTypeName(runtime.Target(runtime.supportedTarget(0))));
+		coverOption = stringOption(0, "cover",
+					"Runs each run test with code coverage enabled, accumulating the counts in the named file. " +
+					"A report of the lines covered is written to the same path with .report appended.");
 		helpOption('?', "help",
 					"Displays this help.");
 	}
@@ -90,6 +93,7 @@ class TestCommand extends process.Command {
 	ref<process.Option<string>> headerOption;
 	ref<process.Option<string>> targetOption;
 	ref<process.Option<string>> testPxiOption;
+	ref<process.Option<string>> coverOption;
 	ref<process.Option<boolean>> logImportsOption;
 	ref<process.Option<boolean>> symbolTableOption;
 	ref<process.Option<boolean>> showParseStageErrorsOption;
@@ -125,7 +129,8 @@ int main(string[] args) {
 			runetsCommand.symbolTableOption.value,
 			runetsCommand.targetOption.value,
 			runetsCommand.importPathOption.value,
-			runetsCommand.rootDirOption.value, runetsCommand.showParseStageErrorsOption.value);
+			runetsCommand.rootDirOption.value, runetsCommand.showParseStageErrorsOption.value,
+			runetsCommand.coverOption.value);
 //		initCommonTestObjects();
 	string[] s = runetsCommand.finalArguments();
 	return test.launch(s);
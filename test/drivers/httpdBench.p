@@ -0,0 +1,326 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// HTTP server benchmark: starts an http.Server on the loopback interface, opens a number of kept-alive
+// connections to it and keeps one request outstanding on each of them for a fixed time. Reports the requests
+// per second and the latency percentiles for 1000 up to 10000 concurrent connections. With -f, every request
+// fetches a file through the static content service.
+import parasol:http;
+import parasol:net.ServerScope;
+import parasol:process;
+import parasol:thread;
+import parasol:time;
+import native:linux;
+import native:net;
+
+class HttpdBenchCommand extends process.Command {
+	public HttpdBenchCommand() {
+		finalArguments(0, 0, "");
+		description("Starts an HTTP server on a loopback port and drives it from load threads in the same process. " +
+					"Each connection is kept alive and sends its next GET as soon as the last response is read. " +
+					"By default the test is run with 1000, 2500, 5000 and 10000 connections. " +
+					"The process' open file limit is raised as far as the hard limit allows.");
+		connectionsOption = integerOption('c', "connections",
+					"Run only with this many concurrent connections.");
+		secondsOption = integerOption('t', "time",
+					"The number of seconds each test runs. Default: 5.");
+		workersOption = integerOption('w', "workers",
+					"The number of server worker threads. Default: the number of CPUs.");
+		acceptOption = integerOption('a', "accept",
+					"The number of server accept threads. Default: the number of CPUs.");
+		loadOption = integerOption('l', "load",
+					"The number of load generating threads. Default: half the number of CPUs, at least 1.");
+		fileOption = stringOption('f', "file",
+					"Request this file, served by the server's static content service, instead of a " +
+					"short generated response.");
+		helpOption('?', "help",
+					"Displays this help.");
+	}
+
+	ref<process.Option<int>> connectionsOption;
+	ref<process.Option<int>> secondsOption;
+	ref<process.Option<int>> workersOption;
+	ref<process.Option<int>> acceptOption;
+	ref<process.Option<int>> loadOption;
+	ref<process.Option<string>> fileOption;
+}
+
+HttpdBenchCommand command;
+
+string BODY = "Hello, world!\n";
+string REQUEST = "GET /bench HTTP/1.1\r\nHost: localhost\r\n\r\n";
+string STATIC_REQUEST = "GET /static HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+class BenchService extends http.Service {
+	public boolean processRequest(ref<http.Request> request, ref<http.Response> response) {
+		response.ok();
+		response.header("Content-Type", "text/plain");
+		response.header("Content-Length", string(BODY.length()));
+		response.write(BODY);
+		return false;
+	}
+}
+/*
+ * One client connection, with one request outstanding.
+ */
+class Client {
+	int fd;
+	long sentAt;
+	string response;
+}
+/*
+ * A load thread drives its share of the connections with its own epoll set.
+ */
+class Load {
+	ref<Client>[] clients;
+	long deadline;
+	long[] latencies;			// nanoseconds
+	int errors;
+}
+
+int main(string[] args) {
+	if (!command.parse(args))
+		command.help();
+	int seconds = command.secondsOption.set() ? command.secondsOption.value : 5;
+	int workers = command.workersOption.set() ? command.workersOption.value : thread.cpuCount();
+	int accepters = command.acceptOption.set() ? command.acceptOption.value : 0;
+	int loadThreads = command.loadOption.set() ? command.loadOption.value : thread.cpuCount() / 2;
+	if (loadThreads < 1)
+		loadThreads = 1;
+	if (seconds <= 0 || workers <= 0 || accepters < 0) {
+		printf("Time and thread counts must be positive\n");
+		return 1;
+	}
+	int[] levels;
+	if (command.connectionsOption.set())
+		levels.append(command.connectionsOption.value);
+	else {
+		levels.append(1000);
+		levels.append(2500);
+		levels.append(5000);
+		levels.append(10000);
+	}
+	long fileLimit = raiseFileLimit();
+
+	http.Server server;
+	BenchService service;
+	server.disableHttps();
+	server.setHttpPort(0);
+	server.setWorkerThreads(workers);
+	server.setAcceptThreads(accepters);
+	server.httpService("/bench", &service);
+	if (command.fileOption.set()) {
+		server.staticContent("/static", command.fileOption.value);
+		REQUEST = STATIC_REQUEST;
+	}
+	server.start(ServerScope.LOCALHOST);
+	char port = server.httpPort();
+
+	printf("Port %d, %d worker threads, %d load threads, %d seconds per test\n", port, workers, loadThreads, seconds);
+	if (command.fileOption.set())
+		printf("Serving %s\n", command.fileOption.value);
+	printf("%11s %10s %10s %9s %9s %9s %9s %9s %7s\n", "connections", "requests", "req/s",
+				"p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms", "errors");
+	boolean success = true;
+	for (i in levels) {
+		int connections = levels[i];
+		// Each connection uses a descriptor in the client and one in the server.
+		if (2 * connections + 100 > fileLimit) {
+			printf("%11d skipped: needs %d open files, the limit is %d\n", connections, 2 * connections + 100, fileLimit);
+			continue;
+		}
+		if (!runLevel(port, connections, loadThreads, seconds))
+			success = false;
+	}
+	server.stop();
+	server.wait();
+	return success ? 0 : 1;
+}
+
+boolean runLevel(char port, int connections, int loadThreads, int seconds) {
+	ref<Load>[] loads;
+	for (int i = 0; i < loadThreads; i++)
+		loads.append(new Load);
+	for (int i = 0; i < connections; i++) {
+		ref<Client> c = new Client;
+		c.fd = connectTo(port);
+		if (c.fd < 0) {
+			printf("%11d connect failed after %d connections: %s\n", connections, i, linux.strerror(linux.errno()));
+			delete c;
+			closeAll(loads);
+			loads.deleteAll();
+			return false;
+		}
+		loads[i % loadThreads].clients.append(c);
+	}
+	long deadline = now() + seconds * long(1000000000);
+	ref<thread.Thread>[] threads;
+	for (i in loads) {
+		loads[i].deadline = deadline;
+		ref<thread.Thread> t = new thread.Thread("load " + i);
+		t.start(runLoad, loads[i]);
+		threads.append(t);
+	}
+	for (i in threads)
+		threads[i].join();
+	threads.deleteAll();
+
+	long[] latencies;
+	int errors;
+	for (i in loads) {
+		for (j in loads[i].latencies)
+			latencies.append(loads[i].latencies[j]);
+		errors += loads[i].errors;
+	}
+	closeAll(loads);
+	loads.deleteAll();
+	latencies.sort();
+	printf("%11d %10d %10.0f %9.3f %9.3f %9.3f %9.3f %9.3f %7d\n", connections, latencies.length(),
+				double(latencies.length()) / seconds, percentile(latencies, 50), percentile(latencies, 90),
+				percentile(latencies, 99), percentile(latencies, 99.9),
+				latencies.length() > 0 ? latencies[latencies.length() - 1] / 1000000.0 : 0.0, errors);
+	return errors == 0;
+}
+
+void runLoad(address arg) {
+	ref<Load> load = ref<Load>(arg);
+	int epollfd = linux.epoll_create1(linux.EPOLL_CLOEXEC);
+	ref<Client>[] byFd;
+	for (i in load.clients) {
+		ref<Client> c = load.clients[i];
+		if (c.fd >= byFd.length())
+			byFd.resize(c.fd + 1);
+		byFd[c.fd] = c;
+		linux.epoll_event e;
+		e.events = linux.EPOLLIN;
+		e.fd = c.fd;
+		linux.epoll_ctl(epollfd, linux.EPOLL_CTL_ADD, c.fd, &e);
+		if (!sendRequest(c))
+			load.errors++;
+	}
+	linux.epoll_event[] events;
+	events.resize(256);
+	byte[] buffer;
+	buffer.resize(65536);
+	for (;;) {
+		long t = now();
+		if (t >= load.deadline)
+			break;
+		int timeout = int((load.deadline - t) / 1000000) + 1;
+		int n = linux.epoll_wait(epollfd, &events[0], events.length(), timeout);
+		for (int i = 0; i < n; i++) {
+			ref<Client> c = byFd[events[i].fd];
+			int actual = net.recv(c.fd, &buffer[0], buffer.length(), 0);
+			if (actual <= 0) {
+				load.errors++;
+				linux.epoll_ctl(epollfd, linux.EPOLL_CTL_DEL, c.fd, null);
+				continue;
+			}
+			c.response.append(&buffer[0], actual);
+			if (!responseComplete(c.response))
+				continue;
+			load.latencies.append(now() - c.sentAt);
+			c.response = null;
+			if (!sendRequest(c))
+				load.errors++;
+		}
+	}
+	linux.close(epollfd);
+}
+
+boolean sendRequest(ref<Client> c) {
+	c.sentAt = now();
+	return net.send(c.fd, &REQUEST[0], REQUEST.length(), net.MSG_NOSIGNAL) == REQUEST.length();
+}
+/*
+ * The responses of BenchService and of the static content service all have a Content-Length header.
+ */
+boolean responseComplete(string response) {
+	int headerEnd = response.indexOf("\r\n\r\n");
+	if (headerEnd < 0)
+		return false;
+	int lengthAt = response.indexOf("Content-Length: ");
+	if (lengthAt < 0 || lengthAt > headerEnd)
+		return false;
+	lengthAt += "Content-Length: ".length();
+	int lineEnd = response.indexOf('\r', lengthAt);
+	int length;
+	boolean success;
+	(length, success) = int.parse(string(response.substr(lengthAt, lineEnd)));
+	return success && response.length() >= headerEnd + 4 + length;
+}
+
+int connectTo(char port) {
+	int fd = net.socket(net.AF_INET, net.SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	net.sockaddr_in address;
+	address.sin_family = net.AF_INET;
+	address.sin_port = net.htons(port);
+	address.sin_addr.s_addr = net.inet_addr("127.0.0.1".c_str());
+	if (net.connect(fd, &address, address.bytes) != 0) {
+		net.closesocket(fd);
+		return -1;
+	}
+	int one = 1;
+	net.setsockopt(fd, net.IPPROTO_TCP, net.TCP_NODELAY, &one, one.bytes);
+	return fd;
+}
+
+/*
+ * Close the client connections. The caller deletes the Load objects, since a vector parameter shares its
+ * storage with the caller's copy.
+ */
+void closeAll(ref<Load>[] loads) {
+	for (i in loads) {
+		for (j in loads[i].clients)
+			net.closesocket(loads[i].clients[j].fd);
+		loads[i].clients.deleteAll();
+	}
+}
+/*
+ * Raise the soft limit on open files to the hard limit.
+ *
+ * @return The resulting limit.
+ */
+long raiseFileLimit() {
+	linux.rlimit limit;
+	if (linux.getrlimit(linux.RLIMIT_NOFILE, &limit) != 0)
+		return 1024;
+	if (limit.rlim_cur != limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		if (linux.setrlimit(linux.RLIMIT_NOFILE, &limit) != 0)
+			linux.getrlimit(linux.RLIMIT_NOFILE, &limit);
+	}
+	if (limit.rlim_cur == linux.RLIM_INFINITY)
+		return long.MAX_VALUE;
+	return limit.rlim_cur;
+}
+/**
+ * @return The latency at a percentile of the sorted samples, in milliseconds.
+ */
+double percentile(long[] sorted, double p) {
+	if (sorted.length() == 0)
+		return 0;
+	int i = int(sorted.length() * p / 100);
+	if (i >= sorted.length())
+		i = sorted.length() - 1;
+	return sorted[i] / 1000000.0;
+}
+
+long now() {
+	time.Instant t = time.Clock.MONOTONIC.get();
+	return t.seconds() * 1000000000 + t.nanoseconds();
+}
@@ -0,0 +1,240 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// Reader benchmark: reads the same generated text through each kind of Reader, a byte at a time, in bulk, by
+// borrowing spans with peek and consume, and a line at a time. Reports the rate of each in megabytes per second.
+// A Reader that only implements _read and unread is included to show the cost of the default methods.
+import parasol:process;
+import parasol:storage;
+import parasol:stream;
+import parasol:text;
+import parasol:time;
+import native:C;
+
+class ReaderBenchCommand extends process.Command {
+	public ReaderBenchCommand() {
+		finalArguments(0, 0, "");
+		description("Generates lines of text, writes them to a temporary file and then reads them back through " +
+					"a FileReader, a BufferReader, a StringReader, a SubstringReader and a Reader that only " +
+					"implements the byte at a time methods. Each reader is read to the end with each method, " +
+					"starting from a new reader each time.");
+		sizeOption = integerOption('s', "size",
+					"The size of the text in megabytes. Default: 32.");
+		lineOption = integerOption('l', "line",
+					"The average length of a line of text. Default: 60.");
+		repeatOption = integerOption('r', "repeat",
+					"The number of times each measurement is made. The fastest is reported. Default: 3.");
+		helpOption('?', "help",
+					"Displays this help.");
+	}
+
+	ref<process.Option<int>> sizeOption;
+	ref<process.Option<int>> lineOption;
+	ref<process.Option<int>> repeatOption;
+}
+
+ReaderBenchCommand command;
+
+enum Method {
+	BYTES,
+	BULK,
+	SPANS,
+	LINES
+}
+
+string[Method] methodLabel = [
+	BYTES: "read()",
+	BULK: "read(buffer)",
+	SPANS: "peek/consume",
+	LINES: "readLine()",
+];
+
+enum Kind {
+	FILE,
+	BUFFER,
+	STRING,
+	SUBSTRING,
+	DEFAULT
+}
+
+string[Kind] kindLabel = [
+	FILE: "FileReader",
+	BUFFER: "BufferReader",
+	STRING: "StringReader",
+	SUBSTRING: "SubstringReader",
+	DEFAULT: "default Reader",
+];
+/*
+ * Implements only the methods every Reader must, so every other method uses the default implementation.
+ */
+class ByteReader extends stream.Reader {
+	ref<string> _source;
+	int _cursor;
+
+	ByteReader(ref<string> source) {
+		_source = source;
+	}
+
+	public int _read() {
+		if (_cursor >= _source.length())
+			return stream.EOF;
+		return (*_source)[_cursor++];
+	}
+
+	public void unread() {
+		if (_cursor > 0)
+			_cursor--;
+	}
+}
+
+string content;
+substring contentSpan;
+byte[] contentBytes;
+string filename;
+
+int main(string[] args) {
+	if (!command.parse(args))
+		command.help();
+	int size = command.sizeOption.set() ? command.sizeOption.value : 32;
+	int lineLength = command.lineOption.set() ? command.lineOption.value : 60;
+	int repeat = command.repeatOption.set() ? command.repeatOption.value : 3;
+	if (size <= 0 || lineLength <= 0 || repeat <= 0) {
+		printf("Size, line and repeat must be positive\n");
+		return 1;
+	}
+	long total = long(size) * 1024 * 1024;
+	if (total >= int.MAX_VALUE) {
+		printf("Size must be less than 2048 megabytes\n");
+		return 1;
+	}
+	int lines;
+	while (content.length() < total) {
+		int length = lineLength / 2 + (lines * 7919) % (lineLength + 1);
+		for (int i = 0; i < length; i++)
+			content.append(byte(' ' + (lines + i) % 95));
+		content.append('\n');
+		lines++;
+	}
+	contentSpan = content;
+	contentBytes.resize(content.length());
+	C.memcpy(&contentBytes[0], &content[0], content.length());
+	ref<storage.FileWriter> w;
+	(filename, w) = storage.createTempFile("readerBenchXXXXXX");
+	if (w == null) {
+		printf("Could not create a temporary file\n");
+		return 1;
+	}
+	w.write(content);
+	delete w;
+
+	printf("%d lines, %d bytes\n", lines, content.length());
+	printf("%-16s", "");
+	for (m in methodLabel)
+		printf(" %14s", methodLabel[m]);
+	printf("   (MB/sec)\n");
+	boolean success = true;
+	for (k in kindLabel) {
+		printf("%-16s", kindLabel[k]);
+		for (m in methodLabel) {
+			long best = long.MAX_VALUE;
+			for (int i = 0; i < repeat; i++) {
+				ref<stream.Reader> reader = open(k);
+				long start = now();
+				long count = readAll(reader, m);
+				long elapsed = now() - start;
+				delete reader;
+				if (count != content.length()) {
+					printf("\n%s %s read %d bytes, expected %d\n", kindLabel[k], methodLabel[m], count,
+								content.length());
+					success = false;
+				}
+				if (elapsed < best)
+					best = elapsed;
+			}
+			if (best == 0)
+				best = 1;
+			printf(" %14.1f", content.length() * 1000000000.0 / (best * 1024.0 * 1024.0));
+		}
+		printf("\n");
+	}
+	storage.deleteFile(filename);
+	return success ? 0 : 1;
+}
+
+ref<stream.Reader> open(Kind kind) {
+	switch (kind) {
+	case FILE:
+		return storage.openBinaryFile(filename);
+
+	case BUFFER:
+		return new stream.BufferReader(&contentBytes);
+
+	case STRING:
+		return new text.StringReader(&content);
+
+	case SUBSTRING:
+		return new text.SubstringReader(&contentSpan);
+	}
+	return new ByteReader(&content);
+}
+/*
+ * Read to the end of the reader with the given method.
+ *
+ * @return The number of bytes read. Each line read counts its line separator.
+ */
+long readAll(ref<stream.Reader> reader, Method method) {
+	long count;
+	switch (method) {
+	case BYTES:
+		while (reader.read() != stream.EOF)
+			count++;
+		break;
+
+	case BULK:
+		byte[] buffer;
+		buffer.resize(8192);
+		for (;;) {
+			int n = reader.read(&buffer);
+			if (n <= 0)
+				break;
+			count += n;
+		}
+		break;
+
+	case SPANS:
+		for (;;) {
+			substring span = reader.peek();
+			if (span.length() == 0)
+				break;
+			count += span.length();
+			reader.consume(span.length());
+		}
+		break;
+
+	case LINES:
+		for (;;) {
+			string line = reader.readLine();
+			if (line == null)
+				break;
+			count += line.length() + 1;
+		}
+	}
+	return count;
+}
+
+long now() {
+	time.Instant t = time.Clock.MONOTONIC.get();
+	return t.seconds() * 1000000000 + t.nanoseconds();
+}
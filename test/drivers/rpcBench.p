@@ -0,0 +1,219 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// RPC benchmark: starts an http.Server on the loopback interface with an rpc.Service and an rpc Web Socket
+// service for the same interface, then has a number of threads call it through each transport. Every caller
+// of the HTTP transport has its own client, while all the callers of the Web Socket transport share one
+// connection and so have calls in flight on it at the same time. Reports calls per second and the median and
+// 99th percentile latency of a call.
+import parasol:http;
+import parasol:net.ServerScope;
+import parasol:process;
+import parasol:rpc;
+import parasol:thread;
+import parasol:time;
+
+class RpcBenchCommand extends process.Command {
+	public RpcBenchCommand() {
+		finalArguments(0, 0, "");
+		description("Starts an HTTP server with an rpc service on a loopback port, reachable both by HTTP and " +
+					"by Web Socket, and calls it from the same process, first over HTTP and then over a single " +
+					"Web Socket. Each call passes a string and an integer and returns both.");
+		callersOption = integerOption('c', "callers",
+					"The number of threads making calls. Default: 8.");
+		callsOption = integerOption('n', "calls",
+					"The number of calls each thread makes. Default: 2000.");
+		sizeOption = integerOption('s', "size",
+					"The length of the string passed on each call. Default: 64.");
+		helpOption('?', "help",
+					"Displays this help.");
+	}
+
+	ref<process.Option<int>> callersOption;
+	ref<process.Option<int>> callsOption;
+	ref<process.Option<int>> sizeOption;
+}
+
+RpcBenchCommand command;
+
+interface Bench {
+	string, int echo(string s, int n);
+}
+
+class BenchObject implements Bench {
+	string, int echo(string s, int n) {
+		return s, n + 1;
+	}
+}
+
+class BenchService extends rpc.Service<Bench> {
+	BenchService(Bench object) {
+		super(object);
+	}
+}
+
+class BenchFactory extends rpc.WebSocketFactory<Bench, rpc.NoMethods> {
+	Bench object;
+
+	BenchFactory(Bench object) {
+		this.object = object;
+	}
+
+	public boolean notifyCreation(ref<http.Request> request, ref<rpc.WebSocket<Bench, rpc.NoMethods>> socket) {
+		socket.setObject(object);
+		return true;
+	}
+}
+
+class Caller {
+	Bench proxy;
+	ref<rpc.Client<Bench>> client;		// Only set for HTTP callers
+	int calls;
+	string argument;
+	long[] latencies;
+	int failures;
+}
+
+int main(string[] args) {
+	if (!command.parse(args))
+		command.help();
+	int callers = command.callersOption.set() ? command.callersOption.value : 8;
+	int calls = command.callsOption.set() ? command.callsOption.value : 2000;
+	int size = command.sizeOption.set() ? command.sizeOption.value : 64;
+	if (callers <= 0 || calls <= 0 || size < 0) {
+		printf("Callers and calls must be positive, size must not be negative\n");
+		return 1;
+	}
+	string argument;
+	for (int i = 0; i < size; i++)
+		argument.append(byte('a' + i % 26));
+
+	Bench object = new BenchObject();
+	ref<BenchService> service = new BenchService(object);
+	ref<BenchFactory> factory = new BenchFactory(object);
+	http.Server server;
+	http.WebSocketService webSocketService;
+	server.disableHttps();
+	server.setHttpPort(0);
+	webSocketService.webSocketProtocol("bench", factory);
+	server.httpService("/http", service);
+	server.httpService("/ws", &webSocketService);
+	server.start(ServerScope.LOCALHOST);
+	char port = server.httpPort();
+
+	printf("%d callers, %d calls each, %d byte string argument\n", callers, calls, size);
+
+	ref<Caller>[] httpCallers;
+	for (int i = 0; i < callers; i++) {
+		ref<Caller> c = new Caller;
+		c.client = new rpc.Client<Bench>("http://localhost:" + string(port) + "/http");
+		c.proxy = c.client.proxy();
+		httpCallers.append(c);
+	}
+	if (!measure("HTTP", &httpCallers, calls, argument))
+		return 1;
+	for (i in httpCallers) {
+		delete httpCallers[i].proxy;
+		delete httpCallers[i].client;
+	}
+	httpCallers.deleteAll();
+
+	rpc.Client<Bench, rpc.NoMethods> client("ws://localhost:" + string(port) + "/ws", "bench", rpc.noMethods);
+	Bench proxy = client.proxy();
+	if (proxy == null) {
+		printf("Could not connect the Web Socket\n");
+		return 1;
+	}
+	ref<Caller>[] webSocketCallers;
+	for (int i = 0; i < callers; i++) {
+		ref<Caller> c = new Caller;
+		c.proxy = proxy;
+		webSocketCallers.append(c);
+	}
+	boolean success = measure("Web Socket", &webSocketCallers, calls, argument);
+	webSocketCallers.deleteAll();
+	delete proxy;
+
+	server.stop();
+	server.wait();
+	delete factory;
+	delete service;
+	delete object;
+	return success ? 0 : 1;
+}
+/*
+ * Run the callers, each on its own thread, and report the results.
+ *
+ * @return true if every call returned the expected values.
+ */
+boolean measure(string transport, ref<ref<Caller>[]> callers, int calls, string argument) {
+	ref<thread.Thread>[] threads;
+	long start = now();
+	for (i in *callers) {
+		ref<Caller> c = (*callers)[i];
+		c.calls = calls;
+		c.argument = argument;
+		ref<thread.Thread> t = new thread.Thread();
+		t.start(callerEntry, c);
+		threads.append(t);
+	}
+	for (i in threads)
+		threads[i].join();
+	long elapsed = now() - start;
+	threads.deleteAll();
+
+	long[] latencies;
+	int failures;
+	for (i in *callers) {
+		latencies.append((*callers)[i].latencies);
+		failures += (*callers)[i].failures;
+	}
+	latencies.sort();
+	printf("%-10s %8.0f calls/sec   p50 %7.1f usec   p99 %7.1f usec\n", transport,
+				latencies.length() * 1000000000.0 / elapsed,
+				percentile(&latencies, 50) / 1000.0, percentile(&latencies, 99) / 1000.0);
+	if (failures > 0) {
+		printf("%d calls over %s returned the wrong values\n", failures, transport);
+		return false;
+	}
+	return true;
+}
+
+void callerEntry(address arg) {
+	ref<Caller> c = ref<Caller>(arg);
+	for (int i = 0; i < c.calls; i++) {
+		long start = now();
+		string s;
+		int n;
+		(s, n) = c.proxy.echo(c.argument, i);
+		c.latencies.append(now() - start);
+		if (s != c.argument || n != i + 1)
+			c.failures++;
+	}
+}
+
+long percentile(ref<long[]> sorted, int p) {
+	if (sorted.length() == 0)
+		return 0;
+	int index = (sorted.length() * p + 99) / 100 - 1;
+	if (index < 0)
+		index = 0;
+	return (*sorted)[index];
+}
+
+long now() {
+	time.Instant t = time.Clock.MONOTONIC.get();
+	return t.seconds() * 1000000000 + t.nanoseconds();
+}
@@ -0,0 +1,139 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// Cold-start benchmark: launches each pxi file repeatedly and reports the distribution of
+// the time from spawn to exit.
+import parasol:process;
+import parasol:storage;
+import parasol:time;
+
+class StartupBenchCommand extends process.Command {
+	public StartupBenchCommand() {
+		finalArguments(0, int.MAX_VALUE, "[ <pxi-file> ... ]");
+		description("Runs each pxi file, with no arguments, the given number of times and reports " +
+					"the minimum, median (p50), 99th percentile (p99) and maximum elapsed time of a launch. " +
+					"If no pxi files are given, the compiler image installed with the runtime is used.");
+		iterationsOption = integerOption('n', "iterations",
+					"The number of times to launch each pxi file. Default: 100.");
+		runtimeOption = stringOption(0, "runtime",
+					"The parasolrt binary to launch. Default: the one running this benchmark.");
+		loaderOption = stringOption(0, "loader",
+					"Sets PARASOLRT_LOADER for each launch (for example 'mmap').");
+		bindingsOption = stringOption(0, "bindings",
+					"Sets PARASOLRT_BINDINGS for each launch (for example 'lazy').");
+		traceOption = booleanOption(0, "trace",
+					"After timing each pxi file, launch it once more with PARASOLRT_STARTUP_TRACE set and " +
+					"display the time spent in each start-up phase.");
+		helpOption('?', "help",
+					"Displays this help.");
+	}
+
+	ref<process.Option<int>> iterationsOption;
+	ref<process.Option<string>> runtimeOption;
+	ref<process.Option<string>> loaderOption;
+	ref<process.Option<string>> bindingsOption;
+	ref<process.Option<boolean>> traceOption;
+}
+
+StartupBenchCommand command;
+
+int main(string[] args) {
+	if (!command.parse(args))
+		command.help();
+	int iterations = command.iterationsOption.set() ? command.iterationsOption.value : 100;
+	if (iterations <= 0) {
+		printf("Iterations must be positive\n");
+		return 1;
+	}
+	string binDir = storage.directory(process.binaryFilename());
+	string runtimeBinary = command.runtimeOption.set() ? command.runtimeOption.value : process.binaryFilename();
+	string[] images = command.finalArguments();
+	if (images.length() == 0)
+		images.append(storage.path(binDir, "x86-64-lnx.pxi"));
+
+	string[string] environ;
+	if (command.loaderOption.set())
+		environ["PARASOLRT_LOADER"] = command.loaderOption.value;
+	if (command.bindingsOption.set())
+		environ["PARASOLRT_BINDINGS"] = command.bindingsOption.value;
+
+	printf("%-40s %8s %10s %10s %10s %10s\n", "image", "launches", "min ms", "p50 ms", "p99 ms", "max ms");
+	boolean success = true;
+	for (i in images) {
+		if (!storage.exists(images[i])) {
+			printf("%s does not exist\n", images[i]);
+			success = false;
+			continue;
+		}
+		long[] nanos;
+		for (int j = 0; j < iterations; j++) {
+			long t = launch(runtimeBinary, images[i], &environ, null);
+			if (t < 0) {
+				printf("%s could not be launched\n", images[i]);
+				success = false;
+				break;
+			}
+			nanos.append(t);
+		}
+		if (nanos.length() < iterations)
+			continue;
+		nanos.sort();
+		printf("%-40s %8d %10.3f %10.3f %10.3f %10.3f\n", images[i], iterations, nanos[0] / 1000000.0,
+						percentile(nanos, 50) / 1000000.0, percentile(nanos, 99) / 1000000.0,
+						nanos[nanos.length() - 1] / 1000000.0);
+		if (command.traceOption.value) {
+			string output;
+			environ["PARASOLRT_STARTUP_TRACE"] = "1";
+			launch(runtimeBinary, images[i], &environ, &output);
+			environ.remove("PARASOLRT_STARTUP_TRACE");
+			int traceStart = output.indexOf("Startup trace");
+			int total = output.indexOf("    total", traceStart);
+			if (traceStart >= 0 && total >= 0) {
+				int traceEnd = output.indexOf('\n', total);
+				if (traceEnd < 0)
+					traceEnd = output.length() - 1;
+				printf("%s\n", output.substr(traceStart, traceEnd));
+			}
+		}
+	}
+	return success ? 0 : 1;
+}
+/**
+ * Launch the image once, discarding its output unless output is not null.
+ *
+ * @return The elapsed time from spawn to exit in nanoseconds, or -1 if the spawn failed.
+ */
+long launch(string runtimeBinary, string image, ref<string[string]> environ, ref<string> output) {
+	process.Process p;
+	p.captureOutput();
+	time.Instant start = time.Clock.MONOTONIC.get();
+	if (!p.spawn(null, runtimeBinary, environ, image))
+		return -1;
+	string text = p.collectOutput();
+	p.waitForExit();
+	time.Duration d = time.Instant.elapsed(start, time.Clock.MONOTONIC.get());
+	if (output != null)
+		*output = text;
+	return d.seconds() * 1000000000 + d.nanoseconds();
+}
+/**
+ * Nearest-rank percentile of a sorted, non-empty array.
+ */
+long percentile(long[] sorted, int p) {
+	int rank = (sorted.length() * p + 99) / 100;
+	if (rank < 1)
+		rank = 1;
+	return sorted[rank - 1];
+}
@@ -0,0 +1,122 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// Thread pool benchmark: runs the same fine-grained work through ThreadPool's execute, executeAll and
+// parallelFor with 1 thread up to the number of CPUs, and reports the time and the speed-up over 1 thread.
+import parasol:process;
+import parasol:thread;
+import parasol:time;
+
+class ThreadPoolBenchCommand extends process.Command {
+	public ThreadPoolBenchCommand() {
+		finalArguments(0, 0, "");
+		description("Runs a number of small work items through a thread pool, first queued one at a time with " +
+					"execute, then all at once with executeAll, then as the iterations of a parallelFor. " +
+					"This is repeated for pools of 1, 2, 4 and so on threads, up to the number of CPUs.");
+		tasksOption = integerOption('n', "tasks",
+					"The number of work items in each run. Default: 100000.");
+		workOption = integerOption('w', "work",
+					"The number of loop iterations done by each work item. Default: 1000.");
+		threadsOption = integerOption('t', "threads",
+					"The largest pool to run. Default: the number of CPUs.");
+		helpOption('?', "help",
+					"Displays this help.");
+	}
+
+	ref<process.Option<int>> tasksOption;
+	ref<process.Option<int>> workOption;
+	ref<process.Option<int>> threadsOption;
+}
+
+ThreadPoolBenchCommand command;
+
+int work;
+long[] results;
+
+int main(string[] args) {
+	if (!command.parse(args))
+		command.help();
+	int tasks = command.tasksOption.set() ? command.tasksOption.value : 100000;
+	work = command.workOption.set() ? command.workOption.value : 1000;
+	int maxThreads = command.threadsOption.set() ? command.threadsOption.value : thread.cpuCount();
+	if (tasks <= 0 || work < 0 || maxThreads <= 0) {
+		printf("Tasks and threads must be positive\n");
+		return 1;
+	}
+	results.resize(tasks);
+	address[] parameters;
+	for (int i = 0; i < tasks; i++)
+		parameters.append(&results[i]);
+
+	int[] threadCounts;
+	for (int n = 1; n < maxThreads; n *= 2)
+		threadCounts.append(n);
+	threadCounts.append(maxThreads);
+
+	printf("%d work items of %d iterations each\n", tasks, work);
+	printf("%8s %14s %8s %14s %8s %14s %8s\n", "threads", "execute ms", "speedup", "executeAll ms", "speedup",
+					"parallelFor ms", "speedup");
+	long[] base;
+	for (i in threadCounts) {
+		thread.ThreadPool<int> pool(threadCounts[i]);
+		pool.waitForIdle();
+		long[] times;
+
+		time.Instant start = time.Clock.MONOTONIC.get();
+		for (int j = 0; j < tasks; j++)
+			pool.execute(runTask, parameters[j]);
+		pool.waitForIdle();
+		times.append(elapsed(start));
+
+		start = time.Clock.MONOTONIC.get();
+		pool.executeAll(runTask, parameters);
+		pool.waitForIdle();
+		times.append(elapsed(start));
+
+		start = time.Clock.MONOTONIC.get();
+		pool.parallelFor(tasks, runIndex, null);
+		times.append(elapsed(start));
+
+		if (base.length() == 0)
+			base = times;
+		printf("%8d", threadCounts[i]);
+		for (j in times)
+			printf(" %14.3f %8.2f", times[j] / 1000000.0, times[j] > 0 ? double(base[j]) / times[j] : 0.0);
+		printf("\n");
+	}
+	return 0;
+}
+
+void runTask(address p) {
+	*ref<long>(p) = spin(long(p));
+}
+
+void runIndex(address p, int index) {
+	results[index] = spin(index);
+}
+
+long spin(long seed) {
+	long x = seed;
+	for (int i = 0; i < work; i++)
+		x = x * 6364136223846793005 + 1442695040888963407;
+	return x;
+}
+/**
+ * @return The time in nanoseconds since start.
+ */
+long elapsed(time.Instant start) {
+	time.Duration d = time.Instant.elapsed(start, time.Clock.MONOTONIC.get());
+	return d.seconds() * 1000000000 + d.nanoseconds();
+}
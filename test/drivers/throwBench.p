@@ -0,0 +1,96 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// Exception microbenchmark: measures the cost of a throw caught a given number of frames up the stack,
+// with the runtime's exception index and with a binary search of the whole exception table.
+import parasol:process;
+import parasol:runtime;
+import parasol:time;
+
+class ThrowBenchCommand extends process.Command {
+	public ThrowBenchCommand() {
+		finalArguments(0, int.MAX_VALUE, "[ <depth> ... ]");
+		description("Throws an exception from the given depths of recursion (default: 1, 4, 16, 64 and 256) " +
+					"and catches it at the top. Reports the average time of each throw and catch, first using " +
+					"the exception index the runtime builds for the image, then searching the whole exception " +
+					"table.");
+		iterationsOption = integerOption('n', "iterations",
+					"The number of throws at each depth. Default: 10000.");
+		helpOption('?', "help",
+					"Displays this help.");
+	}
+
+	ref<process.Option<int>> iterationsOption;
+}
+
+ThrowBenchCommand command;
+
+int main(string[] args) {
+	if (!command.parse(args))
+		command.help();
+	int iterations = command.iterationsOption.set() ? command.iterationsOption.value : 10000;
+	if (iterations <= 0) {
+		printf("Iterations must be positive\n");
+		return 1;
+	}
+	int[] depths;
+	string[] arguments = command.finalArguments();
+	for (i in arguments) {
+		int depth;
+		boolean success;
+		(depth, success) = int.parse(arguments[i]);
+		if (!success || depth < 1) {
+			printf("Depth '%s' is not a positive integer\n", arguments[i]);
+			return 1;
+		}
+		depths.append(depth);
+	}
+	if (depths.length() == 0)
+		depths = [ 1, 4, 16, 64, 256 ];
+
+	address index = runtime.getRuntimeParameter(runtime.EXCEPTION_INDEX);
+	if (index == null)
+		printf("This runtime does not build an exception index, both columns search the whole table.\n");
+	printf("%8s %12s %14s %14s %8s\n", "depth", "throws", "indexed ns", "searched ns", "ratio");
+	for (i in depths) {
+		long indexed = timeThrows(depths[i], iterations);
+		runtime.setRuntimeParameter(runtime.EXCEPTION_INDEX, null);
+		long searched = timeThrows(depths[i], iterations);
+		runtime.setRuntimeParameter(runtime.EXCEPTION_INDEX, index);
+		printf("%8d %12d %14.1f %14.1f %8.2f\n", depths[i], iterations, double(indexed) / iterations,
+					double(searched) / iterations, indexed > 0 ? double(searched) / indexed : 0.0);
+	}
+	return 0;
+}
+/**
+ * @return The total time in nanoseconds taken by the given number of throws from the given depth.
+ */
+long timeThrows(int depth, int iterations) {
+	time.Instant start = time.Clock.MONOTONIC.get();
+	for (int i = 0; i < iterations; i++) {
+		try {
+			throwAt(depth);
+		} catch (Exception e) {
+		}
+	}
+	time.Duration d = time.Instant.elapsed(start, time.Clock.MONOTONIC.get());
+	return d.seconds() * 1000000000 + d.nanoseconds();
+}
+
+void throwAt(int depth) {
+	if (depth <= 1)
+		throw Exception("bench");
+	throwAt(depth - 1);
+}
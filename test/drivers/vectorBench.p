@@ -0,0 +1,181 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// Vector arithmetic benchmark: times sums, dot products and element-wise arithmetic over large vectors,
+// first written as loops over the elements, then as vector expressions, and reports the speed-up.
+import parasol:process;
+import parasol:time;
+
+class VectorBenchCommand extends process.Command {
+	public VectorBenchCommand() {
+		finalArguments(0, 0, "");
+		description("Computes sums, dot products, element-wise sums and products with a scalar over vectors " +
+					"of int, long, float and double. Each is timed as a loop over the elements and as a vector " +
+					"expression, which uses packed SIMD instructions. " +
+					"Set the PARASOLRT_NO_AVX2 environment variable to time the SSE2 code on a machine with AVX2.");
+		lengthOption = integerOption('n', "length",
+					"The number of elements in each vector. Default: 1000000.");
+		repeatOption = integerOption('r', "repeat",
+					"The number of times each computation is repeated. Default: 20.");
+		helpOption('?', "help",
+					"Displays this help.");
+	}
+
+	ref<process.Option<int>> lengthOption;
+	ref<process.Option<int>> repeatOption;
+}
+
+VectorBenchCommand command;
+
+int length;
+int repeat;
+
+int main(string[] args) {
+	if (!command.parse(args))
+		command.help();
+	length = command.lengthOption.set() ? command.lengthOption.value : 1000000;
+	repeat = command.repeatOption.set() ? command.repeatOption.value : 20;
+	if (length <= 0 || repeat <= 0) {
+		printf("Length and repeat must be positive\n");
+		return 1;
+	}
+	printf("%d elements, %d repetitions\n", length, repeat);
+	printf("%-8s %-12s %12s %12s %8s\n", "type", "operation", "loop ms", "vector ms", "speedup");
+	boolean success = true;
+	Bench<int> ints;
+	success &= ints.run("int");
+	Bench<long> longs;
+	success &= longs.run("long");
+	Bench<float> floats;
+	success &= floats.run("float");
+	Bench<double> doubles;
+	success &= doubles.run("double");
+	return success ? 0 : 1;
+}
+
+class Bench<class E> {
+	E[] a, b, c;
+	E scale;
+
+	boolean run(string typeName) {
+		for (int i = 0; i < length; i++) {
+			a.append(E(i % 100));
+			b.append(E(i % 7 + 1));
+		}
+		scale = E(3);
+		boolean success = true;
+
+		E loopSum, vectorSum;
+		time.Instant start = time.Clock.MONOTONIC.get();
+		for (int r = 0; r < repeat; r++) {
+			loopSum = 0;
+			for (int i = 0; i < length; i++)
+				loopSum += a[i];
+		}
+		long loopTime = elapsed(start);
+		start = time.Clock.MONOTONIC.get();
+		for (int r = 0; r < repeat; r++)
+			vectorSum = +=a;
+		report(typeName, "sum", loopTime, elapsed(start));
+		success &= check(typeName, "sum", close(loopSum, vectorSum, exactSum(false)));
+
+		start = time.Clock.MONOTONIC.get();
+		for (int r = 0; r < repeat; r++) {
+			loopSum = 0;
+			for (int i = 0; i < length; i++)
+				loopSum += a[i] * b[i];
+		}
+		loopTime = elapsed(start);
+		start = time.Clock.MONOTONIC.get();
+		for (int r = 0; r < repeat; r++)
+			vectorSum = +=(a * b);
+		report(typeName, "dot", loopTime, elapsed(start));
+		success &= check(typeName, "dot", close(loopSum, vectorSum, exactSum(true)));
+
+		c.resize(length);
+		start = time.Clock.MONOTONIC.get();
+		for (int r = 0; r < repeat; r++) {
+			for (int i = 0; i < length; i++)
+				c[i] = a[i] + b[i];
+		}
+		loopTime = elapsed(start);
+		E[] loopResult = c;
+		start = time.Clock.MONOTONIC.get();
+		for (int r = 0; r < repeat; r++)
+			c = a + b;
+		report(typeName, "a + b", loopTime, elapsed(start));
+		success &= check(typeName, "a + b", same(&c, &loopResult));
+
+		start = time.Clock.MONOTONIC.get();
+		for (int r = 0; r < repeat; r++) {
+			for (int i = 0; i < length; i++)
+				c[i] = a[i] * scale;
+		}
+		loopTime = elapsed(start);
+		loopResult = c;
+		start = time.Clock.MONOTONIC.get();
+		for (int r = 0; r < repeat; r++)
+			c = a * scale;
+		report(typeName, "a * scale", loopTime, elapsed(start));
+		success &= check(typeName, "a * scale", same(&c, &loopResult));
+		return success;
+	}
+
+	/*
+	 * Integer sums must match exactly. A float or double sum is rounded differently depending on the order
+	 * in which the elements are added, and a long float sum added one element at a time drifts far from
+	 * the true sum, so a floating point sum is compared to the sum computed in double precision.
+	 */
+	boolean close(E loopSum, E vectorSum, double exact) {
+		if (E(0.5) == 0)
+			return loopSum == vectorSum;
+		double difference = double(vectorSum) - exact;
+		return difference <= exact * 1e-5 && -difference <= exact * 1e-5;
+	}
+
+	double exactSum(boolean products) {
+		double sum = 0;
+		for (i in a)
+			sum += products ? double(a[i]) * double(b[i]) : double(a[i]);
+		return sum;
+	}
+
+	boolean same(ref<E[]> x, ref<E[]> y) {
+		if (x.length() != y.length())
+			return false;
+		for (i in *x)
+			if ((*x)[i] != (*y)[i])
+				return false;
+		return true;
+	}
+}
+
+void report(string typeName, string operation, long loopTime, long vectorTime) {
+	printf("%-8s %-12s %12.3f %12.3f %8.2f\n", typeName, operation, loopTime / 1000000.0, vectorTime / 1000000.0,
+					vectorTime > 0 ? double(loopTime) / vectorTime : 0.0);
+}
+
+boolean check(string typeName, string operation, boolean matched) {
+	if (!matched)
+		printf("    FAIL: %s %s results differ\n", typeName, operation);
+	return matched;
+}
+/**
+ * @return The time in nanoseconds since start.
+ */
+long elapsed(time.Instant start) {
+	time.Duration d = time.Instant.elapsed(start, time.Clock.MONOTONIC.get());
+	return d.seconds() * 1000000000 + d.nanoseconds();
+}
@@ -0,0 +1,241 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// Web Socket benchmark: starts an http.Server with a Web Socket service on the loopback interface and opens a
+// number of Web Sockets to it from the same process. Reports the memory and threads used per connection, then
+// has the server broadcast messages to every connection and reports the rate at which the clients receive them.
+import parasol:http;
+import parasol:net.ServerScope;
+import parasol:process;
+import parasol:storage;
+import parasol:thread;
+import parasol:time;
+import native:linux;
+
+class WebSocketBenchCommand extends process.Command {
+	public WebSocketBenchCommand() {
+		finalArguments(0, 0, "");
+		description("Starts an HTTP server with a Web Socket service on a loopback port and connects to it " +
+					"from the same process. The resident memory and thread count of the process are measured " +
+					"before and after the connections are opened. Then the server sends each connection the " +
+					"same sequence of messages, one message to every connection before the next message. " +
+					"The process' open file limit is raised as far as the hard limit allows.");
+		connectionsOption = integerOption('c', "connections",
+					"The number of Web Sockets to open. Default: 1000.");
+		messagesOption = integerOption('m', "messages",
+					"The number of messages sent to each connection. Default: 100.");
+		sizeOption = integerOption('s', "size",
+					"The size of each message in bytes. Default: 64.");
+		helpOption('?', "help",
+					"Displays this help.");
+	}
+
+	ref<process.Option<int>> connectionsOption;
+	ref<process.Option<int>> messagesOption;
+	ref<process.Option<int>> sizeOption;
+}
+
+WebSocketBenchCommand command;
+
+class BenchFactory extends http.WebSocketFactory {
+	Sockets accepted;
+	ref<SocketListener> listener;
+
+	BenchFactory() {
+		listener = new SocketListener();
+	}
+
+	~BenchFactory() {
+		delete listener;
+	}
+
+	public boolean start(ref<http.Request> request, ref<http.Response> response) {
+		ref<http.WebSocket> ws = new http.WebSocket(response.connection(), true);
+		lock (accepted) {
+			sockets.append(ws);
+		}
+		ws.startListening(listener);
+		return true;
+	}
+}
+
+monitor class Sockets {
+	ref<http.WebSocket>[] sockets;
+}
+/*
+ * Counts the messages arriving on all the sockets that share it.
+ */
+class SocketListener implements http.WebSocketListener {
+	long received;
+	long closed;
+
+	void message(ref<byte[]> message) {
+		thread.fetchAdd(&received, 1);
+	}
+
+	void endOfMessages(boolean sawClose) {
+		thread.fetchAdd(&closed, 1);
+	}
+}
+
+int main(string[] args) {
+	if (!command.parse(args))
+		command.help();
+	int connections = command.connectionsOption.set() ? command.connectionsOption.value : 1000;
+	int messages = command.messagesOption.set() ? command.messagesOption.value : 100;
+	int size = command.sizeOption.set() ? command.sizeOption.value : 64;
+	if (connections <= 0 || messages <= 0 || size <= 0) {
+		printf("Connections, messages and size must be positive\n");
+		return 1;
+	}
+	// Each connection uses a descriptor in the client and one in the server.
+	long fileLimit = raiseFileLimit();
+	if (2 * connections + 100 > fileLimit) {
+		printf("%d connections need %d open files, the limit is %d\n", connections, 2 * connections + 100, fileLimit);
+		return 1;
+	}
+
+	http.Server server;
+	http.WebSocketService service;
+	BenchFactory factory;
+	server.disableHttps();
+	server.setHttpPort(0);
+	service.webSocketProtocol("bench", &factory);
+	server.httpService("/ws", &service);
+	server.start(ServerScope.LOCALHOST);
+	char port = server.httpPort();
+	string url = "ws://localhost:" + string(port) + "/ws";
+
+	long rssBefore, threadsBefore;
+	(rssBefore, threadsBefore) = processStatus();
+	long start = now();
+	ref<http.WebSocket>[] clients;
+	ref<SocketListener> clientListener = new SocketListener();
+	for (int i = 0; i < connections; i++) {
+		http.Client client(url, "bench");
+		http.ConnectStatus status;
+		unsigned ip;
+		(status, ip) = client.get();
+		ref<http.WebSocket> ws = client.webSocket();
+		if (status != http.ConnectStatus.OK || ws == null) {
+			printf("Connect failed after %d connections: %s\n", i, string(status));
+			delete ws;
+			return 1;
+		}
+		ws.startListening(clientListener);
+		clients.append(ws);
+	}
+	while (acceptedCount(&factory) < connections)
+		thread.sleep(1);
+	long connectTime = now() - start;
+	long rssAfter, threadsAfter;
+	(rssAfter, threadsAfter) = processStatus();
+
+	printf("%d connections opened in %.3f sec\n", connections, connectTime / 1000000000.0);
+	printf("Resident memory %d KB -> %d KB, %.1f KB per connection (both ends)\n", rssBefore, rssAfter,
+				double(rssAfter - rssBefore) / connections);
+	printf("Threads %d -> %d\n", threadsBefore, threadsAfter);
+
+	string message;
+	for (int i = 0; i < size; i++)
+		message.append(byte('a' + i % 26));
+	long expected = long(connections) * messages;
+	start = now();
+	lock (factory.accepted) {
+		for (int i = 0; i < messages; i++)
+			for (j in sockets)
+				sockets[j].write(message);
+	}
+	long sent = now() - start;
+	while (clientListener.received < expected)
+		thread.sleep(1);
+	long delivered = now() - start;
+	printf("%d messages of %d bytes sent in %.3f sec, received in %.3f sec, %.0f messages/sec\n",
+				expected, size, sent / 1000000000.0, delivered / 1000000000.0,
+				expected * 1000000000.0 / delivered);
+
+	// Closing the client end starts the close handshake, which ends the listening at both ends.
+	clients.deleteAll();
+	while (factory.listener.closed < connections)
+		thread.sleep(1);
+	lock (factory.accepted) {
+		sockets.deleteAll();
+	}
+	server.stop();
+	server.wait();
+	return 0;
+}
+
+int acceptedCount(ref<BenchFactory> factory) {
+	lock (factory.accepted) {
+		return sockets.length();
+	}
+}
+/*
+ * @return The resident set size of the process in kilobytes.
+ * @return The number of threads in the process.
+ */
+long, long processStatus() {
+	long rss, threads;
+	ref<storage.FileReader> reader = storage.openTextFile("/proc/self/status");
+	if (reader == null)
+		return 0, 0;
+	for (;;) {
+		string line = reader.readLine();
+		if (line == null)
+			break;
+		string[] fields = line.split(':');
+		if (fields.length() != 2)
+			continue;
+		string value = fields[1].trim();
+		int space = value.indexOf(' ');
+		if (space >= 0)
+			value = value.substr(0, space);
+		long n;
+		boolean success;
+		(n, success) = long.parse(value);
+		if (!success)
+			continue;
+		if (fields[0] == "VmRSS")
+			rss = n;
+		else if (fields[0] == "Threads")
+			threads = n;
+	}
+	delete reader;
+	return rss, threads;
+}
+/*
+ * Raise the soft limit on open files to the hard limit.
+ *
+ * @return The resulting limit.
+ */
+long raiseFileLimit() {
+	linux.rlimit limit;
+	if (linux.getrlimit(linux.RLIMIT_NOFILE, &limit) != 0)
+		return 1024;
+	if (limit.rlim_cur != limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		if (linux.setrlimit(linux.RLIMIT_NOFILE, &limit) != 0)
+			linux.getrlimit(linux.RLIMIT_NOFILE, &limit);
+	}
+	if (limit.rlim_cur == linux.RLIM_INFINITY)
+		return long.MAX_VALUE;
+	return limit.rlim_cur;
+}
+
+long now() {
+	time.Instant t = time.Clock.MONOTONIC.get();
+	return t.seconds() * 1000000000 + t.nanoseconds();
+}
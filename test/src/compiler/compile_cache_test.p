@@ -0,0 +1,149 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:compiler;
+import parasol:context;
+import parasol:process;
+import parasol:pxi;
+import parasol:storage;
+
+// The compile cache is keyed by the pxi file of the running compiler, so this test compiles itself to a pxi
+// file and runs that as the compiler. Each run uses a copy of the core package, which is then changed.
+//
+//	compile_cache_test.p <path of this file>	Drive the test.
+//	compile_cache_test.p store <dir> <core>		Compile and store an entry, using <core> as the core package.
+//	compile_cache_test.p lookup <dir> <core>	Exit with 0 if the entry is current, 3 if it is not.
+
+int main(string[] args) {
+	if (args.length() == 3)
+		return cacheStep(args[0], args[1], args[2]);
+	assert(args.length() == 1);
+
+	// Compiled in memory, this program has no pxi file to hash.
+
+	compiler.CompileCache inMemory("/nonexistent", "compile_cache_test");
+	assert(!inMemory.usable());
+	assert(inMemory.lookup(context.getActiveContext()) == null);
+
+	string dir;
+	ref<storage.FileWriter> w;
+	(dir, w) = storage.createTempFile("compileCacheXXXXXX");
+	delete w;
+	storage.deleteFile(dir);
+	assert(storage.makeDirectory(dir, false));
+	ref<context.Package> core = context.getActiveContext().getPackage(context.PARASOL_CORE_PACKAGE_NAME);
+	string coreCopy = storage.path(dir, "core");
+	assert(storage.copyDirectoryTree(core.directory(), coreCopy, false));
+	w = storage.createTextFile(storage.path(dir, "hello.p"));
+	w.write("int main(string[] args) {\n\treturn 0;\n}\n");
+	delete w;
+	string driver = storage.path(dir, "driver.pxi");
+	assert(compileToPxi(args[0], driver));
+
+	assert(step(driver, "store", dir, coreCopy) == 0);
+	assert(step(driver, "lookup", dir, coreCopy) == 0);
+
+	// A change to the manifest of a package invalidates the entry, until it is changed back.
+
+	string manifest = storage.path(coreCopy, context.PACKAGE_MANIFEST);
+	string original = readFile(manifest);
+	writeFile(manifest, original + "\n");
+	assert(step(driver, "lookup", dir, coreCopy) == 3);
+	writeFile(manifest, original);
+	assert(step(driver, "lookup", dir, coreCopy) == 0);
+
+	// So does a new version.
+
+	string metadata = storage.path(coreCopy, context.PACKAGE_METADATA);
+	string originalMetadata = readFile(metadata);
+	int versionAt = originalMetadata.indexOf("\"version\":\"");
+	assert(versionAt >= 0);
+	versionAt += 11;
+	writeFile(metadata, originalMetadata.substr(0, versionAt) + "99." + originalMetadata.substr(versionAt));
+	assert(step(driver, "lookup", dir, coreCopy) == 3);
+	writeFile(metadata, originalMetadata);
+	assert(step(driver, "lookup", dir, coreCopy) == 0);
+
+	// So does the package resolving to a different directory, even one with the same contents.
+
+	string otherCopy = storage.path(dir, "other");
+	assert(storage.copyDirectoryTree(coreCopy, otherCopy, false));
+	assert(step(driver, "lookup", dir, otherCopy) == 3);
+
+	assert(storage.deleteDirectoryTree(dir));
+	return 0;
+}
+
+int cacheStep(string mode, string dir, string coreDirectory) {
+	ref<context.TemporaryContext> activeContext = new context.TemporaryContext(context.getActiveContext());
+	activeContext.definePackage(new context.Package(null, null, coreDirectory));
+	string hello = storage.path(dir, "hello.p");
+	compiler.CompileCache cache(storage.path(dir, "cache"), hello);
+	assert(cache.usable());
+	if (mode == "lookup")
+		return cache.lookup(activeContext) != null ? 0 : 3;
+	assert(mode == "store");
+	compiler.Arena arena(activeContext);
+	compiler.CompileContext compileContext(&arena, false, false);
+	assert(compileContext.loadRoot(false));
+	ref<compiler.Target> target = compileContext.compile(hello);
+	assert(target != null && arena.countMessages() == 0);
+	assert(cache.store(&arena, target, compileContext.packages()));
+	delete target;
+	assert(cache.lookup(activeContext) != null);
+	return 0;
+}
+
+int step(string driver, string mode, string dir, string coreDirectory) {
+	process.Process p;
+	boolean success;
+	int exitCode;
+	(success, exitCode) = p.execute(process.binaryFilename(), driver, mode, dir, coreDirectory);
+	return exitCode;
+}
+
+boolean compileToPxi(string mainFile, string pxiFile) {
+	compiler.Arena arena;
+	compiler.CompileContext compileContext(&arena, false, false);
+	if (!compileContext.loadRoot(false))
+		return false;
+	ref<compiler.Target> target = compileContext.compile(mainFile);
+	if (target == null || arena.countMessages() > 0) {
+		arena.printMessages();
+		delete target;
+		return false;
+	}
+	ref<pxi.Pxi> output = pxi.Pxi.create(pxiFile);
+	target.writePxi(output);
+	boolean written = output.write();
+	delete output;
+	delete target;
+	return written;
+}
+
+string readFile(string filename) {
+	ref<storage.FileReader> r = storage.openBinaryFile(filename);
+	assert(r != null);
+	string s = r.readAll();
+	delete r;
+	return s;
+}
+
+void writeFile(string filename, string contents) {
+	ref<storage.FileWriter> w = storage.createBinaryFile(filename);
+	assert(w != null);
+	w.write(contents);
+	delete w;
+}
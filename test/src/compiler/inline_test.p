@@ -0,0 +1,218 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:compiler;
+import parasol:process;
+import parasol:pxi;
+import parasol:storage;
+
+// Compiles this file to two images, with and without inlining, and runs each. A fault in an inlined accessor
+// is reported in the caller's frame, so the depth of the stack trace shows whether a call was inlined. A
+// process only recovers from one fault, so each depth is measured by a run of its own.
+//
+//	inline_test.p <path of this file>		Drive the test.
+//	inline_test.p check						Check the results of calls.
+//	inline_test.p frames <call>				Exit with the depth of the stack trace of a fault in <call>.
+
+class Box {
+	int _value;
+
+	Box(int value) {
+		_value = value;
+	}
+
+	int value() {
+		return _value;
+	}
+
+	boolean positive() {
+		if (_value > 0)
+			return true;
+		else
+			return false;
+	}
+}
+
+class Holder {
+	ref<Box> box;
+}
+
+class Outer {
+	ref<Holder> holder;
+}
+
+class Base {
+	ref<Box> box;
+
+	int boxValue() {
+		return box._value;
+	}
+}
+
+class Derived extends Base {
+	int boxValue() {
+		return box._value + 100;
+	}
+}
+
+int main(string[] args) {
+	if (args.length() == 2)
+		return faultFrames(args[1]);
+	assert(args.length() == 1);
+	if (args[0] == "check")
+		return checkCalls();
+
+	string dir;
+	ref<storage.FileWriter> w;
+	(dir, w) = storage.createTempFile("inlineXXXXXX");
+	delete w;
+	storage.deleteFile(dir);
+	assert(storage.makeDirectory(dir, false));
+	string inlined = storage.path(dir, "inline.pxi");
+	string called = storage.path(dir, "no-inline.pxi");
+	assert(compileToPxi(args[0], inlined, false));
+	assert(compileToPxi(args[0], called, true));
+
+	assert(step(inlined, "check") == 0);
+	assert(step(called, "check") == 0);
+
+	// An accessor, read directly or through a chain of refs, is inlined unless --no-inline is given.
+
+	int fieldFrames = step(inlined, "frames", "field");
+	assert(fieldFrames > 0);
+	assert(step(called, "frames", "field") == fieldFrames);
+	assert(step(inlined, "frames", "accessor") == fieldFrames);
+	assert(step(called, "frames", "accessor") == fieldFrames + 1);
+	assert(step(inlined, "frames", "chain") == fieldFrames);
+	assert(step(called, "frames", "chain") == fieldFrames + 1);
+
+	// A method that is overridden is always called.
+
+	assert(step(inlined, "frames", "virtual") == fieldFrames + 1);
+	assert(step(called, "frames", "virtual") == fieldFrames + 1);
+
+	assert(storage.deleteDirectoryTree(dir));
+	return 0;
+}
+
+boolean compileToPxi(string mainFile, string pxiFile, boolean noInline) {
+	compiler.Arena arena;
+	compiler.CompileContext compileContext(&arena, false, false);
+	compileContext.noInline = noInline;
+	if (!compileContext.loadRoot(false))
+		return false;
+	ref<compiler.Target> target = compileContext.compile(mainFile);
+	if (target == null || arena.countMessages() > 0) {
+		arena.printMessages();
+		delete target;
+		return false;
+	}
+	ref<pxi.Pxi> output = pxi.Pxi.create(pxiFile);
+	target.writePxi(output);
+	boolean written = output.write();
+	delete output;
+	delete target;
+	return written;
+}
+
+int step(string image, string... args) {
+	process.Process p;
+	boolean success;
+	int exitCode;
+	string[] arguments = [ image ];
+	arguments.append(args);
+	(success, exitCode) = p.execute(process.binaryFilename(), arguments);
+	return exitCode;
+}
+
+int checkCalls() {
+
+	// A receiver that is checked for null first.
+
+	ref<Box> none;
+	assert(!(none != null && none.value() > 0));
+	assert(none == null || none.positive());
+	ref<Box> box = new Box(5);
+	assert(box != null && box.value() == 5);
+	assert(box != null ? box.positive() : false);
+	box._value = -1;
+	assert(box != null && !box.positive());
+
+	// An accessor reached through a chain of refs sees the current object at each step.
+
+	Outer outer;
+	outer.holder = new Holder;
+	outer.holder.box = box;
+	assert(outer.holder.box.value() == -1);
+	ref<Box> other = new Box(7);
+	outer.holder.box = other;
+	assert(outer.holder.box.value() == 7);
+	assert(outer.holder.box.positive());
+
+	// The object's own override runs.
+
+	ref<Base> base = new Derived();
+	base.box = other;
+	assert(base.boxValue() == 107);
+	ref<Base> plain = new Base();
+	plain.box = other;
+	assert(plain.boxValue() == 7);
+
+	delete base;
+	delete plain;
+	delete outer.holder;
+	delete other;
+	delete box;
+	return 0;
+}
+/*
+ * Reads a field of a null ref, directly or through a method, and returns the number of frames in the stack
+ * trace of the fault.
+ */
+int faultFrames(string call) {
+	ref<Box> none;
+	Outer outer;
+	outer.holder = new Holder;
+	ref<Base> base = new Base();
+	int count;
+	try {
+		int x;
+		switch (call) {
+		case "field":
+			x = none._value;
+			break;
+
+		case "accessor":
+			x = none.value();
+			break;
+
+		case "chain":
+			x = outer.holder.box.value();
+			break;
+
+		case "virtual":
+			x = base.boxValue();
+			break;
+		}
+	} catch (Exception e) {
+		string trace = e.textStackTrace();
+		for (i in trace)
+			if (trace[i] == '\n')
+				count++;
+	}
+	delete base;
+	delete outer.holder;
+	return count;
+}
@@ -0,0 +1,63 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:compiler;
+import parasol:pxi;
+import parasol:storage;
+
+// Compiling with one parsing thread and with several must produce byte-identical images.
+
+int main(string[] args) {
+	assert(args.length() == 1);
+	string single = compileToPxi(args[0], 1);
+	string parallel = compileToPxi(args[0], 4);
+	assert(single != null);
+	assert(parallel != null);
+	assert(single.length() > 0);
+	assert(single == parallel);
+	return 0;
+}
+
+string compileToPxi(string mainFile, int threads) {
+	compiler.Arena arena;
+	compiler.CompileContext compileContext(&arena, false, false);
+	compileContext.threads = threads;
+	if (!compileContext.loadRoot(false))
+		return null;
+	ref<compiler.Target> target = compileContext.compile(mainFile);
+	if (target == null || arena.countMessages() > 0) {
+		printf("%s failed to compile with %d threads\n", mainFile, threads);
+		arena.printMessages();
+		delete target;
+		return null;
+	}
+	string filename;
+	ref<storage.FileWriter> w;
+	(filename, w) = storage.createBinaryTempFile("parallelParseXXXXXX");
+	delete w;
+	ref<pxi.Pxi> output = pxi.Pxi.create(filename);
+	target.writePxi(output);
+	boolean written = output.write();
+	delete output;
+	delete target;
+	string image;
+	if (written) {
+		ref<storage.FileReader> r = storage.openBinaryFile(filename);
+		image = r.readAll();
+		delete r;
+	}
+	storage.deleteFile(filename);
+	return image;
+}
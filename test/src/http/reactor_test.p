@@ -0,0 +1,204 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:http;
+import parasol:net.ServerScope;
+import parasol:thread;
+import native:linux;
+import native:net;
+
+// Requests served by the accept threads' event loops: several requests on one kept-alive connection,
+// pipelined requests, a request split across several packets, the connection closing rules, and an accept
+// that fails for lack of file descriptors.
+
+class EchoService extends http.Service {
+	public boolean processRequest(ref<http.Request> request, ref<http.Response> response) {
+		string body = string(request.method) + " " + request.serviceResource;
+		if (request.method == http.Request.Method.POST) {
+			string content;
+			int length;
+			(content, length) = request.readContent();
+			body += " " + content;
+		}
+		response.ok();
+		response.header("Content-Length", string(body.length()));
+		response.write(body);
+		return false;
+	}
+}
+
+http.Server server;
+EchoService service;
+server.disableHttps();
+server.setHttpPort(0);
+server.setAcceptThreads(2);
+server.httpService("/echo", &service);
+server.start(ServerScope.LOCALHOST);
+char port = server.httpPort();
+
+// Requests sent one at a time on one kept-alive connection.
+
+int fd = connectTo(port);
+assert(fd >= 0);
+for (int i = 0; i < 5; i++) {
+	sendAll(fd, "GET /echo/" + string(i) + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+	assert(readResponse(fd) == "GET " + string(i));
+}
+
+// Pipelined requests, including one with content, sent together and answered in order.
+
+sendAll(fd, "GET /echo/a HTTP/1.1\r\nHost: localhost\r\n\r\n" +
+			"POST /echo/b HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\n\r\nhello" +
+			"GET /echo/c HTTP/1.1\r\nHost: localhost\r\n\r\n");
+assert(readResponse(fd) == "GET a");
+assert(readResponse(fd) == "POST b hello");
+assert(readResponse(fd) == "GET c");
+
+// A request whose header arrives in pieces.
+
+string request = "GET /echo/split HTTP/1.1\r\nHost: localhost\r\n\r\n";
+for (i in request) {
+	sendAll(fd, request.substr(i, i + 1));
+	if (i % 8 == 0)
+		thread.sleep(2);
+}
+assert(readResponse(fd) == "GET split");
+
+// A request asking for the connection to be closed.
+
+sendAll(fd, "GET /echo/last HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+assert(readResponse(fd) == "GET last");
+assert(closedByServer(fd));
+net.closesocket(fd);
+
+// An HTTP/1.0 connection is closed after its response unless it asks to be kept alive.
+
+fd = connectTo(port);
+sendAll(fd, "GET /echo/old HTTP/1.0\r\n\r\n");
+assert(readResponse(fd) == "GET old");
+assert(closedByServer(fd));
+net.closesocket(fd);
+
+fd = connectTo(port);
+sendAll(fd, "GET /echo/old1 HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+assert(readResponse(fd) == "GET old1");
+sendAll(fd, "GET /echo/old2 HTTP/1.0\r\n\r\n");
+assert(readResponse(fd) == "GET old2");
+assert(closedByServer(fd));
+net.closesocket(fd);
+
+// Many connections at once, each with pipelined requests.
+
+int[] fds;
+for (int i = 0; i < 20; i++) {
+	fd = connectTo(port);
+	assert(fd >= 0);
+	fds.append(fd);
+}
+for (i in fds)
+	sendAll(fds[i], "GET /echo/x" + string(i) + " HTTP/1.1\r\nHost: localhost\r\n\r\n" +
+					"GET /echo/y" + string(i) + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+for (i in fds) {
+	assert(readResponse(fds[i]) == "GET x" + string(i));
+	assert(readResponse(fds[i]) == "GET y" + string(i));
+	net.closesocket(fds[i]);
+}
+
+// With no file descriptor left for it, an accept fails. The server keeps its listening sockets open and
+// accepts the connection once a descriptor is free.
+
+fd = net.socket(net.AF_INET, net.SOCK_STREAM, 0);
+assert(fd >= 0);
+int nextFd = linux.dup(fd);
+linux.close(nextFd);
+linux.rlimit saved;
+assert(linux.getrlimit(linux.RLIMIT_NOFILE, &saved) == 0);
+linux.rlimit limited = saved;
+limited.rlim_cur = nextFd;
+assert(linux.setrlimit(linux.RLIMIT_NOFILE, &limited) == 0);
+assert(connect(fd, port));
+thread.sleep(100);
+assert(linux.setrlimit(linux.RLIMIT_NOFILE, &saved) == 0);
+sendAll(fd, "GET /echo/later HTTP/1.1\r\nHost: localhost\r\n\r\n");
+assert(readResponse(fd) == "GET later");
+net.closesocket(fd);
+
+server.stop();
+server.wait();
+
+void sendAll(int fd, string data) {
+	assert(net.send(fd, &data[0], data.length(), net.MSG_NOSIGNAL) == data.length());
+}
+
+byte[] pending;			// bytes received after the end of the last response
+/*
+ * Read one response and return its content. The response must have a Content-Length header.
+ */
+string readResponse(int fd) {
+	string response;
+	response.append(&pending[0], pending.length());
+	pending.clear();
+	int headerEnd;
+	while ((headerEnd = response.indexOf("\r\n\r\n")) < 0)
+		receive(fd, &response);
+	assert(response.startsWith("HTTP/1.1 200"));
+	int at = response.toLowerCase().indexOf("content-length:");
+	assert(at >= 0 && at < headerEnd);
+	string value = response.substr(at + 15, response.indexOf("\r\n", at));
+	int length;
+	boolean success;
+	(length, success) = int.parse(value.trim());
+	assert(success);
+	int end = headerEnd + 4 + length;
+	while (response.length() < end)
+		receive(fd, &response);
+	if (response.length() > end)
+		pending.append(pointer<byte>(&response[end]), response.length() - end);
+	return response.substr(headerEnd + 4, end);
+}
+
+void receive(int fd, ref<string> response) {
+	byte[] buffer;
+	buffer.resize(4096);
+	int actual = net.recv(fd, &buffer[0], buffer.length(), 0);
+	assert(actual > 0);
+	response.append(&buffer[0], actual);
+}
+
+boolean closedByServer(int fd) {
+	assert(pending.length() == 0);
+	byte[] buffer;
+	buffer.resize(16);
+	return net.recv(fd, &buffer[0], buffer.length(), 0) == 0;
+}
+
+int connectTo(char port) {
+	int fd = net.socket(net.AF_INET, net.SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (!connect(fd, port)) {
+		net.closesocket(fd);
+		return -1;
+	}
+	return fd;
+}
+
+boolean connect(int fd, char port) {
+	net.sockaddr_in address;
+	address.sin_family = net.AF_INET;
+	address.sin_port = net.htons(port);
+	address.sin_addr.s_addr = net.inet_addr("127.0.0.1".c_str());
+	return net.connect(fd, &address, address.bytes) == 0;
+}
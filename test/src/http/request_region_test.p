@@ -0,0 +1,162 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:http;
+import parasol:memory;
+import parasol:net.ServerScope;
+import parasol:thread;
+import native:net;
+
+// Requests served with a Region, including a Web Socket upgrade whose socket is deleted on another thread.
+
+class RegionService extends http.Service {
+	public boolean processRequest(ref<http.Request> request, ref<http.Response> response) {
+		assert(memory.threadAllocator() == request.region());
+		assert(request.region() != null);
+		string body = "region " + request.serviceResource;
+		response.ok();
+		response.header("Content-Length", string(body.length()));
+		response.write(body);
+		return false;
+	}
+}
+
+class Factory extends http.WebSocketFactory {
+	Sockets accepted;
+	ref<Listener> listener;
+
+	public boolean start(ref<http.Request> request, ref<http.Response> response) {
+		assert(memory.threadAllocator() == null);
+		ref<http.WebSocket> ws = new http.WebSocket(response.connection(), true);
+		lock (accepted) {
+			sockets.append(ws);
+		}
+		ws.startListening(listener);
+		return true;
+	}
+}
+
+monitor class Sockets {
+	ref<http.WebSocket>[] sockets;
+}
+
+class Listener implements http.WebSocketListener {
+	long received;
+	long closed;
+
+	void message(ref<byte[]> message) {
+		thread.fetchAdd(&received, 1);
+	}
+
+	void endOfMessages(boolean sawClose) {
+		thread.fetchAdd(&closed, 1);
+	}
+}
+
+http.Server server;
+http.WebSocketService webSocketService;
+RegionService service;
+Factory factory;
+factory.listener = new Listener();
+server.disableHttps();
+server.setHttpPort(0);
+assert(!server.setRequestRegions(true));
+webSocketService.webSocketProtocol("test", &factory);
+server.httpService("/region", &service);
+server.httpService("/ws", &webSocketService);
+server.start(ServerScope.LOCALHOST);
+char port = server.httpPort();
+
+// Two requests on one kept-alive connection, each served from a Region.
+
+int fd = connectTo(port);
+assert(fd >= 0);
+for (int i = 0; i < 2; i++) {
+	string request = "GET /region/" + string(i) + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	assert(net.send(fd, &request[0], request.length(), net.MSG_NOSIGNAL) == request.length());
+	string expected = "region " + string(i);
+	string response = readResponse(fd, expected);
+	assert(response.startsWith("HTTP/1.1 200"));
+}
+net.closesocket(fd);
+
+// The server's end of each Web Socket is created during the request, then used and deleted on other threads.
+
+ref<Listener> clientListener = new Listener();
+ref<http.WebSocket>[] clients;
+for (int i = 0; i < 4; i++) {
+	http.Client client("ws://localhost:" + string(port) + "/ws", "test");
+	http.ConnectStatus status;
+	unsigned ip;
+	(status, ip) = client.get();
+	assert(status == http.ConnectStatus.OK);
+	ref<http.WebSocket> ws = client.webSocket();
+	assert(ws != null);
+	ws.startListening(clientListener);
+	clients.append(ws);
+}
+while (socketCount(&factory) < clients.length())
+	thread.sleep(1);
+lock (factory.accepted) {
+	for (i in sockets)
+		sockets[i].write("from the server");
+}
+for (i in clients)
+	clients[i].write("from the client");
+while (clientListener.received < clients.length() || factory.listener.received < clients.length())
+	thread.sleep(1);
+clients.deleteAll();
+while (factory.listener.closed < 4)
+	thread.sleep(1);
+lock (factory.accepted) {
+	sockets.deleteAll();
+}
+server.stop();
+server.wait();
+delete factory.listener;
+delete clientListener;
+
+int socketCount(ref<Factory> factory) {
+	lock (factory.accepted) {
+		return sockets.length();
+	}
+}
+
+string readResponse(int fd, string body) {
+	string response;
+	byte[] buffer;
+	buffer.resize(4096);
+	while (!response.endsWith(body)) {
+		int actual = net.recv(fd, &buffer[0], buffer.length(), 0);
+		assert(actual > 0);
+		response.append(&buffer[0], actual);
+	}
+	return response;
+}
+
+int connectTo(char port) {
+	int fd = net.socket(net.AF_INET, net.SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	net.sockaddr_in address;
+	address.sin_family = net.AF_INET;
+	address.sin_port = net.htons(port);
+	address.sin_addr.s_addr = net.inet_addr("127.0.0.1".c_str());
+	if (net.connect(fd, &address, address.bytes) != 0) {
+		net.closesocket(fd);
+		return -1;
+	}
+	return fd;
+}
@@ -0,0 +1,285 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:http;
+import parasol:net.ServerScope;
+import parasol:storage;
+import native:net;
+
+// Static content: the Range and If-None-Match header parsers, then conditional requests, byte ranges, gzip
+// negotiation and a cache too small to hold every file, served from Regions.
+
+http.RangeResult range;
+long start;
+long length;
+
+(range, start, length) = http.parseRange("bytes=10-19", 100);
+assert(range == http.RangeResult.SATISFIABLE && start == 10 && length == 10);
+(range, start, length) = http.parseRange(" bytes=90- ", 100);
+assert(range == http.RangeResult.SATISFIABLE && start == 90 && length == 10);
+(range, start, length) = http.parseRange("bytes=95-200", 100);
+assert(range == http.RangeResult.SATISFIABLE && start == 95 && length == 5);
+(range, start, length) = http.parseRange("bytes=-30", 100);
+assert(range == http.RangeResult.SATISFIABLE && start == 70 && length == 30);
+(range, start, length) = http.parseRange("bytes=-300", 100);
+assert(range == http.RangeResult.SATISFIABLE && start == 0 && length == 100);
+(range, start, length) = http.parseRange("bytes=100-", 100);
+assert(range == http.RangeResult.UNSATISFIABLE);
+(range, start, length) = http.parseRange("bytes=-0", 100);
+assert(range == http.RangeResult.UNSATISFIABLE);
+(range, start, length) = http.parseRange("bytes=0-", 0);
+assert(range == http.RangeResult.UNSATISFIABLE);
+(range, start, length) = http.parseRange("bytes=20-10", 100);
+assert(range == http.RangeResult.NONE && start == 0 && length == 100);
+(range, start, length) = http.parseRange("bytes=0-1,5-6", 100);
+assert(range == http.RangeResult.NONE);
+(range, start, length) = http.parseRange("items=0-1", 100);
+assert(range == http.RangeResult.NONE);
+(range, start, length) = http.parseRange("bytes=x-1", 100);
+assert(range == http.RangeResult.NONE);
+(range, start, length) = http.parseRange("bytes=5", 100);
+assert(range == http.RangeResult.NONE);
+
+assert(http.etagMatches("\"a1\"", "\"a1\""));
+assert(http.etagMatches("\"b2\", \"a1\"", "\"a1\""));
+assert(http.etagMatches("W/\"a1\"", "\"a1\""));
+assert(http.etagMatches("*", "\"a1\""));
+assert(!http.etagMatches("\"a2\"", "\"a1\""));
+assert(!http.etagMatches("a1", "\"a1\""));
+
+string dir;
+ref<storage.FileWriter> w;
+(dir, w) = storage.createTempFile("staticXXXXXX");
+delete w;
+storage.deleteFile(dir);
+assert(storage.makeDirectory(dir, false));
+
+string[] names = [ "a.txt", "b.txt", "c.txt" ];
+string[] contents;
+for (i in names) {
+	string content;
+	for (int j = 0; j < 1000; j++)
+		content.append(byte('a' + (i * 7 + j) % 26));
+	contents.append(content);
+	writeFile(storage.path(dir, names[i]), content);
+}
+string page = "<html>plain</html>";
+string compressed = "pretend this is gzip";
+writeFile(storage.path(dir, "page.html"), page);
+writeFile(storage.path(dir, "page.html.gz"), compressed);
+
+http.Server server;
+server.disableHttps();
+server.setHttpPort(0);
+assert(!server.setRequestRegions(true));
+server.setStaticContentCache(2500, 2000);
+server.staticContent("/static", dir);
+server.start(ServerScope.LOCALHOST);
+char port = server.httpPort();
+
+int fd = connectTo(port);
+assert(fd >= 0);
+
+// The cache holds two of the three files. Reading them round-robin drops the least recently used file each
+// time, and a file read after an eviction, or served again from the cache, is intact.
+
+for (int round = 0; round < 4; round++) {
+	for (i in names) {
+		ref<Reply> r = get(fd, "/static/" + names[i], "");
+		assert(r.status == 200);
+		assert(r.body == contents[i]);
+		assert(r.headers["content-type"] == "text/plain; charset=utf-8");
+		assert(r.headers["accept-ranges"] == "bytes");
+		delete r;
+	}
+	ref<Reply> r = get(fd, "/static/b.txt", "");
+	assert(r.body == contents[1]);
+	delete r;
+}
+
+// A file that changes is read again.
+
+contents[0] = contents[0].substr(0, 500) + "changed";
+writeFile(storage.path(dir, "a.txt"), contents[0]);
+ref<Reply> r = get(fd, "/static/a.txt", "");
+assert(r.status == 200);
+assert(r.body == contents[0]);
+string etag = r.headers["etag"];
+assert(etag.startsWith("\"") && etag.endsWith("\""));
+delete r;
+
+// If-None-Match.
+
+r = get(fd, "/static/a.txt", "If-None-Match: " + etag + "\r\n");
+assert(r.status == 304);
+assert(r.headers["etag"] == etag);
+assert(r.body.length() == 0);
+delete r;
+r = get(fd, "/static/a.txt", "If-None-Match: \"other\", W/" + etag + "\r\n");
+assert(r.status == 304);
+delete r;
+r = get(fd, "/static/a.txt", "If-None-Match: \"other\"\r\n");
+assert(r.status == 200);
+assert(r.body == contents[0]);
+delete r;
+
+// Range, with and without If-Range.
+
+r = get(fd, "/static/a.txt", "Range: bytes=10-19\r\n");
+assert(r.status == 206);
+assert(r.headers["content-range"] == "bytes 10-19/507");
+assert(r.body == contents[0].substr(10, 20));
+delete r;
+r = get(fd, "/static/a.txt", "Range: bytes=-7\r\n");
+assert(r.status == 206);
+assert(r.headers["content-range"] == "bytes 500-506/507");
+assert(r.body == "changed");
+delete r;
+r = get(fd, "/static/a.txt", "Range: bytes=507-600\r\n");
+assert(r.status == 416);
+assert(r.headers["content-range"] == "bytes */507");
+assert(r.body.length() == 0);
+delete r;
+r = get(fd, "/static/a.txt", "Range: bytes=20-10\r\n");
+assert(r.status == 200);
+assert(r.body == contents[0]);
+delete r;
+r = get(fd, "/static/a.txt", "Range: bytes=0-3\r\nIf-Range: " + etag + "\r\n");
+assert(r.status == 206);
+assert(r.body == contents[0].substr(0, 4));
+delete r;
+r = get(fd, "/static/a.txt", "Range: bytes=0-3\r\nIf-Range: \"stale\"\r\n");
+assert(r.status == 200);
+assert(r.body == contents[0]);
+delete r;
+
+// gzip negotiation. A client that accepts gzip gets the .gz file, with an entity tag of its own.
+
+r = get(fd, "/static/page.html", "");
+assert(r.status == 200);
+assert(r.body == page);
+assert(!r.headers.contains("content-encoding"));
+assert(r.headers["vary"] == "Accept-Encoding");
+string plainTag = r.headers["etag"];
+delete r;
+r = get(fd, "/static/page.html", "Accept-Encoding: deflate, GZIP\r\n");
+assert(r.status == 200);
+assert(r.body == compressed);
+assert(r.headers["content-encoding"] == "gzip");
+assert(r.headers["content-type"] == "text/html; charset=utf-8");
+assert(r.headers["vary"] == "Accept-Encoding");
+string gzipTag = r.headers["etag"];
+assert(gzipTag.endsWith("-gz\""));
+assert(gzipTag != plainTag);
+delete r;
+r = get(fd, "/static/page.html", "Accept-Encoding: gzip;q=0.5\r\n");
+assert(r.body == compressed);
+delete r;
+r = get(fd, "/static/page.html", "Accept-Encoding: gzip;q=0, deflate\r\n");
+assert(r.body == page);
+assert(!r.headers.contains("content-encoding"));
+delete r;
+r = get(fd, "/static/page.html", "Accept-Encoding: gzip\r\nIf-None-Match: " + plainTag + "\r\n");
+assert(r.status == 200);
+assert(r.body == compressed);
+delete r;
+r = get(fd, "/static/page.html", "Accept-Encoding: gzip\r\nIf-None-Match: " + gzipTag + "\r\n");
+assert(r.status == 304);
+delete r;
+r = get(fd, "/static/page.html", "Accept-Encoding: gzip\r\nRange: bytes=0-6\r\n");
+assert(r.status == 206);
+assert(r.body == compressed.substr(0, 7));
+assert(r.headers["content-encoding"] == "gzip");
+delete r;
+
+net.closesocket(fd);
+server.stop();
+server.wait();
+assert(storage.deleteDirectoryTree(dir));
+
+class Reply {
+	int status;
+	string[string] headers;			// keyed by lower case name
+	string body;
+}
+/*
+ * Send a GET request on a kept-alive connection and read the reply. The extra headers must each end with
+ * a CR-LF.
+ */
+ref<Reply> get(int fd, string url, string headers) {
+	string request = "GET " + url + " HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n";
+	assert(net.send(fd, &request[0], request.length(), net.MSG_NOSIGNAL) == request.length());
+	string response;
+	int headerEnd;
+	while ((headerEnd = response.indexOf("\r\n\r\n")) < 0)
+		receive(fd, &response);
+	ref<Reply> r = new Reply;
+	string head = response.substr(0, headerEnd);
+	string[] lines = head.split('\n');
+	assert(lines[0].startsWith("HTTP/1.1 "));
+	string code = lines[0].substr(9, 12);
+	boolean success;
+	(r.status, success) = int.parse(code);
+	assert(success);
+	for (int i = 1; i < lines.length(); i++) {
+		string line = lines[i].trim();
+		int colon = line.indexOf(':');
+		assert(colon > 0);
+		string name = line.substr(0, colon);
+		string value = line.substr(colon + 1);
+		r.headers[name.toLowerCase()] = value.trim();
+	}
+	int contentLength = 0;
+	if (r.headers.contains("content-length")) {
+		(contentLength, success) = int.parse(r.headers["content-length"]);
+		assert(success);
+	}
+	int end = headerEnd + 4 + contentLength;
+	while (response.length() < end)
+		receive(fd, &response);
+	assert(response.length() == end);
+	r.body = response.substr(headerEnd + 4, end);
+	return r;
+}
+
+void receive(int fd, ref<string> response) {
+	byte[] buffer;
+	buffer.resize(4096);
+	int actual = net.recv(fd, &buffer[0], buffer.length(), 0);
+	assert(actual > 0);
+	response.append(&buffer[0], actual);
+}
+
+void writeFile(string filename, string content) {
+	ref<storage.FileWriter> w = storage.createBinaryFile(filename);
+	assert(w != null);
+	w.write(content);
+	delete w;
+}
+
+int connectTo(char port) {
+	int fd = net.socket(net.AF_INET, net.SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	net.sockaddr_in address;
+	address.sin_family = net.AF_INET;
+	address.sin_port = net.htons(port);
+	address.sin_addr.s_addr = net.inet_addr("127.0.0.1".c_str());
+	if (net.connect(fd, &address, address.bytes) != 0) {
+		net.closesocket(fd);
+		return -1;
+	}
+	return fd;
+}
@@ -0,0 +1,475 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:http;
+import parasol:net.ServerScope;
+import parasol:thread;
+import native:net;
+
+// Web Sockets read by the shared reactors, driven by a client that writes its own frames: frames that arrive
+// right behind the upgrade request, a fragmented message with a ping among its fragments, the close handshake,
+// Web Sockets deleted by their own listeners, and large messages to clients that are not reading, which must
+// not hold up the reactor.
+
+class Factory extends http.WebSocketFactory {
+	public boolean start(ref<http.Request> request, ref<http.Response> response) {
+		ref<http.WebSocket> ws = new http.WebSocket(response.connection(), true);
+		ref<ServerListener> listener = new ServerListener(ws);
+		lock (servers) {
+			listeners.append(listener);
+		}
+		ws.startListening(listener);
+		return true;
+	}
+}
+
+monitor class Servers {
+	ref<ServerListener>[] listeners;
+}
+
+monitor class Record {
+	string[] received;
+	boolean ended;
+	boolean sawClose;
+	boolean deleted;
+}
+/*
+ * The server's end of a Web Socket. Messages are recorded, and some are commands:
+ *
+ *	report				reply with the messages recorded so far, separated by |
+ *	echo:text			reply with text
+ *	big:n				reply with a binary message of n bytes, then with after-big
+ *	big-delete:n		reply with a binary message of n bytes, then delete the Web Socket
+ *	delete				delete the Web Socket
+ */
+class ServerListener implements http.WebSocketListener {
+	ref<http.WebSocket> socket;
+	Record record;
+
+	ServerListener(ref<http.WebSocket> socket) {
+		this.socket = socket;
+	}
+
+	void message(ref<byte[]> message) {
+		string text;
+		if (message.length() > 0)
+			text = string(&(*message)[0], message.length());
+		if (text == "report") {
+			string all;
+			lock (record) {
+				for (i in received) {
+					if (i > 0)
+						all.append('|');
+					all.append(received[i]);
+				}
+			}
+			socket.write(all);
+			return;
+		}
+		lock (record) {
+			received.append(text);
+		}
+		if (text.startsWith("echo:"))
+			socket.write(text.substr(5));
+		else if (text.startsWith("big:")) {
+			socket.write(http.WebSocket.OP_BINARY, pattern(sizeAfterColon(text)));
+			socket.write("after-big");
+		} else if (text.startsWith("big-delete:")) {
+			socket.write(http.WebSocket.OP_BINARY, pattern(sizeAfterColon(text)));
+			deleteSocket();
+		} else if (text == "delete")
+			deleteSocket();
+	}
+
+	void endOfMessages(boolean closed) {
+		lock (record) {
+			ended = true;
+			sawClose = closed;
+		}
+	}
+
+	void deleteSocket() {
+		delete socket;
+		socket = null;
+		lock (record) {
+			deleted = true;
+		}
+	}
+}
+
+http.Server server;
+http.WebSocketService webSocketService;
+Factory factory;
+Servers servers;
+server.disableHttps();
+server.setHttpPort(0);
+webSocketService.webSocketProtocol("test", &factory);
+server.httpService("/ws", &webSocketService);
+server.start(ServerScope.LOCALHOST);
+char port = server.httpPort();
+
+// Messages sent along with the upgrade request reach the listener, in order. A reply to one of them follows
+// the response to the upgrade.
+
+ref<Peer> first = open(port, false, frame(1, true, "first") + frame(1, true, "echo:early") + frame(1, true, "second"));
+ref<ServerListener> firstServer = listener(0);
+assert(first.readText() == "early");
+first.sendMessage("report");
+assert(first.readText() == "first|echo:early|second");
+
+// A fragmented message with a ping between its fragments. The pong comes back at once.
+
+first.send(frame(1, false, "frag"));
+first.send(frame(9, true, "p1"));
+first.send(frame(0, false, "men"));
+first.send(frame(0, true, "ted"));
+int opcode;
+string payload;
+(opcode, payload) = first.readMessage();
+assert(opcode == 10 && payload == "p1");
+first.sendMessage("report");
+assert(first.readText() == "first|echo:early|second|fragmented");
+
+// A frame that arrives a few bytes at a time.
+
+string split = frame(1, true, "echo:split");
+for (int i = 0; i < split.length(); i += 3) {
+	first.send(split.substr(i, i + 3 < split.length() ? i + 3 : split.length()));
+	thread.sleep(2);
+}
+assert(first.readText() == "split");
+
+// Long messages, in one frame with a 64 bit length and in fragments with 16 bit lengths. The reply comes back
+// in fragments.
+
+string long;
+for (int i = 0; i < 70000; i++)
+	long.append(byte('a' + i % 26));
+first.sendMessage("echo:" + long);
+assert(first.readText() == long);
+first.send(frame(1, false, "echo:" + long.substr(0, 30000)));
+first.send(frame(0, false, long.substr(30000, 60000)));
+first.send(frame(0, true, long.substr(60000)));
+assert(first.readText() == long);
+
+// The close handshake: the server answers a close, then closes the connection once the Web Socket is deleted.
+
+string reason;
+reason.append(byte(0x03));
+reason.append(byte(0xe8));
+reason.append("bye");
+first.send(frame(8, true, reason));
+(opcode, payload) = first.readMessage();
+assert(opcode == 8);
+assert(payload.length() >= 2 && payload[0] == 0x03 && payload[1] == 0xe8);
+assert(waitForEnd(firstServer));
+lock (firstServer.record) {
+	assert(sawClose);
+}
+delete firstServer.socket;
+assert(first.atEnd());
+delete first;
+
+// A listener deletes its Web Socket while handling a message. The Web Socket sends a close and the connection
+// is closed.
+
+ref<Peer> deleted = open(port, false, "");
+ref<ServerListener> deletedServer = listener(1);
+deleted.sendMessage("delete");
+(opcode, payload) = deleted.readMessage();
+assert(opcode == 8);
+assert(deleted.atEnd());
+assert(deletedServer.socket == null);
+delete deleted;
+
+// A large message to a client that is not reading. The reactor goes on reading the Web Socket, and the client
+// gets everything, in order, once it reads.
+
+ref<Peer> slow = open(port, true, "");
+ref<ServerListener> slowServer = listener(2);
+ref<Peer> other = open(port, false, "");
+ref<ServerListener> otherServer = listener(3);
+slow.sendMessage("big:4000000");
+slow.sendMessage("echo:behind");
+assert(waitForMessage(slowServer, "echo:behind"));
+other.sendMessage("echo:meanwhile");
+assert(other.readText() == "meanwhile");
+(opcode, payload) = slow.readMessage();
+assert(opcode == 2);
+assert(payload == pattern(4000000));
+assert(slow.readText() == "after-big");
+assert(slow.readText() == "behind");
+
+// A listener deletes its Web Socket right after a large message the client is not reading. The message and the
+// close still arrive, then the connection is closed.
+
+ref<Peer> orphan = open(port, true, "");
+ref<ServerListener> orphanServer = listener(4);
+orphan.sendMessage("big-delete:4000000");
+assert(waitForDelete(orphanServer));
+other.sendMessage("echo:still here");
+assert(other.readText() == "still here");
+(opcode, payload) = orphan.readMessage();
+assert(opcode == 2);
+assert(payload == pattern(4000000));
+(opcode, payload) = orphan.readMessage();
+assert(opcode == 8);
+assert(orphan.atEnd());
+delete orphan;
+
+// Clients that close without a handshake.
+
+delete slow;
+delete other;
+assert(waitForEnd(slowServer));
+assert(waitForEnd(otherServer));
+lock (slowServer.record) {
+	assert(!sawClose);
+}
+delete slowServer.socket;
+delete otherServer.socket;
+
+server.stop();
+server.wait();
+lock (servers) {
+	listeners.deleteAll();
+}
+
+ref<ServerListener> listener(int index) {
+	lock (servers) {
+		assert(index < listeners.length());
+		return listeners[index];
+	}
+}
+
+boolean waitForEnd(ref<ServerListener> listener) {
+	for (int i = 0; i < 10000; i++) {
+		lock (listener.record) {
+			if (ended)
+				return true;
+		}
+		thread.sleep(1);
+	}
+	return false;
+}
+
+boolean waitForDelete(ref<ServerListener> listener) {
+	for (int i = 0; i < 10000; i++) {
+		lock (listener.record) {
+			if (deleted)
+				return true;
+		}
+		thread.sleep(1);
+	}
+	return false;
+}
+
+boolean waitForMessage(ref<ServerListener> listener, string message) {
+	for (int i = 0; i < 10000; i++) {
+		lock (listener.record) {
+			for (j in received)
+				if (received[j] == message)
+					return true;
+		}
+		thread.sleep(1);
+	}
+	return false;
+}
+
+int sizeAfterColon(string text) {
+	string digits = text.substr(text.indexOf(':') + 1);
+	int n;
+	boolean success;
+	(n, success) = int.parse(digits);
+	assert(success);
+	return n;
+}
+
+string pattern(int length) {
+	string s;
+	s.resize(length);
+	for (int i = 0; i < length; i++)
+		s[i] = byte(i * 7 + i / 251);
+	return s;
+}
+/*
+ * A masked frame, as a client sends it.
+ */
+string frame(int opcode, boolean fin, string payload) {
+	string f;
+	f.append(byte(opcode | (fin ? 0x80 : 0)));
+	int n = payload.length();
+	if (n > 65535) {
+		f.append(byte(0x80 | 127));
+		for (int i = 0; i < 4; i++)
+			f.append(byte(0));
+		f.append(byte(n >> 24));
+		f.append(byte(n >> 16));
+		f.append(byte(n >> 8));
+		f.append(byte(n));
+	} else if (n > 125) {
+		f.append(byte(0x80 | 126));
+		f.append(byte(n >> 8));
+		f.append(byte(n));
+	} else
+		f.append(byte(0x80 | n));
+	unsigned mask = 0x37fa213d;
+	f.append(byte(mask >> 24));
+	f.append(byte(mask >> 16));
+	f.append(byte(mask >> 8));
+	f.append(byte(mask));
+	for (int i = 0; i < n; i++)
+		f.append(byte(payload[i] ^ byte(mask >> (24 - 8 * (i % 4)))));
+	return f;
+}
+/*
+ * Connect, send the upgrade request followed by the early bytes and read the server's 101 response.
+ */
+ref<Peer> open(char port, boolean smallBuffer, string early) {
+	int fd = net.socket(net.AF_INET, net.SOCK_STREAM, 0);
+	assert(fd >= 0);
+	if (smallBuffer) {
+		// The server's writes then fill the socket buffers sooner.
+		int size = 4096;
+		assert(net.setsockopt(fd, net.SOL_SOCKET, net.SO_RCVBUF, &size, size.bytes) == 0);
+	}
+	net.sockaddr_in address;
+	address.sin_family = net.AF_INET;
+	address.sin_port = net.htons(port);
+	address.sin_addr.s_addr = net.inet_addr("127.0.0.1".c_str());
+	assert(net.connect(fd, &address, address.bytes) == 0);
+	ref<Peer> p = new Peer(fd);
+	p.send("GET /ws HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n" +
+			"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n" +
+			"Sec-WebSocket-Protocol: test\r\n\r\n" + early);
+	string header = p.readHeader();
+	assert(header.startsWith("HTTP/1.1 101"));
+	assert(header.indexOf("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") > 0);
+	return p;
+}
+/*
+ * The client end of a Web Socket.
+ */
+class Peer {
+	int _fd;
+	string _data;			// Bytes received and not yet parsed start at _cursor
+	int _cursor;
+
+	Peer(int fd) {
+		_fd = fd;
+	}
+
+	~Peer() {
+		net.closesocket(_fd);
+	}
+
+	void send(string data) {
+		assert(net.send(_fd, &data[0], data.length(), net.MSG_NOSIGNAL) == data.length());
+	}
+
+	void sendMessage(string text) {
+		send(frame(1, true, text));
+	}
+
+	string readHeader() {
+		int end;
+		while ((end = _data.indexOf("\r\n\r\n")) < 0)
+			assert(fill());
+		_cursor = end + 4;
+		return _data.substr(0, end);
+	}
+
+	string readText() {
+		int opcode;
+		string message;
+		(opcode, message) = readMessage();
+		assert(opcode == 1);
+		return message;
+	}
+	/*
+	 * Read a data message, joining its fragments, or a control frame.
+	 */
+	int, string readMessage() {
+		int opcode;
+		boolean fin;
+		string payload;
+		(opcode, fin, payload) = readFrame();
+		if (opcode >= 8)
+			return opcode, payload;
+		while (!fin) {
+			int continuation;
+			string more;
+			(continuation, fin, more) = readFrame();
+			assert(continuation == 0);
+			payload.append(more);
+		}
+		return opcode, payload;
+	}
+
+	int, boolean, string readFrame() {
+		while (available() < 2)
+			assert(fill());
+		int b0 = _data[_cursor];
+		int b1 = _data[_cursor + 1];
+		assert((b1 & 0x80) == 0);			// A server does not mask its frames
+		int length = b1 & 0x7f;
+		int headerLength = 2;
+		if (length == 126)
+			headerLength = 4;
+		else if (length == 127)
+			headerLength = 10;
+		while (available() < headerLength)
+			assert(fill());
+		if (length == 126)
+			length = (_data[_cursor + 2] << 8) + _data[_cursor + 3];
+		else if (length == 127) {
+			length = 0;
+			for (int i = 6; i < 10; i++)
+				length = (length << 8) + _data[_cursor + i];
+		}
+		while (available() < headerLength + length)
+			assert(fill());
+		string payload;
+		if (length > 0)
+			payload = string(&_data[_cursor + headerLength], length);
+		_cursor += headerLength + length;
+		return b0 & 0x0f, (b0 & 0x80) != 0, payload;
+	}
+	/*
+	 * @return true if the server has closed the connection and every byte it sent has been read.
+	 */
+	boolean atEnd() {
+		return available() == 0 && !fill();
+	}
+
+	private int available() {
+		return _data.length() - _cursor;
+	}
+
+	private boolean fill() {
+		if (_cursor > 0) {
+			string rest = _data.substr(_cursor);
+			_data = rest;
+			_cursor = 0;
+		}
+		byte[] buffer;
+		buffer.resize(65536);
+		int actual = net.recv(_fd, &buffer[0], buffer.length(), 0);
+		if (actual <= 0)
+			return false;
+		_data.append(&buffer[0], actual);
+		return true;
+	}
+}
@@ -0,0 +1,85 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:exception.DivideByZeroException;
+
+// Exceptions thrown through many frames, from several kinds of frames, must reach the right handler.
+
+for (int depth = 0; depth < 300; depth += 7) {
+	try {
+		throwAt(depth);
+		assert(false);
+	} catch (Exception e) {
+		assert(e.message() == "depth");
+	}
+}
+
+assert(catchAt(50, 20) == 20);
+assert(catchAt(20, 20) == 20);
+assert(catchAt(5, 0) == 0);
+
+try {
+	divideAt(30, 0);
+	assert(false);
+} catch (DivideByZeroException e) {
+}
+
+int rethrows;
+try {
+	rethrowAt(40);
+	assert(false);
+} catch (Exception e) {
+	assert(e.message() == "depth");
+}
+assert(rethrows == 40);
+
+void throwAt(int depth) {
+	if (depth == 0)
+		throw Exception("depth");
+	throwAt(depth - 1);
+}
+/*
+ * Recurses to depth, catching at handlerDepth.
+ *
+ * RETURNS: The depth of the frame that caught the exception.
+ */
+int catchAt(int depth, int handlerDepth) {
+	if (depth == handlerDepth) {
+		try {
+			throwAt(depth);
+		} catch (Exception e) {
+			return depth;
+		}
+		return -1;
+	}
+	return catchAt(depth - 1, handlerDepth);
+}
+
+int divideAt(int depth, int divisor) {
+	if (depth == 0)
+		return 10 / divisor;
+	return divideAt(depth - 1, divisor) + 1;
+}
+
+void rethrowAt(int depth) {
+	if (depth == 0)
+		throw Exception("depth");
+	try {
+		rethrowAt(depth - 1);
+	} catch (Exception e) {
+		rethrows++;
+		throw e;
+	}
+}
@@ -0,0 +1,170 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:rpc;
+import native:C;
+
+// Temporaries whose lifetimes do not overlap share stack slots. A temporary that is read before anything is
+// stored in it counts on the zeroed frame, so it must get a slot of its own. The generated RPC proxy and stub
+// code does this when it unmarshals a vector or map. Temporaries created in one arm of a conditional
+// expression must not disturb the other arm or the temporaries that follow.
+
+interface Shapes {
+	int[], string[] split(string[] words, int[string] counts);
+	string[string] firstWords(string[] words, int[] lengths);
+}
+
+class ShapesImpl implements Shapes {
+	int[], string[] split(string[] words, int[string] counts) {
+		int[] lengths;
+		string[] keys;
+		for (i in words)
+			lengths.append(words[i].length());
+		for (key in counts)
+			keys.append(key + "=" + string(counts[key]));
+		keys.sort();
+		return lengths, keys;
+	}
+
+	string[string] firstWords(string[] words, int[] lengths) {
+		string[string] result;
+		for (i in words)
+			result[words[i].substr(0, 1)] = words[i];
+		for (i in lengths)
+			result[string(lengths[i])] = "length";
+		return result;
+	}
+}
+/*
+ * Carries calls straight to the stub of the interface, with no network in between.
+ */
+class LoopbackTransport extends rpc.ClientTransport {
+	Shapes _object;
+	byte[] _arguments;
+	byte[] _returns;
+
+	LoopbackTransport(Shapes object) {
+		_object = object;
+	}
+
+	ref<byte[]> startCall(substring methodID) {
+		_arguments.resize(methodID.length());
+		C.memcpy(&_arguments[0], methodID.c_str(), methodID.length());
+		return &_arguments;
+	}
+
+	pointer<byte> call(ref<byte[]> serializedArguments) {
+		int index;
+		for (index = 0; (*serializedArguments)[index] != ';'; index++)
+			;
+		rpc.StubParams params;
+		params.methodID = substring(pointer<byte>(&(*serializedArguments)[0]), index);
+		pointer<byte> pb = &(*serializedArguments)[index + 1];
+		params.arguments = &pb;
+		_returns.clear();
+		params.output = &_returns;
+		assert(Shapes.stub(_object, &params));
+		_returns.append(0);
+		return &_returns[0];
+	}
+
+	void endCall(ref<byte[]> serializedArguments) {
+	}
+}
+
+ShapesImpl impl;
+LoopbackTransport transport(&impl);
+Shapes proxy = Shapes.proxy(&transport);
+
+for (int round = 0; round < 3; round++) {
+	string[] words = [ "alpha", "beta", "gamma" ];
+	int[string] counts;
+	counts["x"] = round;
+	counts["y"] = 2;
+	int[] lengths;
+	string[] keys;
+	(lengths, keys) = proxy.split(words, counts);
+	assert(lengths.length() == 3);
+	assert(lengths[0] == 5 && lengths[1] == 4 && lengths[2] == 5);
+	assert(keys.length() == 2);
+	assert(keys[0] == "x=" + string(round));
+	assert(keys[1] == "y=2");
+
+	string[string] firstWord = proxy.firstWords(words, lengths);
+	assert(firstWord.size() == 5);
+	assert(firstWord["b"] == "beta");
+	assert(firstWord["4"] == "length");
+}
+delete proxy;
+
+string name(int i) {
+	return "name" + string(i);
+}
+
+string, int pair(int i) {
+	return "pair" + string(i), i;
+}
+
+class Holder {
+	string s;
+
+	string get() {
+		return s;
+	}
+}
+
+int conditionals(boolean take, int i) {
+	string a = name(i) + "/" + name(i + 1);
+	int total = a.length();
+	total += take ? (name(i) + "+").length() : 0;
+	string s;
+	int n;
+	(s, n) = pair(i);
+	total += s.length() + n;
+	string b = take ? name(i) : "none";
+	total += b.length();
+	Holder h;
+	h.s = "held";
+	total += (take ? h.get() : h.s + "!").length();
+	total += (take ? name(i) + "!" : h.get()).length();
+	string c = !take ? a + b : s + a;
+	total += c.length();
+	return total;
+}
+
+int expected(boolean take, int i) {
+	string a = name(i) + "/" + name(i + 1);
+	string s = "pair" + string(i);
+	string b;
+	int total = a.length() + s.length() + i;
+	if (take) {
+		b = name(i);
+		total += name(i).length() + 1;
+		total += 4;
+		total += name(i).length() + 1;
+		total += s.length() + a.length();
+	} else {
+		b = "none";
+		total += 5;
+		total += 4;
+		total += a.length() + b.length();
+	}
+	return total + b.length();
+}
+
+for (int i = 0; i < 100; i++) {
+	boolean take = i % 3 != 0;
+	assert(conditionals(take, i) == expected(take, i));
+}
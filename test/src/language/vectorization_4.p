@@ -0,0 +1,127 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// Vectors long enough to exercise the packed main loops, plus odd lengths that leave scalar tails.
+int N = 1003;
+
+int[] ia, ib, ic;
+long[] la, lb, lc;
+float[] fa, fb, fc;
+double[] da, db, dc;
+
+for (int i = 0; i < N; i++) {
+	ia.append(i * 7 - 3000);
+	ib.append(i % 13 + 1);
+	la.append(long(i) * 0x100000001 - 5);
+	lb.append(i % 17 - 8);
+	fa.append(i * 0.25f);
+	fb.append(i % 5 + 0.5f);
+	da.append(i * 1.5);
+	db.append(i % 7 + 0.25);
+}
+
+ic = ia + ib;
+assert(ic.length() == N);
+for (int i = 0; i < N; i++)
+	assert(ic[i] == ia[i] + ib[i]);
+
+ic = ia * ib;
+for (int i = 0; i < N; i++)
+	assert(ic[i] == ia[i] * ib[i]);
+
+lc = la - lb;
+assert(lc.length() == N);
+for (int i = 0; i < N; i++)
+	assert(lc[i] == la[i] - lb[i]);
+
+lc = la * lb;
+for (int i = 0; i < N; i++)
+	assert(lc[i] == la[i] * lb[i]);
+
+fc = fa / fb;
+assert(fc.length() == N);
+for (int i = 0; i < N; i++)
+	assert(fc[i] == fa[i] / fb[i]);
+
+dc = da * db;
+assert(dc.length() == N);
+for (int i = 0; i < N; i++)
+	assert(dc[i] == da[i] * db[i]);
+
+// A single element operand is combined with every element.
+
+double scale = 3.0;
+dc = da * scale;
+for (int i = 0; i < N; i++)
+	assert(dc[i] == da[i] * 3.0);
+
+dc = scale - db;
+for (int i = 0; i < N; i++)
+	assert(dc[i] == 3.0 - db[i]);
+
+// The destination may also be an operand.
+
+ia = ia + ib;
+for (int i = 0; i < N; i++)
+	assert(ia[i] == i * 7 - 3000 + ib[i]);
+
+// Sums and dot products.
+
+int isum = +=ib;
+int iexpected = 0;
+for (int i = 0; i < N; i++)
+	iexpected += ib[i];
+assert(isum == iexpected);
+
+long ldot = +=(la * lb);
+long lexpected = 0;
+for (int i = 0; i < N; i++)
+	lexpected += la[i] * lb[i];
+assert(ldot == lexpected);
+
+// The values are small whole numbers, so the floating point sums are exact in any order.
+
+double ddot = +=(db * db);
+double dexpected = 0;
+for (int i = 0; i < N; i++)
+	dexpected += db[i] * db[i];
+assert(ddot == dexpected);
+
+float fsum = +=fb;
+float fexpected = 0;
+for (int i = 0; i < N; i++)
+	fexpected += fb[i];
+assert(fsum == fexpected);
+
+// Operands of different lengths repeat, which the element by element loop handles.
+
+int[] short;
+short.append(10);
+short.append(20);
+short.append(30);
+
+ic = ib + short;
+assert(ic.length() == N);
+for (int i = 0; i < N; i++)
+	assert(ic[i] == ib[i] + short[i % 3]);
+
+// Empty vectors.
+
+double[] empty1, empty2, empty3;
+
+empty3 = empty1 + empty2;
+assert(empty3.length() == 0);
+double nothing = +=empty1;
+assert(nothing == 0);
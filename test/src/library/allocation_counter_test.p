@@ -0,0 +1,84 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:memory;
+import parasol:thread.Thread;
+import native:C;
+
+class CountingAllocator extends memory.Allocator {
+	public address alloc(long n) {
+		return C.calloc(n, 1);
+	}
+
+	public void free(address p) {
+		C.free(p);
+	}
+
+	public void clear() {
+	}
+}
+
+// Several threads allocating through one counter at once must not lose any counts.
+
+int THREADS = 4;
+int ROUNDS = 20000;
+
+CountingAllocator counting;
+memory.AllocationCounter counter(&counting);
+
+ref<Thread>[] threads;
+for (int j = 0; j < THREADS; j++) {
+	ref<Thread> t = new Thread();
+	t.start(hammer, null);
+	threads.append(t);
+}
+for (int j = 0; j < THREADS; j++) {
+	threads[j].join();
+	delete threads[j];
+}
+assert(counter.allocations() == THREADS * ROUNDS);
+assert(counter.allocatedBytes() == THREADS * ROUNDS * 24);
+
+// The process heap is counted until each call to countAllocations has been matched by a call to
+// stopCountingAllocations.
+
+ref<memory.AllocationCounter> heapCounter = memory.countAllocations();
+assert(memory.countAllocations() == heapCounter);
+long before = heapCounter.allocations();
+ref<int> p = new int;
+delete p;
+assert(heapCounter.allocations() == before + 1);
+memory.stopCountingAllocations();
+p = new int;
+delete p;
+assert(heapCounter.allocations() == before + 2);
+memory.stopCountingAllocations();
+before = heapCounter.allocations();
+p = new int;
+delete p;
+assert(heapCounter.allocations() == before);
+
+// Counting can start again.
+
+assert(memory.countAllocations() == heapCounter);
+p = new int;
+delete p;
+assert(heapCounter.allocations() == before + 1);
+memory.stopCountingAllocations();
+
+void hammer(address parameter) {
+	for (int j = 0; j < ROUNDS; j++)
+		counter.free(counter.alloc(24));
+}
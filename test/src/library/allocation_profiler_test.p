@@ -0,0 +1,89 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:runtime;
+import parasol:memory;
+import parasol:storage;
+import native:C;
+
+class CountingAllocator extends memory.Allocator {
+	int blocks;
+
+	public address alloc(long n) {
+		blocks++;
+		return C.calloc(n, 1);
+	}
+
+	public void free(address p) {
+		if (p != null)
+			blocks--;
+		C.free(p);
+	}
+
+	public void clear() {
+	}
+}
+
+CountingAllocator counting;
+string path = storage.absolutePath("allocation_profiler_test.txt");
+
+// With an interval of 100 bytes, every 100-byte allocation is sampled.
+
+memory.AllocationProfiler ap(&counting, path, 100, 0);
+assert(ap.interval() == 100);
+
+address[] kept;
+for (int i = 0; i < 10; i++)
+	kept.append(allocate(100));
+for (int i = 0; i < 5; i++)
+	ap.free(allocate(100));
+assert(counting.blocks == 10);
+
+ap.write();
+string profile = readProfile();
+assert(profile.startsWith("15 samples, one per 100 bytes allocated\n"));
+assert(profile.indexOf("1000 live bytes in 10 blocks, 1500 bytes allocated in 15 blocks") > 0);
+// The largest live site comes first, labeled with the line that allocated it.
+string[] lines = profile.split('\n');
+assert(lines[4].indexOf("1000") > 0);
+assert(lines[4].endsWith("allocation_profiler_test.p 49"));
+assert(lines[5].indexOf("500") > 0);
+assert(lines[5].endsWith("allocation_profiler_test.p 51"));
+
+// Blocks larger than the interval are always sampled, and stand for themselves.
+
+for (i in kept)
+	ap.free(kept[i]);
+ap.free(allocate(1000));
+ap.write();
+profile = readProfile();
+assert(profile.indexOf("0 live bytes in 0 blocks, 2500 bytes allocated in 16 blocks") > 0);
+assert(counting.blocks == 0);
+
+storage.deleteFile(path);
+/*
+ * Stands in for memory.alloc, whose frame the profiler skips along with its own.
+ */
+address allocate(long n) {
+	return ap.alloc(n);
+}
+
+string readProfile() {
+	ref<Reader> r = storage.openTextFile(path);
+	assert(r != null);
+	string s = r.readAll();
+	delete r;
+	return s;
+}
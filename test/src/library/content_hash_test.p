@@ -0,0 +1,66 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:compiler;
+import parasol:context;
+import parasol:storage;
+
+// The published FNV-1a 64 test vectors.
+
+storage.ContentHash empty;
+assert(empty.toString() == "cbf29ce484222325");
+
+string a = "a";
+storage.ContentHash ha;
+ha.add(&a[0], a.length());
+assert(ha.toString() == "af63dc4c8601ec8c");
+
+string foobar = "foobar";
+storage.ContentHash hf;
+hf.add(&foobar[0], 3);
+hf.add(&foobar[3], 3);
+assert(hf.toString() == "85944171f73967e8");
+
+// Strings are terminated, so the split between them matters.
+
+storage.ContentHash s1;
+s1.add("ab");
+s1.add("c");
+storage.ContentHash s2;
+s2.add("a");
+s2.add("bc");
+assert(s1.toString() == "ad22872f536e4705");
+assert(s2.toString() == "401801fc84f3ca79");
+
+string path;
+ref<storage.FileWriter> w;
+(path, w) = storage.createTempFile("contentHashXXXXXX");
+w.write("hello, world\n");
+delete w;
+
+long hash;
+boolean success;
+(hash, success) = storage.contentHash(path);
+assert(success);
+assert(hash == 0xe60e7ee648829675);
+
+storage.deleteFile(path);
+(hash, success) = storage.contentHash(path);
+assert(!success);
+
+// An empty cache has no entries.
+
+compiler.CompileCache cache(path + ".cache", "no such program");
+assert(cache.lookup(context.getActiveContext()) == null);
@@ -0,0 +1,68 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:runtime;
+import parasol:storage;
+
+string path;
+ref<storage.FileWriter> w;
+(path, w) = storage.createTempFile("coverageXXXXXX");
+delete w;
+
+// Counts recorded for the same line keep the largest.
+runtime.CoverageTables run;
+run.record("a.p", 3, 5);
+run.record("a.p", 3, 2);
+run.record("a.p", 4, 0);
+run.record("a.p", 7, 0);
+run.record("b.p", 1, 1);
+assert(run.count("a.p", 3) == 5);
+assert(run.count("a.p", 4) == 0);
+assert(run.count("a.p", 5) == -1);
+assert(run.count("c.p", 1) == -1);
+
+int lines, covered;
+(lines, covered) = run.summary("a.p");
+assert(lines == 3);
+assert(covered == 1);
+
+// An empty (just created) file reads as no counts, and runs accumulate.
+runtime.CoverageTables accumulated;
+assert(accumulated.read(path));
+accumulated.add(&run);
+accumulated.add(&run);
+assert(accumulated.write(path));
+
+runtime.CoverageTables reread;
+assert(reread.read(path));
+assert(reread.count("a.p", 3) == 10);
+assert(reread.count("a.p", 4) == 0);
+assert(reread.count("b.p", 1) == 2);
+(lines, covered) = reread.summary("b.p");
+assert(lines == 1);
+assert(covered == 1);
+
+assert(reread.writeReport(path + ".report"));
+ref<Reader> r = storage.openTextFile(path + ".report");
+assert(r != null);
+string report = r.readAll();
+delete r;
+printf("%s", report);
+assert(report.indexOf("2 of 4 lines covered") == 0);
+assert(report.indexOf("a.p not covered: 4-7") > 0);
+assert(report.indexOf("b.p not covered") < 0);
+
+storage.deleteFile(path);
+storage.deleteFile(path + ".report");
@@ -0,0 +1,80 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:runtime;
+import parasol:storage;
+import parasol:time;
+
+string path;
+ref<storage.FileWriter> w;
+(path, w) = storage.createTempFile("profileXXXXXX");
+delete w;
+
+ref<runtime.ProfileTables> tables = new runtime.ProfileTables(path);
+ref<runtime.Profiler> profiler = tables.startProfiler();
+assert(profiler != null);
+
+time.Instant start = time.Clock.MONOTONIC.get();
+double x;
+while (profiler.samples() < 20) {
+	x += spin(100000);
+	time.Duration d = time.Instant.elapsed(start, time.Clock.MONOTONIC.get());
+	assert(d.seconds() < 30);
+}
+printf("%d samples, x = %g\n", profiler.samples(), x);
+tables.write();
+delete profiler;
+
+ref<Reader> r = storage.openTextFile(path);
+assert(r != null);
+string folded = r.readAll();
+delete r;
+string[] lines = folded.split('\n');
+long total;
+boolean sawSpin;
+for (i in lines) {
+	if (lines[i].length() == 0)
+		continue;
+	int space = lines[i].lastIndexOf(' ');
+	assert(space > 0);
+	long count;
+	boolean success;
+	(count, success) = long.parse(lines[i].substr(space + 1));
+	assert(success);
+	assert(count > 0);
+	total += count;
+	if (lines[i].indexOf("profiler_test.p:") >= 0)
+		sawSpin = true;
+}
+assert(total >= 20);
+assert(sawSpin);
+
+r = storage.openTextFile(path + ".report");
+assert(r != null);
+string report = r.readAll();
+delete r;
+assert(report.indexOf(" samples") > 0);
+assert(report.indexOf("profiler_test.p:") > 0);
+
+storage.deleteFile(path);
+storage.deleteFile(path + ".report");
+delete tables;
+
+double spin(int n) {
+	double y;
+	for (int i = 0; i < n; i++)
+		y += i * 0.5;
+	return y;
+}
@@ -0,0 +1,156 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:storage;
+import parasol:stream;
+import parasol:text;
+
+// Every Reader must give the same answers whether it overrides the span methods or not.
+
+string content = "first\r\nsecond\n\nfourth line is longer\rstill\nlast";
+
+void checkLines(ref<stream.Reader> r) {
+	assert(r.readLine() == "first");
+	assert(r.readLine() == "second");
+	assert(r.readLine() == "");
+	assert(r.readLine() == "fourth line is longerstill");
+	assert(r.readLine() == "last");
+	assert(r.readLine() == null);
+}
+
+void checkRead(ref<stream.Reader> r) {
+	byte[] buffer;
+	buffer.resize(10);
+	assert(r.read(&buffer) == 10);
+	assert(string(&buffer[0], 10) == "first\r\nsec");
+	string rest;
+	rest.resize(content.length());
+	long n = r.read(&rest[0], rest.length());
+	assert(n == content.length() - 10);
+	rest.resize(int(n));
+	assert(rest == content.substr(10));
+	assert(r.read(&buffer) == 0);
+}
+
+void checkSpans(ref<stream.Reader> r) {
+	string copy;
+	for (;;) {
+		substring span = r.peek();
+		if (span.length() == 0)
+			break;
+		// Consume only part of a long span to check that the rest stays available.
+		int n = span.length() > 3 ? 3 : span.length();
+		copy.append(substring(span.c_str(), n));
+		r.consume(n);
+	}
+	assert(copy == content);
+	assert(r.read() == stream.EOF);
+}
+
+// A Reader that only implements the required methods, so it exercises the defaults.
+
+class ByteReader extends stream.Reader {
+	ref<string> _source;
+	int _cursor;
+
+	ByteReader(ref<string> source) {
+		_source = source;
+	}
+
+	public int _read() {
+		if (_cursor >= _source.length())
+			return stream.EOF;
+		return (*_source)[_cursor++];
+	}
+
+	public void unread() {
+		if (_cursor > 0)
+			_cursor--;
+	}
+}
+
+{
+	ByteReader r(&content);
+	checkLines(&r);
+	ByteReader r2(&content);
+	checkRead(&r2);
+	ByteReader r3(&content);
+	checkSpans(&r3);
+}
+{
+	text.StringReader r(&content);
+	checkLines(&r);
+	r.reset();
+	checkRead(&r);
+	r.reset();
+	checkSpans(&r);
+}
+{
+	substring s(content);
+	text.SubstringReader r(&s);
+	checkLines(&r);
+	r.reset();
+	checkRead(&r);
+	r.reset();
+	checkSpans(&r);
+}
+{
+	stream.BufferReader r(&content[0], content.length());
+	checkLines(&r);
+	r.reset();
+	checkRead(&r);
+	r.reset();
+	checkSpans(&r);
+}
+
+string path;
+ref<storage.FileWriter> w;
+(path, w) = storage.createTempFile("readerTestXXXXXX");
+w.write(content);
+delete w;
+
+ref<storage.FileReader> f = storage.openBinaryFile(path);
+checkLines(f);
+f.reset();
+checkRead(f);
+f.reset();
+checkSpans(f);
+f.reset();
+// Unread still works after a span has been consumed.
+f.consume(f.peek().length() - 1);
+assert(f.read() == 't');
+f.unread();
+assert(f.read() == 't');
+assert(f.read() == stream.EOF);
+delete f;
+
+// A large read bypasses the FileReader's buffer.
+
+w = storage.createBinaryFile(path);
+string big;
+for (int i = 0; i < 200000; i++)
+	big.append(byte('a' + i % 26));
+w.write(big);
+delete w;
+f = storage.openBinaryFile(path);
+assert(f.read() == 'a');
+string copy;
+copy.resize(big.length());
+copy[0] = 'a';
+assert(f.read(&copy[1], big.length()) == big.length() - 1);
+assert(copy == big);
+delete f;
+
+storage.deleteFile(path);
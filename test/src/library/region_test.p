@@ -0,0 +1,110 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:memory;
+
+memory.Region r;
+
+// Blocks are cleared, aligned and distinct.
+
+pointer<byte>[] blocks;
+for (int size = 0; size <= 20000; size += 37) {
+	pointer<byte> p = pointer<byte>(r.alloc(size));
+	assert((long(p) & 15) == 0);
+	for (int i = 0; i < size; i++) {
+		assert(p[i] == 0);
+		p[i] = 0xa5;
+	}
+	blocks.append(p);
+}
+for (i in blocks) {
+	int size = i * 37;
+	for (int j = 0; j < size; j++)
+		assert(blocks[i][j] == 0xa5);
+}
+assert(r.allocated() > 5000000);
+
+// Freeing memory from the region does nothing, memory from the heap is passed on to it.
+
+r.free(blocks[10]);
+address h = memory.alloc(100);
+r.free(h);
+
+r.reset();
+assert(r.allocated() == 0);
+pointer<byte> p = pointer<byte>(r.alloc(64));
+for (int i = 0; i < 64; i++)
+	assert(p[i] == 0);
+
+// The thread allocator serves new and delete. Everything allocated from the region is gone before it is cleared.
+
+assert(memory.threadAllocator() == null);
+useRegion(&r);
+assert(memory.threadAllocator() == null);
+
+r.clear();
+assert(r.allocated() == 0);
+
+void useRegion(ref<memory.Region> r) {
+	string before = "before";
+	before.append(" the region");
+	assert(memory.setThreadAllocator(r) == null);
+	assert(memory.threadAllocator() == r);
+	long used = r.allocated();
+	string s;
+	for (int i = 0; i < 1000; i++)
+		s.printf("%d,", i);
+	ref<int[]> a = new int[];
+	for (int i = 0; i < 1000; i++)
+		a.append(i);
+	before = "replaced";				// frees a block from the heap
+	assert(r.allocated() > used + 4000);
+	delete a;
+	assert(s.length() == 3890);
+	assert(before == "replaced");
+	s = null;
+	before = null;
+	assert(memory.setThreadAllocator(null) == r);
+}
+
+// Frees of memory in abandoned blocks are ignored, even after the Region is reused.
+
+address small = r.alloc(100);
+address large = r.alloc(100000);
+r.abandon();
+assert(r.allocated() == 0);
+address reused = r.alloc(100);
+r.free(small);
+r.free(large);
+r.free(pointer<byte>(large) + 5000);
+r.reset();
+r.free(small);
+r.free(large);
+
+// Lookups find every block among many, and still pass heap memory on.
+
+pointer<byte>[] many;
+address[] heap;
+for (int i = 0; i < 200; i++) {
+	many.append(pointer<byte>(r.alloc(i % 3 == 0 ? 30000 : 2000)));
+	heap.append(memory.alloc(32));
+}
+for (i in many) {
+	r.free(many[i]);
+	r.free(many[i] + 1000);
+}
+for (i in heap)
+	r.free(heap[i]);
+r.clear();
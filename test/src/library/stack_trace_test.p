@@ -0,0 +1,78 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:runtime;
+
+// A captured stack trace names the capturing function's caller first.
+
+runtime.StackTrace trace;
+captureIn(3, &trace);
+assert(trace.length() >= 4);
+string text = trace.text();
+string[] lines = text.split('\n');
+for (int i = 0; i < 4; i++)
+	assert(lines[i].indexOf("stack_trace_test.p") >= 0);
+// Symbolizing the same frames again comes from the cache and must give the same text.
+assert(trace.text() == text);
+
+string s = runtime.stackTrace();
+assert(s.indexOf("stack_trace_test.p") >= 0);
+
+// The trace of an exception is captured when it is thrown, so it is still correct after the
+// stack where it was thrown has been re-used.
+
+ref<Exception> e = catchFrom(5);
+clobber(20);
+string exceptionTrace = e.textStackTrace();
+lines = exceptionTrace.split('\n');
+int throwerFrames;
+for (i in lines)
+	if (lines[i].indexOf("stack_trace_test.p " + string(THROW_LINE) + " ") >= 0)
+		throwerFrames++;
+assert(throwerFrames == 1);
+assert(exceptionTrace == e.textStackTrace());
+delete e;
+
+@Constant
+int THROW_LINE = 69;
+
+void captureIn(int depth, ref<runtime.StackTrace> trace) {
+	if (depth == 0)
+		trace.capture(0);
+	else
+		captureIn(depth - 1, trace);
+}
+
+ref<Exception> catchFrom(int depth) {
+	try {
+		throwFrom(depth);
+	} catch (Exception e) {
+		return e.clone();
+	}
+	return null;
+}
+
+void throwFrom(int depth) {
+	if (depth == 0)
+		throw Exception("thrown");			// THROW_LINE
+	throwFrom(depth - 1);
+}
+
+long clobber(int depth) {
+	long a = depth, b = depth * 2, c = depth * 3;
+	if (depth == 0)
+		return a;
+	return clobber(depth - 1) + a + b + c;
+}
@@ -0,0 +1,92 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:runtime;
+import parasol:memory;
+import parasol:thread;
+
+memory.ThreadCachingHeap h;
+
+assert(h.initialize());
+
+// Blocks are cleared, aligned and distinct, even when reused.
+
+pointer<byte>[] blocks;
+for (int size = 0; size <= 9000; size += 37) {
+	pointer<byte> p = pointer<byte>(h.alloc(size));
+	assert((long(p) & 15) == 0);
+	for (int i = 0; i < size; i++) {
+		assert(p[i] == 0);
+		p[i] = 0xa5;
+	}
+	blocks.append(p);
+}
+for (i in blocks)
+	h.free(blocks[i]);
+for (i in blocks) {
+	int size = i * 37;
+	pointer<byte> p = pointer<byte>(h.alloc(size));
+	for (int j = 0; j < size; j++)
+		assert(p[j] == 0);
+	blocks[i] = p;
+}
+for (i in blocks)
+	for (j in blocks)
+		if (i != j)
+			assert(blocks[i] != blocks[j]);
+
+// The heap accounts for the blocks held by this thread.
+
+memory.SizeClassStatistics[] stats = h.statistics();
+assert(stats.length() == 36);
+assert(stats[0].blockSize == 16);
+assert(stats[stats.length() - 1].blockSize == 8192);
+long inUse;
+for (i in stats) {
+	if (i > 0)
+		assert(stats[i].blockSize > stats[i - 1].blockSize);
+	assert(stats[i].blocksCached <= stats[i].blocksInUse);
+	inUse += stats[i].blocksInUse - stats[i].blocksCached;
+}
+assert(inUse == 222);			// The blocks of 8192 bytes or less
+
+for (i in blocks)
+	h.free(blocks[i]);
+
+// Blocks freed by another thread return to the classes when it exits, and the spans they
+// empty are released.
+
+h.setRetainedBytes(0);
+long released = h.releasedSpans();
+
+pointer<address> shared = pointer<address>(h.alloc(4000 * address.bytes));
+for (int i = 0; i < 4000; i++)
+	shared[i] = h.alloc(48);
+
+void freeAll(address arg) {
+	pointer<address> a = pointer<address>(arg);
+	for (int i = 0; i < 4000; i++)
+		h.free(a[i]);
+}
+
+thread.Thread t;
+t.start(freeAll, shared);
+t.join();
+h.free(shared);
+
+stats = h.statistics();
+assert(stats[2].blockSize == 48);
+assert(stats[2].blocksInUse == stats[2].blocksCached);
+assert(h.releasedSpans() > released);
@@ -0,0 +1,172 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:json;
+import parasol:pbuild;
+import parasol:process;
+import parasol:storage;
+
+// Builds small trees of make-driven products with the build Coordinator. A package starts only after the
+// products it includes have finished. A failed product, or one that cannot be started at all, fails the
+// build without stalling it, and leaves no duration in the build history.
+
+class BuildCommand extends process.Command {
+	pbuild.BuildOptions buildOptions;
+
+	BuildCommand() {
+		finalArguments(0, int.MAX_VALUE, "[ products ... ]");
+		buildOptions.buildDirOption = stringOption('d', "dir", "");
+		buildOptions.buildFileOption = stringOption('f', "file", "");
+		buildOptions.outputDirOption = stringOption('o', "out", "");
+		buildOptions.buildThreadsOption = integerOption('t', "threads", "");
+	}
+}
+
+string MAKEFILE = "build/slow:\n" +
+				  "\tsleep 0.3\n" +
+				  "\tmkdir -p build && echo slow > build/slow\n" +
+				  "build/fast:\n" +
+				  "\tmkdir -p build && echo fast > build/fast\n" +
+				  "build/broken:\n" +
+				  "\tfalse\n";
+
+string dir;
+ref<storage.FileWriter> w;
+(dir, w) = storage.createTempFile("coordinatorXXXXXX");
+delete w;
+storage.deleteFile(dir);
+
+// The package copies the output of the slow elf, so it must not start until the elf has been built.
+
+string ordered = storage.path(dir, "ordered");
+writeTree(ordered, "package(name: ordered:test.parasollanguage.org, manifest: false) {\n" +
+				   "\telf(name: slow, target: build/slow, makefile: makefile)\n" +
+				   "}\n" +
+				   "elf(name: fast, target: build/fast, makefile: makefile)\n");
+assert(build(ordered) == 0);
+ref<Event>[string] events = traceEvents(ordered);
+ref<Event> slow = events["elf slow"];
+ref<Event> pkg = events["package ordered:test.parasollanguage.org"];
+assert(slow != null && pkg != null && events["elf fast"] != null);
+assert(pkg.start >= slow.start + slow.duration);
+assert(recordedDuration(ordered, "elf slow") >= 300);
+assert(recordedDuration(ordered, "package ordered:test.parasollanguage.org") >= 0);
+
+// A failed elf fails the package that includes it, but the rest of the build finishes.
+
+string failing = storage.path(dir, "failing");
+writeTree(failing, "package(name: failing:test.parasollanguage.org, manifest: false) {\n" +
+				   "\telf(name: broken, target: build/broken, makefile: makefile)\n" +
+				   "}\n" +
+				   "elf(name: fast, target: build/fast, makefile: makefile)\n");
+assert(build(failing) != 0);
+assert(recordedDuration(failing, "elf broken") < 0);
+assert(recordedDuration(failing, "package failing:test.parasollanguage.org") < 0);
+assert(recordedDuration(failing, "elf fast") >= 0);
+
+// With the workers shut down, no product can be started. Each one fails instead of being waited for.
+
+string unscheduled = storage.path(dir, "unscheduled");
+writeTree(unscheduled, "package(name: unscheduled:test.parasollanguage.org, manifest: false) {\n" +
+					   "\telf(name: slow, target: build/slow, makefile: makefile)\n" +
+					   "}\n");
+assert(build(unscheduled, true) != 0);
+assert(recordedDuration(unscheduled, "elf slow") < 0);
+
+assert(storage.deleteDirectoryTree(dir));
+
+class Event {
+	long start;
+	long duration;
+}
+
+void writeTree(string directory, string buildFile) {
+	assert(storage.ensure(directory));
+	writeFile(storage.path(directory, "make.pbld"), buildFile);
+	writeFile(storage.path(directory, "makefile"), MAKEFILE);
+}
+
+void writeFile(string filename, string contents) {
+	w = storage.createTextFile(filename);
+	assert(w != null);
+	w.write(contents);
+	delete w;
+}
+
+int build(string directory) {
+	return build(directory, false);
+}
+
+int build(string directory, boolean shutdownWorkers) {
+	BuildCommand command;
+	string[] args = [ "-d", directory, "-f", storage.path(directory, "make.pbld"),
+					  "-o", storage.path(directory, "build"), "-t", "2" ];
+	assert(command.parse(args));
+	command.buildOptions.setOptionDefaults();
+	pbuild.Coordinator coordinator(&command.buildOptions);
+	assert(coordinator.validate());
+	if (shutdownWorkers)
+		coordinator.workers().shutdown();
+	return coordinator.run();
+}
+/*
+ * The trace events of the last build of a tree, by product name. Times are in microseconds.
+ */
+ref<Event>[string] traceEvents(string directory) {
+	ref<storage.FileReader> r = storage.openTextFile(storage.path(directory, "build/" + pbuild.TRACE_FILE));
+	assert(r != null);
+	var data;
+	boolean success;
+	(data, success) = json.parse(r.readAll());
+	delete r;
+	assert(success);
+	ref<Event>[string] events;
+	assert(data.class == ref<Object>);
+	var list = ref<Object>(data).get("traceEvents");
+	assert(list.class == ref<Array>);
+	for (i in *ref<Array>(list)) {
+		e := ref<Object>((*ref<Array>(list))[i]);
+		if (string(e.get("ph")) != "X")
+			continue;
+		ref<Event> event = new Event;
+		event.start = long(e.get("ts"));
+		event.duration = long(e.get("dur"));
+		events[string(e.get("name"))] = event;
+	}
+	json.dispose(data);
+	return events;
+}
+/*
+ * The duration the build history holds for a product, or -1 if it holds none.
+ */
+long recordedDuration(string directory, string product) {
+	ref<storage.FileReader> r = storage.openTextFile(storage.path(directory, "build/pbuild.history"));
+	assert(r != null);
+	long duration = -1;
+	for (;;) {
+		string line = r.readLine();
+		if (line == null)
+			break;
+		int first = line.indexOf(' ');
+		int second = line.indexOf(' ', first + 1);
+		if (first < 0 || second < 0 || line.substr(second + 1) != product)
+			continue;
+		boolean success;
+		(duration, success) = long.parse(line.substr(0, first));
+		assert(success);
+	}
+	delete r;
+	return duration;
+}
@@ -0,0 +1,225 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:exception.IllegalArgumentException;
+import parasol:exception.IOException;
+import parasol:http;
+import parasol:net;
+import parasol:rpc;
+import parasol:thread;
+import native:C;
+
+// Calls that fail. Over a Web Socket, a server method that throws is answered with an 'E' reply while other
+// calls are still waiting for theirs. Through a transport that counts its calls, a reply that cannot be
+// unmarshalled throws to the caller and still ends the call. This unit declares a class named Exception of its
+// own, which the generated code must not catch in place of parasol:exception.Exception.
+
+interface Upstream {
+	int echo(int value, int delay);
+	int fail(int value);
+}
+
+class ServerFactory extends rpc.WebSocketFactory<Upstream, rpc.NoMethods> {
+	public boolean notifyCreation(ref<http.Request> request, ref<rpc.WebSocket<Upstream, rpc.NoMethods>> socket) {
+		socket.setObject(&work);
+		return true;
+	}
+}
+
+class ServerWork implements Upstream {
+	int echo(int value, int delay) {
+		thread.sleep(delay);
+		return value;
+	}
+
+	int fail(int value) {
+		throw IllegalArgumentException("fail " + string(value));
+	}
+}
+
+ServerWork work;
+
+http.Server server;
+server.disableHttps();
+server.setHttpPort(0);
+http.WebSocketService service;
+service.webSocketProtocol("Failure", new ServerFactory());
+server.httpService("/ws", &service);
+server.start(net.ServerScope.LOCALHOST);
+
+rpc.Client<Upstream, rpc.NoMethods> client("ws://localhost:" + string(server.httpPort()) + "/ws", "Failure",
+											rpc.noMethods);
+Upstream up = client.proxy();
+assert(up != null);
+
+class Caller {
+	Upstream up;
+	int value;
+	int delay;
+	int result;
+}
+
+void callEcho(address arg) {
+	ref<Caller> c = ref<Caller>(arg);
+	c.result = c.up.echo(c.value, c.delay);
+}
+
+// Each round has five calls waiting, answered in the reverse of the order they were made, when a failing call
+// is made. Its reply overtakes theirs. The later rounds reuse the slots of the earlier ones.
+
+for (int round = 0; round < 3; round++) {
+	ref<Caller>[] callers;
+	ref<thread.Thread>[] threads;
+	for (int i = 0; i < 5; i++) {
+		ref<Caller> c = new Caller;
+		c.up = up;
+		c.value = round * 10 + i;
+		c.delay = 100 + (5 - i) * 20;
+		callers.append(c);
+		ref<thread.Thread> t = new thread.Thread();
+		t.start(callEcho, c);
+		threads.append(t);
+	}
+	thread.sleep(20);
+	for (int i = 0; i < 3; i++) {
+		try {
+			up.fail(i);
+			assert(false);
+		} catch (IOException e) {
+			assert(e.message() == "Call failed");
+		}
+	}
+	for (i in threads)
+		threads[i].join();
+	for (i in callers)
+		assert(callers[i].result == round * 10 + i);
+	threads.deleteAll();
+	callers.deleteAll();
+}
+assert(up.echo(99, 0) == 99);
+delete up;
+server.stop();
+server.wait();
+
+interface Values {
+	int number(int x);
+	string text(string s);
+	int[] list(int n);
+}
+
+class ValuesImpl implements Values {
+	int number(int x) {
+		return x + 1;
+	}
+
+	string text(string s) {
+		return s + "!";
+	}
+
+	int[] list(int n) {
+		int[] result;
+		for (int i = 0; i < n; i++)
+			result.append(i);
+		return result;
+	}
+}
+/*
+ * Carries calls straight to the stub of the interface, or when corrupt is set, answers them with a reply
+ * that no unmarshaller accepts. It counts the calls that have been started and not ended.
+ */
+class CountingTransport extends rpc.ClientTransport {
+	Values _object;
+	byte[] _arguments;
+	byte[] _returns;
+	boolean corrupt;
+	int open;
+
+	CountingTransport(Values object) {
+		_object = object;
+	}
+
+	ref<byte[]> startCall(substring methodID) {
+		open++;
+		_arguments.resize(methodID.length());
+		C.memcpy(&_arguments[0], methodID.c_str(), methodID.length());
+		return &_arguments;
+	}
+
+	pointer<byte> call(ref<byte[]> serializedArguments) {
+		_returns.clear();
+		if (corrupt) {
+			_returns.append('?');
+			_returns.append(0);
+			return &_returns[0];
+		}
+		int index;
+		for (index = 0; (*serializedArguments)[index] != ';'; index++)
+			;
+		rpc.StubParams params;
+		params.methodID = substring(pointer<byte>(&(*serializedArguments)[0]), index);
+		pointer<byte> pb = &(*serializedArguments)[index + 1];
+		params.arguments = &pb;
+		params.output = &_returns;
+		assert(Values.stub(_object, &params));
+		_returns.append(0);
+		return &_returns[0];
+	}
+
+	void endCall(ref<byte[]> serializedArguments) {
+		open--;
+	}
+}
+
+ValuesImpl impl;
+CountingTransport transport(&impl);
+Values proxy = Values.proxy(&transport);
+
+assert(proxy.number(3) == 4);
+assert(proxy.text("a") == "a!");
+assert(proxy.list(3).length() == 3);
+assert(transport.open == 0);
+
+transport.corrupt = true;
+int failures;
+try {
+	proxy.number(3);
+} catch (IllegalArgumentException e) {
+	failures++;
+}
+assert(transport.open == 0);
+try {
+	proxy.text("a");
+} catch (IllegalArgumentException e) {
+	failures++;
+}
+assert(transport.open == 0);
+try {
+	proxy.list(3);
+} catch (IllegalArgumentException e) {
+	failures++;
+}
+assert(transport.open == 0);
+assert(failures == 3);
+
+transport.corrupt = false;
+assert(proxy.number(5) == 6);
+assert(transport.open == 0);
+delete proxy;
+/*
+ * The generated proxy and stub catch parasol:exception.Exception, not whatever the name means in this unit.
+ */
+class Exception {
+	int unrelated;
+}
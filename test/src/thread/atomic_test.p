@@ -0,0 +1,99 @@
+/*
+   Copyright 2015 Robert Jervis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import parasol:thread;
+import parasol:thread.Thread;
+
+// The atomic operations must use the processor's instructions, not the process-wide lock.
+
+assert(thread.nativeAtomics());
+
+int i = 5;
+
+assert(thread.atomicLoad(&i) == 5);
+thread.atomicStore(&i, 7);
+assert(i == 7);
+assert(thread.compareAndSwap(&i, 6, 9) == 7);
+assert(i == 7);
+assert(thread.compareAndSwap(&i, 7, 9) == 7);
+assert(i == 9);
+assert(thread.fetchAdd(&i, -4) == 9);
+assert(i == 5);
+assert(thread.exchange(&i, 12) == 5);
+assert(i == 12);
+
+long l = 0x100000000;
+
+assert(thread.atomicLoad(&l) == 0x100000000);
+thread.atomicStore(&l, 0x200000001);
+assert(l == 0x200000001);
+assert(thread.compareAndSwap(&l, 0x200000001, 3) == 0x200000001);
+assert(l == 3);
+assert(thread.fetchAdd(&l, 0x100000000) == 3);
+assert(l == 0x100000003);
+assert(thread.exchange(&l, -1) == 0x100000003);
+assert(l == -1);
+
+thread.fence();
+
+class Counted extends thread.RefCounted {
+}
+
+ref<Counted> c = new Counted();
+c.refer();
+assert(c.references() == 2);
+c.release();
+assert(c.references() == 1);
+
+// Several threads hammering the same counters must not lose any updates.
+
+int THREADS = 4;
+int ROUNDS = 100000;
+
+int counter;
+long longCounter;
+int lockedCounter;
+Monitor counterLock;
+
+ref<Thread>[] threads;
+for (int j = 0; j < THREADS; j++) {
+	ref<Thread> t = new Thread();
+	t.start(hammer, null);
+	threads.append(t);
+}
+for (int j = 0; j < THREADS; j++) {
+	threads[j].join();
+	delete threads[j];
+}
+
+assert(counter == THREADS * ROUNDS);
+assert(longCounter == THREADS * ROUNDS * 3);
+assert(lockedCounter == THREADS * ROUNDS);
+assert(c.references() == 1);
+c.release();
+
+void hammer(address parameter) {
+	for (int j = 0; j < ROUNDS; j++) {
+		thread.fetchAdd(&counter, 1);
+		thread.fetchAdd(&longCounter, 3);
+		c.refer();
+		lock (counterLock) {
+			lock (counterLock) {
+				lockedCounter++;
+			}
+		}
+		c.release();
+	}
+}
@@ -32,3 +32,91 @@ void f(address p) {
 	ref<int> pvalue = ref<int>(p);
 	*pvalue = 17;
 }
+
+// Futures carry the values of their work items.
+
+ref<thread.Future<int>>[] futures;
+for (int i = 0; i < 100; i++)
+	futures.append(pool.execute(square, address(i)));
+for (i in futures) {
+	assert(futures[i].success());
+	assert(futures[i].get() == i * i);
+}
+futures.deleteAll();
+
+// A batch of work items queued together.
+
+address[] parameters;
+for (int i = 0; i < 1000; i++)
+	parameters.append(address(i));
+futures = pool.executeAll(square, parameters);
+assert(futures.length() == 1000);
+for (i in futures)
+	assert(futures[i].get() == i * i);
+futures.deleteAll();
+
+int[] counts;
+counts.resize(1000);
+parameters.clear();
+for (i in counts)
+	parameters.append(&counts[i]);
+assert(pool.executeAll(increment, parameters));
+pool.waitForIdle();
+for (i in counts)
+	assert(counts[i] == 1);
+
+// Every index of a parallelFor is visited once, including from nested loops run in the pool.
+
+assert(pool.parallelFor(counts.length(), incrementAt, &counts[0]));
+for (i in counts)
+	assert(counts[i] == 2);
+
+int[] totals;
+totals.resize(16);
+assert(pool.parallelFor(totals.length(), sumRange, &totals[0]));
+for (i in totals)
+	assert(totals[i] == 1000 * 999 / 2);
+
+assert(!pool.parallelFor(10, failAt, null));
+
+// Work that arrives after shutdown is refused.
+
+pool.shutdown();
+assert(pool.execute(square, address(3)) == null);
+assert(!pool.execute(f, &value));
+
+int square(address p) {
+	int i = int(p);
+	return i * i;
+}
+
+void increment(address p) {
+	ref<int> count = ref<int>(p);
+	(*count)++;
+}
+
+void incrementAt(address p, int index) {
+	pointer<int> counts = pointer<int>(p);
+	counts[index]++;
+}
+
+void sumRange(address p, int index) {
+	pointer<int> totals = pointer<int>(p);
+	int[] values;
+	values.resize(1000);
+	assert(pool.parallelFor(values.length(), setValue, &values[0]));
+	int sum;
+	for (i in values)
+		sum += values[i];
+	totals[index] = sum;
+}
+
+void setValue(address p, int index) {
+	pointer<int> values = pointer<int>(p);
+	values[index] = index;
+}
+
+void failAt(address p, int index) {
+	if (index == 7)
+		throw Exception("expected failure");
+}